@@ -0,0 +1,54 @@
+/*
+** AOT-compiled modules opened in more than one lua_State.
+**
+** Every open of a compiled module binds its functions to its prototypes,
+** so opening `preprocess` (which is AOT-compiled into the library) in a
+** second state, or in two threads at once, must bind them the same way
+** as the first open did. Build against the static library, for example:
+**
+**   cc -O2 -I../../cobalt23/src aot_states.c \
+**      <build>/cobalt23/libcobalt_static.a -lstdc++ -lm -ldl -lpthread
+**
+** and run without arguments; the exit code is zero on success.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+static const char *script =
+    "var p = require('preprocess')\n"
+    "var out = p.compile('#define N 40\\nreturn N + 2\\n')\n"
+    "return out\n";
+
+/* open the module in a fresh state and run some of its code */
+static int run(const char *who) {
+  lua_State *L = luaL_newstate();
+  int ok;
+  luaL_openlibs(L);
+  ok = luaL_dostring(L, script) == LUA_OK && lua_type(L, -1) == LUA_TSTRING &&
+       strstr(lua_tostring(L, -1), "40 + 2") != NULL;
+  if (!ok)
+    fprintf(stderr, "%s: %s\n", who,
+            lua_isstring(L, -1) ? lua_tostring(L, -1) : "wrong result");
+  lua_close(L);
+  return ok;
+}
+
+static void *thread(void *arg) { return (void *)(long)run((const char *)arg); }
+
+int main(void) {
+  pthread_t t[2];
+  void *res[2];
+  int ok = run("first state") && run("second state");
+  pthread_create(&t[0], NULL, thread, "thread 1");
+  pthread_create(&t[1], NULL, thread, "thread 2");
+  pthread_join(t[0], &res[0]);
+  pthread_join(t[1], &res[1]);
+  ok = ok && res[0] != NULL && res[1] != NULL;
+  printf("%s\n", ok ? "ok" : "failed");
+  return !ok;
+}
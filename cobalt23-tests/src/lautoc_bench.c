@@ -0,0 +1,100 @@
+/*
+** Microbenchmark for luaA_push / luaA_to on nested structs.
+**
+** Build against the static library, for example:
+**
+**   cc -O2 -I../../cobalt23/src lautoc_bench.c \
+**      <build>/cobalt23/libcobalt_static.a -lstdc++ -lm -ldl -lpthread
+**
+** and run with an optional iteration count (default 200000).
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lautoc.h"
+
+typedef enum { SHAPE_POINT, SHAPE_BOX, SHAPE_CIRCLE } shape_kind;
+
+typedef struct {
+  float x, y, z;
+} vec3;
+
+typedef struct {
+  vec3 pos;
+  vec3 vel;
+  vec3 scale;
+  shape_kind kind;
+  int id;
+  double mass;
+  short flags;
+  unsigned char layer;
+  long long stamp;
+  float radius;
+} body;
+
+static double seconds(void) { return (double)clock() / CLOCKS_PER_SEC; }
+
+int main(int argc, char** argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 200000;
+
+  lua_State* L = luaL_newstate();
+  luaA_open(L);
+
+  luaA_enum(L, shape_kind);
+  luaA_enum_value(L, shape_kind, SHAPE_POINT);
+  luaA_enum_value(L, shape_kind, SHAPE_BOX);
+  luaA_enum_value(L, shape_kind, SHAPE_CIRCLE);
+
+  luaA_struct(L, vec3);
+  luaA_struct_member(L, vec3, x, float);
+  luaA_struct_member(L, vec3, y, float);
+  luaA_struct_member(L, vec3, z, float);
+
+  luaA_struct(L, body);
+  luaA_struct_member(L, body, pos, vec3);
+  luaA_struct_member(L, body, vel, vec3);
+  luaA_struct_member(L, body, scale, vec3);
+  luaA_struct_member(L, body, kind, shape_kind);
+  luaA_struct_member(L, body, id, int);
+  luaA_struct_member(L, body, mass, double);
+  luaA_struct_member(L, body, flags, short);
+  luaA_struct_member(L, body, layer, unsigned char);
+  luaA_struct_member(L, body, stamp, long long);
+  luaA_struct_member(L, body, radius, float);
+
+  body b = {{1, 2, 3}, {4, 5, 6}, {1, 1, 1}, SHAPE_BOX, 42,
+            2.5, 7, 3, 1234567890123LL, 0.5f};
+  body out;
+  luaA_Type tbody = luaA_type(L, body);
+
+  double t = seconds();
+  for (int i = 0; i < n; i++) {
+    luaA_push_type(L, tbody, &b);
+    lua_pop(L, 1);
+  }
+  double push = seconds() - t;
+
+  luaA_push_type(L, tbody, &b);
+  t = seconds();
+  for (int i = 0; i < n; i++) {
+    luaA_to_type(L, tbody, &out, -1);
+  }
+  double to = seconds() - t;
+  lua_pop(L, 1);
+
+  if (memcmp(&out.pos, &b.pos, sizeof(vec3) * 3) != 0 ||
+      out.kind != b.kind || out.id != b.id || out.mass != b.mass ||
+      out.flags != b.flags || out.layer != b.layer || out.stamp != b.stamp ||
+      out.radius != b.radius) {
+    fprintf(stderr, "round trip mismatch\n");
+    return 1;
+  }
+
+  printf("push body  %8.0f ns/op\n", push * 1e9 / n);
+  printf("to body    %8.0f ns/op\n", to * 1e9 / n);
+
+  luaA_close(L);
+  lua_close(L);
+  return 0;
+}
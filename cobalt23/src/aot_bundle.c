@@ -0,0 +1,106 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+// Runtime support for programs generated by `cobaltaot --bundle`.
+// Every module is stored as precompiled bytecode together with the
+// compiled functions of its prototypes.
+
+typedef struct AotBundledModule {
+  const char *name;
+  const unsigned char *bytecode;
+  size_t size;
+  AotCompiledFunction *functions;
+} AotBundledModule;
+
+static void aot_bundle_bind(Proto *f, AotCompiledFunction **next) {
+  // This traversal order should be the same one that cobaltaot.c uses
+  f->aot_implementation = *(*next)++;
+  for (int i = 0; i < f->sizep; i++) {
+    aot_bundle_bind(f->p[i], next);
+  }
+}
+
+static int aot_bundle_load(lua_State *L, const AotBundledModule *m) {
+  int status = luaL_loadbufferx(L, (const char *)m->bytecode, m->size,
+                                m->name, "b");
+  if (status == LUA_OK) {
+    LClosure *cl = (void *)lua_topointer(L, -1);
+    AotCompiledFunction *next = m->functions;
+    aot_bundle_bind(cl->p, &next);
+  }
+  return status;
+}
+
+// package.preload loader of a bundled module (upvalue 1)
+static int aot_bundle_loader(lua_State *L) {
+  const AotBundledModule *m = lua_touserdata(L, lua_upvalueindex(1));
+  if (aot_bundle_load(L, m) != LUA_OK) {
+    return lua_error(L);
+  }
+  lua_pushvalue(L, 1);  // module name
+  lua_pushvalue(L, 2);  // loader data
+  lua_call(L, 2, 1);
+  return 1;
+}
+
+// Register every module but the first (the main script) in package.preload
+static void aot_bundle_preload(lua_State *L, const AotBundledModule *bundle) {
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+  for (const AotBundledModule *m = bundle + 1; m->name != NULL; m++) {
+    lua_pushlightuserdata(L, (void *)m);
+    lua_pushcclosure(L, aot_bundle_loader, 1);
+    lua_setfield(L, -2, m->name);
+  }
+  lua_pop(L, 1);
+}
+
+static void aot_bundle_preload_lib(lua_State *L, const char *name,
+                                   lua_CFunction open) {
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+  lua_pushcfunction(L, open);
+  lua_setfield(L, -2, name);
+  lua_pop(L, 1);
+}
+
+static int aot_bundle_msghandler(lua_State *L) {
+  const char *msg = lua_tostring(L, 1);
+  if (msg == NULL) {
+    msg = lua_pushfstring(L, "(error object is a %s value)",
+                          luaL_typename(L, 1));
+  }
+  luaL_traceback(L, L, msg, 1);
+  return 1;
+}
+
+// Run the main script with the command-line arguments, reporting errors
+static int aot_bundle_run(lua_State *L, const AotBundledModule *bundle,
+                          int argc, char *argv[]) {
+  lua_createtable(L, argc, 1);
+  for (int i = 0; i < argc; i++) {
+    lua_pushstring(L, argv[i]);
+    lua_rawseti(L, -2, i);
+  }
+  lua_setglobal(L, "arg");
+
+  lua_pushcfunction(L, aot_bundle_msghandler);
+  int base = lua_gettop(L);
+  int status = aot_bundle_load(L, &bundle[0]);
+  if (status == LUA_OK) {
+    for (int i = 1; i < argc; i++) {
+      lua_pushstring(L, argv[i]);
+    }
+    status = lua_pcall(L, argc > 0 ? argc - 1 : 0, 0, base);
+  }
+  if (status != LUA_OK) {
+    fprintf(stderr, "%s: %s\n", argc > 0 ? argv[0] : bundle[0].name,
+            lua_tostring(L, -1));
+  }
+  lua_settop(L, base - 1);
+  return status;
+}
@@ -7,13 +7,13 @@
 #include "lauxlib.h"
 #include "lualib.h"
 
-static int next_id = 0;
-
-static void bind_magic(Proto *f) {
+// 'next' counts the functions bound so far. It is local to each open, so
+// the module can be opened in any number of states, from any thread
+static void bind_magic(Proto *f, int *next) {
   // This traversal order should be the same one that cobaltaot.c uses
-  f->aot_implementation = AOT_FUNCTIONS[next_id++];
+  f->aot_implementation = AOT_FUNCTIONS[(*next)++];
   for (int i = 0; i < f->sizep; i++) {
-    bind_magic(f->p[i]);
+    bind_magic(f->p[i], next);
   }
 }
 #ifndef EXTERNAL
@@ -42,7 +42,8 @@ EXTERNAL int AOT_LUAOPEN_NAME(lua_State *L) {
   }
 
   LClosure *cl = (void *)lua_topointer(L, -1);
-  bind_magic(cl->p);
+  int next = 0;
+  bind_magic(cl->p, &next);
 
   lua_call(L, 0, 1);
   return 1;
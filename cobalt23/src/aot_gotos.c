@@ -23,8 +23,23 @@ static void println_goto_ret() {
   println("    }");
 }
 
+// Go to the entry 'e' of the jump table at 'pc' (see OP_JMPTAB)
+static void println_goto_entry(Proto *f, int pc) {
+  Instruction instr = f->code[pc];
+  int first = pc + jmptabfirst(instr);
+  println("    switch (e) {");
+  for (int e = 0; e < GETARG_Bx(instr); e++) {
+    println("      case %d: goto label_%02d;", e, first + e);
+  }
+  println("      default: goto label_%02d;", first + GETARG_Bx(instr));
+  println("    }");
+}
+
 static void create_function(Proto *f) {
   int func_id = nfunctions++;
+  AotTypes *T = aottypes ? aot_analyze(f) : NULL;
+  ProfileFunction *prof = profile_find(f);
+  char *hook_macros = NULL;
 
   println("// source = %s", getstr(f->source));
   if (f->linedefined == 0) {
@@ -63,13 +78,21 @@ static void create_function(Proto *f) {
   println("  Instruction *code = cl->p->code;");  // (!!!)
   println("  Instruction i;");
   println("  StkId ra;");
+  aot_print_declarations(T);
   printnl();
 
   // If we are returning from another function, or resuming a coroutine,
-  // jump back to where left.
+  // jump back to where left. Numeric locals do not survive leaving the
+  // function, so they are reloaded from the stack.
   println("  switch (pc - code) {");
   for (int pc = 0; pc < f->sizecode; pc++) {
-    println("    case %d: goto label_%02d;", pc, pc);
+    if (T != NULL && aot_has_reloads(T, pc)) {
+      println("    case %d:", pc);
+      aot_print_reloads(T, pc);
+      println("      goto label_%02d;", pc);
+    } else {
+      println("    case %d: goto label_%02d;", pc, pc);
+    }
   }
   println("  }");
   printnl();
@@ -99,8 +122,22 @@ static void create_function(Proto *f) {
       println("  #define AOT_SKIP1 label_%02d", skip1);
     }
 
+    if (testTMode(op)) {
+      println("  #undef  AOT_SKIP_HINT");
+      println("  #define AOT_SKIP_HINT(c) %s", profile_skip_hint(prof, pc));
+    }
+
+    aot_print_hook_macros(T, pc, &hook_macros);
+
     println("  label_%02d: {", pc);
     println("    aot_vmfetch(0x%08x);", instr);
+    aot_print_spills(f, T, pc);
+
+    if (aot_native(f, T, pc, 1)) {
+      println("  }");
+      printnl();
+      continue;
+    }
 
     switch (op) {
       case OP_MOVE: {
@@ -578,7 +615,7 @@ static void create_function(Proto *f) {
       }
       case OP_TESTSET: {
         println("    TValue *rb = vRB(i);");
-        println("    if (l_isfalse(rb) == GETARG_k(i))");
+        println("    if (AOT_SKIP_HINT(l_isfalse(rb) == GETARG_k(i)))");
         println("      goto AOT_SKIP1;");  // (!)
         println("    else {");
         println("      setobj2s(L, ra, rb);");
@@ -586,6 +623,31 @@ static void create_function(Proto *f) {
         println("    }");
         break;
       }
+      case OP_JMPTAB: {
+        println("    TValue *rv = s2v(ra);");
+        println("    lua_Integer n;");
+        println("    lua_Unsigned e = GETARG_Bx(i);");
+        println("    if (tointegerns(rv, &n)) {");
+        println("      n = l_castU2S(l_castS2U(n) - "
+                "l_castS2U(ivalue(k + GETARG_Ax(0x%08x))));",
+                f->code[pc + 1]);
+        println("      if (l_castS2U(n) < e) e = l_castS2U(n);");
+        println("    }");
+        println_goto_entry(f, pc);
+        break;
+      }
+      case OP_JMPSTR: {
+        println("    TValue *rv = s2v(ra);");
+        println("    int e = GETARG_Bx(i);");
+        println("    if (ttisstring(rv)) {");
+        println("      const TValue *slot = "
+                "luaH_get(cl->p->jumptabs[GETARG_Ax(0x%08x)], rv);",
+                f->code[pc + 1]);
+        println("      if (ttisinteger(slot)) e = cast_int(ivalue(slot));");
+        println("    }");
+        println_goto_entry(f, pc);
+        break;
+      }
       case OP_CALL: {
         println("    CallInfo *newci;");
         println("    int b = GETARG_B(i);");
@@ -745,6 +807,7 @@ static void create_function(Proto *f) {
         println("    if (forprep(L, ra))");
         println("      goto label_%02d; /* skip the loop */",
                 ((pc + 1) + GETARG_Bx(instr) + 1));  //(!)
+        aot_print_forprep_loads(f, T, pc);
         break;
       }
       case OP_TFORPREP: {
@@ -864,6 +927,14 @@ static void create_function(Proto *f) {
     printnl();
   }
 
+  if (hook_macros != NULL) {
+    println("  #undef  AOT_SPILL_ALL");
+    println("  #define AOT_SPILL_ALL() {}");
+    println("  #undef  AOT_RELOAD_ALL");
+    println("  #define AOT_RELOAD_ALL() {}");
+  }
   println("}");
   printnl();
+  free(hook_macros);
+  aot_free_types(T);
 }
@@ -95,11 +95,15 @@
     goto AOT_NEXT_JUMP; \
   }
 
+// cobaltaot redefines AOT_SKIP_HINT before a test when the profile says
+// which way it usually goes
+#define AOT_SKIP_HINT(c) (c)
+
 #undef docondjump
-#define docondjump()       \
-  if (cond != GETARG_k(i)) \
-    goto AOT_SKIP1;        \
-  else                     \
+#define docondjump()                      \
+  if (AOT_SKIP_HINT(cond != GETARG_k(i))) \
+    goto AOT_SKIP1;                       \
+  else                                    \
     donextjump(ci);
 
 //
@@ -109,6 +113,15 @@
 #undef savepc
 #define savepc(L) (ci->u.l.savedpc = AOT_PC)
 
+//
+// Registers kept in C locals (see aot_types.c) are written to the stack
+// before hooks run, and read back afterwards. The compiler redefines these
+// two macros wherever the set of such registers changes.
+//
+
+#define AOT_SPILL_ALL() {}
+#define AOT_RELOAD_ALL() {}
+
 //
 // Our modified version of vmfetch(). Since instr and index are compile time
 // constants, the C compiler should be able to optimize the code in many cases.
@@ -118,8 +131,10 @@
 #define aot_vmfetch(instr)                                                     \
   {                                                                            \
     if (l_unlikely(trap)) {                 /* stack reallocation or hooks? */ \
+      AOT_SPILL_ALL();                      /* let hooks see the registers */  \
       trap = luaG_traceexec(L, AOT_PC - 1); /* handle hooks */                 \
       updatebase(ci);                       /* correct stack */                \
+      AOT_RELOAD_ALL();                                                        \
     }                                                                          \
     i = instr;                                                                 \
     ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */         \
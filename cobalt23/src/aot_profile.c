@@ -0,0 +1,159 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+
+//
+// Profile-guided compilation.
+//
+// `cobalt -P file script` records, for every function that ran, how often
+// it was called, how often it jumped backwards and which way each of its
+// tests went (see lua_dumpprofile). Given that file with --profile, only
+// functions with at least --hot calls plus loop iterations are compiled;
+// the others keep running as bytecode. Tests that went the same way at
+// least AOT_HINT_RATIO of the time get a branch-likelihood hint.
+//
+// Functions are matched by source name and the line where they start, so
+// the profile must come from a run of the same version of the script.
+//
+
+#define AOT_HINT_RATIO 0.9
+#define AOT_HINT_MINSAMPLES 16
+
+typedef struct {
+  int pc;
+  unsigned long jumps;  // times the test went to its jump's target
+  unsigned long skips;  // times the test skipped its jump
+} ProfileBranch;
+
+typedef struct {
+  char *source;
+  int linedefined;
+  unsigned long long calls;
+  unsigned long long loops;
+  ProfileBranch *branches;
+  int nbranches;
+} ProfileFunction;
+
+static const char *profile_filename = NULL;
+static unsigned long long hot_threshold = 1000;
+static ProfileFunction *profile = NULL;
+static int nprofile = 0;
+
+// Chunk name of the script being compiled, which the profile refers to
+// even when the preprocessed copy is what gets loaded
+static char *profile_script = NULL;
+
+static void profile_set_script(const char *filename) {
+  free(profile_script);
+  profile_script = malloc(strlen(filename) + 2);
+  profile_script[0] = '@';
+  strcpy(profile_script + 1, filename);
+}
+
+static void read_profile() {
+  FILE *f = fopen(profile_filename, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s: cannot open profile %s: %s\n", program_name,
+            profile_filename, strerror(errno));
+    exit(1);
+  }
+
+  char line[4096];
+  int lineno = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    line[strcspn(line, "\n")] = '\0';
+
+    ProfileFunction fn;
+    ProfileBranch b;
+    int n = 0;
+    if (sscanf(line, "f %d %llu %llu %n", &fn.linedefined, &fn.calls,
+               &fn.loops, &n) == 3 && n > 0) {
+      fn.source = malloc(strlen(line + n) + 1);
+      strcpy(fn.source, line + n);
+      fn.branches = NULL;
+      fn.nbranches = 0;
+      profile = realloc(profile, (nprofile + 1) * sizeof(ProfileFunction));
+      profile[nprofile++] = fn;
+    } else if (nprofile > 0 &&
+               sscanf(line, "b %d %lu %lu", &b.pc, &b.jumps, &b.skips) == 3) {
+      ProfileFunction *last = &profile[nprofile - 1];
+      last->branches = realloc(last->branches,
+                               (last->nbranches + 1) * sizeof(ProfileBranch));
+      last->branches[last->nbranches++] = b;
+    } else if (line[0] != '\0') {
+      fprintf(stderr, "%s: %s:%d: malformed profile line\n", program_name,
+              profile_filename, lineno);
+      exit(1);
+    }
+  }
+  fclose(f);
+}
+
+// Compare chunk names; file names match when they name the same file
+// from the current directory
+static int same_source(const char *a, const char *b) {
+  if (*a != *b) {
+    return 0;
+  }
+  if (0 == strcmp(a, b)) {
+    return 1;
+  }
+  if (*a != '@') {
+    return 0;
+  }
+  char *ra = realpath(a + 1, NULL);
+  char *rb = realpath(b + 1, NULL);
+  int same = ra != NULL && rb != NULL && 0 == strcmp(ra, rb);
+  free(ra);
+  free(rb);
+  return same;
+}
+
+static ProfileFunction *profile_find(Proto *f) {
+  for (int i = 0; i < nprofile; i++) {
+    ProfileFunction *fn = &profile[i];
+    if (fn->linedefined != f->linedefined) {
+      continue;
+    }
+    if (same_source(fn->source, getstr(f->source)) ||
+        (profile_script != NULL && same_source(fn->source, profile_script))) {
+      return fn;
+    }
+  }
+  return NULL;
+}
+
+// Whether a function should be compiled to C
+static int profile_is_hot(Proto *f) {
+  if (profile_filename == NULL) {
+    return 1;
+  }
+  ProfileFunction *fn = profile_find(f);
+  return fn != NULL && fn->calls + fn->loops >= hot_threshold;
+}
+
+// The AOT_SKIP_HINT for the test at 'pc': how to wrap the condition under
+// which the test skips its jump
+static const char *profile_skip_hint(ProfileFunction *fn, int pc) {
+  for (int i = 0; fn != NULL && i < fn->nbranches; i++) {
+    ProfileBranch *b = &fn->branches[i];
+    if (b->pc != pc) {
+      continue;
+    }
+    double total = (double)b->jumps + (double)b->skips;
+    if (total < AOT_HINT_MINSAMPLES) {
+      break;
+    }
+    if (b->skips >= AOT_HINT_RATIO * total) {
+      return "l_likely(c)";
+    }
+    if (b->jumps >= AOT_HINT_RATIO * total) {
+      return "l_unlikely(c)";
+    }
+    break;
+  }
+  return "(c)";
+}
@@ -585,6 +585,39 @@ static void create_function_switches(Proto *f) {
         // PC
         break;
       }
+      case OP_JMPTAB: {
+        println("        TValue *rv = s2v(ra);");
+        println("        lua_Integer n;");
+        println("        lua_Unsigned e = GETARG_Bx(i);");
+        println("        if (tointegerns(rv, &n)) {");
+        println("          n = l_castU2S(l_castS2U(n) - "
+                "l_castS2U(ivalue(k + GETARG_Ax(0x%08x))));",
+                f->code[pc + 1]);
+        println("          if (l_castS2U(n) < e) e = l_castS2U(n);");
+        println("        }");
+        println("        pc += 1 + e;");
+        println("        i = *pc;");
+        println("        dojump(ci, i, 1);");
+        println("        break;");
+        // PC
+        break;
+      }
+      case OP_JMPSTR: {
+        println("        TValue *rv = s2v(ra);");
+        println("        int e = GETARG_Bx(i);");
+        println("        if (ttisstring(rv)) {");
+        println("          const TValue *slot = "
+                "luaH_get(cl->p->jumptabs[GETARG_Ax(0x%08x)], rv);",
+                f->code[pc + 1]);
+        println("          if (ttisinteger(slot)) e = cast_int(ivalue(slot));");
+        println("        }");
+        println("        pc += 1 + GETARG_Bx(i) + e;");
+        println("        i = *pc;");
+        println("        dojump(ci, i, 1);");
+        println("        break;");
+        // PC
+        break;
+      }
       case OP_EQ: {
         println("        int cond;");
         println("        TValue *rb = vRB(i);");
@@ -0,0 +1,1049 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+
+//
+// Type specialization for the gotos backend.
+//
+// The registers of a function are split into webs: all the definitions of a
+// register that reach a common use belong to the same web, so a register the
+// parser reuses for unrelated temporaries ends up with one web per value. A
+// web whose definitions all produce integers (or all produce floats) lives in
+// a C local instead of in its stack slot, and the instructions that only
+// touch such webs are emitted as plain C arithmetic.
+//
+// The stack slot of a native web is only brought up to date ("spilled")
+// before an instruction that can call out of the function, raise an error or
+// read the register generically. Since a call to a Lua function (or a yield)
+// leaves this C function, the locals are reloaded from the stack when the
+// function is re-entered, and around the hook in aot_vmfetch.
+//
+// Parameters are always boxed: the parser discards type hints and a caller
+// may pass anything, so nothing can be proven about them.
+//
+
+typedef enum { AOT_UNDEF, AOT_INT, AOT_FLT, AOT_ANY } AotType;
+
+typedef struct {
+  int nregs;
+  int nwebs;
+  unsigned char *type;    // per web
+  unsigned char *forced;  // per web: must stay boxed
+  int *cur;               // [pc * nregs + r] web in r before 'pc', or -1
+  int *def;               // [pc * nregs + r] web 'pc' stores into r, or -1
+  unsigned char *dirty;   // [pc * nwebs + w] stack copy of w may be stale
+} AotTypes;
+
+typedef struct {
+  AotType type;
+  char expr[64];
+} AotOperand;
+
+// Functions bigger than this (instructions times registers) are left boxed
+#define AOT_MAXCELLS (1 << 22)
+
+static int aot_isnative(AotTypes *T, int w) {
+  return T != NULL && w >= 0 &&
+         (T->type[w] == AOT_INT || T->type[w] == AOT_FLT);
+}
+
+static int aot_cur(AotTypes *T, int pc, int r) {
+  return T->cur[pc * T->nregs + r];
+}
+
+static int aot_def(AotTypes *T, int pc, int r) {
+  return T->def[pc * T->nregs + r];
+}
+
+static const char *aot_local(AotTypes *T, int w) {
+  static char buf[4][32];
+  static int n = 0;
+  char *s = buf[n++ % 4];
+  snprintf(s, sizeof(buf[0]), "aot_%c%d", T->type[w] == AOT_INT ? 'i' : 'f', w);
+  return s;
+}
+
+//
+// Registers read and written by an instruction, and its successors. These
+// may over-approximate: any instruction with imprecise sets is emitted
+// generically, which spills every native web first.
+//
+
+static void aot_mark(char *set, int from, int to, int nregs) {
+  for (int r = from; r < to && r < nregs; r++) {
+    if (r >= 0) set[r] = 1;
+  }
+}
+
+static void aot_uses(Proto *f, int pc, char *use) {
+  Instruction i = f->code[pc];
+  int n = f->maxstacksize;
+  int a = GETARG_A(i), b = GETARG_B(i), c = GETARG_C(i);
+  switch (GET_OPCODE(i)) {
+    case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADKX:
+    case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE: case OP_LOADNIL:
+    case OP_GETUPVAL: case OP_GETTABUP: case OP_NEWTABLE: case OP_JMP:
+    case OP_RETURN0: case OP_VARARG: case OP_VARARGPREP: case OP_EXTRAARG:
+    case OP_CLOSE:
+      break;
+    case OP_MOVE: case OP_GETI: case OP_GETFIELD: case OP_ADDI: case OP_ADDK:
+    case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK: case OP_DIVK:
+    case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK: case OP_SHRI:
+    case OP_SHLI: case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+    case OP_TESTSET:
+      aot_mark(use, b, b + 1, n);
+      break;
+    case OP_SETUPVAL: case OP_EQK: case OP_EQI: case OP_LTI: case OP_LEI:
+    case OP_GTI: case OP_GEI: case OP_TEST: case OP_TBC: case OP_RETURN1:
+    case OP_MMBINI: case OP_MMBINK: case OP_JMPTAB: case OP_JMPSTR:
+      aot_mark(use, a, a + 1, n);
+      break;
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR:
+      aot_mark(use, b, b + 1, n);
+      aot_mark(use, c, c + 1, n);
+      break;
+    case OP_SETTABUP:
+      if (!GETARG_k(i)) aot_mark(use, c, c + 1, n);
+      break;
+    case OP_SETTABLE:
+      aot_mark(use, b, b + 1, n);
+      /* FALLTHROUGH */
+    case OP_SETI: case OP_SETFIELD:
+      aot_mark(use, a, a + 1, n);
+      if (!GETARG_k(i)) aot_mark(use, c, c + 1, n);
+      break;
+    case OP_SELF:
+      aot_mark(use, b, b + 1, n);
+      if (!GETARG_k(i)) aot_mark(use, c, c + 1, n);
+      break;
+    case OP_MMBIN: case OP_EQ: case OP_LT: case OP_LE:
+      aot_mark(use, a, a + 1, n);
+      aot_mark(use, b, b + 1, n);
+      break;
+    case OP_CONCAT:
+      aot_mark(use, a, a + b, n);
+      break;
+    case OP_CALL: case OP_RETURN: case OP_SETLIST:
+      aot_mark(use, a, b == 0 ? n : a + b, n);
+      break;
+    case OP_FORLOOP: case OP_FORPREP:
+      aot_mark(use, a, a + 3, n);
+      break;
+    case OP_TFORPREP:
+      aot_mark(use, a + 3, a + 4, n);
+      break;
+    case OP_TFORCALL:
+      aot_mark(use, a, a + 4, n);
+      break;
+    case OP_TFORLOOP:
+      aot_mark(use, a + 4, a + 5, n);
+      break;
+    case OP_CLOSURE: {
+      Proto *p = f->p[GETARG_Bx(i)];
+      for (int j = 0; j < p->sizeupvalues; j++) {
+        if (p->upvalues[j].instack) {
+          aot_mark(use, p->upvalues[j].idx, p->upvalues[j].idx + 1, n);
+        }
+      }
+      break;
+    }
+    default:  // OP_TAILCALL and anything unknown
+      aot_mark(use, 0, n, n);
+      break;
+  }
+}
+
+static void aot_defs(Proto *f, int pc, char *def) {
+  Instruction i = f->code[pc];
+  int n = f->maxstacksize;
+  int a = GETARG_A(i), b = GETARG_B(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADKX:
+    case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE: case OP_GETUPVAL:
+    case OP_GETTABUP: case OP_GETTABLE: case OP_GETI: case OP_GETFIELD:
+    case OP_NEWTABLE: case OP_ADDI: case OP_ADDK: case OP_SUBK: case OP_MULK:
+    case OP_MODK: case OP_POWK: case OP_DIVK: case OP_IDIVK: case OP_BANDK:
+    case OP_BORK: case OP_BXORK: case OP_SHRI: case OP_SHLI: case OP_ADD:
+    case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW: case OP_DIV:
+    case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL:
+    case OP_SHR: case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+    case OP_TESTSET: case OP_CLOSURE: case OP_DEFER:
+      aot_mark(def, a, a + 1, n);
+      break;
+    case OP_LOADNIL:
+      aot_mark(def, a, a + b + 1, n);
+      break;
+    case OP_SELF:
+      aot_mark(def, a, a + 2, n);
+      break;
+    case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
+      int ra = GETARG_A(f->code[pc - 1]);
+      aot_mark(def, ra, ra + 1, n);
+      break;
+    }
+    case OP_CONCAT:
+      aot_mark(def, a, a + b, n);
+      break;
+    case OP_CALL: case OP_VARARG:
+      aot_mark(def, a, n, n);
+      break;
+    case OP_FORLOOP:
+      aot_mark(def, a, a + 2, n);
+      aot_mark(def, a + 3, a + 4, n);
+      break;
+    case OP_FORPREP:
+      aot_mark(def, a, a + 4, n);
+      break;
+    case OP_TFORCALL:
+      aot_mark(def, a + 4, n, n);
+      break;
+    case OP_TFORLOOP:
+      aot_mark(def, a + 2, a + 3, n);
+      break;
+    default:
+      break;
+  }
+}
+
+static int aot_successors(Proto *f, int pc, int *succ) {
+  Instruction i = f->code[pc];
+  switch (GET_OPCODE(i)) {
+    case OP_JMP:
+      succ[0] = pc + 1 + GETARG_sJ(i);
+      return 1;
+    case OP_LOADKX: case OP_LFALSESKIP: case OP_NEWTABLE:
+      succ[0] = pc + 2;
+      return 1;
+    case OP_SETLIST:
+      succ[0] = TESTARG_k(i) ? pc + 2 : pc + 1;
+      return 1;
+    case OP_EQ: case OP_LT: case OP_LE: case OP_EQK: case OP_EQI: case OP_LTI:
+    case OP_LEI: case OP_GTI: case OP_GEI: case OP_TEST: case OP_TESTSET:
+    case OP_ADDI: case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK:
+    case OP_POWK: case OP_DIVK: case OP_IDIVK: case OP_BANDK: case OP_BORK:
+    case OP_BXORK: case OP_SHRI: case OP_SHLI: case OP_ADD: case OP_SUB:
+    case OP_MUL: case OP_MOD: case OP_POW: case OP_DIV: case OP_IDIV:
+    case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+      succ[0] = pc + 1;
+      succ[1] = pc + 2;
+      return 2;
+    case OP_FORPREP:
+      succ[0] = pc + 1;
+      succ[1] = pc + GETARG_Bx(i) + 2;
+      return 2;
+    case OP_FORLOOP: case OP_TFORLOOP:
+      succ[0] = pc + 1;
+      succ[1] = pc + 1 - GETARG_Bx(i);
+      return 2;
+    case OP_TFORPREP:
+      succ[0] = pc + 1 + GETARG_Bx(i);
+      return 1;
+    case OP_RETURN: case OP_RETURN0: case OP_RETURN1: case OP_TAILCALL:
+      return 0;
+    default:
+      succ[0] = pc + 1;
+      return 1;
+  }
+}
+
+//
+// Operands
+//
+
+static void aot_reg_operand(AotTypes *T, int pc, int r, AotOperand *o) {
+  int w = aot_cur(T, pc, r);
+  o->type = w < 0 ? AOT_ANY : (AotType)T->type[w];
+  o->expr[0] = '\0';
+  if (aot_isnative(T, w)) {
+    snprintf(o->expr, sizeof(o->expr), "%s", aot_local(T, w));
+  }
+}
+
+static void aot_k_operand(Proto *f, int idx, AotOperand *o) {
+  TValue *k = &f->k[idx];
+  if (ttisinteger(k)) {
+    lua_Integer v = ivalue(k);
+    o->type = AOT_INT;
+    if (v == LUA_MININTEGER) {
+      snprintf(o->expr, sizeof(o->expr), "LUA_MININTEGER");
+    } else {
+      snprintf(o->expr, sizeof(o->expr), "((lua_Integer)%lldLL)", (long long)v);
+    }
+  } else if (ttisfloat(k)) {
+    lua_Number v = fltvalue(k);
+    o->type = AOT_FLT;
+    if (isfinite(v)) {
+      snprintf(o->expr, sizeof(o->expr), "((lua_Number)%a)", (double)v);
+    } else {
+      snprintf(o->expr, sizeof(o->expr), "fltvalue(k + %d)", idx);
+    }
+  } else {
+    o->type = AOT_ANY;
+    o->expr[0] = '\0';
+  }
+}
+
+static void aot_imm_operand(int v, AotOperand *o) {
+  o->type = AOT_INT;
+  snprintf(o->expr, sizeof(o->expr), "((lua_Integer)%d)", v);
+}
+
+static const char *aot_as_float(AotOperand *o) {
+  static char buf[2][80];
+  static int n = 0;
+  if (o->type == AOT_FLT) return o->expr;
+  char *s = buf[n++ % 2];
+  snprintf(s, sizeof(buf[0]), "cast_num(%s)", o->expr);
+  return s;
+}
+
+//
+// Arithmetic. 'kind' is the register-register opcode of the operation.
+//
+
+static AotType aot_arith_type(OpCode kind, AotType b, AotType c) {
+  if (b == AOT_ANY || c == AOT_ANY) return AOT_ANY;
+  if (b == AOT_UNDEF || c == AOT_UNDEF) return AOT_UNDEF;
+  switch (kind) {
+    case OP_POW: case OP_DIV:
+      return AOT_FLT;
+    case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+    case OP_BNOT:
+      return (b == AOT_INT && c == AOT_INT) ? AOT_INT : AOT_ANY;
+    case OP_UNM:
+      return b;
+    default:
+      return (b == AOT_INT && c == AOT_INT) ? AOT_INT : AOT_FLT;
+  }
+}
+
+// Decodes an arithmetic instruction; returns 0 if 'pc' is not one.
+static int aot_arith_operands(Proto *f, AotTypes *T, int pc, OpCode *kind,
+                              AotOperand *b, AotOperand *c) {
+  Instruction i = f->code[pc];
+  OpCode op = GET_OPCODE(i);
+  switch (op) {
+    case OP_ADDI:
+      *kind = OP_ADD;
+      aot_reg_operand(T, pc, GETARG_B(i), b);
+      aot_imm_operand(GETARG_sC(i), c);
+      return 1;
+    case OP_SHRI:
+      *kind = OP_SHR;
+      aot_reg_operand(T, pc, GETARG_B(i), b);
+      aot_imm_operand(GETARG_sC(i), c);
+      return 1;
+    case OP_SHLI:
+      *kind = OP_SHL;
+      aot_imm_operand(GETARG_sC(i), b);
+      aot_reg_operand(T, pc, GETARG_B(i), c);
+      return 1;
+    case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK:
+    case OP_DIVK: case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK:
+      *kind = (OpCode)(op - OP_ADDK + OP_ADD);
+      aot_reg_operand(T, pc, GETARG_B(i), b);
+      aot_k_operand(f, GETARG_C(i), c);
+      return 1;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW:
+    case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR:
+    case OP_SHL: case OP_SHR:
+      *kind = op;
+      aot_reg_operand(T, pc, GETARG_B(i), b);
+      aot_reg_operand(T, pc, GETARG_C(i), c);
+      return 1;
+    case OP_UNM: case OP_BNOT:
+      *kind = op;
+      aot_reg_operand(T, pc, GETARG_B(i), b);
+      aot_imm_operand(0, c);
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static void aot_arith_expr(OpCode kind, AotType t, AotOperand *b,
+                           AotOperand *c, char *out, size_t size) {
+  const char *x = b->expr, *y = c->expr;
+  if (t == AOT_FLT) {
+    x = aot_as_float(b);
+    y = aot_as_float(c);
+  }
+  // integer and float versions; unary operations ignore their second operand
+  static const struct {
+    OpCode op;
+    const char *i, *f;
+  } ops[] = {
+      {OP_ADD, "intop(+, %s, %s)", "luai_numadd(L, %s, %s)"},
+      {OP_SUB, "intop(-, %s, %s)", "luai_numsub(L, %s, %s)"},
+      {OP_MUL, "intop(*, %s, %s)", "luai_nummul(L, %s, %s)"},
+      {OP_MOD, "luaV_mod(L, %s, %s)", "luaV_modf(L, %s, %s)"},
+      {OP_IDIV, "luaV_idiv(L, %s, %s)", "luai_numidiv(L, %s, %s)"},
+      {OP_POW, NULL, "luai_numpow(L, %s, %s)"},
+      {OP_DIV, NULL, "luai_numdiv(L, %s, %s)"},
+      {OP_BAND, "intop(&, %s, %s)", NULL},
+      {OP_BOR, "intop(|, %s, %s)", NULL},
+      {OP_BXOR, "intop(^, %s, %s)", NULL},
+      {OP_SHL, "luaV_shiftl(%s, %s)", NULL},
+      {OP_SHR, "luaV_shiftr(%s, %s)", NULL},
+      {OP_UNM, "intop(-, 0, %s)%.0s", "luai_numunm(L, %s)%.0s"},
+      {OP_BNOT, "intop(^, ~l_castS2U(0), %s)%.0s", NULL},
+  };
+  const char *fmt = NULL;
+  for (size_t j = 0; j < sizeof(ops) / sizeof(ops[0]); j++) {
+    if (ops[j].op == kind) fmt = t == AOT_INT ? ops[j].i : ops[j].f;
+  }
+  if (fmt == NULL) fatal_error("unexpected arithmetic opcode");
+  snprintf(out, size, fmt, x, y);
+}
+
+//
+// Type inference
+//
+
+static AotType aot_join(AotType a, AotType b) {
+  if (a == AOT_UNDEF) return b;
+  if (b == AOT_UNDEF) return a;
+  return a == b ? a : AOT_ANY;
+}
+
+static AotType aot_reg_type(AotTypes *T, int pc, int r) {
+  int w = aot_cur(T, pc, r);
+  return w < 0 ? AOT_ANY : (AotType)T->type[w];
+}
+
+// Type of the value 'pc' stores into register 'r'
+static AotType aot_deftype(Proto *f, AotTypes *T, int pc, int r) {
+  Instruction i = f->code[pc];
+  int a = GETARG_A(i);
+  AotOperand b, c;
+  OpCode kind;
+  switch (GET_OPCODE(i)) {
+    case OP_LOADI:
+      return AOT_INT;
+    case OP_LOADF:
+      return AOT_FLT;
+    case OP_LOADK:
+      aot_k_operand(f, GETARG_Bx(i), &b);
+      return b.type;
+    case OP_LOADKX:
+      aot_k_operand(f, GETARG_Ax(f->code[pc + 1]), &b);
+      return b.type;
+    case OP_MOVE:
+      return aot_reg_type(T, pc, GETARG_B(i));
+    case OP_FORPREP:
+      // integer loop: 'forprep' leaves integers in all four registers
+      if (aot_reg_type(T, pc, a) == AOT_INT &&
+          aot_reg_type(T, pc, a + 2) == AOT_INT)
+        return AOT_INT;
+      return AOT_ANY;
+    case OP_FORLOOP: {
+      AotType t = AOT_INT;
+      for (int j = 0; j < 3; j++) t = aot_join(t, aot_reg_type(T, pc, a + j));
+      return t;
+    }
+    case OP_MMBIN: case OP_MMBINI: case OP_MMBINK:
+      // the result of the operation before it, when that one cannot fail
+      return aot_deftype(f, T, pc - 1, r);
+    default:
+      if (r == a && aot_arith_operands(f, T, pc, &kind, &b, &c))
+        return aot_arith_type(kind, b.type, c.type);
+      return AOT_ANY;
+  }
+}
+
+static int aot_native(Proto *f, AotTypes *T, int pc, int emit);
+
+static void aot_infer(Proto *f, AotTypes *T) {
+  int n = T->nregs;
+  int changed;
+  do {
+    for (int w = 0; w < T->nwebs; w++) {
+      T->type[w] = T->forced[w] ? AOT_ANY : AOT_UNDEF;
+    }
+    do {
+      changed = 0;
+      for (int pc = 0; pc < f->sizecode; pc++) {
+        for (int r = 0; r < n; r++) {
+          int w = aot_def(T, pc, r);
+          if (w < 0) continue;
+          AotType t = aot_join(T->type[w], aot_deftype(f, T, pc, r));
+          if (t != T->type[w]) {
+            T->type[w] = t;
+            changed = 1;
+          }
+        }
+      }
+    } while (changed);
+    for (int w = 0; w < T->nwebs; w++) {
+      if (T->type[w] == AOT_UNDEF) T->type[w] = AOT_ANY;
+    }
+    // Every store into a native web has to be emitted natively (or, for
+    // FORPREP, reload the local afterwards). Otherwise keep the web boxed.
+    for (int pc = 0; pc < f->sizecode; pc++) {
+      if (GET_OPCODE(f->code[pc]) == OP_FORPREP || aot_native(f, T, pc, 0))
+        continue;
+      for (int r = 0; r < n; r++) {
+        int w = aot_def(T, pc, r);
+        if (aot_isnative(T, w)) {
+          T->forced[w] = 1;
+          changed = 1;
+        }
+      }
+    }
+  } while (changed);
+}
+
+//
+// Webs
+//
+
+static int aot_find(int *parent, int x) {
+  while (parent[x] != x) x = parent[x] = parent[parent[x]];
+  return x;
+}
+
+static void aot_build_webs(Proto *f, AotTypes *T, char *uses, char *defs,
+                           int *succ, int *nsucc, char *forced) {
+  int n = T->nregs;
+  int size = f->sizecode;
+  int *didx = malloc(size * sizeof(int));
+  int *dpc = malloc((size + 1) * sizeof(int));
+  int *parent = malloc((size + 1) * sizeof(int));
+  int *webof = malloc((size + 1) * sizeof(int));
+  int *work = malloc(size * sizeof(int));
+  char *queued = malloc(size);
+
+  for (int r = 0; r < n; r++) {
+    // Definitions of 'r'; index 0 is the caller's argument, if any
+    int nd = 0;
+    int entry = r < f->numparams;
+    if (entry) dpc[nd++] = -1;
+    for (int pc = 0; pc < size; pc++) {
+      didx[pc] = defs[pc * n + r] ? nd : -1;
+      if (didx[pc] >= 0) dpc[nd++] = pc;
+    }
+    if (nd == 0) continue;
+
+    // Reaching definitions
+    int nw = (nd + 63) / 64;
+    uint64_t *in = calloc((size_t)size * nw, sizeof(uint64_t));
+    uint64_t *out = malloc(nw * sizeof(uint64_t));
+    if (entry) in[0] |= 1;
+    int top = 0;
+    for (int pc = size - 1; pc >= 0; pc--) {
+      work[top++] = pc;
+      queued[pc] = 1;
+    }
+    while (top > 0) {
+      int pc = work[--top];
+      queued[pc] = 0;
+      if (didx[pc] >= 0) {
+        memset(out, 0, nw * sizeof(uint64_t));
+        out[didx[pc] / 64] |= (uint64_t)1 << (didx[pc] % 64);
+      } else {
+        memcpy(out, &in[(size_t)pc * nw], nw * sizeof(uint64_t));
+      }
+      for (int s = 0; s < nsucc[pc]; s++) {
+        uint64_t *dst = &in[(size_t)succ[2 * pc + s] * nw];
+        int grew = 0;
+        for (int j = 0; j < nw; j++) {
+          if (out[j] & ~dst[j]) {
+            dst[j] |= out[j];
+            grew = 1;
+          }
+        }
+        if (grew && !queued[succ[2 * pc + s]]) {
+          work[top++] = succ[2 * pc + s];
+          queued[succ[2 * pc + s]] = 1;
+        }
+      }
+    }
+
+    // Definitions reaching the same use share a web
+    for (int d = 0; d < nd; d++) parent[d] = d;
+    for (int pc = 0; pc < size; pc++) {
+      if (!uses[pc * n + r]) continue;
+      int first = -1;
+      for (int d = 0; d < nd; d++) {
+        if (in[(size_t)pc * nw + d / 64] & ((uint64_t)1 << (d % 64))) {
+          if (first < 0)
+            first = d;
+          else
+            parent[aot_find(parent, d)] = aot_find(parent, first);
+        }
+      }
+    }
+    for (int d = 0; d < nd; d++) webof[d] = -1;
+    for (int d = 0; d < nd; d++) {
+      int root = aot_find(parent, d);
+      if (webof[root] < 0) {
+        webof[root] = T->nwebs++;
+        T->forced = realloc(T->forced, T->nwebs);
+        T->forced[webof[root]] = forced[r];
+      }
+      webof[d] = webof[root];
+      if (dpc[d] < 0) {
+        T->forced[webof[d]] = 1;
+      } else {
+        T->def[dpc[d] * n + r] = webof[d];
+      }
+    }
+
+    for (int pc = 0; pc < size; pc++) {
+      int w = -1;
+      for (int d = 0; d < nd; d++) {
+        if (in[(size_t)pc * nw + d / 64] & ((uint64_t)1 << (d % 64))) {
+          if (w == -1)
+            w = webof[d];
+          else if (w != webof[d])
+            w = -2;
+        }
+      }
+      T->cur[pc * n + r] = w < 0 ? -1 : w;
+    }
+    free(in);
+    free(out);
+  }
+
+  free(didx);
+  free(dpc);
+  free(parent);
+  free(webof);
+  free(work);
+  free(queued);
+}
+
+//
+// Spilling
+//
+
+// Instructions that never leave the function nor raise an error
+static int aot_pure(OpCode op) {
+  switch (op) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADKX:
+    case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE: case OP_LOADNIL:
+    case OP_GETUPVAL: case OP_JMP: case OP_TEST: case OP_TESTSET: case OP_NOT:
+    case OP_EQK: case OP_EQI: case OP_EXTRAARG:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int aot_reads_native(Proto *f, AotTypes *T, int pc) {
+  char *use = calloc(T->nregs ? T->nregs : 1, 1);
+  int found = 0;
+  aot_uses(f, pc, use);
+  for (int r = 0; r < T->nregs && !found; r++) {
+    found = use[r] && aot_isnative(T, aot_cur(T, pc, r));
+  }
+  free(use);
+  return found;
+}
+
+// 0: nothing to spill; 1: spill the registers 'pc' reads; 2: spill everything
+static int aot_spill_kind(Proto *f, AotTypes *T, int pc) {
+  OpCode op = GET_OPCODE(f->code[pc]);
+  int native = aot_native(f, T, pc, 0);
+  if (native == 1) return 0;
+  if (native == 2) return 2;
+  switch (op) {
+    case OP_RETURN: case OP_RETURN0: case OP_RETURN1: case OP_TAILCALL:
+      return 1;  // the frame is gone afterwards
+    default:
+      if (aot_pure(op) && !aot_reads_native(f, T, pc)) return 0;
+      return 2;
+  }
+}
+
+static void aot_compute_dirty(Proto *f, AotTypes *T, int *succ, int *nsucc) {
+  int size = f->sizecode;
+  int nw = T->nwebs;
+  T->dirty = calloc((size_t)size * (nw ? nw : 1), 1);
+  unsigned char *out = malloc(nw ? nw : 1);
+  int *work = malloc(size * sizeof(int));
+  char *queued = calloc(size, 1);
+  char *use = malloc(T->nregs ? T->nregs : 1);
+  int top = 0;
+  for (int pc = size - 1; pc >= 0; pc--) {
+    work[top++] = pc;
+    queued[pc] = 1;
+  }
+  while (top > 0) {
+    int pc = work[--top];
+    queued[pc] = 0;
+    memcpy(out, &T->dirty[(size_t)pc * nw], nw);
+    int spill = aot_spill_kind(f, T, pc);
+    if (spill) {
+      memset(use, spill == 2, T->nregs);
+      if (spill == 1) aot_uses(f, pc, use);
+      for (int r = 0; r < T->nregs; r++) {
+        int w = aot_cur(T, pc, r);
+        if (use[r] && w >= 0) out[w] = 0;
+      }
+    }
+    int forprep = GET_OPCODE(f->code[pc]) == OP_FORPREP;
+    for (int r = 0; r < T->nregs; r++) {
+      int w = aot_def(T, pc, r);
+      if (aot_isnative(T, w)) out[w] = !forprep;
+    }
+    for (int s = 0; s < nsucc[pc]; s++) {
+      unsigned char *dst = &T->dirty[(size_t)succ[2 * pc + s] * nw];
+      int grew = 0;
+      for (int w = 0; w < nw; w++) {
+        if (out[w] && !dst[w]) {
+          dst[w] = 1;
+          grew = 1;
+        }
+      }
+      if (grew && !queued[succ[2 * pc + s]]) {
+        work[top++] = succ[2 * pc + s];
+        queued[succ[2 * pc + s]] = 1;
+      }
+    }
+  }
+  free(out);
+  free(work);
+  free(queued);
+  free(use);
+}
+
+static void aot_free_types(AotTypes *T) {
+  if (T == NULL) return;
+  free(T->type);
+  free(T->forced);
+  free(T->cur);
+  free(T->def);
+  free(T->dirty);
+  free(T);
+}
+
+// Returns NULL when nothing in 'f' can be kept in C locals
+static AotTypes *aot_analyze(Proto *f) {
+  int n = f->maxstacksize;
+  int size = f->sizecode;
+  if (n == 0 || (long)size * n > AOT_MAXCELLS) return NULL;
+
+  for (int pc = 0; pc < size; pc++) {
+    if (GET_OPCODE(f->code[pc]) == OP_DEFER) return NULL;
+  }
+
+  AotTypes *T = calloc(1, sizeof(AotTypes));
+  T->nregs = n;
+  T->cur = malloc((size_t)size * n * sizeof(int));
+  T->def = malloc((size_t)size * n * sizeof(int));
+  for (long j = 0; j < (long)size * n; j++) T->cur[j] = T->def[j] = -1;
+
+  char *uses = calloc((size_t)size * n, 1);
+  char *defs = calloc((size_t)size * n, 1);
+  int *succ = malloc(2 * size * sizeof(int));
+  int *nsucc = malloc(size * sizeof(int));
+  char *forced = calloc(n, 1);
+  int tablelast = -1;  // last entry of the jump table being scanned
+  for (int pc = 0; pc < size; pc++) {
+    Instruction i = f->code[pc];
+    aot_uses(f, pc, &uses[pc * n]);
+    aot_defs(f, pc, &defs[pc * n]);
+    int ns = aot_successors(f, pc, &succ[2 * pc]);
+    // Any entry of a jump table may be taken, so each one is also made
+    // to lead to the next
+    if (GET_OPCODE(i) == OP_JMPTAB || GET_OPCODE(i) == OP_JMPSTR) {
+      tablelast = pc + jmptabfirst(i) + GETARG_Bx(i);
+    } else if (GET_OPCODE(i) == OP_JMP && pc < tablelast) {
+      succ[2 * pc + ns++] = pc + 1;
+    }
+    nsucc[pc] = 0;
+    for (int s = 0; s < ns; s++) {
+      if (succ[2 * pc + s] < size) {
+        succ[2 * pc + nsucc[pc]++] = succ[2 * pc + s];
+      }
+    }
+    // Captured and to-be-closed registers are accessed through the stack
+    if (GET_OPCODE(i) == OP_CLOSURE) {
+      Proto *p = f->p[GETARG_Bx(i)];
+      for (int j = 0; j < p->sizeupvalues; j++) {
+        if (p->upvalues[j].instack) forced[p->upvalues[j].idx] = 1;
+      }
+    } else if (GET_OPCODE(i) == OP_TBC) {
+      forced[GETARG_A(i)] = 1;
+    } else if (GET_OPCODE(i) == OP_TFORPREP && GETARG_A(i) + 3 < n) {
+      forced[GETARG_A(i) + 3] = 1;
+    }
+  }
+
+  aot_build_webs(f, T, uses, defs, succ, nsucc, forced);
+  T->type = malloc(T->nwebs ? T->nwebs : 1);
+  aot_infer(f, T);
+
+  int any = 0;
+  for (int w = 0; w < T->nwebs; w++) any |= aot_isnative(T, w);
+  if (any) aot_compute_dirty(f, T, succ, nsucc);
+
+  free(uses);
+  free(defs);
+  free(succ);
+  free(nsucc);
+  free(forced);
+  if (!any) {
+    aot_free_types(T);
+    return NULL;
+  }
+  return T;
+}
+
+//
+// Code generation
+//
+
+static void aot_print_store(AotTypes *T, int w, int r) {
+  println("    %s(s2v(base + %d), %s);",
+          T->type[w] == AOT_INT ? "setivalue" : "setfltvalue", r,
+          aot_local(T, w));
+}
+
+static void aot_print_load(AotTypes *T, int w, int r, const char *indent) {
+  println("%s%s = %s(s2v(base + %d));", indent, aot_local(T, w),
+          T->type[w] == AOT_INT ? "ivalue" : "fltvalue", r);
+}
+
+static void aot_print_declarations(AotTypes *T) {
+  if (T == NULL) return;
+  for (int w = 0; w < T->nwebs; w++) {
+    if (aot_isnative(T, w)) {
+      println("  %s %s = 0;",
+              T->type[w] == AOT_INT ? "lua_Integer" : "lua_Number",
+              aot_local(T, w));
+    }
+  }
+}
+
+static int aot_has_reloads(AotTypes *T, int pc) {
+  for (int r = 0; r < T->nregs; r++) {
+    if (aot_isnative(T, aot_cur(T, pc, r))) return 1;
+  }
+  return 0;
+}
+
+// Reloads the webs that are live at 'pc' when the function is re-entered
+static void aot_print_reloads(AotTypes *T, int pc) {
+  if (T == NULL) return;
+  for (int r = 0; r < T->nregs; r++) {
+    int w = aot_cur(T, pc, r);
+    if (aot_isnative(T, w)) aot_print_load(T, w, r, "      ");
+  }
+}
+
+// AOT_SPILL_ALL and AOT_RELOAD_ALL are used by aot_vmfetch around hooks
+static void aot_print_hook_macros(AotTypes *T, int pc, char **last) {
+  if (T == NULL) return;
+  size_t size = 64 + (size_t)T->nregs * 96;
+  char *spill = malloc(size), *reload = malloc(size);
+  size_t ns = 0, nr = 0;
+  spill[0] = reload[0] = '\0';
+  for (int r = 0; r < T->nregs; r++) {
+    int w = aot_cur(T, pc, r);
+    if (!aot_isnative(T, w)) continue;
+    int isint = T->type[w] == AOT_INT;
+    ns += snprintf(spill + ns, size - ns, " %s(s2v(base + %d), %s);",
+                   isint ? "setivalue" : "setfltvalue", r, aot_local(T, w));
+    nr += snprintf(reload + nr, size - nr, " %s = %s(s2v(base + %d));",
+                   aot_local(T, w), isint ? "ivalue" : "fltvalue", r);
+  }
+  if (*last == NULL || strcmp(*last, spill) != 0) {
+    println("  #undef  AOT_SPILL_ALL");
+    println("  #define AOT_SPILL_ALL() {%s }", spill);
+    println("  #undef  AOT_RELOAD_ALL");
+    println("  #define AOT_RELOAD_ALL() {%s }", reload);
+    free(*last);
+    *last = spill;
+  } else {
+    free(spill);
+  }
+  free(reload);
+}
+
+static void aot_print_spills(Proto *f, AotTypes *T, int pc) {
+  if (T == NULL) return;
+  int spill = aot_spill_kind(f, T, pc);
+  if (spill == 0) return;
+  char *use = malloc(T->nregs);
+  memset(use, spill == 2, T->nregs);
+  if (spill == 1) aot_uses(f, pc, use);
+  for (int r = 0; r < T->nregs; r++) {
+    int w = aot_cur(T, pc, r);
+    if (use[r] && aot_isnative(T, w) && T->dirty[(size_t)pc * T->nwebs + w]) {
+      aot_print_store(T, w, r);
+    }
+  }
+  free(use);
+}
+
+// After FORPREP has run on the stack
+static void aot_print_forprep_loads(Proto *f, AotTypes *T, int pc) {
+  if (T == NULL) return;
+  int a = GETARG_A(f->code[pc]);
+  for (int r = a; r < a + 4; r++) {
+    int w = aot_def(T, pc, r);
+    if (aot_isnative(T, w)) aot_print_load(T, w, r, "    ");
+  }
+}
+
+// Stores 'expr' of type 't' into register 'r' as defined at 'pc'
+static void aot_print_result(AotTypes *T, int pc, int r, AotType t,
+                             const char *expr) {
+  int w = aot_def(T, pc, r);
+  if (aot_isnative(T, w)) {
+    println("    %s = %s;", aot_local(T, w), expr);
+  } else {
+    println("    %s(s2v(ra), %s);", t == AOT_INT ? "setivalue" : "setfltvalue",
+            expr);
+  }
+}
+
+static int aot_is_numeric(AotOperand *o) {
+  return (o->type == AOT_INT || o->type == AOT_FLT) && o->expr[0] != '\0';
+}
+
+//
+// Emits the specialized version of the instruction at 'pc' (only if 'emit').
+// Returns 0 if the instruction has to go through the generic code, 1 if it
+// was specialized and 2 if it was specialized but may still raise an error.
+//
+static int aot_native(Proto *f, AotTypes *T, int pc, int emit) {
+  if (T == NULL) return 0;
+  Instruction i = f->code[pc];
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i);
+  int wa = aot_def(T, pc, a);
+  AotOperand b, c;
+  OpCode kind;
+  char expr[256];
+
+  switch (op) {
+    case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADKX: {
+      if (!aot_isnative(T, wa)) return 0;
+      if (op == OP_LOADI || op == OP_LOADF) {
+        aot_imm_operand(GETARG_sBx(i), &b);
+        if (op == OP_LOADF) {
+          b.type = AOT_FLT;
+          snprintf(b.expr, sizeof(b.expr), "cast_num(%d)", GETARG_sBx(i));
+        }
+      } else {
+        int idx = op == OP_LOADK ? GETARG_Bx(i) : GETARG_Ax(f->code[pc + 1]);
+        aot_k_operand(f, idx, &b);
+      }
+      if (emit) {
+        println("    %s = %s;", aot_local(T, wa), b.expr);
+        if (op == OP_LOADKX) println("    goto AOT_SKIP1;");
+      }
+      return 1;
+    }
+    case OP_MOVE: {
+      aot_reg_operand(T, pc, GETARG_B(i), &b);
+      if (!aot_is_numeric(&b)) return 0;
+      if (emit) aot_print_result(T, pc, a, b.type, b.expr);
+      return 1;
+    }
+    case OP_EQ: case OP_LT: case OP_LE: {
+      aot_reg_operand(T, pc, a, &b);
+      aot_reg_operand(T, pc, GETARG_B(i), &c);
+      if (!aot_is_numeric(&b) || !aot_is_numeric(&c)) return 0;
+      const char *cmp = op == OP_EQ ? "==" : op == OP_LT ? "<" : "<=";
+      if (b.type == c.type) {
+        snprintf(expr, sizeof(expr), "(%s %s %s)", b.expr, cmp, c.expr);
+      } else if (op == OP_EQ) {
+        return 0;
+      } else {
+        snprintf(expr, sizeof(expr), "%s%s(%s, %s)", op == OP_LT ? "LT" : "LE",
+                 b.type == AOT_INT ? "intfloat" : "floatint", b.expr, c.expr);
+      }
+      break;
+    }
+    case OP_EQK: {
+      aot_reg_operand(T, pc, a, &b);
+      aot_k_operand(f, GETARG_B(i), &c);
+      if (!aot_is_numeric(&b) || b.type != c.type) return 0;
+      snprintf(expr, sizeof(expr), "(%s == %s)", b.expr, c.expr);
+      break;
+    }
+    case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI: {
+      static const char *const cmps[] = {"==", "<", "<=", ">", ">="};
+      aot_reg_operand(T, pc, a, &b);
+      if (!aot_is_numeric(&b)) return 0;
+      aot_imm_operand(GETARG_sB(i), &c);
+      snprintf(expr, sizeof(expr), "(%s %s %s)", b.expr, cmps[op - OP_EQI],
+               b.type == AOT_FLT ? aot_as_float(&c) : c.expr);
+      break;
+    }
+    case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
+      // only reached when the operation before it falls back to metamethods
+      if (!aot_native(f, T, pc - 1, 0)) return 0;
+      if (emit) println("    lua_assert(0);  /* the operation cannot fail */");
+      return 1;
+    }
+    case OP_TEST: {
+      aot_reg_operand(T, pc, a, &b);
+      if (!aot_is_numeric(&b)) return 0;
+      snprintf(expr, sizeof(expr), "1  /* numbers are true */");
+      break;
+    }
+    case OP_FORLOOP: {
+      int wc = aot_cur(T, pc, a + 1), ws = aot_cur(T, pc, a + 2);
+      int wi = aot_cur(T, pc, a);
+      if (!aot_isnative(T, wi) || !aot_isnative(T, wc) ||
+          !aot_isnative(T, ws) || T->type[wi] != AOT_INT ||
+          T->type[wc] != AOT_INT || T->type[ws] != AOT_INT ||
+          aot_def(T, pc, a) != wi || aot_def(T, pc, a + 1) != wc)
+        return 0;
+      if (emit) {
+        int wv = aot_def(T, pc, a + 3);
+        println("    if (l_castS2U(%s) > 0) {  /* still more iterations? */",
+                aot_local(T, wc));
+        println("      %s = l_castU2S(l_castS2U(%s) - 1);", aot_local(T, wc),
+                aot_local(T, wc));
+        println("      %s = intop(+, %s, %s);", aot_local(T, wi),
+                aot_local(T, wi), aot_local(T, ws));
+        if (aot_isnative(T, wv)) {
+          println("      %s = %s;", aot_local(T, wv), aot_local(T, wi));
+        } else {
+          println("      setivalue(s2v(ra + 3), %s);", aot_local(T, wi));
+        }
+        println("      goto label_%02d; /* jump back */",
+                (pc + 1) - GETARG_Bx(i));
+        println("    }");
+        println("    updatetrap(ci);  /* allows a signal to break the loop */");
+      }
+      return 1;
+    }
+    default: {
+      if (!aot_arith_operands(f, T, pc, &kind, &b, &c)) return 0;
+      if (!aot_is_numeric(&b) || !aot_is_numeric(&c)) return 0;
+      AotType t = aot_arith_type(kind, b.type, c.type);
+      if (t != AOT_INT && t != AOT_FLT) return 0;
+      // Integer division by a non-constant (or zero) can raise an error
+      int canerror = t == AOT_INT && (kind == OP_MOD || kind == OP_IDIV) &&
+                     !(op == OP_MODK || op == OP_IDIVK) ? 1 : 0;
+      if (t == AOT_INT && (op == OP_MODK || op == OP_IDIVK) &&
+          ivalue(&f->k[GETARG_C(i)]) == 0)
+        canerror = 1;
+      if (emit) {
+        aot_arith_expr(kind, t, &b, &c, expr, sizeof(expr));
+        if (canerror) println("    savestate(L, ci);  /* in case of errors */");
+        aot_print_result(T, pc, a, t, expr);
+        if (op != OP_UNM && op != OP_BNOT) println("    goto AOT_SKIP1;");
+      }
+      return canerror ? 2 : 1;
+    }
+  }
+
+  // Conditional jumps
+  if (emit) {
+    println("    int cond = %s;", expr);
+    println("    docondjump();");
+  }
+  return 1;
+}
@@ -32,6 +32,8 @@ static lua_State *globalL = NULL;
 
 static const char *progname = LUA_PROGNAME;
 
+static const char *profilename = NULL; /* file given with '-P' */
+
 #if defined(LUA_USE_POSIX) /* { */
 
 /*
@@ -74,7 +76,7 @@ static void laction(int i) {
 
 static void print_usage(const char *badoption) {
   lua_writestringerror("%s: ", progname);
-  if (badoption[1] == 'e' || badoption[1] == 'l')
+  if (badoption[1] == 'e' || badoption[1] == 'l' || badoption[1] == 'P')
     lua_writestringerror("'%s' needs argument\n", badoption);
   else
     lua_writestringerror("unrecognized option '%s'\n", badoption);
@@ -88,9 +90,11 @@ static void print_usage(const char *badoption) {
       "  -v        show version information\n"
       "  -E        ignore environment variables\n"
       "  -W        turn warnings on\n"
-      "  -r        run preprocessor (not reccomended on runtime, try with "
-      "bytecoder or AST)\n"
+      "  -r        run the preprocessor on loaded files (set "
+      "COBALT_PRECACHE to a\n"
+      "            directory to cache its output across runs)\n"
       "  -p        use cobalt without pool allocator\n"
+      "  -P file   write a profile of the run to 'file' (for cobaltaot)\n"
       "  --        stop handling options\n"
       "  -         stop handling options and execute stdin\n",
       progname);
@@ -303,6 +307,14 @@ static int collectargs(char **argv, int *first) {
             return has_error; /* no next argument or it is another option */
         }
         break;
+      case 'P':                    /* needs an argument too */
+        if (argv[i][2] != '\0')    /* concatenated argument? */
+          profilename = argv[i] + 2;
+        else if (argv[i + 1] == NULL || argv[i + 1][0] == '-')
+          return has_error;
+        else
+          profilename = argv[++i];
+        break;
       default: /* invalid option */
         return has_error;
     }
@@ -336,6 +348,9 @@ static int runargs(lua_State *L, char **argv, int n) {
       case 'W':
         lua_warning(L, "@on", 0); /* warnings on */
         break;
+      case 'P':
+        if (argv[i][2] == '\0') i++; /* skip the file name */
+        break;
     }
   }
   return 1;
@@ -612,10 +627,12 @@ static int pmain(lua_State *L) {
   if (!(args & has_p)) {
     init_pool_alloc();
   }
-  if (args & has_r) {
-    lua_error("preprocessor not implemented into interpreter yet.");
-  }
   luaL_openlibs(L);                      /* open standard libraries */
+  if (args & has_r) {      /* option '-r'? */
+    lua_pushboolean(L, 1); /* signal 'luaL_loadfilex' to preprocess files */
+    lua_setfield(L, LUA_REGISTRYINDEX, LUA_PREPROCESS_KEY);
+  }
+  if (profilename != NULL) lua_setprofile(L, 1);
   createargtable(L, argv, argc, script); /* create table 'arg' */
   lua_gc(L, LUA_GCGEN, 0, 0);            /* GC in generational mode */
   if (!(args & has_E)) {                 /* no option '-E'? */
@@ -639,6 +656,20 @@ static int pmain(lua_State *L) {
   return 1;
 }
 
+static int profilewriter(lua_State *L, const void *p, size_t sz, void *f) {
+  (void)L;
+  return fwrite(p, 1, sz, (FILE *)f) != sz;
+}
+
+/* write the counts collected by option '-P' */
+static int writeprofile(lua_State *L, const char *fname) {
+  FILE *f = fopen(fname, "w");
+  int ok = (f != NULL && lua_dumpprofile(L, profilewriter, f) == 0);
+  if (f != NULL && fclose(f) != 0) ok = 0;
+  if (!ok) l_message(progname, "cannot write profile");
+  return ok;
+}
+
 #include "fatal.h" /* Handle fatal-errors */
 
 int main(int argc, char **argv) {
@@ -657,6 +688,7 @@ int main(int argc, char **argv) {
   status = lua_pcall(L, 2, 1, 0); /* do the call */
   result = lua_toboolean(L, -1);  /* get result */
   report(L, status);
+  if (profilename != NULL && !writeprofile(L, profilename)) result = 0;
   lua_close(L);
   return (result && status == LUA_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
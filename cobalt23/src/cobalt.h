@@ -275,6 +275,8 @@ LUA_API int(lua_load)(lua_State *L, lua_Reader reader, void *dt,
 
 LUA_API int(lua_dump)(lua_State *L, lua_Writer writer, void *data, int strip);
 
+LUA_API void(lua_setoptimize)(lua_State *L, int level);
+
 /*
 ** coroutine functions
 */
@@ -307,6 +309,7 @@ LUA_API void(lua_warning)(lua_State *L, const char *msg, int tocont);
 #define LUA_GCISRUNNING 9
 #define LUA_GCGEN 10
 #define LUA_GCINC 11
+#define LUA_GCDEBT 12 /* count memory the collector does not see */
 
 LUA_API int(lua_gc)(lua_State *L, int what, ...);
 
@@ -502,6 +505,9 @@ LUA_API lua_Hook(lua_gethook)(lua_State *L);
 LUA_API int(lua_gethookmask)(lua_State *L);
 LUA_API int(lua_gethookcount)(lua_State *L);
 
+LUA_API void(lua_setprofile)(lua_State *L, int on);
+LUA_API int(lua_dumpprofile)(lua_State *L, lua_Writer writer, void *data);
+
 LUA_API int(lua_setcstacklimit)(lua_State *L, unsigned int limit);
 
 struct lua_Debug {
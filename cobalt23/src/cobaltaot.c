@@ -10,7 +10,9 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,21 +38,54 @@ static char *provided_input_filename = NULL;
 static char *module_name = NULL;
 
 int aotswitches = 0;
+int aottypes = 1;
 int preprocessor = 1;
 int executable = 0;
+int bundle = 0;
 
 static FILE *output_file = NULL;
 static int nfunctions = 0;
 static TString **tmname;
 
+// Modules of a --bundle, in the order they are generated. The first one is
+// the main script; the rest are registered in package.preload.
+typedef struct BundleModule {
+  char *name;      // the name 'require' is called with
+  char *filename;  // the script it is compiled from
+  int first;       // index of its first magic_implementation
+} BundleModule;
+
+static BundleModule *bundle_modules = NULL;
+static int nbundle = 0;
+static int sizebundle = 0;
+static const char *bundle_dir = "";  // directory of the main script
+
+// Standard libraries selected with -l (all of them when there is none)
+static const char **bundle_libs = NULL;
+static int nbundle_libs = 0;
+
+static void bundle_add_file(const char *);
+static void bundle_add_lib(const char *);
+
+#include "aot_profile.c"
+
 static void usage() {
   fprintf(stderr,
           "usage: %s [options] [filename]\nAvailable options are:\n  -o name  "
           "output to file 'name'\n  -p       do not run the preprocessor on "
           "the input\n  -i name  preprocess to file 'name'\n  -m name  "
           "generate code with `name` function as main function\n  -s       use "
-          "switches instead of gotos in generated code\n  -D name  provide "
-          "'name' to the preprocessor\n  -e       add a main symbol for executables\n",
+          "switches instead of gotos in generated code\n  -n       keep "
+          "every register on the Lua stack (no numeric specialization)\n  "
+          "-D name  provide "
+          "'name' to the preprocessor\n  -e       add a main symbol for executables\n"
+          "  --profile file  compile only the functions that are hot in "
+          "'file'\n           (written by `cobalt -P file script`)\n"
+          "  --hot n  calls plus loop iterations that make a function hot "
+          "(default 1000)\n"
+          "  --bundle main [modules]  compile a script and the modules it "
+          "requires\n           into one program\n  -l name  with --bundle, "
+          "link only the standard library 'name' (repeatable)\n",
           program_name);
 }
 
@@ -121,10 +156,41 @@ static void doargs(int argc, char **argv) {
             "cobaltpre to input preprocessor definitions.");
       } else if (0 == strcmp(arg, "-s")) {
         aotswitches = 1;
+      } else if (0 == strcmp(arg, "-n")) {
+        aottypes = 0;
+      } else if (0 == strcmp(arg, "--bundle")) {
+        bundle = 1;
+        executable = 1;
+        if (input_filename != NULL) {
+          bundle_add_file(input_filename);
+        }
+      } else if (0 == strcmp(arg, "--profile")) {
+        i++;
+        if (i >= argc) {
+          fatal_error("missing argument for --profile");
+        }
+        profile_filename = argv[i];
+      } else if (0 == strcmp(arg, "--hot")) {
+        i++;
+        char *end = NULL;
+        if (i < argc) {
+          hot_threshold = strtoull(argv[i], &end, 10);
+        }
+        if (end == NULL || end == argv[i] || *end != '\0') {
+          fatal_error("--hot needs a number");
+        }
+      } else if (0 == strcmp(arg, "-l")) {
+        i++;
+        if (i >= argc) {
+          fatal_error("missing argument for -l");
+        }
+        bundle_add_lib(argv[i]);
       } else {
         fprintf(stderr, "unknown option %s\n", arg);
         exit(1);
       }
+    } else if (bundle) {
+      bundle_add_file(arg);
     } else {
       switch (npos) {
         case 0:
@@ -142,6 +208,16 @@ static void doargs(int argc, char **argv) {
     usage();
     exit(1);
   }
+  if (bundle) {
+    if (nbundle == 0) {
+      fatal_error("--bundle needs at least the main script");
+    }
+    if (aotswitches || module_name || provided_input_filename) {
+      fatal_error("-s, -m and -i cannot be used with --bundle");
+    }
+  } else if (nbundle_libs > 0) {
+    fatal_error("-l can only be used with --bundle");
+  }
 }
 
 static char *get_module_name_from_filename(const char *);
@@ -149,11 +225,21 @@ static void check_module_name(const char *);
 static void replace_dots(char *);
 static void print_functions();
 static void print_source_code();
+static char *run_preprocessor(const char *, const char *);
+static void print_bundle();
 
 int main(int argc, char **argv) {
   // Process input arguments
 
   doargs(argc, argv);
+  if (profile_filename != NULL) {
+    read_profile();
+  }
+
+  if (bundle) {
+    print_bundle();
+    return 0;
+  }
 
   if (!module_name) {
     module_name = get_module_name_from_filename(output_filename);
@@ -162,37 +248,16 @@ int main(int argc, char **argv) {
   replace_dots(module_name);
 
   // Run preprocessor
-  char process[256];
-  if (preprocessor == 1){
-    char command[256];
-    // set process to input_filename+.ii
-    if (provided_input_filename == NULL) {
-      strcpy(process, input_filename);
-      strcat(process, ".cii");
-    } else {
-      strcpy(process, provided_input_filename);
-    }
-
-    snprintf(command, sizeof(command),
-            "cobalt -e 'import(\"preprocess\")->Interface(\"%s\", \"-o\", \"%s\")'",
-            input_filename, process);
-    // printf(command);
-    FILE *fp;
-    char path[1035];
-    fp = popen(command, "r");
-    if (fp == NULL) {
-      printf("Failed to run preprocessor\n");
-      exit(1);
-    }
-    while (fgets(path, sizeof(path) - 1, fp) != NULL) {
-      printf("%s", path);
-    }
-    pclose(fp);
+  const char *source = input_filename;
+  if (preprocessor == 1) {
+    source = run_preprocessor(input_filename, provided_input_filename);
   }
+
   // Read the input
 
+  profile_set_script(input_filename);
   lua_State *L = luaL_newstate();
-  if (luaL_loadfile(L, preprocessor == 1 ? process : input_filename) != LUA_OK) {
+  if (luaL_loadfile(L, source) != LUA_OK) {
     fatal_error(lua_tostring(L, -1));
   }
   Proto *proto = getproto(s2v(L->top - 1));
@@ -238,6 +303,37 @@ int main(int argc, char **argv) {
   }
 }
 
+// Run the preprocessor on 'filename', writing to 'output' (or to
+// 'filename'.cii when 'output' is NULL). Returns the preprocessed file name.
+static char *run_preprocessor(const char *filename, const char *output) {
+  char *process;
+  if (output == NULL) {
+    process = malloc(strlen(filename) + 5);
+    strcpy(process, filename);
+    strcat(process, ".cii");
+  } else {
+    process = malloc(strlen(output) + 1);
+    strcpy(process, output);
+  }
+
+  char command[1024];
+  snprintf(command, sizeof(command),
+           "cobalt -e 'import(\"preprocess\")->Interface(\"%s\", \"-o\", \"%s\")'",
+           filename, process);
+  FILE *fp;
+  char path[1035];
+  fp = popen(command, "r");
+  if (fp == NULL) {
+    printf("Failed to run preprocessor\n");
+    exit(1);
+  }
+  while (fgets(path, sizeof(path) - 1, fp) != NULL) {
+    printf("%s", path);
+  }
+  pclose(fp);
+  return process;
+}
+
 // Deduce the Lua module name given the file name
 // Example:  ./foo/bar/baz.c -> foo.bar.baz
 static char *get_module_name_from_filename(const char *filename) {
@@ -714,6 +810,11 @@ static void aot_PrintOpcodeComment(Proto *f, int pc) {
     case OP_TESTSET:
       print("%d %d %d", a, b, isk);
       break;
+    case OP_JMPTAB:
+    case OP_JMPSTR:
+      print("%d %d", a, bx);
+      print(COMMENT "%d entries", bx + 1);
+      break;
     case OP_CALL:
       print("%d %d %d", a, b, c);
       print(COMMENT);
@@ -793,12 +894,18 @@ static void aot_PrintOpcodeComment(Proto *f, int pc) {
   print("\n");
 }
 
+#include "aot_types.c"
 #include "aot_gotos.c"
 #include "aot_switches.c"
 
 static void create_functions(Proto *p) {
   // aot_footer.c should use the same traversal order as this.
-  if (aotswitches == 0) {
+  if (!profile_is_hot(p)) {
+    println("// cold function (lines %d - %d) runs as bytecode", p->linedefined,
+            p->lastlinedefined);
+    println("#define magic_implementation_%02d NULL", nfunctions++);
+    printnl();
+  } else if (aotswitches == 0) {
     create_function(p);
   } else {
     create_function_switches(p);
@@ -861,3 +968,345 @@ static void print_source_code() {
 
   fclose(infile);
 }
+
+//
+// Bundling
+// --------
+//
+// `--bundle main.cobalt [modules...]` compiles the main script and every
+// module it requires into a single C file. The modules are found by
+// following `require("name")` calls with a constant name, looked up next to
+// the main script and in the current directory like the default
+// package.path does. Each module is embedded as precompiled bytecode with
+// its compiled functions and registered in package.preload, so the program
+// neither searches the filesystem nor parses source at startup.
+//
+
+// Standard libraries, mirroring linit.cpp. 'preload' ones are registered in
+// package.preload instead of being opened into the globals.
+static const struct {
+  const char *name;
+  const char *open;
+  int preload;
+} bundle_stdlibs[] = {
+    {"_G", "luaopen_base", 0},        {"_", "luaopen_under", 0},
+    {"package", "luaopen_package", 0}, {"table", "luaopen_table", 0},
+    {"io", "luaopen_io", 0},          {"os", "luaopen_os", 0},
+    {"string", "luaopen_string", 0},  {"math", "luaopen_math", 0},
+    {"debug", "luaopen_debug", 0},    {"core", "luaopen_core", 0},
+    {"device", "luaopen_device", 0},  {"file", "luaopen_lfs", 0},
+    {"signal", "luaopen_signal", 0},  {"unix", "luaopen_unix", 1},
+    {"win", "luaopen_win", 1},        {"preprocess", "luaopen_preprocess", 1},
+    {"struct", "luaopen_struct", 1},  {"Color", "luaopen_color", 1},
+    {"alloc", "luaopen_alloc", 1},    {"lpeg", "luaopen_lpeg", 1},
+    {"json", "luaopen_json", 1},      {"coroutine", "luaopen_coroutine", 1},
+    {"async", "luaopen_async", 1},    {"utf8", "luaopen_utf8", 1},
+    {"bit32", "luaopen_bit32", 1},    {"glmath", "luaopen_moonglmath", 1},
+    {"bit", "luaopen_bit", 1},        {"msg", "luaopen_chan", 1},
+    {"crypt", "luaopen_crypt", 1},    {"dynamic", "luaopen_dyn", 1},
+    {"ffi", "luaopen_ffi", 1},        {"sdl", "luaopen_moonsdl2", 1},
+    {"python", "luaopen_python", 1},  {NULL, NULL, 0}};
+
+// The libraries every bundle needs: the base library and 'package'
+#define BUNDLE_NREQUIRED_LIBS 3
+
+static int bundle_find_lib(const char *name) {
+  for (int i = 0; bundle_stdlibs[i].name != NULL; i++) {
+    if (0 == strcmp(bundle_stdlibs[i].name, name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void bundle_select_lib(int lib) {
+  for (int i = 0; i < nbundle_libs; i++) {
+    if (0 == strcmp(bundle_libs[i], bundle_stdlibs[lib].name)) {
+      return;
+    }
+  }
+  bundle_libs = realloc(bundle_libs, (nbundle_libs + 1) * sizeof(char *));
+  bundle_libs[nbundle_libs++] = bundle_stdlibs[lib].name;
+}
+
+static void bundle_add_lib(const char *name) {
+  int lib = bundle_find_lib(name);
+  if (lib < 0) {
+    fprintf(stderr, "%s: unknown standard library '%s'\n", program_name,
+            name);
+    exit(1);
+  }
+  bundle_select_lib(lib);
+}
+
+static void bundle_add(char *name, char *filename) {
+  for (int i = 0; i < nbundle; i++) {
+    if (0 == strcmp(bundle_modules[i].name, name)) {
+      free(name);
+      free(filename);
+      return;
+    }
+  }
+  if (nbundle == sizebundle) {
+    sizebundle = sizebundle ? 2 * sizebundle : 8;
+    bundle_modules =
+        realloc(bundle_modules, sizebundle * sizeof(BundleModule));
+  }
+  bundle_modules[nbundle].name = name;
+  bundle_modules[nbundle].filename = filename;
+  bundle_modules[nbundle].first = 0;
+  nbundle++;
+}
+
+// Deduce the name a module is required with from its file name
+// Example:  lib/util/init.cobalt -> util (with main script in lib/)
+static char *bundle_module_name(const char *filename) {
+  size_t ndir = strlen(bundle_dir);
+  if (0 == strncmp(filename, bundle_dir, ndir)) {
+    filename += ndir;
+  }
+  while (filename[0] == '.' && filename[1] == '/') {
+    filename += 2;
+  }
+
+  char *name = malloc(strlen(filename) + 1);
+  strcpy(name, filename);
+  char *ext = strrchr(name, '.');
+  char *sep = strrchr(name, '/');
+  if (ext != NULL && (sep == NULL || ext > sep)) {
+    *ext = '\0';
+  }
+  size_t n = strlen(name);
+  if (n > 5 && 0 == strcmp(name + n - 5, "/init")) {
+    name[n - 5] = '\0';
+  }
+
+  for (char *c = name; *c != '\0'; c++) {
+    if (*c == '/') {
+      *c = '.';
+    } else if (!isalnum((unsigned char)*c) && *c != '_' && *c != '.') {
+      fprintf(stderr, "%s: cannot bundle '%s': module names must contain "
+              "only letters, numbers, '_' or '.'\n", program_name, filename);
+      exit(1);
+    }
+  }
+  return name;
+}
+
+static void bundle_add_file(const char *filename) {
+  if (nbundle == 0) {
+    const char *sep = strrchr(filename, '/');
+    if (sep != NULL) {
+      size_t n = sep - filename + 1;
+      char *dir = malloc(n + 1);
+      memcpy(dir, filename, n);
+      dir[n] = '\0';
+      bundle_dir = dir;
+    }
+  }
+  char *copy = malloc(strlen(filename) + 1);
+  strcpy(copy, filename);
+  bundle_add(bundle_module_name(filename), copy);
+}
+
+// Look a module up like package.path does; NULL if it is not a script
+static char *bundle_find(const char *name) {
+  static const char *templates[] = {"?" LUA_SCRIPT_EXT, "?/init" LUA_SCRIPT_EXT};
+  const char *dirs[] = {bundle_dir, ""};
+  int ndirs = bundle_dir[0] == '\0' ? 1 : 2;
+
+  for (int d = 0; d < ndirs; d++) {
+    for (int t = 0; t < 2; t++) {
+      size_t n = strlen(dirs[d]) + strlen(name) + strlen(templates[t]);
+      char *path = malloc(n + 1);
+      strcpy(path, dirs[d]);
+      char *p = path + strlen(path);
+      for (const char *c = templates[t]; *c != '\0'; c++) {
+        if (*c != '?') {
+          *p++ = *c;
+          continue;
+        }
+        for (const char *m = name; *m != '\0'; m++) {
+          *p++ = (*m == '.') ? '/' : *m;
+        }
+      }
+      *p = '\0';
+
+      FILE *f = fopen(path, "r");
+      if (f != NULL) {
+        fclose(f);
+        return path;
+      }
+      free(path);
+    }
+  }
+  return NULL;
+}
+
+static void bundle_require(const char *name) {
+  for (const char *c = name; *c != '\0'; c++) {
+    if (!isalnum((unsigned char)*c) && *c != '_' && *c != '.') {
+      return;  // leave it to the searchers at run time
+    }
+  }
+  char *filename = bundle_find(name);
+  if (filename != NULL) {
+    char *copy = malloc(strlen(name) + 1);
+    strcpy(copy, name);
+    bundle_add(copy, filename);
+  } else if (nbundle_libs > 0) {
+    int lib = bundle_find_lib(name);
+    if (lib >= 0 && bundle_stdlibs[lib].preload) {
+      bundle_select_lib(lib);
+    }
+  }
+}
+
+// Find `require "name"` calls: a GETTABUP of _ENV.require (or its alias
+// import) followed by a LOADK of the argument.
+static void bundle_scan_requires(const Proto *f) {
+  for (int pc = 0; pc + 1 < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    if (GET_OPCODE(i) != OP_GETTABUP) {
+      continue;
+    }
+    const TString *up = f->upvalues[GETARG_B(i)].name;
+    const TValue *fn = &f->k[GETARG_C(i)];
+    if (up == NULL || 0 != strcmp(getstr(up), "_ENV") || !ttisstring(fn) ||
+        (0 != strcmp(svalue(fn), "require") &&
+         0 != strcmp(svalue(fn), "import"))) {
+      continue;
+    }
+    Instruction next = f->code[pc + 1];
+    if (GET_OPCODE(next) == OP_LOADK && GETARG_A(next) == GETARG_A(i) + 1 &&
+        ttisstring(&f->k[GETARG_Bx(next)])) {
+      bundle_require(svalue(&f->k[GETARG_Bx(next)]));
+    }
+  }
+  for (int i = 0; i < f->sizep; i++) {
+    bundle_scan_requires(f->p[i]);
+  }
+}
+
+static int bundle_writer(lua_State *L, const void *p, size_t size, void *ud) {
+  const unsigned char *bytes = p;
+  int *col = ud;
+  (void)L;
+  for (size_t i = 0; i < size; i++) {
+    if (*col == 0) {
+      print(" ");
+    }
+    print(" %3d,", bytes[i]);
+    if (++*col == 16) {
+      print("\n");
+      *col = 0;
+    }
+  }
+  return 0;
+}
+
+static void print_bundle_main() {
+  for (int i = 0; i < nbundle_libs; i++) {
+    println("int %s(lua_State *L);",
+            bundle_stdlibs[bundle_find_lib(bundle_libs[i])].open);
+  }
+  if (nbundle_libs > 0) {
+    printnl();
+  }
+  println("int main(int argc, char *argv[]) {");
+  println("  lua_State *L = luaL_newstate();");
+  if (nbundle_libs == 0) {
+    println("  luaL_openlibs(L);");
+  } else {
+    for (int i = 0; i < BUNDLE_NREQUIRED_LIBS; i++) {
+      println("  luaL_requiref(L, \"%s\", %s, 1);", bundle_stdlibs[i].name,
+              bundle_stdlibs[i].open);
+      println("  lua_pop(L, 1);");
+    }
+    for (int i = 0; i < nbundle_libs; i++) {
+      int lib = bundle_find_lib(bundle_libs[i]);
+      if (lib < BUNDLE_NREQUIRED_LIBS) {
+        continue;
+      }
+      if (bundle_stdlibs[lib].preload) {
+        println("  aot_bundle_preload_lib(L, \"%s\", %s);",
+                bundle_stdlibs[lib].name, bundle_stdlibs[lib].open);
+      } else {
+        println("  luaL_requiref(L, \"%s\", %s, 1);", bundle_stdlibs[lib].name,
+                bundle_stdlibs[lib].open);
+        println("  lua_pop(L, 1);");
+      }
+    }
+  }
+  println("  aot_bundle_preload(L, AOT_BUNDLE);");
+  println("  int status = aot_bundle_run(L, AOT_BUNDLE, argc, argv);");
+  println("  lua_close(L);");
+  println("  return status == LUA_OK ? EXIT_SUCCESS : EXIT_FAILURE;");
+  println("}");
+}
+
+static void print_bundle() {
+  output_file = fopen(output_filename, "w");
+  if (output_file == NULL) {
+    fatal_error(strerror(errno));
+  }
+
+  println("#include \"aot_header.c\"");
+  println("#include \"aot_bundle.c\"");
+  printnl();
+
+  lua_State *L = luaL_newstate();
+  tmname = G(L)->tmname;
+
+  // Requires found while compiling a module are appended to the list
+  for (int m = 0; m < nbundle; m++) {
+    const char *source = bundle_modules[m].filename;
+    if (preprocessor == 1) {
+      source = run_preprocessor(source, NULL);
+    }
+    if (luaL_loadfile(L, source) != LUA_OK) {
+      fatal_error(lua_tostring(L, -1));
+    }
+    Proto *proto = getproto(s2v(L->top - 1));
+    bundle_scan_requires(proto);
+    profile_set_script(bundle_modules[m].filename);
+
+    bundle_modules[m].first = nfunctions;
+    println("// module %s (%s)", bundle_modules[m].name,
+            bundle_modules[m].filename);
+    printnl();
+    create_functions(proto);
+
+    println("static AotCompiledFunction AOT_FUNCTIONS_%d[] = {", m);
+    for (int i = bundle_modules[m].first; i < nfunctions; i++) {
+      println("  magic_implementation_%02d,", i);
+    }
+    println("  NULL");
+    println("};");
+    printnl();
+
+    println("static const unsigned char AOT_BYTECODE_%d[] = {", m);
+    int col = 0;
+    lua_dump(L, bundle_writer, &col, 0);
+    if (col != 0) {
+      printnl();
+    }
+    println("};");
+    printnl();
+    lua_pop(L, 1);
+  }
+
+  println("static const AotBundledModule AOT_BUNDLE[] = {");
+  for (int m = 0; m < nbundle; m++) {
+    println("  {\"%s\", AOT_BYTECODE_%d, sizeof(AOT_BYTECODE_%d), "
+            "AOT_FUNCTIONS_%d},",
+            bundle_modules[m].name, m, m, m);
+  }
+  println("  {NULL, NULL, 0, NULL}");
+  println("};");
+  printnl();
+  print_bundle_main();
+
+  lua_close(L);
+  fclose(output_file);
+}
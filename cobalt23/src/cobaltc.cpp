@@ -13,6 +13,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
 #include "cobalt.h"
 #include "lauxlib.h"
 #include "ldebug.h"
@@ -21,6 +27,7 @@
 #include "lopnames.h"
 #include "lprefix.h"
 #include "lstate.h"
+#include "lualib.h"
 #include "lundump.h"
 
 static void PrintFunction(const Proto* f, int full);
@@ -34,6 +41,8 @@ static int listing = 0;          /* list bytecodes? */
 static int dumping = 1;          /* dump bytecodes? */
 static int stripping = 0;        /* strip debug information? */
 static int preprocess = 1;       /* strip debug information? */
+static int jobs = 1;             /* number of files compiled at once */
+static int optimize = 0;         /* level of the bytecode optimizer */
 static char Output[] = {OUTPUT}; /* default output file name */
 static char Process[] = {PROCESS};
 static const char* output = Output; /* actual output file name */
@@ -68,6 +77,8 @@ static void usage(const char* message) {
           "  -v       show version information\n"
           "  -i       preprocess file\n"
           "  -D name  provide 'name' to the preprocessor\n"
+          "  -j n     compile 'n' files at once (0 is one per core)\n"
+          "  -O n     optimize bytecode at level 'n' (0 to 2, also -On)\n"
           "  --       stop handling options\n"
           "  -        stop handling options and process stdin\n",
           progname, Output);
@@ -109,6 +120,19 @@ static int doargs(int argc, char* argv[]) {
       fatal(
           "inputting preprocessor definitions not supported yet. use cobaltpre "
           "to input preprocessor definitions.");
+    } else if (IS("-j")) /* parallel jobs */
+    {
+      const char* n = argv[++i];
+      if (n == NULL || !isdigit((unsigned char)*n)) usage("'-j' needs argument");
+      jobs = atoi(n);
+      if (jobs == 0) jobs = (int)std::thread::hardware_concurrency();
+      if (jobs <= 0) jobs = 1;
+    } else if (strncmp(argv[i], "-O", 2) == 0) /* optimization level */
+    {
+      const char* n = (argv[i][2] != 0) ? argv[i] + 2 : argv[++i];
+      if (n == NULL || *n < '0' || *n > '2' || n[1] != 0)
+        usage("'-O' needs 0, 1 or 2");
+      optimize = *n - '0';
     } else if (IS("-r")) /* parse only */
       dumping = 0;
     else if (IS("-p")) /* don't run preprocessor */
@@ -161,6 +185,7 @@ static const Proto* combine(lua_State* L, int n) {
       if (f->p[i]->sizeupvalues > 0) f->p[i]->upvalues[0].instack = 0;
     }
     luaM_freearray(L, f->lineinfo, f->sizelineinfo);
+    f->lineinfo = NULL;
     f->sizelineinfo = 0;
     return f;
   }
@@ -171,43 +196,166 @@ static int writer(lua_State* L, const void* p, size_t size, void* u) {
   return (fwrite(p, size, 1, (FILE*)u) != 1) && (size != 0);
 }
 
+/*
+** Parallel loading ('-j'). Every worker thread has a state of its own
+** and takes the next file not yet taken, loads it and dumps the main
+** function to memory. The inputs are then undumped in order into the
+** main state, where 'combine' joins them as for a serial run. Workers
+** preprocess in the loader (see luaL_loadfilex) rather than through an
+** external 'cobalt', which would share the preprocess file.
+*/
+
+struct Chunk {
+  std::string code;  /* dumped main function */
+  std::string error; /* or why the file could not be loaded */
+};
+
+struct Worker {
+  int argc;
+  char** argv;
+  std::atomic<int>* next; /* next input to take */
+  std::vector<Chunk>* chunks;
+};
+
+static int chunkwriter(lua_State* L, const void* p, size_t size, void* u) {
+  UNUSED(L);
+  static_cast<std::string*>(u)->append(static_cast<const char*>(p), size);
+  return 0;
+}
+
+/*
+** Libraries the 'preprocess' module uses; workers need no others. The
+** module itself is opened by the loader.
+*/
+static const luaL_Reg workerlibs[] = {
+    {LUA_GNAME, luaopen_base},       {LUA_LOADLIBNAME, luaopen_package},
+    {LUA_TABLIBNAME, luaopen_table}, {LUA_IOLIBNAME, luaopen_io},
+    {LUA_OSLIBNAME, luaopen_os},     {LUA_STRLIBNAME, luaopen_string},
+    {LUA_MATHLIBNAME, luaopen_math}, {LUA_DBLIBNAME, luaopen_debug},
+    {NULL, NULL}};
+
+static const luaL_Reg workerpreload[] = {
+    {LUA_BITOPNAME, luaopen_bit}, {LUA_COLIBNAME, luaopen_coroutine},
+    {NULL, NULL}};
+
+static void openworkerlibs(lua_State* L) {
+  const luaL_Reg* lib;
+  for (lib = workerlibs; lib->func; lib++) {
+    luaL_requiref(L, lib->name, lib->func, 1);
+    lua_pop(L, 1);
+  }
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+  for (lib = workerpreload; lib->func; lib++) {
+    lua_pushcfunction(L, lib->func);
+    lua_setfield(L, -2, lib->name);
+  }
+  lua_pop(L, 1);
+}
+
+static int workermain(lua_State* L) {
+  Worker* w = (Worker*)lua_touserdata(L, 1);
+  int i;
+  lua_setoptimize(L, optimize);
+  if (preprocess) {
+    openworkerlibs(L);
+    lua_pushboolean(L, 1);
+    lua_setfield(L, LUA_REGISTRYINDEX, LUA_PREPROCESS_KEY);
+  }
+  while ((i = (*w->next)++) < w->argc) {
+    Chunk& c = (*w->chunks)[i];
+    const char* filename = (strcmp(w->argv[i], "-") == 0) ? NULL : w->argv[i];
+    if (luaL_loadfile(L, filename) != LUA_OK)
+      c.error = lua_tostring(L, -1);
+    else if (lua_dump(L, chunkwriter, &c.code, 0) != 0 || c.code.empty())
+      c.error = std::string("cannot dump ") + w->argv[i];
+    lua_settop(L, 1);
+  }
+  return 0;
+}
+
+static void worker(Worker* w) {
+  lua_State* L = luaL_newstate();
+  int i;
+  if (L != NULL) {
+    lua_pushcfunction(L, &workermain);
+    lua_pushlightuserdata(L, w);
+    if (lua_pcall(L, 1, 0, 0) == LUA_OK) {
+      lua_close(L);
+      return;
+    }
+  }
+  while ((i = (*w->next)++) < w->argc) /* fail the files left */
+    (*w->chunks)[i].error = (L != NULL) ? lua_tostring(L, -1)
+                                        : "cannot create state: not enough memory";
+  if (L != NULL) lua_close(L);
+}
+
+static void loadparallel(lua_State* L, int argc, char** argv) {
+  std::vector<Chunk> chunks(argc);
+  std::atomic<int> next(0);
+  Worker w = {argc, argv, &next, &chunks};
+  std::vector<std::thread> threads;
+  int i;
+  for (i = 0; i < jobs - 1 && i < argc - 1; i++) {
+    try {
+      threads.emplace_back(worker, &w);
+    } catch (const std::system_error&) {
+      break; /* go on with the threads already running */
+    }
+  }
+  worker(&w); /* the main thread works too */
+  for (std::thread& t : threads) t.join();
+  for (i = 0; i < argc; i++) {
+    Chunk& c = chunks[i];
+    if (!c.error.empty()) fatal(c.error.c_str());
+    if (luaL_loadbufferx(L, c.code.data(), c.code.size(), argv[i], "b") !=
+        LUA_OK)
+      fatal(lua_tostring(L, -1));
+  }
+}
+
 static int pmain(lua_State* L) {
   int argc = (int)lua_tointeger(L, 1);
   char** argv = (char**)lua_touserdata(L, 2);
   const Proto* f;
   int i;
   tmname = G(L)->tmname;
+  lua_setoptimize(L, optimize);
   if (!lua_checkstack(L, argc)) fatal("too many input files");
   const char* filename;
-  for (i = 0; i < argc; i++) {
-    filename = IS("-") ? NULL : argv[i];
-    if (preprocess) {
-      // using popen() to run the preprocessor run:
-      /*
-      - cobalt -e "cobalt -e 'import("preprocess")("<INPUT>", "file", true,
-      "<PROCESS>")'"
-      */
-      char command[256];
-      snprintf(command, sizeof(command),
-            "cobalt -e 'import(\"preprocess\")->Interface(\"%s\", \"-o\", \"%s\")'",
-            filename, process);
-      // printf(command);
-      FILE* fp;
-      char path[1035];
-      fp = popen(command, "r");
-      if (fp == NULL) {
-        printf("Failed to run preprocessor\n");
-        exit(1);
-      }
-      while (fgets(path, sizeof(path) - 1, fp) != NULL) {
-        printf("%s", path);
+  if (jobs > 1 && argc > 1)
+    loadparallel(L, argc, argv);
+  else {
+    for (i = 0; i < argc; i++) {
+      filename = IS("-") ? NULL : argv[i];
+      if (preprocess) {
+        // using popen() to run the preprocessor run:
+        /*
+        - cobalt -e "cobalt -e 'import("preprocess")("<INPUT>", "file", true,
+        "<PROCESS>")'"
+        */
+        char command[256];
+        snprintf(command, sizeof(command),
+              "cobalt -e 'import(\"preprocess\")->Interface(\"%s\", \"-o\", \"%s\")'",
+              filename, process);
+        // printf(command);
+        FILE* fp;
+        char path[1035];
+        fp = popen(command, "r");
+        if (fp == NULL) {
+          printf("Failed to run preprocessor\n");
+          exit(1);
+        }
+        while (fgets(path, sizeof(path) - 1, fp) != NULL) {
+          printf("%s", path);
+        }
+        pclose(fp);
+      }else{
+        process = filename;
       }
-      pclose(fp);
-    }else{
-      process = filename;
-    }
 
-    if (luaL_loadfile(L, process) != LUA_OK) fatal(lua_tostring(L, -1));
+      if (luaL_loadfile(L, process) != LUA_OK) fatal(lua_tostring(L, -1));
+    }
   }
   f = combine(L, argc);
   if (listing) luaU_print(f, listing > 1);
@@ -682,6 +830,11 @@ static void PrintCode(const Proto* f) {
       case OP_TESTSET:
         printf("%d %d %d", a, b, isk);
         break;
+      case OP_JMPTAB:
+      case OP_JMPSTR:
+        printf("%d %d", a, bx);
+        printf(COMMENT "%d entries", bx + 1);
+        break;
       case OP_CALL:
         printf("%d %d %d", a, b, c);
         printf(COMMENT);
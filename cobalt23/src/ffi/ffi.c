@@ -26,6 +26,7 @@ int abi_key;
 int next_unnamed_key;
 int niluv_key;
 int asmname_key;
+int stubs_key;
 
 void push_upval(lua_State* L, int* key) {
   lua_pushlightuserdata(L, key);
@@ -1455,6 +1456,9 @@ static int cdata_free(lua_State* L) {
   lua_pushvalue(L, 1);
   lua_pushnil(L);
   lua_rawset(L, lua_upvalueindex(1));
+  lua_pushvalue(L, 1);
+  lua_pushnil(L);
+  lua_rawset(L, lua_upvalueindex(3));
 
   if (ct.is_jitted) {
     free_code(get_jit(L), L, *p);
@@ -1490,6 +1494,53 @@ static int cdata_set(lua_State* L) {
   return 0;
 }
 
+/* push_call_stub pushes the closure that calls func with the function type
+ * whose usr table is at the top of the stack. Closures are cached by
+ * signature and address, so every cdata holding the same function pointer
+ * (struct fields, casts, ...) shares one compiled stub. The cache holds them
+ * weakly, the jitted code is released with the closure.
+ */
+static void push_call_stub(lua_State* L, cfunction func,
+                           const struct ctype* ct) {
+  int ct_usr = lua_gettop(L);
+
+  if (!lua_istable(L, ct_usr)) {
+    compile_function(L, func, ct_usr, ct);
+    return;
+  }
+
+  push_upval(L, &stubs_key);
+  lua_pushvalue(L, ct_usr);
+  lua_rawget(L, -2);
+
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+
+    /* stubs[ct_usr] = addresses */
+    lua_pushvalue(L, ct_usr);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -4);
+  }
+  lua_remove(L, -2); /* stubs */
+
+  lua_rawgetp(L, -1, (void*)func);
+  if (!lua_isfunction(L, -1)) {
+    lua_pop(L, 1);
+    compile_function(L, func, ct_usr, ct);
+
+    /* addresses[func] = closure */
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, -3, (void*)func);
+  }
+  lua_remove(L, -2); /* addresses */
+  assert(lua_gettop(L) == ct_usr + 1);
+}
+
 static int cdata_call(lua_State* L) {
   struct ctype ct;
   int top = lua_gettop(L);
@@ -1505,37 +1556,60 @@ static int cdata_call(lua_State* L) {
       lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
       return lua_gettop(L);
     }
+    lua_pop(L, 2); /* __call, user_mt */
   }
   if (ct.pointers || ct.type != FUNCTION_PTR_TYPE) {
     return luaL_error(L, "only function callbacks are callable");
   }
+  if (*p == NULL) {
+    return luaL_error(L, "attempt to call a NULL function pointer");
+  }
 
+  /* closures[func] holds the stub last used by this cdata */
   lua_pushvalue(L, 1);
-  lua_rawget(L, lua_upvalueindex(1));
+  lua_rawget(L, lua_upvalueindex(3));
 
   if (!lua_isfunction(L, -1)) {
     lua_pop(L, 1);
-    compile_function(L, *p, -1, &ct);
-
-    assert(lua_gettop(L) == top + 2); /* uv, closure */
+    push_call_stub(L, *p, &ct);
 
-    /* closures[func] = closure */
     lua_pushvalue(L, 1);
     lua_pushvalue(L, -2);
-    lua_rawset(L, lua_upvalueindex(1));
-
-    lua_replace(L, 1);
-  } else {
-    lua_replace(L, 1);
+    lua_rawset(L, lua_upvalueindex(3));
   }
 
-  lua_pop(L, 1); /* uv */
+  lua_replace(L, 1);
+  lua_pop(L, 1); /* ct_usr */
   assert(lua_gettop(L) == top);
 
   lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
   return lua_gettop(L);
 }
 
+/* ffi.tofunction(cdata) returns the closure behind a function pointer, which
+ * hot call sites can call directly without going through __call and the
+ * cdata checks on every call */
+static int ffi_tofunction(lua_State* L) {
+  struct ctype ct;
+  cfunction* p;
+
+  if (lua_type(L, 1) == LUA_TFUNCTION) {
+    lua_settop(L, 1);
+    return 1;
+  }
+
+  p = (cfunction*)check_cdata(L, 1, &ct);
+  if (ct.pointers || ct.type != FUNCTION_PTR_TYPE) {
+    return luaL_argerror(L, 1, "expected a function pointer");
+  }
+  if (*p == NULL) {
+    return luaL_argerror(L, 1, "NULL function pointer");
+  }
+
+  push_call_stub(L, *p, &ct);
+  return 1;
+}
+
 static int user_mt_key;
 
 static int ffi_metatype(lua_State* L) {
@@ -2684,12 +2758,363 @@ static int ffi_string(lua_State* L) {
   return luaL_error(L, "unable to convert cdata to string");
 }
 
+/* element_type fills et with the element type of the array or pointer type
+ * ct */
+static void element_type(struct ctype* et, const struct ctype* ct) {
+  *et = *ct;
+  et->pointers--;
+  et->const_mask >>= 1;
+  et->is_array = 0;
+  et->is_reference = 0;
+  et->is_variable_array = 0;
+}
+
+static size_t element_size(const struct ctype* et) {
+  return et->pointers ? sizeof(void*) : et->base_size;
+}
+
+#define FROM_TABLE(TYPE, GET)                    \
+  for (i = 0; i < n; i++) {                      \
+    lua_rawgeti(L, idx, (lua_Integer)(i + 1));   \
+    ((TYPE*)to)[i] = (TYPE)GET(L, -1);           \
+    lua_pop(L, 1);                               \
+  }                                              \
+  return
+
+static int64_t table_int64(lua_State* L, int idx) {
+  if (lua_isinteger(L, idx)) {
+    return lua_tointeger(L, idx);
+  } else if (lua_type(L, idx) == LUA_TNUMBER) {
+    return (int64_t)lua_tonumber(L, idx);
+  }
+  return cast_int64(L, idx, 0);
+}
+
+static double table_double(lua_State* L, int idx) {
+  int isnum;
+  double d = lua_tonumberx(L, idx, &isnum);
+  return isnum ? d : check_double(L, idx);
+}
+
+/* table_to_array converts t[1..n] into n elements of type et at to. Numeric
+ * elements are converted directly, everything else as with cdata[i] = v.
+ */
+static void table_to_array(lua_State* L, int idx, char* to, int to_usr,
+                           const struct ctype* et, size_t n) {
+  size_t i, esz = element_size(et);
+
+  idx = lua_absindex(L, idx);
+  to_usr = lua_absindex(L, to_usr);
+
+#ifndef ALLOW_MISALIGNED_ACCESS
+  if (((uintptr_t)to & (esz - 1)) == 0)
+#endif
+  if (!et->pointers && !et->is_bitfield) {
+    switch (et->type) {
+      case DOUBLE_TYPE:
+        FROM_TABLE(double, table_double);
+      case FLOAT_TYPE:
+        FROM_TABLE(float, table_double);
+      case INT8_TYPE:
+        FROM_TABLE(int8_t, table_int64);
+      case INT16_TYPE:
+        FROM_TABLE(int16_t, table_int64);
+      case INT32_TYPE:
+        FROM_TABLE(int32_t, table_int64);
+      case INT64_TYPE:
+        FROM_TABLE(int64_t, table_int64);
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    lua_rawgeti(L, idx, (lua_Integer)(i + 1));
+    set_value(L, -1, to + esz * i, to_usr, et, 1);
+    lua_pop(L, 1);
+  }
+}
+
+static void push_element(lua_State* L, const char* data, int usr,
+                         const struct ctype* ct);
+
+/* push_struct pushes a table with the named members of the struct at data */
+static void push_struct(lua_State* L, const char* data, int usr,
+                        const struct ctype* ct) {
+  struct ctype mt;
+  ptrdiff_t off;
+
+  usr = lua_absindex(L, usr);
+  lua_newtable(L);
+
+  lua_pushnil(L);
+  while (lua_next(L, usr)) {
+    if (lua_type(L, -2) == LUA_TSTRING && lua_type(L, -1) == LUA_TUSERDATA) {
+      lua_pushvalue(L, -2);
+      off = get_member(L, usr, ct, &mt);
+      if (off >= 0) {
+        push_element(L, data + off, -1, &mt);
+        lua_pushvalue(L, -4);
+        lua_insert(L, -2);
+        lua_rawset(L, -6); /* tbl[name] = value */
+      }
+      lua_pop(L, 1); /* mbr usr */
+    }
+    lua_pop(L, 1);
+  }
+}
+
+/* push_element pushes the value of type ct at data as a lua value. Numbers
+ * become lua numbers (64 bit integers included), arrays and structs become
+ * tables, anything else a cdata copy.
+ */
+static void push_element(lua_State* L, const char* data, int usr,
+                         const struct ctype* ct) {
+  union {
+    uint8_t c[8];
+    double d;
+    float f;
+    int64_t i64;
+    uint64_t u64;
+    int32_t i32;
+    uint32_t u32;
+    int16_t i16;
+    uint16_t u16;
+    int8_t i8;
+    uint8_t u8;
+    _Bool b;
+  } u;
+  void* to;
+
+  usr = lua_absindex(L, usr);
+
+  if (ct->is_array && !ct->is_variable_array) {
+    struct ctype et;
+    size_t i, esz;
+    element_type(&et, ct);
+    esz = element_size(&et);
+    lua_createtable(L, (int)ct->array_size, 0);
+    for (i = 0; i < ct->array_size; i++) {
+      push_element(L, data + esz * i, usr, &et);
+      lua_rawseti(L, -2, (lua_Integer)(i + 1));
+    }
+    return;
+
+  } else if (ct->pointers || ct->is_array) {
+    struct ctype pt = *ct;
+    pt.is_reference = 0;
+    to = push_cdata(L, usr, &pt);
+    memcpy(to, data, sizeof(void*));
+    return;
+
+  } else if (ct->is_bitfield) {
+    memcpy(u.c, data, 8);
+    u.u64 >>= ct->bit_offset;
+    u.u64 &= (UINT64_C(1) << ct->bit_size) - 1;
+    if (ct->type == BOOL_TYPE) {
+      lua_pushboolean(L, (int)u.u64);
+    } else {
+      lua_pushinteger(L, (lua_Integer)u.u64);
+    }
+    return;
+
+  } else if (ct->type == STRUCT_TYPE || ct->type == UNION_TYPE) {
+    push_struct(L, data, usr, ct);
+    return;
+  }
+
+  switch (ct->type) {
+    case BOOL_TYPE:
+    case INT8_TYPE:
+    case INT16_TYPE:
+    case INT32_TYPE:
+    case ENUM_TYPE:
+    case INT64_TYPE:
+    case FLOAT_TYPE:
+    case DOUBLE_TYPE:
+      memcpy(u.c, data, ct->base_size);
+      break;
+    default:
+      to = push_cdata(L, usr, ct);
+      memcpy(to, data, ctype_size(L, ct));
+      return;
+  }
+
+  switch (ct->type) {
+    case BOOL_TYPE:
+      lua_pushboolean(L, u.b);
+      break;
+    case INT8_TYPE:
+      lua_pushinteger(L, ct->is_unsigned ? (lua_Integer)u.u8 : u.i8);
+      break;
+    case INT16_TYPE:
+      lua_pushinteger(L, ct->is_unsigned ? (lua_Integer)u.u16 : u.i16);
+      break;
+    case INT32_TYPE:
+    case ENUM_TYPE:
+      lua_pushinteger(L, ct->is_unsigned ? (lua_Integer)u.u32 : u.i32);
+      break;
+    case INT64_TYPE:
+      lua_pushinteger(L, (lua_Integer)u.i64);
+      break;
+    case FLOAT_TYPE:
+      lua_pushnumber(L, u.f);
+      break;
+    case DOUBLE_TYPE:
+      lua_pushnumber(L, u.d);
+      break;
+  }
+}
+
+#define TO_TABLE(TYPE, PUSH)                    \
+  for (i = 0; i < n; i++) {                     \
+    PUSH(L, ((const TYPE*)data)[i]);            \
+    lua_rawseti(L, -2, (lua_Integer)(i + 1));   \
+  }                                             \
+  return
+
+/* array_to_table pushes a table with the n elements of type et at data */
+static void array_to_table(lua_State* L, const char* data, int usr,
+                           const struct ctype* et, size_t n) {
+  size_t i, esz = element_size(et);
+
+  usr = lua_absindex(L, usr);
+  lua_createtable(L, (int)(n < INT_MAX ? n : 0), 0);
+
+#ifndef ALLOW_MISALIGNED_ACCESS
+  if (((uintptr_t)data & (esz - 1)) == 0)
+#endif
+  if (!et->pointers && !et->is_bitfield) {
+    switch (et->type) {
+      case DOUBLE_TYPE:
+        TO_TABLE(double, lua_pushnumber);
+      case FLOAT_TYPE:
+        TO_TABLE(float, lua_pushnumber);
+      case INT8_TYPE:
+        if (et->is_unsigned) {
+          TO_TABLE(uint8_t, lua_pushinteger);
+        }
+        TO_TABLE(int8_t, lua_pushinteger);
+      case INT16_TYPE:
+        if (et->is_unsigned) {
+          TO_TABLE(uint16_t, lua_pushinteger);
+        }
+        TO_TABLE(int16_t, lua_pushinteger);
+      case INT32_TYPE:
+        if (et->is_unsigned) {
+          TO_TABLE(uint32_t, lua_pushinteger);
+        }
+        TO_TABLE(int32_t, lua_pushinteger);
+      case INT64_TYPE:
+        TO_TABLE(int64_t, lua_pushinteger);
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    push_element(L, data + esz * i, usr, et);
+    lua_rawseti(L, -2, (lua_Integer)(i + 1));
+  }
+}
+
+/* ffi.fromtable(ctype, t) creates an array from the values in t. ctype is
+ * either the element type or an array type, a variable array (eg
+ * "double[?]") gets #t elements.
+ */
+static int ffi_fromtable(lua_State* L) {
+  struct ctype ct, et;
+  size_t n;
+  void* p;
+
+  lua_settop(L, 2);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  n = (size_t)lua_rawlen(L, 2);
+  check_ctype(L, 1, &ct);
+
+  if (ct.is_variable_array) {
+    ct.array_size = n;
+    ct.is_variable_array = 0;
+  } else if (!ct.is_array) {
+    if (ct.pointers >= POINTER_MAX || ct.type == VOID_TYPE) {
+      return luaL_argerror(L, 1, "invalid element type");
+    }
+    ct.pointers++;
+    ct.const_mask <<= 1;
+    ct.is_array = 1;
+    ct.array_size = n;
+  } else if (n > ct.array_size) {
+    return luaL_error(L, "too many initializers");
+  }
+
+  element_type(&et, &ct);
+  p = push_cdata(L, -1, &ct);
+  table_to_array(L, 2, (char*)p, 3, &et, n);
+  return 1;
+}
+
+/* ffi.totable(cdata [, n]) returns a table with the first n elements of an
+ * array or pointer, n defaults to the size of the array.
+ */
+static int ffi_totable(lua_State* L) {
+  struct ctype ct, et;
+  size_t n;
+  char* data;
+
+  lua_settop(L, 2);
+  data = (char*)check_pointer(L, 1, &ct);
+
+  if (!ct.pointers || ct.is_null || is_void_ptr(&ct)) {
+    return luaL_argerror(L, 1, "expected an array or a typed pointer");
+  }
+
+  if (!lua_isnil(L, 2)) {
+    lua_Integer i = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, i >= 0, 2, "negative size");
+    n = (size_t)i;
+    if (ct.is_array && !ct.is_variable_array) {
+      luaL_argcheck(L, n <= ct.array_size, 2, "out of bounds");
+    }
+  } else if (ct.is_array && !ct.is_variable_array) {
+    n = ct.array_size;
+  } else {
+    return luaL_argerror(L, 2, "size required for pointers");
+  }
+
+  element_type(&et, &ct);
+  array_to_table(L, data, 3, &et, n);
+  return 1;
+}
+
+/* ffi.copy(dst, src, len) copies bytes, ffi.copy(dst, t [, n]) converts the
+ * first n (default #t) values of the table t into the elements of dst */
 static int ffi_copy(lua_State* L) {
   struct ctype ft, tt;
   char *to, *from;
 
   setmintop(L, 3);
   to = (char*)check_pointer(L, 1, &tt);
+
+  if (lua_istable(L, 2)) {
+    struct ctype et;
+    size_t n = (size_t)lua_rawlen(L, 2);
+
+    if (!tt.pointers || is_void_ptr(&tt)) {
+      return luaL_argerror(L, 1, "expected an array or a typed pointer");
+    }
+    if (tt.const_mask & 1) {
+      return luaL_error(L, "can't set const data");
+    }
+    if (!lua_isnoneornil(L, 3)) {
+      lua_Integer i = luaL_checkinteger(L, 3);
+      luaL_argcheck(L, i >= 0 && (size_t)i <= n, 3, "out of bounds");
+      n = (size_t)i;
+    }
+    if (tt.is_array && !tt.is_variable_array && n > tt.array_size) {
+      return luaL_error(L, "too many initializers");
+    }
+
+    element_type(&et, &tt);
+    table_to_array(L, 2, to, 4, &et, n);
+    return 0;
+  }
+
   from = (char*)check_pointer(L, 2, &ft);
 
   if (!lua_isnoneornil(L, 3)) {
@@ -3019,6 +3444,8 @@ static int ffi_debug(lua_State* L) {
   lua_setfield(L, -2, "abi");
   push_upval(L, &next_unnamed_key);
   lua_setfield(L, -2, "next_unnamed");
+  push_upval(L, &stubs_key);
+  lua_setfield(L, -2, "stubs");
   return 1;
 }
 
@@ -3103,7 +3530,9 @@ static const luaL_Reg ffi_reg[] = {
     {"string", &ffi_string},   {"copy", &ffi_copy},
     {"fill", &ffi_fill},       {"abi", &ffi_abi},
     {"debug", &ffi_debug},     {"i64", &ffi_i64},
-    {"u64", &ffi_u64},         {NULL, NULL}};
+    {"u64", &ffi_u64},         {"tofunction", &ffi_tofunction},
+    {"fromtable", &ffi_fromtable}, {"totable", &ffi_totable},
+    {NULL, NULL}};
 
 /* leaves the usr table on the stack */
 static void push_builtin(lua_State* L, struct ctype* ct, const char* name,
@@ -3504,7 +3933,12 @@ int luaopen_ffi(lua_State* L) {
   lua_newtable(L);
   push_upval(L, &callbacks_key);
   push_upval(L, &gc_key);
-  setup_mt(L, cdata_mt, 2);
+  lua_newtable(L); /* closures, see cdata_call */
+  lua_newtable(L);
+  lua_pushliteral(L, "k");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+  setup_mt(L, cdata_mt, 3);
   set_upval(L, &cdata_mt_key);
 
   lua_newtable(L);
@@ -3533,6 +3967,14 @@ int luaopen_ffi(lua_State* L) {
   lua_newtable(L);
   set_upval(L, &asmname_key);
 
+  /* call stubs by signature, see push_call_stub */
+  lua_newtable(L);
+  lua_newtable(L);
+  lua_pushliteral(L, "k");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+  set_upval(L, &stubs_key);
+
   lua_newtable(L);
   set_upval(L, &abi_key);
 
@@ -250,6 +250,7 @@ extern int abi_key;
 extern int next_unnamed_key;
 extern int niluv_key;
 extern int asmname_key;
+extern int stubs_key;
 
 int equals_upval(lua_State* L, int idx, int* key);
 void push_upval(lua_State* L, int* key);
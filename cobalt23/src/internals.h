@@ -277,6 +277,8 @@ LUA_API int(lua_load)(lua_State *L, lua_Reader reader, void *dt,
 
 LUA_API int(lua_dump)(lua_State *L, lua_Writer writer, void *data, int strip);
 
+LUA_API void(lua_setoptimize)(lua_State *L, int level);
+
 /*
 ** coroutine functions
 */
@@ -309,6 +311,7 @@ LUA_API void(lua_warning)(lua_State *L, const char *msg, int tocont);
 #define LUA_GCISRUNNING 9
 #define LUA_GCGEN 10
 #define LUA_GCINC 11
+#define LUA_GCDEBT 12 /* count memory the collector does not see */
 
 LUA_API int(lua_gc)(lua_State *L, int what, ...);
 
@@ -504,6 +507,9 @@ LUA_API lua_Hook(lua_gethook)(lua_State *L);
 LUA_API int(lua_gethookmask)(lua_State *L);
 LUA_API int(lua_gethookcount)(lua_State *L);
 
+LUA_API void(lua_setprofile)(lua_State *L, int on);
+LUA_API int(lua_dumpprofile)(lua_State *L, lua_Writer writer, void *data);
+
 LUA_API int(lua_setcstacklimit)(lua_State *L, unsigned int limit);
 
 struct lua_Debug {
@@ -1834,6 +1840,12 @@ typedef struct luaL_Buffer luaL_Buffer;
 /* key, in the registry, for table of preloaded loaders */
 #define LUA_PRELOAD_TABLE "_PRELOAD"
 
+/* key, in the registry, set when 'luaL_loadfilex' runs the preprocessor */
+#define LUA_PREPROCESS_KEY "_PREPROCESS"
+
+/* key, in the registry, for the cache of preprocessed sources */
+#define LUA_PRECACHE_TABLE "_PRECACHE"
+
 typedef struct luaL_Reg {
   const char *name;
   lua_CFunction func;
@@ -2237,7 +2249,11 @@ LUAI_FUNC void luaK_posfix(FuncState *fs, BinOpr op, expdesc *v1, expdesc *v2,
 LUAI_FUNC void luaK_settablesize(FuncState *fs, int pc, int ra, int asize,
                                  int hsize);
 LUAI_FUNC void luaK_setlist(FuncState *fs, int base, int nelems, int tostore);
+LUAI_FUNC int luaK_jumptable(FuncState *fs, int reg, lua_Integer lo,
+                             TString *const *keys, int n);
+LUAI_FUNC void luaK_removejump(FuncState *fs);
 LUAI_FUNC void luaK_finish(FuncState *fs);
+LUAI_FUNC void luaK_optimize(FuncState *fs, int level);
 LUAI_FUNC l_noret luaK_semerror(LexState *ls, const char *msg);
 
 #endif
@@ -2361,6 +2377,12 @@ extern "C" {
 
 #define resethookcount(L) (L->hookcount = L->basehookcount)
 
+/* 'hookmask' bit set while the profiler (lua_setprofile) is on */
+#define LUAI_MASKPROFILE (1 << 6)
+
+/* registry table anchoring the closures of profiled functions */
+#define LUA_PROFILE_TABLE "_PROFILE"
+
 /*
 ** mark for entries in 'lineinfo' array that has absolute information in
 ** 'abslineinfo' array
@@ -2396,6 +2418,7 @@ LUAI_FUNC const char *luaG_addinfo(lua_State *L, const char *msg, TString *src,
                                    int line);
 LUAI_FUNC l_noret luaG_errormsg(lua_State *L);
 LUAI_FUNC int luaG_traceexec(lua_State *L, const Instruction *pc);
+LUAI_FUNC void luaG_profilecall(lua_State *L, CallInfo *ci);
 
 #endif
 
@@ -2630,7 +2653,6 @@ returning: /* trap already set */
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
-        StkId ra = RA(i);
         const TValue *slot;
         TValue *rb = vRB(i);
         TValue *rc = vRC(i);
@@ -2676,8 +2698,7 @@ returning: /* trap already set */
         TString *key = tsvalue(rb); /* key must be a string */
         
         /* verify locks */
-        Table *t = hvalue(upval);
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(upval) && hvalue(upval)->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
@@ -2693,8 +2714,7 @@ returning: /* trap already set */
         lua_Unsigned n;
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (ttisinteger(rb) /* fast track for integers? */
@@ -2712,8 +2732,7 @@ returning: /* trap already set */
         TValue *rc = RKC(i);
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (luaV_fastgeti(L, s2v(ra), c, slot)) {
@@ -3014,7 +3033,6 @@ returning: /* trap already set */
         vmbreak;
       }
       vmcase(OP_TESTSET) {
-        StkId ra = RA(i);
         TValue *rb = vRB(i);
         if (GETARG_C(i) == NULL_COALESCE) { /* R(C) is used as an identifier, as it was previously unused. */
           if (ttisnil(rb)) {
@@ -3037,6 +3055,31 @@ returning: /* trap already set */
         }
         vmbreak;
       }
+      vmcase(OP_JMPTAB) {
+        TValue *rv = s2v(ra);
+        lua_Integer n;
+        lua_Unsigned e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (tointegerns(rv, &n)) {
+          n = l_castU2S(l_castS2U(n) - l_castS2U(ivalue(&k[GETARG_Ax(*pc)])));
+          if (l_castS2U(n) < e) e = l_castS2U(n);
+        }
+        pc += 1 + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
+      vmcase(OP_JMPSTR) {
+        TValue *rv = s2v(ra);
+        int e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (ttisstring(rv)) {
+          const TValue *slot = luaH_get(cl->p->jumptabs[GETARG_Ax(*pc)], rv);
+          if (ttisinteger(slot)) e = cast_int(ivalue(slot));
+        }
+        pc += 1 + GETARG_Bx(i) + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
       vmcase(OP_CALL) {
         CallInfo *newci;
         int b = GETARG_B(i);
@@ -3289,6 +3332,15 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
   trap = L->hookmask;
  returning:  /* trap already set */
   cl = clLvalue(s2v(ci->func));
+#if AOT
+  if (l_unlikely(cl->p->aot_implementation != NULL)) {
+    /* compiled by cobaltaot; it returns the next frame to run */
+    ci = cl->p->aot_implementation(L, ci);
+    if (ci == NULL)
+      return;  /* end this frame */
+    goto startfunc;
+  }
+#endif
   k = cl->p->k;
   pc = ci->u.l.savedpc;
   if (l_unlikely(trap)) {
@@ -3376,15 +3428,25 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *upval = cl->upvals[GETARG_B(i)]->v;
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
+        LookupCache *lc = NULL;
+        if (cl->p->lcacheidx != NULL && cl->p->lcacheidx[pcRel(pc, cl->p)]) {
+          lc = &cl->p->lcache[cl->p->lcacheidx[pcRel(pc, cl->p)] - 1];
+          if (ttistable(upval) && !trap &&
+              (slot = luaV_cachedslot(lc, hvalue(upval))) != NULL) {
+            setobj2s(L, ra, slot);
+            pc += lc->pair;  /* skip the OP_GETFIELD it also covers */
+            vmbreak;
+          }
+        }
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
           setobj2s(L, ra, slot);
+          if (lc != NULL) luaV_fillcache(L, lc, hvalue(upval), slot, pc, k);
         }
         else
           Protect(luaV_finishget(L, upval, rc, ra, slot));
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
-        StkId ra = RA(i);
         const TValue *slot;
         TValue *rb = vRB(i);
         TValue *rc = vRC(i);
@@ -3432,8 +3494,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TString *key = tsvalue(rb);  /* key must be a string */
 
         /* verify locks */
-        Table *t = hvalue(upval);
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(upval) && hvalue(upval)->locked))
           luaG_runerror(L, "attempt to modify locked table.");
 
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
@@ -3450,8 +3511,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lua_Unsigned n;
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (ttisinteger(rb)  /* fast track for integers? */
@@ -3469,8 +3529,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = RKC(i);
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (luaV_fastgeti(L, s2v(ra), c, slot)) {
@@ -3777,7 +3836,6 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_TESTSET) {
-        StkId ra = RA(i);
         TValue *rb = vRB(i);
         if (GETARG_C(i) == NULL_COALESCE) { /* R(C) is used as an identifier, as it was previously unused. */
           if (ttisnil(rb)) {
@@ -3800,6 +3858,31 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         vmbreak;
       }
+      vmcase(OP_JMPTAB) {
+        TValue *rv = s2v(ra);
+        lua_Integer n;
+        lua_Unsigned e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (tointegerns(rv, &n)) {
+          n = l_castU2S(l_castS2U(n) - l_castS2U(ivalue(&k[GETARG_Ax(*pc)])));
+          if (l_castS2U(n) < e) e = l_castS2U(n);
+        }
+        pc += 1 + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
+      vmcase(OP_JMPSTR) {
+        TValue *rv = s2v(ra);
+        int e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (ttisstring(rv)) {
+          const TValue *slot = luaH_get(cl->p->jumptabs[GETARG_Ax(*pc)], rv);
+          if (ttisinteger(slot)) e = cast_int(ivalue(slot));
+        }
+        pc += 1 + GETARG_Bx(i) + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
       vmcase(OP_CALL) {
         CallInfo *newci;
         int b = GETARG_B(i);
@@ -4121,6 +4204,8 @@ extern "C" {
 #define CLOSEKTOP (-1)
 
 LUAI_FUNC Proto *luaF_newproto(lua_State *L);
+LUAI_FUNC void luaF_initcache(lua_State *L, Proto *f);
+LUAI_FUNC void luaF_initjumptabs(lua_State *L, Proto *f);
 LUAI_FUNC CClosure *luaF_newCclosure(lua_State *L, int nupvals);
 LUAI_FUNC LClosure *luaF_newLclosure(lua_State *L, int nupvals);
 LUAI_FUNC void luaF_initupvals(lua_State *L, LClosure *cl);
@@ -4375,7 +4460,8 @@ static const void *const disptab[NUM_OPCODES] = {
     &&L_OP_CALL,     &&L_OP_TAILCALL,   &&L_OP_RETURN,     &&L_OP_RETURN0,
     &&L_OP_RETURN1,  &&L_OP_FORLOOP,    &&L_OP_FORPREP,    &&L_OP_TFORPREP,
     &&L_OP_TFORCALL, &&L_OP_TFORLOOP,   &&L_OP_SETLIST,    &&L_OP_CLOSURE,
-    &&L_OP_VARARG,   &&L_OP_VARARGPREP, &&L_OP_EXTRAARG
+    &&L_OP_VARARG,   &&L_OP_VARARGPREP, &&L_OP_EXTRAARG,
+    &&L_OP_JMPTAB,   &&L_OP_JMPSTR
 
 };
 #ifdef __cplusplus
@@ -4539,7 +4625,7 @@ enum RESERVED {
 };
 
 /* number of reserved words */
-#define NUM_RESERVED (cast_int(TK_WHILE - FIRST_RESERVED))
+#define NUM_RESERVED (cast_int(TK_WHILE - FIRST_RESERVED + 1))
 
 typedef union {
   lua_Number r;
@@ -4575,6 +4661,7 @@ typedef struct LexState {
   /** configurations */
   bool strict_type_config=false;
   bool check_type=false;
+  int optimize=0; /* level of 'luaK_optimize', 0 to skip it */
 } LexState;
 
 LUAI_FUNC void luaX_init(lua_State *L);
@@ -6558,6 +6645,23 @@ typedef struct AbsLineInfo {
   int line;
 } AbsLineInfo;
 
+/*
+** Cache of a global lookup made in a loop: the slot of table 'env' where
+** 'OP_GETTABUP' found its value and, with 'pair', the slot of table 'tab'
+** (the value in the first slot) where the 'OP_GETFIELD' after it found
+** its own. Slots are read when the cache is used, so stores do not affect
+** it; it is valid while the shapes of the tables are the ones recorded.
+*/
+typedef struct LookupCache {
+  struct Table *env; /* NULL if never filled */
+  struct Table *tab;
+  const TValue *slot;
+  const TValue *fslot;
+  lu_mem envshape;
+  lu_mem tabshape;
+  lu_byte pair;
+} LookupCache;
+
 /*
 ** AOT implementation
 */
@@ -6591,6 +6695,15 @@ typedef struct Proto {
   TString *source; /* used for debug information */
   GCObject *gclist;
   AotCompiledFunction aot_implementation; /* used in AOT C compiler */
+  lu_mem ncalls;      /* profiling: number of calls */
+  lu_mem nloops;      /* profiling: number of backward jumps */
+  l_uint32 *branches; /* profiling: jumps and skips of each test, or NULL */
+  LookupCache *lcache; /* caches of the global lookups in loops, or NULL */
+  lu_byte *lcacheidx;  /* 1 + cache used by each instruction, or 0 */
+  int sizelcache;
+  struct Table **jumptabs; /* entry of each string for the OP_JMPSTRs */
+  int sizejumptabs;
+  struct LClosure *cache; /* closure shared by all instances (no upvalues) */
 } Proto;
 
 /* }================================================================== */
@@ -6764,6 +6877,16 @@ typedef union Node {
 #define setrealasize(t) ((t)->flags &= cast_byte(~BITRAS))
 #define setnorealasize(t) ((t)->flags |= BITRAS)
 
+/*
+** Tables read by a lookup cache (see 'luaV_fillcache') are 'watched'. A
+** watched table takes a new 'shape' whenever its nodes may move; shapes
+** come from 'shapestamp' in the global state, so they are never reused,
+** not even by a table allocated where a freed one was.
+*/
+#define BITWATCH (1 << 6)
+#define iswatched(t) ((t)->flags & BITWATCH)
+#define setwatched(t) ((t)->flags |= BITWATCH)
+
 typedef struct Table {
   CommonHeader;
   lu_byte flags;       /* 1<<p means tagmethod(p) is not present */
@@ -6775,6 +6898,7 @@ typedef struct Table {
   struct Table *metatable;
   GCObject *gclist;
   int locked; /* for locked tables */
+  lu_mem shape; /* layout of 'node' while watched, 0 before */
 } Table;
 
 /*
@@ -7147,11 +7271,16 @@ typedef enum {
 
   OP_VARARGPREP, /*A	(adjust vararg parameters)			*/
 
-  OP_EXTRAARG /*	Ax	extra (larger) argument for previous opcode
+  OP_EXTRAARG, /*	Ax	extra (larger) argument for previous opcode
                */
+
+  /* opcodes added after the chunk format was fixed go here, so that
+     precompiled chunks keep their opcode numbers */
+  OP_JMPTAB, /*	A Bx	take entry R[A] - K[extra arg] of the jump table (*) */
+  OP_JMPSTR  /*	A Bx	take the entry of string R[A] in the jump table (*) */
 } OpCode;
 
-#define NUM_OPCODES ((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES ((int)(OP_JMPSTR) + 1)
 
 /*===========================================================================
   Notes:
@@ -7204,6 +7333,16 @@ typedef enum {
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) OP_JMPTAB and OP_JMPSTR are followed by a jump table of Bx + 1
+  OP_JMPs; they jump to where the selected entry jumps, or to where the
+  last entry jumps when no entry is selected. For OP_JMPTAB, the next
+  instruction is an OP_EXTRAARG with the constant index of the integer
+  that selects the first entry, and the table follows it. For
+  OP_JMPSTR, the next instruction is an OP_EXTRAARG with the index of
+  the table in 'jumptabs' of the function, then come Bx OP_EXTRAARGs
+  with the constant index of the string that selects each entry, and
+  then the table.
+
 ===========================================================================*/
 
 /*
@@ -7233,6 +7372,9 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 /* "in top" (uses top from previous instruction) */
 #define isIT(i) (testITMode(GET_OPCODE(i)) && GETARG_B(i) == 0)
 
+/* offset from an OP_JMPTAB or OP_JMPSTR to the first entry of its table */
+#define jmptabfirst(i) (GET_OPCODE(i) == OP_JMPSTR ? 2 + GETARG_Bx(i) : 2)
+
 #define opmode(mm, ot, it, t, a, m) \
   (((mm) << 7) | ((ot) << 6) | ((it) << 5) | ((t) << 4) | ((a) << 3) | (m))
 
@@ -7270,9 +7412,10 @@ static const char *const opnames[] = {
     "MMBINK",     "UNM",      "BNOT",     "NOT",        "LEN",      "CONCAT",
     "CLOSE",      "TBC",      "JMP",      "EQ",         "LT",       "LE",
     "EQK",        "EQI",      "LTI",      "LEI",        "GTI",      "GEI",
-    "TEST",       "TESTSET",  "CALL",     "TAILCALL",   "RETURN",   "RETURN0",
-    "RETURN1",    "FORLOOP",  "FORPREP",  "TFORPREP",   "TFORCALL", "TFORLOOP",
-    "SETLIST",    "CLOSURE",  "VARARG",   "VARARGPREP", "EXTRAARG", NULL};
+    "TEST",       "TESTSET",  "JMPTAB",   "JMPSTR",     "CALL",     "TAILCALL",
+    "RETURN",     "RETURN0",  "RETURN1",  "FORLOOP",    "FORPREP",  "TFORPREP",
+    "TFORCALL",   "TFORLOOP", "SETLIST",  "CLOSURE",    "VARARG",   "VARARGPREP",
+    "EXTRAARG",   NULL};
 
 #endif
 
@@ -7603,6 +7746,7 @@ typedef struct TTree {
 typedef struct Pattern {
   union Instruction *code;
   int codesize;
+  struct NativeCode *native; /* machine code, if compiled to it */
   TTree tree[1];
 } Pattern;
 
@@ -7823,6 +7967,18 @@ typedef union Instruction {
 /* extract 24-bit value from an instruction */
 #define utf_to(inst) (((inst)->i.key << 8) | (inst)->i.aux)
 
+/*
+** Entry of the call/backtrack stack. In a native match, 'p' is the
+** address of machine code instead (see lplnative.h).
+*/
+typedef struct Stack {
+  const char *s;        /* saved position (or NULL for calls) */
+  const Instruction *p; /* next instruction */
+  int caplevel;
+  byte labenv;     /* labeled failure */
+  byte predchoice; /* labeled failure */
+} Stack;
+
 LUAI_FUNC void printpatt(Instruction *p, int n);
 LUAI_FUNC const char *match(lua_State *L, const char *o, const char *s,
                             const char *e, Instruction *op, Capture *capture,
@@ -7841,6 +7997,86 @@ extern "C" {
 
 
 
+#if !defined(lplnative_h)
+#define lplnative_h
+
+/*
+** Patterns can be compiled to machine code for x86-64 with the System V
+** calling convention; everywhere else 'lpeg.compile(p, "native")'
+** raises an error.
+*/
+#if !defined(LPEG_NATIVE)
+#if (defined(__x86_64__) || defined(__amd64__)) && !defined(_WIN32)
+#define LPEG_NATIVE 1
+#else
+#define LPEG_NATIVE 0
+#endif
+#endif
+
+/*
+** State of a native match, in memory whenever the machine code is not
+** running. Machine code handles the frequent instructions itself and
+** leaves, with one of the NEXIT codes, for 'nativematch' to do the
+** rest: the instructions that may call Lua or raise errors run in C,
+** so that no error ever unwinds through machine code.
+*/
+typedef struct NState {
+  const char *s;       /* current position */
+  const char *e;       /* end of the subject */
+  const char *o;       /* start of the subject */
+  Stack *stack;        /* first empty slot in the backtrack stack */
+  Stack *stacklimit;
+  Capture *capture;
+  int captop;          /* first empty slot in captures */
+  int capsize;
+  int ndyncap;         /* number of dynamic captures (in Lua stack) */
+  int insidepred;      /* labeled failure */
+  int labelf;          /* labeled failure */
+  int pc;              /* instruction to run in C or to resume at */
+  const char *sfail;   /* labeled failure */
+} NState;
+
+/* why machine code left */
+#define NEXIT_END 0     /* match succeeded; result in 's' */
+#define NEXIT_GIVEUP 1  /* match failed */
+#define NEXIT_STEP 2    /* run instruction 'pc' in C */
+#define NEXIT_FAIL 3    /* backtrack in C (there are dynamic captures) */
+#define NEXIT_CAPTURE 4 /* grow the capture list and resume at 'pc' */
+
+/*
+** Machine code of a pattern, in a mapping of 'size' bytes that starts
+** with this header. 'run' loads the state from 'ns' and jumps to 'at',
+** which is either the code of an instruction ('addr') or an address
+** saved in the backtrack stack.
+*/
+typedef struct NativeCode {
+  size_t size;
+  int (*run)(NState *ns, const void *at);
+  const void *giveup; /* bottom of the backtrack stack */
+  unsigned int addr[1]; /* offset of the code of each instruction */
+} NativeCode;
+
+#define nataddr(nc, pc) ((const void *)((const char *)(nc) + (nc)->addr[pc]))
+
+LUAI_FUNC NativeCode *lpn_compile(lua_State *L, Instruction *code, int n);
+LUAI_FUNC void lpn_free(NativeCode *nc);
+LUAI_FUNC const char *nativematch(lua_State *L, const char *o, const char *s,
+                                  const char *e, Instruction *op,
+                                  NativeCode *nc, Capture *capture, int ptop,
+                                  short *labelf, const char **sfail);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
 void* alloc_entry(void* ud, void* ptr, size_t osize, size_t nsize);
 void* pool_alloc(void* ud, void* ptr, size_t osize, size_t nsize);
 void init_pool_alloc();
@@ -7904,6 +8140,7 @@ extern "C" {
 #ifndef PYTHONINLUA_H
 #define PYTHONINLUA_H
 #define POBJECT "Python Object"
+#define PBUFFER "Python Buffer"
 
 #if PY_MAJOR_VERSION < 3
   #define PyBytes_Check           PyString_Check
@@ -7918,7 +8155,16 @@ typedef struct
     int asindx;
 } py_object;
 
+/* a Python buffer exported to Cobalt, see python.buffer() */
+typedef struct
+{
+    Py_buffer view;
+    int released;
+    char kind;    /* 'i', 'u', 'f' or '?'; 0 when only bytes are accessible */
+} py_buffer;
+
 py_object*    luaPy_to_pobject(lua_State *L, int n);
+py_buffer*    luaPy_to_pbuffer(lua_State *L, int n);
 
 #endif
 #ifdef __cplusplus
@@ -8222,6 +8468,7 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M]; /* cache for strings in API */
   lua_WarnFunction warnf;                    /* warning function */
   void *ud_warn;                             /* auxiliary data to 'warnf' */
+  lu_mem shapestamp; /* last shape given to a watched table ('BITWATCH') */
 } global_State;
 
 /*
@@ -10247,6 +10494,19 @@ typedef enum {
     luaC_barrierback(L, gcvalue(t), v);   \
   }
 
+/*
+** Slot with the value cached by 'lc' for a lookup in table 't', or NULL
+** if the cache does not hold it (see 'LookupCache').
+*/
+#define luaV_cachedslot(lc, t)                                             \
+  (((t) == (lc)->env && (t)->shape == (lc)->envshape &&                    \
+    !isempty((lc)->slot) &&                                                \
+    (!(lc)->pair ||                                                        \
+     (ttistable((lc)->slot) && hvalue((lc)->slot) == (lc)->tab &&          \
+      (lc)->tab->shape == (lc)->tabshape && !isempty((lc)->fslot))))       \
+       ? ((lc)->pair ? (lc)->fslot : (lc)->slot)                           \
+       : NULL)
+
 LUAI_FUNC int luaV_equalobj(lua_State *L, const TValue *t1, const TValue *t2);
 LUAI_FUNC int luaV_lessthan(lua_State *L, const TValue *l, const TValue *r);
 LUAI_FUNC int luaV_lessequal(lua_State *L, const TValue *l, const TValue *r);
@@ -10258,6 +10518,9 @@ LUAI_FUNC void luaV_finishget(lua_State *L, const TValue *t, TValue *key,
                               StkId val, const TValue *slot);
 LUAI_FUNC void luaV_finishset(lua_State *L, const TValue *t, TValue *key,
                               TValue *val, const TValue *slot);
+LUAI_FUNC void luaV_fillcache(lua_State *L, LookupCache *lc, Table *env,
+                              const TValue *slot, const Instruction *pc,
+                              const TValue *k);
 LUAI_FUNC void luaV_finishOp(lua_State *L);
 LUAI_FUNC void luaV_execute(lua_State *L, CallInfo *ci);
 LUAI_FUNC void luaV_concat(lua_State *L, int total);
@@ -10356,6 +10619,28 @@ extern PyTypeObject LuaObject_Type;
 
 PyObject* LuaConvert(lua_State *L, int n);
 
+/*
+** Exposes 'len' bytes at 'ptr', owned by the Cobalt value at 'n', through
+** the buffer protocol without copying; the value is kept alive until the
+** last view is gone. 'format' is a struct module code of 'itemsize' bytes.
+*/
+typedef struct
+{
+    PyObject_HEAD
+    int ref;
+    char *buf;
+    Py_ssize_t len;
+    Py_ssize_t itemsize;
+    Py_ssize_t shape;
+    int readonly;
+    char format[2];
+} LuaBuffer;
+
+extern PyTypeObject LuaBuffer_Type;
+
+PyObject* LuaBuffer_New(lua_State *L, int n, void *ptr, size_t len,
+                        int readonly, char format, size_t itemsize);
+
 extern lua_State *LuaState;
 
 #if PY_MAJOR_VERSION < 3
@@ -1054,6 +1054,16 @@ LUA_API int lua_dump(lua_State *L, lua_Writer writer, void *data, int strip) {
   return status;
 }
 
+/*
+** Set the optimization level of the chunks loaded from now on (see
+** 'luaK_optimize'); a 'config optimize' statement overrides it.
+*/
+LUA_API void lua_setoptimize(lua_State *L, int level) {
+  lua_lock(L);
+  G(L)->optlevel = cast_byte(level < 0 ? 0 : level > 2 ? 2 : level);
+  lua_unlock(L);
+}
+
 LUA_API int lua_status(lua_State *L) { return L->status; }
 
 /*
@@ -1144,6 +1154,11 @@ LUA_API int lua_gc(lua_State *L, int what, ...) {
       luaC_changemode(L, KGC_INC);
       break;
     }
+    case LUA_GCDEBT: { /* add 'data' KBytes to the debt, but do not step */
+      int data = va_arg(argp, int);
+      luaE_setdebt(g, cast(l_mem, data) * 1024 + g->GCdebt);
+      break;
+    }
     default:
       res = -1; /* invalid option */
   }
@@ -6,31 +6,118 @@
 
 #include "lautoc.h"
 
+/*
+** Registry
+**
+** Everything a conversion needs is kept in a C array indexed by the type
+** id, so converting a value costs a single registry lookup (to find the
+** array) no matter how deeply its structs nest. Name lookups and enum
+** values stay in Lua tables, referenced from the entries and anchored in
+** the user value of the registry userdata.
+*/
+
+enum { LUAA_KIND_STRUCT = 1, LUAA_KIND_ENUM = 2 };
+
+typedef struct luaA_Member {
+  const char* name; /* anchored as a key of the struct's 'names' table */
+  luaA_Type type;
+  size_t offset;
+} luaA_Member;
+
+typedef struct luaA_TypeInfo {
+  const char* name; /* anchored as a key of 'type_ids' */
+  size_t size;
+  luaA_Pushfunc push;
+  luaA_Tofunc to;
+  int kind;
+  /* structs, in registration order */
+  luaA_Member* members;
+  int nmembers;
+  int sizemembers;
+  int names; /* ref: member name -> index in 'members' */
+  /* enums */
+  size_t enum_size;
+  int enum_names;  /* ref: name -> value */
+  int enum_values; /* ref: value -> name */
+} luaA_TypeInfo;
+
+typedef struct luaA_Registry {
+  luaA_TypeInfo* types; /* 'types[id]', ids start at 1 */
+  luaA_Type ntypes;
+  luaA_Type sizetypes;
+} luaA_Registry;
+
+static int luaA_registry_gc(lua_State* L) {
+  luaA_Registry* R = lua_touserdata(L, 1);
+  for (luaA_Type id = 1; id <= R->ntypes; id++) {
+    free(R->types[id].members);
+  }
+  free(R->types);
+  R->types = NULL;
+  R->ntypes = R->sizetypes = 0;
+  return 0;
+}
+
+static luaA_Registry* luaA_registry(lua_State* L) {
+  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "types");
+  luaA_Registry* R = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (R == NULL) {
+    lua_pushfstring(L, "lautoc: luaA_open has not been called!");
+    lua_error(L);
+  }
+  return R;
+}
+
+static luaA_TypeInfo* luaA_info(luaA_Registry* R, luaA_Type id) {
+  return (id > 0 && id <= R->ntypes) ? &R->types[id] : NULL;
+}
+
+/* pushes the table stored under 'ref' in the registry anchor */
+static void luaA_pushref(lua_State* L, int ref) {
+  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "types");
+  lua_getiuservalue(L, -1, 1);
+  lua_rawgeti(L, -1, ref);
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+}
+
+/* anchors a new table, leaving it on the stack, and returns its ref */
+static int luaA_newref(lua_State* L) {
+  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "types");
+  lua_getiuservalue(L, -1, 1);
+  lua_newtable(L);
+  lua_pushvalue(L, -1);
+  int ref = luaL_ref(L, -3);
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+  return ref;
+}
+
+static void luaA_unref(lua_State* L, int ref) {
+  if (ref == LUA_NOREF) return;
+  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "types");
+  lua_getiuservalue(L, -1, 1);
+  luaL_unref(L, -1, ref);
+  lua_pop(L, 2);
+}
+
 void luaA_open(lua_State* L) {
-  lua_pushinteger(L, 0);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_index");
   lua_newtable(L);
   lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_ids");
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_names");
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_sizes");
 
+  luaA_Registry* R = lua_newuserdatauv(L, sizeof(luaA_Registry), 1);
+  R->types = NULL;
+  R->ntypes = R->sizetypes = 0;
   lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_push");
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_to");
+  lua_setiuservalue(L, -2, 1);
+  if (luaL_newmetatable(L, LUAA_REGISTRYPREFIX "registry")) {
+    lua_pushcfunction(L, luaA_registry_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "types");
 
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_sizes");
-  lua_newtable(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_values");
   lua_newtable(L);
   lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "functions");
 
@@ -97,30 +184,11 @@ void luaA_open(lua_State* L) {
 }
 
 void luaA_close(lua_State* L) {
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_index");
   lua_pushnil(L);
   lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_ids");
   lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_names");
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_sizes");
-
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_push");
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_to");
+  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "types");
 
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_sizes");
-  lua_pushnil(L);
-  lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_values");
   lua_pushnil(L);
   lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "functions");
 
@@ -146,38 +214,39 @@ luaA_Type luaA_type_add(lua_State* L, const char* type, size_t size) {
     luaA_Type id = lua_tointeger(L, -1);
     lua_pop(L, 2);
     return id;
+  }
 
-  } else {
-    lua_pop(L, 2);
-
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_index");
-
-    luaA_Type id = lua_tointeger(L, -1);
-    lua_pop(L, 1);
-    id++;
+  lua_pop(L, 1);
 
-    lua_pushinteger(L, id);
-    lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_index");
+  luaA_Registry* R = luaA_registry(L);
 
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_ids");
-    lua_pushinteger(L, id);
-    lua_setfield(L, -2, type);
-    lua_pop(L, 1);
+  if (R->ntypes + 1 >= R->sizetypes) {
+    luaA_Type size = R->sizetypes ? R->sizetypes * 2 : 64;
+    luaA_TypeInfo* types = realloc(R->types, size * sizeof(luaA_TypeInfo));
+    if (types == NULL) {
+      lua_pop(L, 1);
+      lua_pushfstring(L, "luaA_type: Out of memory!");
+      lua_error(L);
+      return LUAA_INVALID_TYPE;
+    }
+    R->types = types;
+    R->sizetypes = size;
+  }
 
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_names");
-    lua_pushinteger(L, id);
-    lua_pushstring(L, type);
-    lua_settable(L, -3);
-    lua_pop(L, 1);
+  luaA_Type id = ++R->ntypes;
+  luaA_TypeInfo* info = &R->types[id];
+  memset(info, 0, sizeof(luaA_TypeInfo));
+  info->size = size;
+  info->names = info->enum_names = info->enum_values = LUA_NOREF;
 
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_sizes");
-    lua_pushinteger(L, id);
-    lua_pushinteger(L, size);
-    lua_settable(L, -3);
-    lua_pop(L, 1);
+  /* the key keeps the string that 'info->name' points into alive */
+  lua_pushstring(L, type);
+  info->name = lua_tostring(L, -1);
+  lua_pushinteger(L, id);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
 
-    return id;
-  }
+  return id;
 }
 
 luaA_Type luaA_type_find(lua_State* L, const char* type) {
@@ -191,51 +260,42 @@ luaA_Type luaA_type_find(lua_State* L, const char* type) {
 }
 
 const char* luaA_typename(lua_State* L, luaA_Type id) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_names");
-  lua_pushinteger(L, id);
-  lua_gettable(L, -2);
-
-  const char* type =
-      lua_isnil(L, -1) ? "LUAA_INVALID_TYPE" : lua_tostring(L, -1);
-  lua_pop(L, 2);
-
-  return type;
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), id);
+  return info ? info->name : "LUAA_INVALID_TYPE";
 }
 
 size_t luaA_typesize(lua_State* L, luaA_Type id) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "type_sizes");
-  lua_pushinteger(L, id);
-  lua_gettable(L, -2);
-
-  size_t size = lua_isnil(L, -1) ? -1 : lua_tointeger(L, -1);
-  lua_pop(L, 2);
-
-  return size;
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), id);
+  return info ? info->size : (size_t)-1;
 }
 
 /*
 ** Stack
 */
 
-int luaA_push_type(lua_State* L, luaA_Type type_id, const void* c_in) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_push");
-  lua_pushinteger(L, type_id);
-  lua_gettable(L, -2);
+static int luaA_struct_push_info(lua_State* L, luaA_Registry* R,
+                                 luaA_Type type, const void* c_in);
+static void luaA_struct_to_info(lua_State* L, luaA_Registry* R,
+                                luaA_Type type, void* c_out, int index);
 
-  if (!lua_isnil(L, -1)) {
-    luaA_Pushfunc func = lua_touserdata(L, -1);
-    lua_pop(L, 2);
-    return func(L, type_id, c_in);
-  }
-
-  lua_pop(L, 2);
-
-  if (luaA_struct_registered_type(L, type_id)) {
-    return luaA_struct_push_type(L, type_id, c_in);
-  }
+/*
+** 'R->types' may move while a conversion function runs (it can register
+** new types), so entries are looked up again after every call out.
+*/
+static int luaA_push_info(lua_State* L, luaA_Registry* R, luaA_Type type_id,
+                          const void* c_in) {
+  luaA_TypeInfo* info = luaA_info(R, type_id);
 
-  if (luaA_enum_registered_type(L, type_id)) {
-    return luaA_enum_push_type(L, type_id, c_in);
+  if (info != NULL) {
+    if (info->push != NULL) {
+      return info->push(L, type_id, c_in);
+    }
+    if (info->kind == LUAA_KIND_STRUCT) {
+      return luaA_struct_push_info(L, R, type_id, c_in);
+    }
+    if (info->kind == LUAA_KIND_ENUM) {
+      return luaA_enum_push_type(L, type_id, c_in);
+    }
   }
 
   lua_pushfstring(
@@ -245,28 +305,23 @@ int luaA_push_type(lua_State* L, luaA_Type type_id, const void* c_in) {
   return 0;
 }
 
-void luaA_to_type(lua_State* L, luaA_Type type_id, void* c_out, int index) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_to");
-  lua_pushinteger(L, type_id);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    luaA_Tofunc func = lua_touserdata(L, -1);
-    lua_pop(L, 2);
-    func(L, type_id, c_out, index);
-    return;
-  }
-
-  lua_pop(L, 2);
+static void luaA_to_info(lua_State* L, luaA_Registry* R, luaA_Type type_id,
+                         void* c_out, int index) {
+  luaA_TypeInfo* info = luaA_info(R, type_id);
 
-  if (luaA_struct_registered_type(L, type_id)) {
-    luaA_struct_to_type(L, type_id, c_out, index);
-    return;
-  }
-
-  if (luaA_enum_registered_type(L, type_id)) {
-    luaA_enum_to_type(L, type_id, c_out, index);
-    return;
+  if (info != NULL) {
+    if (info->to != NULL) {
+      info->to(L, type_id, c_out, index);
+      return;
+    }
+    if (info->kind == LUAA_KIND_STRUCT) {
+      luaA_struct_to_info(L, R, type_id, c_out, index);
+      return;
+    }
+    if (info->kind == LUAA_KIND_ENUM) {
+      luaA_enum_to_type(L, type_id, c_out, index);
+      return;
+    }
   }
 
   lua_pushfstring(
@@ -275,6 +330,25 @@ void luaA_to_type(lua_State* L, luaA_Type type_id, void* c_out, int index) {
   lua_error(L);
 }
 
+int luaA_push_type(lua_State* L, luaA_Type type_id, const void* c_in) {
+  return luaA_push_info(L, luaA_registry(L), type_id, c_in);
+}
+
+void luaA_to_type(lua_State* L, luaA_Type type_id, void* c_out, int index) {
+  luaA_to_info(L, luaA_registry(L), type_id, c_out, index);
+}
+
+static luaA_TypeInfo* luaA_check_info(lua_State* L, luaA_Type type_id,
+                                      const char* fname) {
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), type_id);
+  if (info == NULL) {
+    lua_pushfstring(L, "%s: Type id '%d' not registered!", fname,
+                    (int)type_id);
+    lua_error(L);
+  }
+  return info;
+}
+
 void luaA_conversion_type(lua_State* L, luaA_Type type_id,
                           luaA_Pushfunc push_func, luaA_Tofunc to_func) {
   luaA_conversion_push_type(L, type_id, push_func);
@@ -283,20 +357,12 @@ void luaA_conversion_type(lua_State* L, luaA_Type type_id,
 
 void luaA_conversion_push_type(lua_State* L, luaA_Type type_id,
                                luaA_Pushfunc func) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_push");
-  lua_pushinteger(L, type_id);
-  lua_pushlightuserdata(L, func);
-  lua_settable(L, -3);
-  lua_pop(L, 1);
+  luaA_check_info(L, type_id, "luaA_conversion_push")->push = func;
 }
 
 void luaA_conversion_to_type(lua_State* L, luaA_Type type_id,
                              luaA_Tofunc func) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_to");
-  lua_pushinteger(L, type_id);
-  lua_pushlightuserdata(L, func);
-  lua_settable(L, -3);
-  lua_pop(L, 1);
+  luaA_check_info(L, type_id, "luaA_conversion_to")->to = func;
 }
 
 int luaA_push_bool(lua_State* L, luaA_Type type_id, const void* c_in) {
@@ -484,664 +550,388 @@ bool luaA_conversion_registered_type(lua_State* L, luaA_Type type_id) {
 }
 
 bool luaA_conversion_push_registered_type(lua_State* L, luaA_Type type_id) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_push");
-  lua_pushinteger(L, type_id);
-  lua_gettable(L, -2);
-
-  bool reg = !lua_isnil(L, -1);
-  lua_pop(L, 2);
-
-  return reg;
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), type_id);
+  return info != NULL && info->push != NULL;
 }
 
 bool luaA_conversion_to_registered_type(lua_State* L, luaA_Type type_id) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "stack_to");
-  lua_pushinteger(L, type_id);
-  lua_gettable(L, -2);
-
-  bool reg = !lua_isnil(L, -1);
-  lua_pop(L, 2);
-
-  return reg;
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), type_id);
+  return info != NULL && info->to != NULL;
 }
 
 /*
 ** Structs
 */
 
-int luaA_struct_push_member_offset_type(lua_State* L, luaA_Type type,
-                                        size_t offset, const void* c_in) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_pushinteger(L, offset);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "type");
-      luaA_Type stype = lua_tointeger(L, -1);
-      lua_pop(L, 4);
-      return luaA_push_type(L, stype, c_in + offset);
-    }
+static luaA_TypeInfo* luaA_struct_info(lua_State* L, luaA_Registry* R,
+                                       luaA_Type type, const char* fname) {
+  luaA_TypeInfo* info = luaA_info(R, type);
+  if (info == NULL || info->kind != LUAA_KIND_STRUCT) {
+    lua_pushfstring(L, "%s: Struct '%s' not registered!", fname,
+                    luaA_typename(L, type));
+    lua_error(L);
+  }
+  return info;
+}
 
-    lua_pop(L, 3);
+static const luaA_Member* luaA_member_offset(lua_State* L,
+                                             const luaA_TypeInfo* info,
+                                             size_t offset, const char* fname,
+                                             bool check) {
+  for (int i = 0; i < info->nmembers; i++) {
+    if (info->members[i].offset == offset) return &info->members[i];
+  }
+  if (check) {
     lua_pushfstring(L,
-                    "luaA_struct_push_member: Member offset '%d' not "
-                    "registered for struct '%s'!",
-                    offset, luaA_typename(L, type));
+                    "%s: Member offset '%d' not registered for struct '%s'!",
+                    fname, (int)offset, info->name);
     lua_error(L);
   }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_push_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return 0;
+  return NULL;
 }
 
-int luaA_struct_push_member_name_type(lua_State* L, luaA_Type type,
-                                      const char* member, const void* c_in) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_getfield(L, -1, member);
-
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "type");
-      luaA_Type stype = lua_tointeger(L, -1);
-      lua_pop(L, 1);
-      lua_getfield(L, -1, "offset");
-      size_t offset = lua_tointeger(L, -1);
-      lua_pop(L, 4);
-      return luaA_push_type(L, stype, c_in + offset);
-    }
-
-    lua_pop(L, 3);
-    lua_pushfstring(L,
-                    "luaA_struct_push_member: Member name '%s' not registered "
-                    "for struct '%s'!",
-                    member, luaA_typename(L, type));
+static const luaA_Member* luaA_member_name(lua_State* L,
+                                           const luaA_TypeInfo* info,
+                                           const char* member,
+                                           const char* fname, bool check) {
+  for (int i = 0; i < info->nmembers; i++) {
+    if (strcmp(info->members[i].name, member) == 0) return &info->members[i];
+  }
+  if (check) {
+    lua_pushfstring(L, "%s: Member name '%s' not registered for struct '%s'!",
+                    fname, member, info->name);
     lua_error(L);
   }
+  return NULL;
+}
 
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_push_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return 0;
+int luaA_struct_push_member_offset_type(lua_State* L, luaA_Type type,
+                                        size_t offset, const void* c_in) {
+  luaA_Registry* R = luaA_registry(L);
+  const char* fname = "luaA_struct_push_member";
+  luaA_Member m = *luaA_member_offset(
+      L, luaA_struct_info(L, R, type, fname), offset, fname, true);
+  return luaA_push_info(L, R, m.type, (const char*)c_in + m.offset);
+}
+
+int luaA_struct_push_member_name_type(lua_State* L, luaA_Type type,
+                                      const char* member, const void* c_in) {
+  luaA_Registry* R = luaA_registry(L);
+  const char* fname = "luaA_struct_push_member";
+  luaA_Member m = *luaA_member_name(L, luaA_struct_info(L, R, type, fname),
+                                    member, fname, true);
+  return luaA_push_info(L, R, m.type, (const char*)c_in + m.offset);
 }
 
 void luaA_struct_to_member_offset_type(lua_State* L, luaA_Type type,
                                        size_t offset, void* c_out, int index) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_pushinteger(L, offset);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "type");
-      luaA_Type stype = lua_tointeger(L, -1);
-      lua_pop(L, 4);
-      luaA_to_type(L, stype, c_out + offset, index);
-      return;
-    }
-
-    lua_pop(L, 3);
-    lua_pushfstring(L,
-                    "luaA_struct_to_member: Member offset '%d' not registered "
-                    "for struct '%s'!",
-                    offset, luaA_typename(L, type));
-    lua_error(L);
-  }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_to_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
+  luaA_Registry* R = luaA_registry(L);
+  const char* fname = "luaA_struct_to_member";
+  luaA_Member m = *luaA_member_offset(
+      L, luaA_struct_info(L, R, type, fname), offset, fname, true);
+  luaA_to_info(L, R, m.type, (char*)c_out + m.offset, index);
 }
 
 void luaA_struct_to_member_name_type(lua_State* L, luaA_Type type,
                                      const char* member, void* c_out,
                                      int index) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_pushstring(L, member);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "type");
-      luaA_Type stype = lua_tointeger(L, -1);
-      lua_pop(L, 1);
-      lua_getfield(L, -1, "offset");
-      size_t offset = lua_tointeger(L, -1);
-      lua_pop(L, 4);
-      luaA_to_type(L, stype, c_out + offset, index);
-      return;
-    }
-
-    lua_pop(L, 3);
-    lua_pushfstring(L,
-                    "luaA_struct_to_member: Member name '%s' not registered "
-                    "for struct '%s'!",
-                    member, luaA_typename(L, type));
-    lua_error(L);
-  }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_to_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
+  luaA_Registry* R = luaA_registry(L);
+  const char* fname = "luaA_struct_to_member";
+  luaA_Member m = *luaA_member_name(L, luaA_struct_info(L, R, type, fname),
+                                    member, fname, true);
+  luaA_to_info(L, R, m.type, (char*)c_out + m.offset, index);
 }
 
 bool luaA_struct_has_member_offset_type(lua_State* L, luaA_Type type,
                                         size_t offset) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_pushinteger(L, offset);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_pop(L, 3);
-      return true;
-    }
-
-    lua_pop(L, 3);
-    return false;
-  }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_has_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return false;
+  const char* fname = "luaA_struct_has_member";
+  luaA_TypeInfo* info = luaA_struct_info(L, luaA_registry(L), type, fname);
+  return luaA_member_offset(L, info, offset, fname, false) != NULL;
 }
 
 bool luaA_struct_has_member_name_type(lua_State* L, luaA_Type type,
                                       const char* member) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_pushstring(L, member);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_pop(L, 3);
-      return true;
-    }
-
-    lua_pop(L, 3);
-    return false;
-  }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_has_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return false;
+  const char* fname = "luaA_struct_has_member";
+  luaA_TypeInfo* info = luaA_struct_info(L, luaA_registry(L), type, fname);
+  return luaA_member_name(L, info, member, fname, false) != NULL;
 }
 
 luaA_Type luaA_struct_typeof_member_offset_type(lua_State* L, luaA_Type type,
                                                 size_t offset) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_pushinteger(L, offset);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "type");
-      luaA_Type stype = lua_tointeger(L, -1);
-      lua_pop(L, 4);
-      return stype;
-    }
-
-    lua_pop(L, 3);
-    lua_pushfstring(L,
-                    "luaA_struct_typeof_member: Member offset '%d' not "
-                    "registered for struct '%s'!",
-                    offset, luaA_typename(L, type));
-    lua_error(L);
-  }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_typeof_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return 0;
+  const char* fname = "luaA_struct_typeof_member";
+  luaA_TypeInfo* info = luaA_struct_info(L, luaA_registry(L), type, fname);
+  return luaA_member_offset(L, info, offset, fname, true)->type;
 }
 
 luaA_Type luaA_struct_typeof_member_name_type(lua_State* L, luaA_Type type,
                                               const char* member) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_pushstring(L, member);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "type");
-      luaA_Type type = lua_tointeger(L, -1);
-      lua_pop(L, 4);
-      return type;
-    }
-
-    lua_pop(L, 3);
-    lua_pushfstring(L,
-                    "luaA_struct_typeof_member: Member name '%s' not "
-                    "registered for struct '%s'!",
-                    member, luaA_typename(L, type));
-    lua_error(L);
-  }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_typeof_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return 0;
+  const char* fname = "luaA_struct_typeof_member";
+  luaA_TypeInfo* info = luaA_struct_info(L, luaA_registry(L), type, fname);
+  return luaA_member_name(L, info, member, fname, true)->type;
 }
 
 void luaA_struct_type(lua_State* L, luaA_Type type) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_newtable(L);
-  lua_settable(L, -3);
-  lua_pop(L, 1);
-
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-  lua_pushinteger(L, type);
-  lua_newtable(L);
-  lua_settable(L, -3);
+  luaA_TypeInfo* info = luaA_check_info(L, type, "luaA_struct");
+  int names = info->names;
+  info->kind = LUAA_KIND_STRUCT;
+  info->nmembers = 0;
+  info->names = LUA_NOREF;
+
+  luaA_unref(L, names);
+  int ref = luaA_newref(L);
   lua_pop(L, 1);
+  luaA_struct_info(L, luaA_registry(L), type, "luaA_struct")->names = ref;
 }
 
 void luaA_struct_member_type(lua_State* L, luaA_Type type, const char* member,
                              luaA_Type mtype, size_t offset) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_newtable(L);
+  luaA_TypeInfo* info =
+      luaA_struct_info(L, luaA_registry(L), type, "luaA_struct_member");
+  luaA_Member* m = (luaA_Member*)luaA_member_name(L, info, member, NULL, false);
+
+  if (m == NULL) {
+    if (info->nmembers == info->sizemembers) {
+      int size = info->sizemembers ? info->sizemembers * 2 : 8;
+      luaA_Member* members = realloc(info->members, size * sizeof(luaA_Member));
+      if (members == NULL) {
+        lua_pushfstring(L, "luaA_struct_member: Out of memory!");
+        lua_error(L);
+        return;
+      }
+      info->members = members;
+      info->sizemembers = size;
+    }
 
-    lua_pushinteger(L, mtype);
-    lua_setfield(L, -2, "type");
-    lua_pushinteger(L, offset);
-    lua_setfield(L, -2, "offset");
+    /* the key of 'names' keeps the string 'm->name' points into alive */
+    luaA_pushref(L, info->names);
     lua_pushstring(L, member);
-    lua_setfield(L, -2, "name");
-
-    lua_setfield(L, -2, member);
-
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs_offset");
-    lua_pushinteger(L, type);
-    lua_gettable(L, -2);
-
-    lua_pushinteger(L, offset);
-    lua_getfield(L, -4, member);
-    lua_settable(L, -3);
-    lua_pop(L, 4);
-    return;
+    m = &info->members[info->nmembers];
+    m->name = lua_tostring(L, -1);
+    lua_pushinteger(L, info->nmembers++);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
   }
 
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
+  m->type = mtype;
+  m->offset = offset;
 }
 
 bool luaA_struct_registered_type(lua_State* L, luaA_Type type) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  bool reg = !lua_isnil(L, -1);
-  lua_pop(L, 2);
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), type);
+  return info != NULL && info->kind == LUAA_KIND_STRUCT;
+}
+
+static int luaA_struct_push_info(lua_State* L, luaA_Registry* R,
+                                 luaA_Type type, const void* c_in) {
+  lua_createtable(L, 0, R->types[type].nmembers);
+
+  for (int i = 0; i < R->types[type].nmembers; i++) {
+    luaA_Member m = R->types[type].members[i];
+    int num = luaA_push_info(L, R, m.type, (const char*)c_in + m.offset);
+    if (num > 1) {
+      lua_pop(L, num + 1);
+      lua_pushfstring(L,
+                      "luaA_struct_push: Conversion pushed %d values to stack,"
+                      " don't know how to include in struct!",
+                      num);
+      lua_error(L);
+    }
+    if (num == 1) {
+      lua_setfield(L, -2, m.name);
+    }
+  }
 
-  return reg;
+  return 1;
 }
 
 int luaA_struct_push_type(lua_State* L, luaA_Type type, const void* c_in) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
+  luaA_Registry* R = luaA_registry(L);
+  luaA_struct_info(L, R, type, "lua_struct_push");
+  return luaA_struct_push_info(L, R, type, c_in);
+}
 
-  if (!lua_isnil(L, -1)) {
-    lua_remove(L, -2);
-    lua_newtable(L);
+static void luaA_struct_to_info(lua_State* L, luaA_Registry* R,
+                                luaA_Type type, void* c_out, int index) {
+  index = lua_absindex(L, index);
+  luaA_pushref(L, R->types[type].names);
 
-    lua_pushnil(L);
-    while (lua_next(L, -3)) {
-      if (lua_type(L, -2) == LUA_TSTRING) {
-        lua_getfield(L, -1, "name");
-        const char* name = lua_tostring(L, -1);
-        lua_pop(L, 1);
-        int num = luaA_struct_push_member_name_type(L, type, name, c_in);
-        if (num > 1) {
-          lua_pop(L, 5);
-          lua_pushfstring(
-              L,
-              "luaA_struct_push: Conversion pushed %d values to stack,"
-              " don't know how to include in struct!",
-              num);
-          lua_error(L);
-        }
-        lua_remove(L, -2);
-        lua_pushvalue(L, -2);
-        lua_insert(L, -2);
-        lua_settable(L, -4);
-      } else {
-        lua_pop(L, 1);
+  lua_pushnil(L);
+  while (lua_next(L, index)) {
+    if (lua_type(L, -2) == LUA_TSTRING) {
+      lua_pushvalue(L, -2);
+      lua_rawget(L, -4);
+      if (!lua_isinteger(L, -1)) {
+        lua_pushfstring(L,
+                        "luaA_struct_to_member: Member name '%s' not "
+                        "registered for struct '%s'!",
+                        lua_tostring(L, -3), R->types[type].name);
+        lua_error(L);
       }
+      luaA_Member m = R->types[type].members[lua_tointeger(L, -1)];
+      lua_pop(L, 1);
+      luaA_to_info(L, R, m.type, (char*)c_out + m.offset, -1);
     }
 
-    lua_remove(L, -2);
-    return 1;
+    lua_pop(L, 1);
   }
 
-  lua_pop(L, 2);
-  lua_pushfstring(L, "lua_struct_push: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return 0;
+  lua_pop(L, 1);
 }
 
 void luaA_struct_to_type(lua_State* L, luaA_Type type, void* c_out, int index) {
-  lua_pushnil(L);
-  while (lua_next(L, index - 1)) {
-    if (lua_type(L, -2) == LUA_TSTRING) {
-      luaA_struct_to_member_name_type(L, type, lua_tostring(L, -2), c_out, -1);
-    }
-
-    lua_pop(L, 1);
-  }
+  luaA_Registry* R = luaA_registry(L);
+  luaA_struct_info(L, R, type, "luaA_struct_to");
+  luaA_struct_to_info(L, R, type, c_out, index);
 }
 
 const char* luaA_struct_next_member_name_type(lua_State* L, luaA_Type type,
                                               const char* member) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "structs");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    if (!member) {
-      lua_pushnil(L);
-    } else {
-      lua_pushstring(L, member);
-    }
-    if (!lua_next(L, -2)) {
-      lua_pop(L, 2);
-      return LUAA_INVALID_MEMBER_NAME;
-    }
-    const char* result = lua_tostring(L, -2);
-    lua_pop(L, 4);
-    return result;
+  const char* fname = "luaA_struct_next_member";
+  luaA_TypeInfo* info = luaA_struct_info(L, luaA_registry(L), type, fname);
+
+  int i = 0;
+  if (member) {
+    const luaA_Member* m = luaA_member_name(L, info, member, fname, false);
+    if (m == NULL) return LUAA_INVALID_MEMBER_NAME;
+    i = (int)(m - info->members) + 1;
   }
 
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_struct_next_member: Struct '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return NULL;
+  return i < info->nmembers ? info->members[i].name : LUAA_INVALID_MEMBER_NAME;
 }
 
 /*
 ** Enums
 */
 
-int luaA_enum_push_type(lua_State* L, luaA_Type type, const void* value) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_values");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_sizes");
-    lua_pushinteger(L, type);
-    lua_gettable(L, -2);
-    size_t size = lua_tointeger(L, -1);
-    lua_pop(L, 2);
-
-    lua_Integer lvalue = 0;
-    memcpy(&lvalue, value, size);
+static luaA_TypeInfo* luaA_enum_info(lua_State* L, luaA_Type type,
+                                     const char* fname) {
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), type);
+  if (info == NULL || info->kind != LUAA_KIND_ENUM) {
+    lua_pushfstring(L, "%s: Enum '%s' not registered!", fname,
+                    luaA_typename(L, type));
+    lua_error(L);
+  }
+  return info;
+}
 
-    lua_pushinteger(L, lvalue);
-    lua_gettable(L, -2);
+int luaA_enum_push_type(lua_State* L, luaA_Type type, const void* value) {
+  luaA_TypeInfo* info = luaA_enum_info(L, type, "luaA_enum_push");
 
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "name");
-      lua_remove(L, -2);
-      lua_remove(L, -2);
-      lua_remove(L, -2);
-      return 1;
-    }
+  lua_Integer lvalue = 0;
+  memcpy(&lvalue, value, info->enum_size);
 
-    lua_pop(L, 3);
-    lua_pushfstring(L, "luaA_enum_push: Enum '%s' value %d not registered!",
+  luaA_pushref(L, info->enum_values);
+  if (lua_rawgeti(L, -1, lvalue) == LUA_TNIL) {
+    lua_pop(L, 2);
+    lua_pushfstring(L, "luaA_enum_push: Enum '%s' value %I not registered!",
                     luaA_typename(L, type), lvalue);
     lua_error(L);
     return 0;
   }
 
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_enum_push: Enum '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return 0;
+  lua_remove(L, -2);
+  return 1;
 }
 
 void luaA_enum_to_type(lua_State* L, luaA_Type type, void* c_out, int index) {
   const char* name = lua_tostring(L, index);
+  luaA_TypeInfo* info = luaA_enum_info(L, type, "luaA_enum_to");
+  size_t size = info->enum_size;
 
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_sizes");
-    lua_pushinteger(L, type);
-    lua_gettable(L, -2);
-    size_t size = lua_tointeger(L, -1);
+  luaA_pushref(L, info->enum_names);
+  if (name != NULL && lua_getfield(L, -1, name) == LUA_TNUMBER) {
+    lua_Integer value = lua_tointeger(L, -1);
     lua_pop(L, 2);
-
-    lua_pushstring(L, name);
-    lua_gettable(L, -2);
-
-    if (!lua_isnil(L, -1)) {
-      lua_getfield(L, -1, "value");
-      lua_Integer value = lua_tointeger(L, -1);
-      lua_pop(L, 4);
-      memcpy(c_out, &value, size);
-      return;
-    }
-
-    lua_pop(L, 3);
-    lua_pushfstring(L, "luaA_enum_to: Enum '%s' field '%s' not registered!",
-                    luaA_typename(L, type), name);
-    lua_error(L);
+    memcpy(c_out, &value, size);
     return;
   }
 
-  lua_pop(L, 3);
-  lua_pushfstring(L, "luaA_enum_to: Enum '%s' not registered!",
-                  luaA_typename(L, type));
+  lua_pushfstring(L, "luaA_enum_to: Enum '%s' field '%s' not registered!",
+                  luaA_typename(L, type), name);
   lua_error(L);
-  return;
 }
 
 bool luaA_enum_has_value_type(lua_State* L, luaA_Type type, const void* value) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_values");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
+  luaA_TypeInfo* info = luaA_enum_info(L, type, "luaA_enum_has_value");
 
-  if (!lua_isnil(L, -1)) {
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_sizes");
-    lua_pushinteger(L, type);
-    lua_gettable(L, -2);
-    size_t size = lua_tointeger(L, -1);
-    lua_pop(L, 2);
-
-    lua_Integer lvalue = 0;
-    memcpy(&lvalue, value, size);
-
-    lua_pushinteger(L, lvalue);
-    lua_gettable(L, -2);
-
-    if (lua_isnil(L, -1)) {
-      lua_pop(L, 3);
-      return false;
-    } else {
-      lua_pop(L, 3);
-      return true;
-    }
-  }
+  lua_Integer lvalue = 0;
+  memcpy(&lvalue, value, info->enum_size);
 
+  luaA_pushref(L, info->enum_values);
+  bool has = lua_rawgeti(L, -1, lvalue) != LUA_TNIL;
   lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_enum_has_value: Enum '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return false;
+  return has;
 }
 
 bool luaA_enum_has_name_type(lua_State* L, luaA_Type type, const char* name) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_getfield(L, -1, name);
-
-    if (lua_isnil(L, -1)) {
-      lua_pop(L, 3);
-      return false;
-    } else {
-      lua_pop(L, 3);
-      return true;
-    }
-  }
+  luaA_TypeInfo* info = luaA_enum_info(L, type, "luaA_enum_has_name");
 
+  luaA_pushref(L, info->enum_names);
+  bool has = lua_getfield(L, -1, name) != LUA_TNIL;
   lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_enum_has_name: Enum '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return false;
+  return has;
 }
 
 void luaA_enum_type(lua_State* L, luaA_Type type, size_t size) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_pushinteger(L, type);
-  lua_newtable(L);
-  lua_settable(L, -3);
-  lua_pop(L, 1);
-
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_values");
-  lua_pushinteger(L, type);
-  lua_newtable(L);
-  lua_settable(L, -3);
-  lua_pop(L, 1);
+  luaA_TypeInfo* info = luaA_check_info(L, type, "luaA_enum");
+  int names = info->enum_names, values = info->enum_values;
+  info->kind = LUAA_KIND_ENUM;
+  info->enum_size = size;
+  info->enum_names = info->enum_values = LUA_NOREF;
+
+  luaA_unref(L, names);
+  luaA_unref(L, values);
+  names = luaA_newref(L);
+  values = luaA_newref(L);
+  lua_pop(L, 2);
 
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_sizes");
-  lua_pushinteger(L, type);
-  lua_pushinteger(L, size);
-  lua_settable(L, -3);
-  lua_pop(L, 1);
+  info = luaA_enum_info(L, type, "luaA_enum");
+  info->enum_names = names;
+  info->enum_values = values;
 }
 
 void luaA_enum_value_type(lua_State* L, luaA_Type type, const void* value,
                           const char* name) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-
-  if (!lua_isnil(L, -1)) {
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_sizes");
-    lua_pushinteger(L, type);
-    lua_gettable(L, -2);
-    size_t size = lua_tointeger(L, -1);
-    lua_pop(L, 2);
+  luaA_TypeInfo* info = luaA_enum_info(L, type, "luaA_enum_value");
 
-    lua_newtable(L);
-
-    lua_Integer lvalue = 0;
-    memcpy(&lvalue, value, size);
-
-    lua_pushinteger(L, lvalue);
-    lua_setfield(L, -2, "value");
-
-    lua_pushstring(L, name);
-    lua_setfield(L, -2, "name");
-
-    lua_setfield(L, -2, name);
-
-    lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums_values");
-    lua_pushinteger(L, type);
-    lua_gettable(L, -2);
-    lua_pushinteger(L, lvalue);
-    lua_getfield(L, -4, name);
-    lua_settable(L, -3);
+  lua_Integer lvalue = 0;
+  memcpy(&lvalue, value, info->enum_size);
 
-    lua_pop(L, 4);
-    return;
-  }
+  luaA_pushref(L, info->enum_names);
+  lua_pushinteger(L, lvalue);
+  lua_setfield(L, -2, name);
+  lua_pop(L, 1);
 
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_enum_value: Enum '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
+  luaA_pushref(L, info->enum_values);
+  lua_pushstring(L, name);
+  lua_rawseti(L, -2, lvalue);
+  lua_pop(L, 1);
 }
 
 bool luaA_enum_registered_type(lua_State* L, luaA_Type type) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
-  bool reg = !lua_isnil(L, -1);
-  lua_pop(L, 2);
-  return reg;
+  luaA_TypeInfo* info = luaA_info(luaA_registry(L), type);
+  return info != NULL && info->kind == LUAA_KIND_ENUM;
 }
 
 const char* luaA_enum_next_value_name_type(lua_State* L, luaA_Type type,
                                            const char* member) {
-  lua_getfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "enums");
-  lua_pushinteger(L, type);
-  lua_gettable(L, -2);
+  luaA_TypeInfo* info =
+      luaA_enum_info(L, type, "luaA_enum_next_enum_name_type");
 
-  if (!lua_isnil(L, -1)) {
-    if (!member) {
-      lua_pushnil(L);
-    } else {
-      lua_pushstring(L, member);
-    }
-    if (!lua_next(L, -2)) {
-      lua_pop(L, 2);
-      return LUAA_INVALID_MEMBER_NAME;
-    }
-    const char* result = lua_tostring(L, -2);
-    lua_pop(L, 4);
-    return result;
+  luaA_pushref(L, info->enum_names);
+  if (!member) {
+    lua_pushnil(L);
+  } else {
+    lua_pushstring(L, member);
   }
-
-  lua_pop(L, 2);
-  lua_pushfstring(L, "luaA_enum_next_enum_name_type: Enum '%s' not registered!",
-                  luaA_typename(L, type));
-  lua_error(L);
-  return NULL;
+  if (!lua_next(L, -2)) {
+    lua_pop(L, 1);
+    return LUAA_INVALID_MEMBER_NAME;
+  }
+  /* the key stays alive in the names table */
+  const char* result = lua_tostring(L, -2);
+  lua_pop(L, 3);
+  return result;
 }
 
 /*
@@ -1285,7 +1075,7 @@ int luaA_call_entry(lua_State* L) {
 
   if (!arg_heap) {
     lua_pushinteger(L, arg_ptr);
-    lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "argument_ptr");
+    lua_setfield(L, LUA_REGISTRYINDEX, LUAA_REGISTRYPREFIX "call_arg_ptr");
   } else {
     free(arg_data);
   }
@@ -7,6 +7,7 @@
 #define lauxlib_c
 #define LUA_LIB
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -22,6 +23,7 @@
 
 #include "cobalt.h"
 #include "lauxlib.h"
+#include "lualib.h"
 
 #if !defined(MAX_SIZET)
 /* maximum value for size_t */
@@ -391,6 +393,69 @@ LUALIB_API const char *luaL_checklstring(lua_State *L, int arg, size_t *len) {
   return s;
 }
 
+/*
+** Get the bytes of a string, of a string buffer or of an open mapped
+** buffer (see 'io.map'). Returns NULL for any other value.
+*/
+LUALIB_API const char *luaL_tolbytes(lua_State *L, int idx, size_t *len) {
+  if (lua_type(L, idx) == LUA_TUSERDATA) {
+    luaL_Mapped *m;
+    luaL_StrBuf *sb = (luaL_StrBuf *)luaL_testudata(L, idx, LUA_STRBUFHANDLE);
+    if (sb != NULL) {
+      if (len) *len = luaL_strbuflen(sb);
+      return (sb->b != NULL) ? luaL_strbufaddr(sb) : "";
+    }
+    m = (luaL_Mapped *)luaL_testudata(L, idx, LUA_MAPHANDLE);
+    if (m == NULL || m->data == NULL) return NULL;
+    if (len) *len = m->len;
+    return m->data;
+  }
+  return lua_tolstring(L, idx, len);
+}
+
+LUALIB_API const char *luaL_checklbytes(lua_State *L, int arg, size_t *len) {
+  const char *s = luaL_tolbytes(L, arg, len);
+  if (l_unlikely(!s)) {
+    if (luaL_testudata(L, arg, LUA_MAPHANDLE))
+      luaL_argerror(L, arg, "attempt to use a closed mapped buffer");
+    tag_error(L, arg, LUA_TSTRING);
+  }
+  return s;
+}
+
+/*
+** Pin count of the string buffer or mapped buffer at 'idx' (NULL for
+** any other value). While it is positive the buffer cannot move or
+** release its bytes, so a caller can keep using the pointer from
+** 'luaL_checklbytes' across calls into Lua code.
+*/
+LUALIB_API int *luaL_lbytespins(lua_State *L, int idx) {
+  luaL_StrBuf *sb;
+  luaL_Mapped *m;
+  if (lua_type(L, idx) != LUA_TUSERDATA) return NULL;
+  sb = (luaL_StrBuf *)luaL_testudata(L, idx, LUA_STRBUFHANDLE);
+  if (sb != NULL) return &sb->pins;
+  m = (luaL_Mapped *)luaL_testudata(L, idx, LUA_MAPHANDLE);
+  return (m != NULL) ? &m->pins : NULL;
+}
+
+/*
+** Push the method table of mapped buffers, creating their metatable
+** and its '__index' table if needed. Both 'io' (which creates mapped
+** buffers) and 'string' (whose read-only functions are also their
+** methods) add their entries here, in whichever order they open.
+*/
+LUALIB_API void luaL_mapmethods(lua_State *L) {
+  luaL_newmetatable(L, LUA_MAPHANDLE);
+  if (lua_getfield(L, -1, "__index") != LUA_TTABLE) { /* no methods yet? */
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, "__index");
+  }
+  lua_remove(L, -2); /* remove metatable */
+}
+
 LUALIB_API const char *luaL_optlstring(lua_State *L, int arg, const char *def,
                                        size_t *len) {
   if (lua_isnoneornil(L, arg)) {
@@ -601,6 +666,110 @@ LUALIB_API char *luaL_buffinitsize(lua_State *L, luaL_Buffer *B, size_t sz) {
 
 /* }====================================================== */
 
+/*
+** {======================================================
+** String buffers
+** =======================================================
+*/
+
+static int strbufgc(lua_State *L) {
+  luaL_strbuffree(L, (luaL_StrBuf *)luaL_checkudata(L, 1, LUA_STRBUFHANDLE));
+  return 0;
+}
+
+/*
+** Create a new string buffer with room for 'sz' bytes and push it.
+** Libraries may add methods to its metatable; the finalizer is set
+** here so that buffers created from C are always released.
+*/
+LUALIB_API luaL_StrBuf *luaL_newstrbuf(lua_State *L, size_t sz) {
+  luaL_StrBuf *sb =
+      (luaL_StrBuf *)lua_newuserdatauv(L, sizeof(luaL_StrBuf), 0);
+  sb->b = NULL;
+  sb->size = sb->r = sb->w = 0;
+  sb->pins = 0;
+  if (luaL_newmetatable(L, LUA_STRBUFHANDLE)) { /* creating metatable? */
+    lua_pushcfunction(L, strbufgc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  if (sz > 0) luaL_strbufprep(L, sb, sz);
+  return sb;
+}
+
+/*
+** The collector does not see buffer storage, so growth is added to its
+** debt, as if that much memory had been allocated. The collector then
+** runs at its next check, not here: a step could run finalizers that
+** change this buffer or free the source of the bytes being added.
+*/
+static void strbufgrown(lua_State *L, size_t grown) {
+  size_t kb = (grown + 1023) >> 10;
+  lua_gc(L, LUA_GCDEBT, (int)(kb < INT_MAX ? kb : INT_MAX));
+}
+
+/*
+** Returns a pointer to a free area with at least 'sz' bytes after the
+** contents of 'sb'. Consumed bytes are reclaimed before growing, and
+** growth doubles the size, as in 'newbuffsize'.
+*/
+LUALIB_API char *luaL_strbufprep(lua_State *L, luaL_StrBuf *sb, size_t sz) {
+  size_t len = luaL_strbuflen(sb);
+  if (sb->size - sb->w >= sz) /* enough space? */
+    return sb->b + sb->w;
+  if (l_unlikely(sb->pins > 0)) /* contents cannot move now */
+    luaL_error(L, "string buffer is in use");
+  if (sb->r > 0) { /* move contents to the start of the buffer */
+    memmove(sb->b, sb->b + sb->r, len);
+    sb->r = 0;
+    sb->w = len;
+    if (sb->size - len >= sz) return sb->b + len;
+  }
+  {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    size_t oldsize = sb->size;
+    size_t newsize = oldsize * 2; /* double buffer size */
+    char *temp;
+    if (l_unlikely(MAX_SIZET - sz < len)) /* overflow in (len + sz)? */
+      luaL_error(L, "buffer too large");
+    if (newsize < len + sz) /* double is not big enough? */
+      newsize = len + sz;
+    if (newsize < LUAL_BUFFERSIZE) newsize = LUAL_BUFFERSIZE;
+    temp = (char *)allocf(ud, sb->b, oldsize, newsize);
+    if (l_unlikely(temp == NULL)) { /* allocation error? */
+      lua_pushliteral(L, "not enough memory");
+      lua_error(L); /* raise a memory error */
+    }
+    sb->b = temp;
+    sb->size = newsize;
+    strbufgrown(L, newsize - oldsize);
+    return temp + sb->w;
+  }
+}
+
+LUALIB_API void luaL_strbufaddlstring(lua_State *L, luaL_StrBuf *sb,
+                                      const char *s, size_t l) {
+  if (l > 0) { /* avoid 'memcpy' when 's' can be NULL */
+    char *b = luaL_strbufprep(L, sb, l);
+    memcpy(b, s, l * sizeof(char));
+    luaL_strbufaddsize(sb, l);
+  }
+}
+
+LUALIB_API void luaL_strbuffree(lua_State *L, luaL_StrBuf *sb) {
+  if (l_unlikely(sb->pins > 0)) luaL_error(L, "string buffer is in use");
+  if (sb->b != NULL) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    allocf(ud, sb->b, sb->size, 0);
+    sb->b = NULL;
+    sb->size = sb->r = sb->w = 0;
+  }
+}
+
+/* }====================================================== */
+
 /*
 ** {======================================================
 ** Reference system
@@ -721,12 +890,275 @@ static int skipcomment(LoadF *lf, int *cp) {
     return 0; /* no comment */
 }
 
+/*
+** {======================================================
+** Preprocessed loading
+** =======================================================
+*/
+
+/*
+** When the registry has a true LUA_PREPROCESS_KEY, 'luaL_loadfilex'
+** runs source files with directives through the 'preprocess' module
+** before compiling them. The output is cached by a hash of the file
+** name and contents: in the registry for the life of the state and, if
+** the environment variable COBALT_PRECACHE names a directory, on disk
+** across runs. The preprocessor keeps line numbers, so the chunk keeps
+** the name of the original file.
+*/
+
+#define PRECACHE_ENV "COBALT_PRECACHE"
+
+static int preprocessing(lua_State *L) {
+  int on;
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_PREPROCESS_KEY);
+  on = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  return on;
+}
+
+/* directives of the 'preprocess' module, written as '#' and a name */
+static const char *const directives[] = {
+    "define", "undef", "include", "include_next", "if",      "ifdef",
+    "ifndef", "elif",  "else",    "endif",        "error",   "warning",
+    "pragma", NULL};
+
+/* whether the name at 's' (which ends before 'e') is a directive */
+static int isdirective(const char *s, const char *e) {
+  size_t n = 0;
+  int i;
+  while (s + n < e && (isalnum((unsigned char)s[n]) || s[n] == '_')) n++;
+  for (i = 0; directives[i] != NULL; i++) {
+    if (strlen(directives[i]) == n && memcmp(directives[i], s, n) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+/*
+** Whether some line of 's' is a directive, and not just a line that
+** starts with the length operator ("#t > 0").
+*/
+static int hasdirectives(const char *s, size_t l) {
+  const char *e = s + l;
+  while (s < e) {
+    while (s < e && (*s == ' ' || *s == '\t')) s++;
+    if (s < e && *s == '#') {
+      do s++; while (s < e && (*s == ' ' || *s == '\t'));
+      if (isdirective(s, e)) return 1;
+    }
+    s = (const char *)memchr(s, '\n', e - s);
+    if (s == NULL) break;
+    s++;
+  }
+  return 0;
+}
+
+/* 64-bit FNV-1a, continued from 'h' */
+static unsigned long long prehash(unsigned long long h, const char *s,
+                                  size_t l) {
+  while (l--) {
+    h ^= (unsigned char)*s++;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/*
+** Pushes the file name of the on-disk cache entry 'key', or returns 0
+** if there is no cache directory.
+*/
+static int precachefile(lua_State *L, const char *key) {
+  const char *dir;
+  int noenv;
+  lua_getfield(L, LUA_REGISTRYINDEX, "LUA_NOENV");
+  noenv = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  dir = noenv ? NULL : getenv(PRECACHE_ENV);
+  if (dir == NULL || *dir == '\0') return 0;
+  lua_pushfstring(L, "%s" LUA_DIRSEP "%s.cobalt", dir, key);
+  return 1;
+}
+
+/* pushes the contents of file 'fname', or returns 0 if it cannot */
+static int readwhole(lua_State *L, const char *fname) {
+  luaL_Buffer b;
+  size_t n;
+  int err;
+  FILE *f = fopen(fname, "rb");
+  if (f == NULL) return 0;
+  luaL_buffinit(L, &b);
+  do {
+    char *p = luaL_prepbuffer(&b);
+    n = fread(p, 1, LUAL_BUFFERSIZE, f);
+    luaL_addsize(&b, n);
+  } while (n == LUAL_BUFFERSIZE);
+  err = ferror(f);
+  fclose(f);
+  luaL_pushresult(&b);
+  if (err) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  return 1;
+}
+
+/*
+** Opens a new file for writing, named after 'tmp' with its final
+** "XXXXXX" replaced. POSIX makes the name unique ('mkstemp'); elsewhere
+** it comes from the clock.
+*/
+#if !defined(l_opentemp) /* { */
+
+#if defined(LUA_USE_POSIX)
+
+#include <unistd.h>
+
+static FILE *l_opentemp(char *tmp) {
+  FILE *f;
+  int fd = mkstemp(tmp);
+  if (fd == -1) return NULL;
+  f = fdopen(fd, "wb");
+  if (f == NULL) {
+    close(fd);
+    remove(tmp);
+  }
+  return f;
+}
+
+#else
+
+static FILE *l_opentemp(char *tmp) {
+  snprintf(tmp + strlen(tmp) - 6, 7, "%06lx",
+           (unsigned long)clock() & 0xffffffUL);
+  return fopen(tmp, "wb");
+}
+
+#endif
+
+#endif /* } */
+
+/*
+** Writes the cache entry 'fname' into a temporary file in the same
+** directory and renames it into place, so that a state reading the
+** entry at the same time sees either all of it or none. On failure
+** there is no new entry; the cache is only an optimization.
+*/
+static void writewhole(lua_State *L, const char *fname, const char *s,
+                       size_t l) {
+  size_t n = strlen(fname);
+  char *tmp = (char *)lua_newuserdatauv(L, n + sizeof(".XXXXXX"), 0);
+  FILE *f;
+  memcpy(tmp, fname, n);
+  memcpy(tmp + n, ".XXXXXX", sizeof(".XXXXXX"));
+  f = l_opentemp(tmp);
+  if (f != NULL) {
+    int err = fwrite(s, 1, l, f) != l;
+    if (fclose(f) != 0 || err || rename(tmp, fname) != 0) remove(tmp);
+  }
+  lua_pop(L, 1);
+}
+
+/*
+** Runs the preprocessor on the source at the top of the stack, which
+** is replaced by the output. Returns LUA_OK or an error status with the
+** message on the top.
+*/
+static int preprocess(lua_State *L, const char *filename) {
+  int status;
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+  if (lua_getfield(L, -1, LUA_PREPROCESSORNAME) == LUA_TNIL) {
+    lua_pop(L, 1);
+    luaL_requiref(L, LUA_PREPROCESSORNAME, luaopen_preprocess, 0);
+  }
+  lua_getfield(L, -1, "compile");
+  lua_insert(L, -4); /* compile, source, _LOADED, module */
+  lua_pop(L, 2);
+  lua_createtable(L, 0, 1); /* predefines */
+  lua_pushstring(L, filename);
+  lua_setfield(L, -2, "FILE");
+  status = lua_pcall(L, 2, 1, 0);
+  if (status != LUA_OK)
+    status = LUA_ERRSYNTAX;
+  else if (!lua_isstring(L, -1)) {
+    lua_pop(L, 1);
+    lua_pushfstring(L, "%s: preprocessor returned no source", filename);
+    status = LUA_ERRSYNTAX;
+  }
+  return status;
+}
+
+/*
+** Loads 'filename', whose chunk name is at 'fnameindex', through the
+** preprocessor.
+*/
+static int loadpreprocessed(lua_State *L, const char *filename,
+                            const char *mode, int fnameindex) {
+  const char *s;
+  size_t l;
+  char key[17];
+  int status;
+  if (!readwhole(L, filename)) return errfile(L, "read", fnameindex);
+  s = lua_tolstring(L, -1, &l);
+  if (l >= 3 && memcmp(s, "\xEF\xBB\xBF", 3) == 0) { /* BOM? */
+    s += 3;
+    l -= 3;
+  }
+  if (l >= 2 && s[0] == '#' && s[1] == '!') { /* Unix exec. file? */
+    const char *nl = (const char *)memchr(s, '\n', l);
+    size_t skip = nl ? (size_t)(nl - s) : l; /* keep the newline */
+    s += skip;
+    l -= skip;
+  }
+  if (l > 0 && s[0] == LUA_SIGNATURE[0]) /* binary chunk? */
+    status = luaL_loadbufferx(L, s, l, lua_tostring(L, fnameindex), mode);
+  else if (!hasdirectives(s, l)) {
+    status = luaL_loadbufferx(L, s, l, lua_tostring(L, fnameindex), mode);
+  } else {
+    unsigned long long h = prehash(0xcbf29ce484222325ULL, LUA_RELEASE,
+                                   sizeof(LUA_RELEASE));
+    h = prehash(h, filename, strlen(filename) + 1);
+    h = prehash(h, s, l);
+    snprintf(key, sizeof(key), "%016llx", h);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRECACHE_TABLE);
+    if (lua_getfield(L, -1, key) == LUA_TNIL) { /* not cached in memory? */
+      lua_pop(L, 1);
+      int disk = precachefile(L, key);
+      if (!(disk && readwhole(L, lua_tostring(L, -1)))) {
+        size_t ol;
+        const char *out;
+        lua_pushlstring(L, s, l);
+        if ((status = preprocess(L, filename)) != LUA_OK) {
+          lua_replace(L, fnameindex);
+          lua_settop(L, fnameindex);
+          return status;
+        }
+        out = lua_tolstring(L, -1, &ol);
+        if (disk) writewhole(L, lua_tostring(L, -2), out, ol);
+      }
+      if (disk) lua_remove(L, -2); /* cache file name */
+      lua_pushvalue(L, -1);
+      lua_setfield(L, -3, key);
+    }
+    s = lua_tolstring(L, -1, &l);
+    status = luaL_loadbufferx(L, s, l, lua_tostring(L, fnameindex), mode);
+  }
+  lua_replace(L, fnameindex); /* chunk or message replaces the name */
+  lua_settop(L, fnameindex);
+  return status;
+}
+
+/* }====================================================== */
+
 LUALIB_API int luaL_loadfilex(lua_State *L, const char *filename,
                               const char *mode) {
   LoadF lf;
   int status, readstatus;
   int c;
   int fnameindex = lua_gettop(L) + 1; /* index of filename on the stack */
+  if (filename != NULL && preprocessing(L)) {
+    lua_pushfstring(L, "@%s", filename);
+    return loadpreprocessed(L, filename, mode, fnameindex);
+  }
   if (filename == NULL) {
     lua_pushliteral(L, "=stdin");
     lf.f = stdin;
@@ -31,6 +31,12 @@ typedef struct luaL_Buffer luaL_Buffer;
 /* key, in the registry, for table of preloaded loaders */
 #define LUA_PRELOAD_TABLE "_PRELOAD"
 
+/* key, in the registry, set when 'luaL_loadfilex' runs the preprocessor */
+#define LUA_PREPROCESS_KEY "_PREPROCESS"
+
+/* key, in the registry, for the cache of preprocessed sources */
+#define LUA_PRECACHE_TABLE "_PRECACHE"
+
 typedef struct luaL_Reg {
   const char *name;
   lua_CFunction func;
@@ -48,6 +54,10 @@ LUALIB_API const char *(luaL_tolstring)(lua_State *L, int idx, size_t *len);
 LUALIB_API int(luaL_argerror)(lua_State *L, int arg, const char *extramsg);
 LUALIB_API int(luaL_typeerror)(lua_State *L, int arg, const char *tname);
 LUALIB_API const char *(luaL_checklstring)(lua_State *L, int arg, size_t *l);
+LUALIB_API const char *(luaL_tolbytes)(lua_State *L, int idx, size_t *len);
+LUALIB_API const char *(luaL_checklbytes)(lua_State *L, int arg, size_t *l);
+LUALIB_API int *(luaL_lbytespins)(lua_State *L, int idx);
+LUALIB_API void(luaL_mapmethods)(lua_State *L);
 LUALIB_API const char *(luaL_optlstring)(lua_State *L, int arg, const char *def,
                                          size_t *l);
 LUALIB_API lua_Number(luaL_checknumber)(lua_State *L, int arg);
@@ -209,6 +219,37 @@ LUALIB_API char *(luaL_buffinitsize)(lua_State *L, luaL_Buffer *B, size_t sz);
 
 /* }====================================================== */
 
+/*
+** {======================================================
+** String buffers: growable byte buffers that live in a userdata
+** (with metatable 'LUA_STRBUFHANDLE'), so they can outlive a C call.
+** The contents are the bytes in [r, w). 'luaL_checklbytes' accepts
+** them in place of strings.
+** =======================================================
+*/
+
+#define LUA_STRBUFHANDLE "STRBUF*"
+
+typedef struct luaL_StrBuf {
+  char *b;     /* buffer address (NULL while nothing was allocated) */
+  size_t size; /* allocated size */
+  size_t r;    /* read position (start of contents) */
+  size_t w;    /* write position (end of contents) */
+  int pins;    /* readers holding 'b' (see 'luaL_lbytespins') */
+} luaL_StrBuf;
+
+#define luaL_strbuflen(sb) ((sb)->w - (sb)->r)
+#define luaL_strbufaddr(sb) ((sb)->b + (sb)->r)
+#define luaL_strbufaddsize(sb, s) ((sb)->w += (s))
+
+LUALIB_API luaL_StrBuf *(luaL_newstrbuf)(lua_State *L, size_t sz);
+LUALIB_API char *(luaL_strbufprep)(lua_State *L, luaL_StrBuf *sb, size_t sz);
+LUALIB_API void(luaL_strbufaddlstring)(lua_State *L, luaL_StrBuf *sb,
+                                       const char *s, size_t l);
+LUALIB_API void(luaL_strbuffree)(lua_State *L, luaL_StrBuf *sb);
+
+/* }====================================================== */
+
 /*
 ** {======================================================
 ** File handles for IO library
@@ -228,6 +269,20 @@ typedef struct luaL_Stream {
   lua_CFunction closef; /* to close stream (NULL for closed streams) */
 } luaL_Stream;
 
+/*
+** A mapped buffer is a read-only userdata with metatable 'LUA_MAPHANDLE'
+** and structure 'luaL_Mapped'. Functions that only read their subject
+** accept it in place of a string through 'luaL_checklbytes'.
+*/
+
+#define LUA_MAPHANDLE "MAPPED*"
+
+typedef struct luaL_Mapped {
+  const char *data; /* mapped bytes (NULL for closed buffers) */
+  size_t len;       /* number of mapped bytes */
+  int pins;         /* readers holding 'data' (see 'luaL_lbytespins') */
+} luaL_Mapped;
+
 /* }====================================================== */
 
 /*
@@ -7,6 +7,7 @@
 #define lcode_c
 #define LUA_CORE
 
+#include <bitset>
 #include <vector>
 #include <stack>
 
@@ -1748,6 +1749,41 @@ void luaK_setlist(FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1; /* free registers with list values */
 }
 
+/*
+** Code a jump table over register 'reg' (see OP_JMPTAB and OP_JMPSTR).
+** Without 'keys', its 'n' entries are selected by the integers from 'lo'
+** up; otherwise, by the strings in 'keys'. Return the position of the
+** first of its n + 1 entries, which are jumps still to be patched; the
+** last one is taken when no other is selected.
+*/
+int luaK_jumptable(FuncState *fs, int reg, lua_Integer lo,
+                   TString *const *keys, int n) {
+  int e;
+  lua_assert(n <= MAXARG_Bx);
+  if (keys == NULL) {
+    luaK_codeABx(fs, OP_JMPTAB, reg, n);
+    codeextraarg(fs, luaK_intK(fs, lo));
+  } else {
+    int t = 0; /* tables are numbered in the order of their OP_JMPSTRs */
+    for (e = 0; e < fs->pc; e++)
+      if (GET_OPCODE(fs->f->code[e]) == OP_JMPSTR) t++;
+    luaK_codeABx(fs, OP_JMPSTR, reg, n);
+    codeextraarg(fs, t);
+    for (e = 0; e < n; e++) codeextraarg(fs, stringK(fs, keys[e]));
+  }
+  for (e = 0; e <= n; e++) luaK_jump(fs);
+  return fs->pc - n - 1;
+}
+
+/*
+** Remove the last instruction coded, which must be a jump not yet
+** linked to any other jump.
+*/
+void luaK_removejump(FuncState *fs) {
+  lua_assert(GET_OPCODE(fs->f->code[fs->pc - 1]) == OP_JMP);
+  removelastinstruction(fs);
+}
+
 /*
 ** return the final target of a jump (skipping jumps to jumps)
 */
@@ -1797,3 +1833,1270 @@ void luaK_finish(FuncState *fs) {
     }
   }
 }
+
+/*
+** {======================================================
+** Optimizer
+** =======================================================
+*/
+
+/*
+** After 'luaK_finish', 'luaK_optimize' rewrites the code of a function as
+** a whole. Level 1 threads jumps into returns and removes unreachable
+** code and jumps to the next instruction; level 2 also copies small
+** local functions into their calls, propagates constants from register
+** to register across basic blocks, folds the tests they decide and
+** removes the stores nothing reads. Registers
+** captured by closures are never assumed to hold a constant, as a call
+** may change them, nor to be dead, as a call may read them. The result
+** is checked by 'optverify'.
+*/
+
+/* what is known about a register: nothing, or its constant value */
+typedef struct RegValue {
+  int known;
+  TValue v;
+} RegValue;
+
+/* whether 'i' starts a jump table (see OP_JMPTAB) */
+#define isjumptable(i) \
+  (GET_OPCODE(i) == OP_JMPTAB || GET_OPCODE(i) == OP_JMPSTR)
+
+/* position of the last entry of the jump table at 'pc' */
+#define jumptablelast(code, pc) \
+  ((pc) + jmptabfirst(code[pc]) + GETARG_Bx(code[pc]))
+
+/*
+** Fill 's' with the positions that may run after the instruction at
+** 'pc' and return how many there are. For a loop preparation, the loop
+** instruction is listed too, so that it is never removed; for a jump
+** table, so are its extra arguments, and for a tail call, the return
+** that must follow it although it never runs.
+*/
+static int optsuccessors(const Instruction *code, int pc,
+                         std::vector<int> &s) {
+  Instruction i = code[pc];
+  s.clear();
+  switch (GET_OPCODE(i)) {
+    case OP_JMP:
+      s.push_back(pc + 1 + GETARG_sJ(i));
+      break;
+    case OP_RETURN:
+    case OP_RETURN0:
+    case OP_RETURN1:
+      break;
+    case OP_LFALSESKIP:
+      s.push_back(pc + 1);
+      s.push_back(pc + 2);
+      break;
+    case OP_FORPREP:
+      s.push_back(pc + 1);
+      s.push_back(pc + GETARG_Bx(i) + 1);
+      s.push_back(pc + GETARG_Bx(i) + 2);
+      break;
+    case OP_FORLOOP:
+    case OP_TFORLOOP:
+      s.push_back(pc + 1);
+      s.push_back(pc + 1 - GETARG_Bx(i));
+      break;
+    case OP_TFORPREP:
+      s.push_back(pc + 1 + GETARG_Bx(i));
+      break;
+    case OP_JMPTAB:
+    case OP_JMPSTR:
+      s.push_back(pc + 1);
+      for (int e = pc + jmptabfirst(i); e <= jumptablelast(code, pc); e++)
+        s.push_back(e);
+      break;
+    default:
+      s.push_back(pc + 1);
+      if (testTMode(GET_OPCODE(i))) s.push_back(pc + 2);
+      break;
+  }
+  return cast_int(s.size());
+}
+
+/* whether the instruction before 'pc' may skip it (a test or OP_LFALSESKIP) */
+static int optskipped(const Instruction *code, int pc) {
+  return pc > 0 && (testTMode(GET_OPCODE(code[pc - 1])) ||
+                    GET_OPCODE(code[pc - 1]) == OP_LFALSESKIP);
+}
+
+/* mark in 'captured' the registers that closures of 'f' capture */
+static void optcaptured(const Proto *f, int n, lu_byte *captured) {
+  for (int pc = 0; pc < n; pc++) {
+    if (GET_OPCODE(f->code[pc]) == OP_CLOSURE) {
+      Proto *p = f->p[GETARG_Bx(f->code[pc])];
+      for (int k = 0; k < p->sizeupvalues; k++)
+        if (p->upvalues[k].instack) captured[p->upvalues[k].idx] = 1;
+    }
+  }
+}
+
+static void optkill(RegValue *r, int from, int to) {
+  for (; from < to; from++) r[from].known = 0;
+}
+
+/* record that register 'a' now holds the value in 'r[a].v' */
+static void optknow(RegValue *r, const lu_byte *captured, int a) {
+  r[a].known = !captured[a];
+}
+
+/*
+** Update what is known about the registers after the instruction at
+** 'pc' runs.
+*/
+static void opttransfer(const Proto *f, int pc, RegValue *r,
+                        const lu_byte *captured, int nregs) {
+  Instruction i = f->code[pc];
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE:
+      r[a] = r[GETARG_B(i)];
+      r[a].known &= !captured[a];
+      break;
+    case OP_LOADI:
+      setivalue(&r[a].v, GETARG_sBx(i));
+      optknow(r, captured, a);
+      break;
+    case OP_LOADF:
+      setfltvalue(&r[a].v, cast_num(GETARG_sBx(i)));
+      optknow(r, captured, a);
+      break;
+    case OP_LOADK:
+      r[a].v = f->k[GETARG_Bx(i)];
+      optknow(r, captured, a);
+      break;
+    case OP_LOADKX:
+      r[a].v = f->k[GETARG_Ax(f->code[pc + 1])];
+      optknow(r, captured, a);
+      break;
+    case OP_LOADFALSE:
+    case OP_LFALSESKIP:
+      setbfvalue(&r[a].v);
+      optknow(r, captured, a);
+      break;
+    case OP_LOADTRUE:
+      setbtvalue(&r[a].v);
+      optknow(r, captured, a);
+      break;
+    case OP_LOADNIL: {
+      int b = GETARG_B(i);
+      for (; b >= 0; b--, a++) {
+        setnilvalue(&r[a].v);
+        optknow(r, captured, a);
+      }
+      break;
+    }
+    case OP_CALL:
+    case OP_TAILCALL:
+    case OP_VARARG:
+    case OP_TFORCALL:
+      optkill(r, a, nregs);
+      break;
+    case OP_SELF:
+      optkill(r, a, a + 2);
+      break;
+    case OP_CONCAT:
+      optkill(r, a, a + GETARG_B(i));
+      break;
+    case OP_FORPREP:
+    case OP_FORLOOP:
+      optkill(r, a, a + 4);
+      break;
+    case OP_TFORPREP:
+    case OP_TFORLOOP:
+      optkill(r, a, a + 5);
+      break;
+    default:
+      if (testAMode(GET_OPCODE(i))) r[a].known = 0;
+      break;
+  }
+}
+
+/*
+** Compare two known numbers of the same variant: 'lt' selects '<' or
+** '<=', and 'swap' exchanges the operands. Return 0 when they cannot be
+** compared here.
+*/
+static int optnumcompare(const TValue *v, const TValue *w, int lt, int swap,
+                         int *res) {
+  if (swap) {
+    const TValue *t = v;
+    v = w;
+    w = t;
+  }
+  if (ttisinteger(v) && ttisinteger(w))
+    *res = lt ? ivalue(v) < ivalue(w) : ivalue(v) <= ivalue(w);
+  else if (ttisfloat(v) && ttisfloat(w))
+    *res = lt ? luai_numlt(fltvalue(v), fltvalue(w))
+              : luai_numle(fltvalue(v), fltvalue(w));
+  else
+    return 0;
+  return 1;
+}
+
+/*
+** Decide the test at 'pc' from what is known about the registers:
+** return 1 if it always takes the jump that follows it, 0 if it always
+** skips it, and -1 if that depends on the run.
+*/
+static int optfoldtest(const Proto *f, int pc, const RegValue *r) {
+  Instruction i = f->code[pc];
+  const RegValue *ra = &r[GETARG_A(i)];
+  TValue imm;
+  int cond;
+  if (!ra->known) return -1;
+  switch (GET_OPCODE(i)) {
+    case OP_TEST:
+      cond = !l_isfalse(&ra->v);
+      break;
+    case OP_EQ:
+      if (!r[GETARG_B(i)].known) return -1;
+      cond = luaV_rawequalobj(&ra->v, &r[GETARG_B(i)].v);
+      break;
+    case OP_LT:
+    case OP_LE:
+      if (!r[GETARG_B(i)].known ||
+          !optnumcompare(&ra->v, &r[GETARG_B(i)].v, GET_OPCODE(i) == OP_LT, 0,
+                         &cond))
+        return -1;
+      break;
+    case OP_EQK:
+      cond = luaV_rawequalobj(&ra->v, &f->k[GETARG_B(i)]);
+      break;
+    case OP_EQI:
+    case OP_LTI:
+    case OP_LEI:
+    case OP_GTI:
+    case OP_GEI: {
+      OpCode op = GET_OPCODE(i);
+      if (ttisfloat(&ra->v)) {
+        setfltvalue(&imm, cast_num(GETARG_sB(i)));
+      } else {
+        setivalue(&imm, GETARG_sB(i));
+      }
+      if (op == OP_EQI)
+        cond = luaV_rawequalobj(&ra->v, &imm);
+      else if (!optnumcompare(&ra->v, &imm, op == OP_LTI || op == OP_GTI,
+                              op == OP_GTI || op == OP_GEI, &cond))
+        return -1;
+      break;
+    }
+    default:
+      return -1;
+  }
+  /* the test skips its jump when 'cond' differs from 'k' */
+  return cond == GETARG_k(i);
+}
+
+/*
+** Constant propagation over the basic blocks of 'f' and folding of the
+** tests whose outcome it decides. A test always taken becomes a jump to
+** the target of the jump that follows it; a test never taken becomes a
+** jump over it, which dead code removal then deletes.
+*/
+static void optconstants(FuncState *fs) {
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int n = fs->pc;
+  int nregs = f->maxstacksize;
+  int k, pc, b;
+  std::vector<int> s;
+  std::vector<lu_byte> captured(nregs + 1, 0);
+  std::vector<int> block(n + 1, -1);
+  std::vector<int> leaders;
+  optcaptured(f, n, captured.data());
+  /* basic blocks start at the entry and at every branch destination */
+  block[0] = 0;
+  leaders.push_back(0);
+  for (pc = 0; pc < n; pc++) {
+    int ns = optsuccessors(code, pc, s);
+    if (ns == 1 && s[0] == pc + 1) continue;
+    for (k = 0; k < ns; k++) {
+      lua_assert(0 <= s[k] && s[k] <= n);
+      if (s[k] < n && block[s[k]] < 0) {
+        block[s[k]] = cast_int(leaders.size());
+        leaders.push_back(s[k]);
+      }
+    }
+  }
+  int nblocks = cast_int(leaders.size());
+  std::vector<RegValue> in(cast_sizet(nblocks) * (nregs + 1));
+  std::vector<RegValue> cur(nregs + 1);
+  std::vector<lu_byte> seen(nblocks, 0);
+  std::vector<int> work;
+  std::vector<int> fold(n, -2); /* -2: not reached */
+  seen[0] = 1;
+  for (k = 0; k < nregs; k++) in[k].known = 0;
+  work.push_back(0);
+  while (!work.empty()) {
+    b = work.back();
+    work.pop_back();
+    std::copy(in.begin() + cast_sizet(b) * (nregs + 1),
+              in.begin() + cast_sizet(b + 1) * (nregs + 1), cur.begin());
+    for (pc = leaders[b];; pc++) {
+      int ns = optsuccessors(code, pc, s);
+      opttransfer(f, pc, cur.data(), captured.data(), nregs);
+      if (ns == 1 && s[0] == pc + 1 && block[pc + 1] < 0) continue;
+      for (k = 0; k < ns; k++) {
+        int t;
+        RegValue *r;
+        if (s[k] >= n) continue;
+        t = block[s[k]];
+        r = &in[cast_sizet(t) * (nregs + 1)];
+        if (!seen[t]) {
+          std::copy(cur.begin(), cur.end(), r);
+          seen[t] = 1;
+          work.push_back(t);
+        } else {
+          int changed = 0;
+          for (int j = 0; j < nregs; j++) {
+            if (r[j].known &&
+                !(cur[j].known && ttypetag(&r[j].v) == ttypetag(&cur[j].v) &&
+                  luaV_rawequalobj(&r[j].v, &cur[j].v))) {
+              r[j].known = 0;
+              changed = 1;
+            }
+          }
+          if (changed) work.push_back(t);
+        }
+      }
+      break;
+    }
+  }
+  /* with the final states, decide the tests */
+  for (b = 0; b < nblocks; b++) {
+    if (!seen[b]) continue;
+    std::copy(in.begin() + cast_sizet(b) * (nregs + 1),
+              in.begin() + cast_sizet(b + 1) * (nregs + 1), cur.begin());
+    for (pc = leaders[b];; pc++) {
+      int ns = optsuccessors(code, pc, s);
+      if (testTMode(GET_OPCODE(code[pc])))
+        fold[pc] = optfoldtest(f, pc, cur.data());
+      opttransfer(f, pc, cur.data(), captured.data(), nregs);
+      if (ns == 1 && s[0] == pc + 1 && block[pc + 1] < 0) continue;
+      break;
+    }
+  }
+  for (pc = 0; pc < n; pc++) {
+    if (fold[pc] < 0) continue;
+    lua_assert(GET_OPCODE(code[pc + 1]) == OP_JMP);
+    int sj = fold[pc] ? GETARG_sJ(code[pc + 1]) + 1 /* always taken */
+                      : 1;                          /* never taken */
+    code[pc] = CREATE_sJ(OP_JMP, sj + OFFSET_sJ, 0);
+  }
+}
+
+/*
+** Decode the line of every instruction of 'f' before its code moves
+*/
+static void optgetlines(FuncState *fs, std::vector<int> &lines) {
+  Proto *f = fs->f;
+  int line = f->linedefined;
+  int a = 0;
+  for (int pc = 0; pc < fs->pc; pc++) {
+    if (f->lineinfo[pc] != ABSLINEINFO)
+      line += f->lineinfo[pc];
+    else {
+      lua_assert(a < fs->nabslineinfo && f->abslineinfo[a].pc == pc);
+      line = f->abslineinfo[a++].line;
+    }
+    lines[pc] = line;
+  }
+}
+
+/*
+** Rebuild the code of 'fs' without the instructions not marked in
+** 'keep' and, when 'with' is given, with every instruction that has a
+** non-empty entry there replaced by that sequence, whose jumps are
+** relative to itself and whose lines are those of the instruction it
+** replaces. Jump offsets, line information and the ranges of local
+** variables follow the instructions they belong to.
+*/
+static void optrewrite(FuncState *fs, const std::vector<lu_byte> &keep,
+                       const std::vector<std::vector<Instruction>> *with) {
+  Proto *f = fs->f;
+  lua_State *L = fs->ls->L;
+  int n = fs->pc;
+  int pc, np = 0;
+  int previousline = f->linedefined, iwthabs = 0;
+  std::vector<Instruction> code(f->code, f->code + n);
+  std::vector<int> lines(n);
+  std::vector<int> nmap(n + 1); /* new position of each old position */
+  optgetlines(fs, lines);
+  for (pc = 0; pc < n; pc++) {
+    nmap[pc] = np;
+    if (keep[pc])
+      np += (with && !(*with)[pc].empty()) ? cast_int((*with)[pc].size()) : 1;
+  }
+  nmap[n] = np;
+  if (np > f->sizecode) {
+    f->code = luaM_reallocvector(L, f->code, f->sizecode, np, Instruction);
+    f->sizecode = np;
+  }
+  if (np > f->sizelineinfo) {
+    f->lineinfo = luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, np,
+                                     ls_byte);
+    f->sizelineinfo = np;
+  }
+  fs->nabslineinfo = 0;
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    const Instruction *seq = &i;
+    int p = nmap[pc];
+    int len = 1;
+    if (!keep[pc]) continue;
+    if (with && !(*with)[pc].empty()) {
+      seq = (*with)[pc].data();
+      len = cast_int((*with)[pc].size());
+    } else {
+      switch (GET_OPCODE(i)) {
+        case OP_JMP:
+          SETARG_sJ(i, nmap[pc + 1 + GETARG_sJ(i)] - p - 1);
+          break;
+        case OP_FORPREP:
+          SETARG_Bx(i, nmap[pc + GETARG_Bx(i) + 2] - p - 2);
+          break;
+        case OP_FORLOOP:
+        case OP_TFORLOOP:
+          SETARG_Bx(i, p + 1 - nmap[pc + 1 - GETARG_Bx(i)]);
+          break;
+        case OP_TFORPREP:
+          SETARG_Bx(i, nmap[pc + 1 + GETARG_Bx(i)] - p - 1);
+          break;
+        default:
+          break;
+      }
+    }
+    for (int k = 0; k < len; k++, p++) {
+      /* same encoding as 'savelineinfo' */
+      int linedif = lines[pc] - previousline;
+      f->code[p] = seq[k];
+      if (abs(linedif) >= LIMLINEDIFF || iwthabs++ >= MAXIWTHABS) {
+        luaM_growvector(L, f->abslineinfo, fs->nabslineinfo,
+                        f->sizeabslineinfo, AbsLineInfo, MAX_INT, "lines");
+        f->abslineinfo[fs->nabslineinfo].pc = p;
+        f->abslineinfo[fs->nabslineinfo++].line = lines[pc];
+        linedif = ABSLINEINFO;
+        iwthabs = 1;
+      }
+      f->lineinfo[p] = linedif;
+      previousline = lines[pc];
+    }
+  }
+  for (pc = 0; pc < fs->ndebugvars; pc++) {
+    LocVar *v = &f->locvars[pc];
+    v->startpc = nmap[v->startpc];
+    v->endpc = nmap[v->endpc];
+  }
+  fs->pc = np;
+  fs->previousline = previousline;
+  fs->iwthabs = iwthabs;
+}
+
+/*
+** Remove the instructions not marked in 'keep', moving the others
+** down.
+*/
+static void optcompact(FuncState *fs, const std::vector<lu_byte> &keep) {
+  optrewrite(fs, keep, NULL);
+}
+
+/*
+** Point jumps at their final destination and replace the unconditional
+** ones that land on a return with a copy of that return. The entries
+** of a jump table must stay jumps.
+*/
+static void optthread(FuncState *fs) {
+  Instruction *code = fs->f->code;
+  for (int pc = 0; pc < fs->pc; pc++) {
+    if (isjumptable(code[pc])) {
+      int last = jumptablelast(code, pc);
+      for (pc += jmptabfirst(code[pc]); pc <= last; pc++)
+        fixjump(fs, pc, finaltarget(code, pc));
+      pc = last;
+      continue;
+    }
+    if (GET_OPCODE(code[pc]) != OP_JMP) continue;
+    int target = finaltarget(code, pc);
+    Instruction ret = code[target];
+    if (!optskipped(code, pc) &&
+        (GET_OPCODE(ret) == OP_RETURN0 || GET_OPCODE(ret) == OP_RETURN1 ||
+         (GET_OPCODE(ret) == OP_RETURN && GETARG_B(ret) != 0)))
+      code[pc] = ret;
+    else
+      fixjump(fs, pc, target);
+  }
+}
+
+/*
+** Remove the instructions that cannot run and the unconditional jumps
+** to the instruction that follows them, until there is nothing left to
+** remove.
+*/
+static void optdeadcode(FuncState *fs) {
+  Instruction *code = fs->f->code;
+  int n = fs->pc;
+  int k, pc;
+  std::vector<int> s;
+  std::vector<lu_byte> keep(n, 0);
+  std::vector<int> work(1, 0);
+  std::vector<int> next(n + 1);
+  keep[0] = 1;
+  while (!work.empty()) {
+    pc = work.back();
+    work.pop_back();
+    int ns = optsuccessors(code, pc, s);
+    for (k = 0; k < ns; k++) {
+      lua_assert(0 <= s[k] && s[k] <= n);
+      if (s[k] < n && !keep[s[k]]) {
+        keep[s[k]] = 1;
+        work.push_back(s[k]);
+      }
+    }
+  }
+  for (int changed = 1; changed;) {
+    changed = 0;
+    next[n] = n; /* first kept position at or after each position */
+    for (pc = n - 1; pc >= 0; pc--) next[pc] = keep[pc] ? pc : next[pc + 1];
+    for (pc = 0; pc < n; pc++) {
+      if (keep[pc] && isjumptable(code[pc])) {
+        pc = jumptablelast(code, pc); /* its entries must stay */
+        continue;
+      }
+      if (!keep[pc] || GET_OPCODE(code[pc]) != OP_JMP) continue;
+      if (pc > 0 && keep[pc - 1] && optskipped(code, pc)) continue;
+      if (next[pc + 1 + GETARG_sJ(code[pc])] == next[pc + 1]) {
+        keep[pc] = 0;
+        changed = 1;
+      }
+    }
+  }
+  optcompact(fs, keep);
+}
+
+/* a set of registers */
+typedef std::bitset<MAXREGS + 1> RegSet;
+
+static void optrange(RegSet &r, int from, int to) {
+  for (; from <= to && from <= MAXREGS; from++) r.set(from);
+}
+
+/*
+** Fill 'use' with the registers that the instruction 'i' reads and
+** 'def' with those it always writes. Return 0 when they are not known
+** (e.g., the instruction reads up to the top); the instruction must
+** then be taken to read every register.
+*/
+static int optregs(Instruction i, RegSet &use, RegSet &def) {
+  int a = GETARG_A(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  use.reset();
+  def.reset();
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE:
+      use.set(b);
+      def.set(a);
+      break;
+    case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADKX:
+    case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE:
+    case OP_GETUPVAL: case OP_GETTABUP: case OP_NEWTABLE:
+    case OP_CLOSURE:
+      def.set(a);
+      break;
+    case OP_LOADNIL:
+      optrange(def, a, a + b);
+      break;
+    case OP_SETUPVAL: case OP_MMBINI: case OP_MMBINK:
+    case OP_EQK: case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI:
+    case OP_GEI: case OP_TEST: case OP_TBC: case OP_DEFER:
+    case OP_JMPTAB: case OP_JMPSTR: case OP_RETURN1:
+      use.set(a);
+      break;
+    case OP_GETTABLE:
+      use.set(b);
+      use.set(c);
+      def.set(a);
+      break;
+    case OP_GETI: case OP_GETFIELD: case OP_ADDI: case OP_ADDK:
+    case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK: case OP_DIVK:
+    case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK:
+    case OP_SHRI: case OP_SHLI: case OP_UNM: case OP_BNOT: case OP_NOT:
+    case OP_LEN:
+      use.set(b);
+      def.set(a);
+      break;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW:
+    case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR:
+    case OP_SHL: case OP_SHR:
+      use.set(b);
+      use.set(c);
+      def.set(a);
+      break;
+    case OP_SETTABUP:
+      if (!GETARG_k(i)) use.set(c);
+      break;
+    case OP_SETTABLE:
+      use.set(b);
+      /* FALLTHROUGH */
+    case OP_SETI:
+    case OP_SETFIELD:
+      use.set(a);
+      if (!GETARG_k(i)) use.set(c);
+      break;
+    case OP_SELF:
+      use.set(b);
+      if (!GETARG_k(i)) use.set(c);
+      def.set(a);
+      def.set(a + 1);
+      break;
+    case OP_MMBIN: case OP_EQ: case OP_LT: case OP_LE:
+      use.set(a);
+      use.set(b);
+      break;
+    case OP_TESTSET: /* writes 'a' only when it does not jump */
+      use.set(b);
+      break;
+    case OP_CONCAT:
+      optrange(use, a, a + b - 1);
+      def.set(a);
+      break;
+    case OP_CLOSE: /* its closing methods may read any of them */
+      optrange(use, a, MAXREGS);
+      break;
+    case OP_CALL:
+      if (b == 0) return 0;
+      optrange(use, a, a + b - 1);
+      optrange(def, a, a + c - 2);
+      break;
+    case OP_RETURN:
+      if (b == 0) return 0;
+      optrange(use, a, a + b - 2);
+      break;
+    case OP_FORPREP: case OP_FORLOOP:
+      optrange(use, a, a + 3);
+      break;
+    case OP_TFORPREP: case OP_TFORLOOP:
+      optrange(use, a, a + 4);
+      break;
+    case OP_TFORCALL:
+      optrange(use, a, a + 3);
+      optrange(def, a + 4, a + 3 + c);
+      break;
+    case OP_SETLIST:
+      if (b == 0) return 0;
+      optrange(use, a, a + b);
+      break;
+    case OP_VARARG:
+      optrange(def, a, a + c - 2);
+      break;
+    case OP_JMP: case OP_RETURN0: case OP_VARARGPREP: case OP_EXTRAARG:
+      break;
+    default:
+      return 0;
+  }
+  return 1;
+}
+
+/*
+** Fill 'w' with every register that the instruction 'i' may write,
+** including those it writes only on some runs or leaves garbage in.
+*/
+static void optwrites(Instruction i, RegSet &w) {
+  RegSet use;
+  int a = GETARG_A(i);
+  if (!optregs(i, use, w)) {
+    optrange(w, a, MAXREGS);
+    return;
+  }
+  switch (GET_OPCODE(i)) {
+    case OP_CALL: case OP_TFORCALL: case OP_VARARG:
+      optrange(w, a, MAXREGS); /* the frame of the callee lies above 'a' */
+      break;
+    case OP_CONCAT:
+      optrange(w, a, a + GETARG_B(i) - 1);
+      break;
+    case OP_TESTSET:
+      w.set(a);
+      break;
+    case OP_FORPREP: case OP_FORLOOP:
+      optrange(w, a, a + 3);
+      break;
+    case OP_TFORPREP: case OP_TFORLOOP:
+      optrange(w, a, a + 4);
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+** Remove the loads, moves and closures into registers that no path
+** reads before writing them again. Return whether anything was removed.
+*/
+static int optdeadstores(FuncState *fs) {
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int n = fs->pc;
+  int pc, k, changed, removed = 0;
+  std::vector<int> s;
+  std::vector<lu_byte> captured(MAXREGS + 1, 0);
+  std::vector<lu_byte> known(n), keep(n, 1);
+  std::vector<RegSet> use(n), def(n), live(n); /* live: before each pc */
+  RegSet out;
+  optcaptured(f, n, captured.data());
+  for (pc = 0; pc < n; pc++) {
+    known[pc] = cast_byte(optregs(code[pc], use[pc], def[pc]));
+    if (!known[pc]) live[pc].set();
+  }
+  do {
+    changed = 0;
+    for (pc = n - 1; pc >= 0; pc--) {
+      if (!known[pc]) continue;
+      int ns = optsuccessors(code, pc, s);
+      out.reset();
+      for (k = 0; k < ns; k++)
+        if (s[k] < n) out |= live[s[k]];
+      out = use[pc] | (out & ~def[pc]);
+      if (out != live[pc]) {
+        live[pc] = out;
+        changed = 1;
+      }
+    }
+  } while (changed);
+  for (pc = 0; pc < n; pc++) {
+    switch (GET_OPCODE(code[pc])) {
+      case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+      case OP_LOADFALSE: case OP_LOADTRUE: case OP_LOADNIL:
+      case OP_GETUPVAL: case OP_CLOSURE:
+        break;
+      default:
+        continue;
+    }
+    if (optskipped(code, pc)) continue; /* would shift what is skipped */
+    int ns = optsuccessors(code, pc, s);
+    out.reset();
+    for (k = 0; k < ns; k++)
+      if (s[k] < n) out |= live[s[k]];
+    for (k = 0; k <= MAXREGS; k++)
+      if (def[pc][k] && (out[k] || captured[k])) break;
+    if (k > MAXREGS) {
+      keep[pc] = 0;
+      removed = 1;
+    }
+  }
+  if (removed) optcompact(fs, keep);
+  return removed;
+}
+
+/* largest function, in instructions, that 'optinline' copies */
+#define INLINEMAX 32
+
+/* index in the constants of 'fs' of the constant 'v' of another function */
+static int optinlinek(FuncState *fs, const TValue *v) {
+  switch (ttypetag(v)) {
+    case LUA_VNUMINT: return luaK_intK(fs, ivalue(v));
+    case LUA_VNUMFLT: return luaK_numberK(fs, fltvalue(v));
+    case LUA_VFALSE: return boolF(fs);
+    case LUA_VTRUE: return boolT(fs);
+    case LUA_VNIL: return nilK(fs);
+    default:
+      lua_assert(ttisstring(v));
+      return stringK(fs, tsvalue(v));
+  }
+}
+
+/*
+** Translate the instruction 'i' of 'p', run with its registers from
+** 'base' in 'fs', into 'out'. Upvalues of 'p' become the upvalues or
+** registers of 'fs' they refer to. Return 0 when 'i' needs a frame of
+** its own or an operand does not fit.
+*/
+static int optinlineins(FuncState *fs, const Proto *p, int base,
+                        int maxreg, Instruction i, Instruction *out) {
+  int a = GETARG_A(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  int k;
+  const Upvaldesc *up;
+#define reg(r) ((r) + base)
+#define setk(set, x, limit) \
+  if ((k = optinlinek(fs, &p->k[x])) > (limit)) return 0; \
+  set(i, k)
+#define setrk(x) \
+  if (GETARG_k(i)) { setk(SETARG_C, x, MAXARG_C); } else SETARG_C(i, reg(x))
+  switch (GET_OPCODE(i)) {
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR:
+      SETARG_C(i, reg(c));
+      /* FALLTHROUGH */
+    case OP_MOVE: case OP_GETI: case OP_ADDI: case OP_SHRI: case OP_SHLI:
+    case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN: case OP_MMBIN:
+    case OP_EQ: case OP_LT: case OP_LE: case OP_TESTSET:
+      SETARG_A(i, reg(a));
+      SETARG_B(i, reg(b));
+      break;
+    case OP_LOADI: case OP_LOADF: case OP_LOADFALSE: case OP_LFALSESKIP:
+    case OP_LOADTRUE: case OP_LOADNIL: case OP_NEWTABLE: case OP_MMBINI:
+    case OP_CONCAT: case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI:
+    case OP_GEI: case OP_TEST: case OP_CALL: case OP_FORPREP:
+    case OP_FORLOOP:
+      SETARG_A(i, reg(a));
+      break;
+    case OP_SETLIST:
+      if (GETARG_k(i)) return 0; /* has an extra argument */
+      SETARG_A(i, reg(a));
+      break;
+    case OP_LOADK:
+      SETARG_A(i, reg(a));
+      setk(SETARG_Bx, GETARG_Bx(i), MAXARG_Bx);
+      break;
+    case OP_GETFIELD: case OP_ADDK: case OP_SUBK: case OP_MULK:
+    case OP_MODK: case OP_POWK: case OP_DIVK: case OP_IDIVK: case OP_BANDK:
+    case OP_BORK: case OP_BXORK:
+      SETARG_A(i, reg(a));
+      SETARG_B(i, reg(b));
+      setk(SETARG_C, c, MAXARG_C);
+      break;
+    case OP_MMBINK: case OP_EQK:
+      SETARG_A(i, reg(a));
+      setk(SETARG_B, b, MAXARG_B);
+      break;
+    case OP_SETTABLE:
+      SETARG_B(i, reg(b));
+      /* FALLTHROUGH */
+    case OP_SETI:
+      SETARG_A(i, reg(a));
+      setrk(c);
+      break;
+    case OP_SETFIELD:
+      SETARG_A(i, reg(a));
+      setk(SETARG_B, b, MAXARG_B);
+      setrk(c);
+      break;
+    case OP_SELF:
+      SETARG_A(i, reg(a));
+      SETARG_B(i, reg(b));
+      setrk(c);
+      break;
+    case OP_GETUPVAL:
+      up = &p->upvalues[b];
+      if (up->instack && up->idx > maxreg) return 0;
+      i = up->instack ? CREATE_ABCk(OP_MOVE, reg(a), up->idx, 0, 0)
+                      : CREATE_ABCk(OP_GETUPVAL, reg(a), up->idx, 0, 0);
+      break;
+    case OP_SETUPVAL:
+      up = &p->upvalues[b];
+      if (up->instack && up->idx > maxreg) return 0;
+      i = up->instack ? CREATE_ABCk(OP_MOVE, up->idx, reg(a), 0, 0)
+                      : CREATE_ABCk(OP_SETUPVAL, reg(a), up->idx, 0, 0);
+      break;
+    case OP_GETTABUP:
+      up = &p->upvalues[b];
+      if (up->instack && up->idx > maxreg) return 0;
+      i = CREATE_ABCk(up->instack ? OP_GETFIELD : OP_GETTABUP, reg(a),
+                      up->idx, 0, 0);
+      setk(SETARG_C, c, MAXARG_C);
+      break;
+    case OP_SETTABUP:
+      up = &p->upvalues[a];
+      if (up->instack && up->idx > maxreg) return 0;
+      SET_OPCODE(i, up->instack ? OP_SETFIELD : OP_SETTABUP);
+      SETARG_A(i, up->idx);
+      setk(SETARG_B, b, MAXARG_B);
+      setrk(c);
+      break;
+    case OP_JMP: case OP_EXTRAARG: /* jumps stay within the copy */
+      break;
+    default: /* closures, returns, varargs, to-be-closed variables... */
+      return 0;
+  }
+#undef reg
+#undef setk
+#undef setrk
+  *out = i;
+  return 1;
+}
+
+/*
+** Fill 'out' with the code that replaces the instruction 'call', a call
+** to a closure of 'p': the code of 'p' with its registers moved above
+** the called function, and its return turned into moves of the results
+** into place. Return 0 when 'p' is not small, has more than one return
+** or needs a frame of its own.
+*/
+static int optinlinebody(FuncState *fs, const Proto *p, Instruction call,
+                         std::vector<Instruction> &out) {
+  int func = GETARG_A(call), base = func + 1;
+  int nargs = GETARG_B(call) - 1, nresults = GETARG_C(call) - 1;
+  int last = p->sizecode - 1;
+  int first, nret, k;
+  Instruction ret = p->code[last];
+  out.clear();
+  if (p->is_vararg || p->sizecode > INLINEMAX ||
+      base + p->maxstacksize >= MAXREGS || optskipped(p->code, last))
+    return 0;
+  switch (GET_OPCODE(ret)) {
+    case OP_RETURN0:
+      nret = 0;
+      break;
+    case OP_RETURN1:
+      nret = 1;
+      break;
+    case OP_RETURN:
+      if (GETARG_B(ret) == 0 || GETARG_k(ret)) return 0;
+      nret = GETARG_B(ret) - 1;
+      break;
+    default:
+      return 0;
+  }
+  first = GETARG_A(ret) + base; /* first result, after the move */
+  if (nargs < p->numparams)
+    out.push_back(CREATE_ABCk(OP_LOADNIL, base + nargs,
+                              p->numparams - nargs - 1, 0, 0));
+  for (int pc = 0; pc < last; pc++) {
+    Instruction i;
+    if (!optinlineins(fs, p, base, func - 1, p->code[pc], &i)) return 0;
+    out.push_back(i);
+  }
+  /* each result moves down, below the sources of the next ones */
+  for (k = 0; k < nresults && k < nret; k++)
+    out.push_back(CREATE_ABCk(OP_MOVE, func + k, first + k, 0, 0));
+  if (k < nresults)
+    out.push_back(CREATE_ABCk(OP_LOADNIL, func + k, nresults - k - 1, 0, 0));
+  return 1;
+}
+
+/*
+** Replace the calls to small local functions by a copy of their code
+** (see 'optinlinebody'). The call must pass and want fixed numbers of
+** values, and the function must come straight from a register that is
+** no parameter, that no closure captures and that only one closure
+** instruction writes, so that it holds a closure of the same prototype
+** whenever the call runs. Errors in the copy report the line of the
+** call, and tracebacks lose the frame of the function.
+*/
+static void optinline(FuncState *fs) {
+  Proto *f = fs->f;
+  const Instruction *code = f->code;
+  int n = fs->pc;
+  int pc, j, k, changed = 0;
+  std::vector<int> s;
+  std::vector<int> writers(MAXREGS + 1, 0), closure(MAXREGS + 1, -1);
+  std::vector<lu_byte> captured(MAXREGS + 1, 0), target(n + 1, 0);
+  std::vector<lu_byte> keep(n, 1);
+  std::vector<std::vector<Instruction>> with(n);
+  RegSet w;
+  optcaptured(f, n, captured.data());
+  for (pc = 0; pc < n; pc++) {
+    int ns = optsuccessors(code, pc, s);
+    for (k = 0; k < ns; k++)
+      if (s[k] != pc + 1) target[s[k]] = 1;
+    optwrites(code[pc], w);
+    for (k = 0; k <= MAXREGS; k++) writers[k] += w[k];
+    if (GET_OPCODE(code[pc]) == OP_CLOSURE)
+      closure[GETARG_A(code[pc])] = GETARG_Bx(code[pc]);
+  }
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    int func = GETARG_A(i);
+    if (GET_OPCODE(i) != OP_CALL || GETARG_B(i) == 0 || GETARG_C(i) == 0)
+      continue;
+    /* find the instruction that sets the function on every path */
+    for (j = pc; j > 0 && !target[j]; j--) {
+      optwrites(code[j - 1], w);
+      if (w[func]) break;
+    }
+    if (j == 0 || target[j] || GET_OPCODE(code[j - 1]) != OP_MOVE) continue;
+    int a = GETARG_B(code[j - 1]);
+    if (a >= func || a < f->numparams || captured[a] || writers[a] != 1 ||
+        closure[a] < 0)
+      continue;
+    Proto *p = f->p[closure[a]];
+    if (!optinlinebody(fs, p, i, with[pc])) {
+      with[pc].clear();
+      continue;
+    }
+    if (with[pc].empty()) keep[pc] = 0; /* nothing to do */
+    if (func + 1 + p->maxstacksize > f->maxstacksize)
+      f->maxstacksize = cast_byte(func + 1 + p->maxstacksize);
+    changed = 1;
+  }
+  if (changed) optrewrite(fs, keep, &with);
+}
+
+/*
+** Check the code of 'fs' as the virtual machine relies on it: operands
+** within the registers, constants, upvalues and prototypes of the
+** function, every jump and fall-through landing on an instruction, the
+** instructions that must follow tests, arithmetic and jump tables in
+** place, and the ranges of local variables. Return NULL if the code is
+** sound, else what is wrong, with its position in '*where'.
+*/
+static const char *optverify(FuncState *fs, int *where) {
+  Proto *f = fs->f;
+  const Instruction *code = f->code;
+  int n = fs->pc;
+  int nregs = f->maxstacksize;
+  int njmpstr = 0;
+  int pc, k;
+  std::vector<int> s;
+#define checkreg(r) if ((r) >= nregs) return "register out of range"
+#define checkk(x) if ((x) >= fs->nk) return "constant out of range"
+#define checkrk(x) \
+  if (GETARG_k(i)) { checkk(x); } else { checkreg(x); }
+#define checkextra(p) \
+  if ((p) >= n || GET_OPCODE(code[p]) != OP_EXTRAARG) \
+    return "missing extra argument"
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    OpCode op = GET_OPCODE(i);
+    int a = GETARG_A(i);
+    int b = GETARG_B(i);
+    int c = GETARG_C(i);
+    *where = pc;
+    if (op >= NUM_OPCODES) return "invalid opcode";
+    if (pc > 0 && testTMode(GET_OPCODE(code[pc - 1])) && op != OP_JMP)
+      return "test not followed by a jump";
+    if (pc > 0 && isOT(code[pc - 1]) != isIT(i))
+      return "unmatched use of the stack top";
+    switch (op) {
+      case OP_MOVE:
+        checkreg(a);
+        checkreg(b);
+        break;
+      case OP_LOADK:
+        checkreg(a);
+        checkk(GETARG_Bx(i));
+        break;
+      case OP_LOADKX:
+        checkreg(a);
+        checkextra(pc + 1);
+        checkk(GETARG_Ax(code[pc + 1]));
+        pc++;
+        break;
+      case OP_LOADNIL:
+        checkreg(a + b);
+        break;
+      case OP_GETUPVAL:
+      case OP_SETUPVAL:
+        checkreg(a);
+        if (b >= fs->nups) return "upvalue out of range";
+        break;
+      case OP_GETTABUP:
+        checkreg(a);
+        if (b >= fs->nups) return "upvalue out of range";
+        checkk(c);
+        break;
+      case OP_GETTABLE:
+        checkreg(c);
+        /* FALLTHROUGH */
+      case OP_GETI:
+        checkreg(a);
+        checkreg(b);
+        break;
+      case OP_GETFIELD:
+        checkreg(a);
+        checkreg(b);
+        checkk(c);
+        break;
+      case OP_SETTABUP:
+        if (a >= fs->nups) return "upvalue out of range";
+        checkk(b);
+        checkrk(c);
+        break;
+      case OP_SETTABLE:
+        checkreg(b);
+        /* FALLTHROUGH */
+      case OP_SETI:
+        checkreg(a);
+        checkrk(c);
+        break;
+      case OP_SETFIELD:
+        checkreg(a);
+        checkk(b);
+        checkrk(c);
+        break;
+      case OP_NEWTABLE:
+        checkreg(a);
+        checkextra(pc + 1);
+        pc++;
+        break;
+      case OP_SELF:
+        checkreg(a + 1);
+        checkreg(b);
+        checkrk(c);
+        break;
+      case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK:
+      case OP_DIVK: case OP_IDIVK: case OP_BANDK: case OP_BORK:
+      case OP_BXORK:
+        checkk(c);
+        /* FALLTHROUGH */
+      case OP_ADDI: case OP_SHRI: case OP_SHLI:
+        checkreg(a);
+        checkreg(b);
+        if (pc + 1 >= n || !testMMMode(GET_OPCODE(code[pc + 1])))
+          return "arithmetic without its metamethod call";
+        break;
+      case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW:
+      case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR:
+      case OP_SHL: case OP_SHR:
+        checkreg(a);
+        checkreg(b);
+        checkreg(c);
+        if (pc + 1 >= n || !testMMMode(GET_OPCODE(code[pc + 1])))
+          return "arithmetic without its metamethod call";
+        break;
+      case OP_MMBIN: case OP_MMBINI: case OP_MMBINK:
+        checkreg(a);
+        if (op == OP_MMBIN) checkreg(b);
+        if (op == OP_MMBINK) checkk(b);
+        if (pc == 0 || GET_OPCODE(code[pc - 1]) < OP_ADDI ||
+            GET_OPCODE(code[pc - 1]) > OP_SHR)
+          return "metamethod call without its arithmetic";
+        break;
+      case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+      case OP_EQ: case OP_LT: case OP_LE: case OP_TESTSET:
+        checkreg(a);
+        checkreg(b);
+        break;
+      case OP_CONCAT:
+        checkreg(a + b - 1);
+        break;
+      case OP_EQK:
+        checkreg(a);
+        checkk(b);
+        break;
+      case OP_JMPTAB:
+      case OP_JMPSTR: {
+        int last = jumptablelast(code, pc);
+        checkreg(a);
+        checkextra(pc + 1);
+        if (last >= n) return "jump table beyond the end of the code";
+        if (op == OP_JMPTAB) {
+          checkk(GETARG_Ax(code[pc + 1]));
+        } else if (GETARG_Ax(code[pc + 1]) != njmpstr++)
+          return "jump table out of order";
+        for (k = pc + 2; k < pc + jmptabfirst(i); k++) {
+          checkextra(k);
+          checkk(GETARG_Ax(code[k]));
+        }
+        for (; k <= last; k++) {
+          int target = k + 1 + GETARG_sJ(code[k]);
+          *where = k;
+          if (GET_OPCODE(code[k]) != OP_JMP) return "entry not a jump";
+          if (target < 0 || target >= n) return "jump out of the code";
+        }
+        pc = last;
+        continue;
+      }
+      case OP_CALL:
+        if (c > 1) checkreg(a + c - 2);
+        /* FALLTHROUGH */
+      case OP_TAILCALL: /* its 'c' is not a register count */
+        checkreg(a);
+        if (b > 0) checkreg(a + b - 1);
+        break;
+      case OP_RETURN:
+        if (a > nregs || (b > 1 && a + b - 2 >= nregs))
+          return "register out of range";
+        break;
+      case OP_FORPREP: case OP_FORLOOP: case OP_TFORPREP:
+      case OP_TFORLOOP:
+        checkreg(a + 3);
+        break;
+      case OP_TFORCALL:
+        checkreg(a + 3 + c);
+        break;
+      case OP_SETLIST:
+        checkreg(a + b);
+        if (GETARG_k(i)) {
+          checkextra(pc + 1);
+          pc++;
+        }
+        break;
+      case OP_CLOSURE:
+        checkreg(a);
+        if (GETARG_Bx(i) >= fs->np) return "prototype out of range";
+        break;
+      case OP_VARARG:
+        if (c > 1) checkreg(a + c - 2);
+        break;
+      case OP_EXTRAARG:
+        return "extra argument without its instruction";
+      case OP_JMP: case OP_RETURN0: case OP_VARARGPREP:
+        break;
+      default: /* the rest only have register 'a' */
+        checkreg(a);
+        break;
+    }
+    int ns = optsuccessors(code, *where = pc, s);
+    for (k = 0; k < ns; k++)
+      if (s[k] < 0 || s[k] >= n)
+        return s[k] == n ? "code falls off its end" : "jump out of the code";
+  }
+#undef checkreg
+#undef checkk
+#undef checkrk
+#undef checkextra
+  for (k = 0; k < fs->ndebugvars; k++) {
+    *where = f->locvars[k].startpc;
+    if (f->locvars[k].startpc > f->locvars[k].endpc ||
+        f->locvars[k].endpc > n)
+      return "local variable out of the code";
+  }
+  return NULL;
+}
+
+/*
+** Optimize the code of 'fs' and verify the result. Code that fails the
+** check is a bug in the optimizer: the function then keeps the code it
+** had, and a warning tells where the check failed.
+*/
+void luaK_optimize(FuncState *fs, int level) {
+  Proto *f = fs->f;
+  int n = fs->pc, nabs = fs->nabslineinfo;
+  int previousline = fs->previousline, iwthabs = fs->iwthabs;
+  lu_byte maxstacksize = f->maxstacksize;
+  int where, k;
+  const char *err;
+  char id[LUA_IDSIZE];
+  std::vector<Instruction> code(f->code, f->code + n);
+  std::vector<ls_byte> lineinfo(f->lineinfo, f->lineinfo + n);
+  std::vector<AbsLineInfo> abslineinfo(f->abslineinfo, f->abslineinfo + nabs);
+  std::vector<LocVar> locvars(f->locvars, f->locvars + fs->ndebugvars);
+  if (level >= 2) {
+    optinline(fs);
+    optconstants(fs);
+  }
+  optthread(fs);
+  optdeadcode(fs);
+  if (level >= 2) {
+    while (optdeadstores(fs))
+      optdeadcode(fs); /* may remove the jumps left around them */
+  }
+  if ((err = optverify(fs, &where)) != NULL) {
+    std::copy(code.begin(), code.end(), f->code);
+    std::copy(lineinfo.begin(), lineinfo.end(), f->lineinfo);
+    std::copy(abslineinfo.begin(), abslineinfo.end(), f->abslineinfo);
+    for (k = 0; k < fs->ndebugvars; k++) f->locvars[k] = locvars[k];
+    fs->pc = n;
+    f->maxstacksize = maxstacksize;
+    fs->nabslineinfo = nabs;
+    fs->previousline = previousline;
+    fs->iwthabs = cast_byte(iwthabs);
+    luaO_chunkid(id, getstr(fs->ls->source), tsslen(fs->ls->source));
+    luaE_warning(fs->ls->L,
+                 luaO_pushfstring(fs->ls->L,
+                                  "%s:%d: bytecode optimizer: %s at "
+                                  "instruction %d; function left unoptimized",
+                                  id, f->linedefined, err, where + 1),
+                 0);
+    fs->ls->L->top--;
+  }
+}
+
+/* }====================================================== */
@@ -124,7 +124,11 @@ LUAI_FUNC void luaK_posfix(FuncState *fs, BinOpr op, expdesc *v1, expdesc *v2,
 LUAI_FUNC void luaK_settablesize(FuncState *fs, int pc, int ra, int asize,
                                  int hsize);
 LUAI_FUNC void luaK_setlist(FuncState *fs, int base, int nelems, int tostore);
+LUAI_FUNC int luaK_jumptable(FuncState *fs, int reg, lua_Integer lo,
+                             TString *const *keys, int n);
+LUAI_FUNC void luaK_removejump(FuncState *fs);
 LUAI_FUNC void luaK_finish(FuncState *fs);
+LUAI_FUNC void luaK_optimize(FuncState *fs, int level);
 
 #endif
 
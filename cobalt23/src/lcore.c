@@ -9622,7 +9622,7 @@ static int unix_shutdown(lua_State *L) {
 static int unix_send(lua_State *L) {
   int fd = unixL_checkfileno(L, 1);
   size_t size;
-  const char *src = luaL_checklstring(L, 2, &size);
+  const char *src = luaL_checklbytes(L, 2, &size);
   int flags = unixL_optinteger(L, 3, 0, 0, INT_MAX);
   ssize_t n;
 
@@ -9637,7 +9637,7 @@ static int unix_send(lua_State *L) {
 static int unix_sendto(lua_State *L) {
   int fd = unixL_checkfileno(L, 1);
   size_t size;
-  const char *src = luaL_checklstring(L, 2, &size);
+  const char *src = luaL_checklbytes(L, 2, &size);
   int flags = unixL_optinteger(L, 3, 0, 0, INT_MAX);
   size_t tolen;
   void *to = unixL_checksockaddr(L, 4, &tolen);
@@ -9654,7 +9654,7 @@ static int unix_sendto(lua_State *L) {
 static int unix_sendtofrom(lua_State *L) {
   int fd = unixL_checkfileno(L, 1);
   size_t size;
-  const char *src = luaL_checklstring(L, 2, &size);
+  const char *src = luaL_checklbytes(L, 2, &size);
   int flags = unixL_optinteger(L, 3, 0, 0, INT_MAX);
   size_t tolen;
   struct sockaddr *to = unixL_checksockaddr(L, 4, &tolen);
@@ -10623,7 +10623,7 @@ static int unix_waitpid(lua_State *L) {
 static int unix_write(lua_State *L) {
   int fd = unixL_checkfileno(L, 1);
   size_t size;
-  const char *src = luaL_checklstring(L, 2, &size);
+  const char *src = luaL_checklbytes(L, 2, &size);
   ssize_t n;
 
   if (-1 == (n = write(fd, src, size)))
@@ -5,8 +5,11 @@
 
 #include "cobalt.h"
 #include "lauxlib.h"
+#include "lcrypthash.h"
 
 #include <time.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
@@ -360,6 +363,16 @@ des_key(lua_State *L, uint32_t SK[32]) {
 	des_main_ks(SK, key);
 }
 
+/* the decryption schedule runs the subkeys backwards */
+static void
+des_reversekey(const uint32_t ESK[32], uint32_t SK[32]) {
+	int i;
+	for( i = 0; i < 32; i += 2 ) {
+		SK[i] = ESK[30 - i];
+		SK[i + 1] = ESK[31 - i];
+	}
+}
+
 static int
 ldesencode(lua_State *L) {
 	uint32_t SK[32];
@@ -401,10 +414,7 @@ ldesdecode(lua_State *L) {
 	des_key(L, ESK);
 	uint32_t SK[32];
 	int i;
-	for( i = 0; i < 32; i += 2 ) {
-		SK[i] = ESK[30 - i];
-		SK[i + 1] = ESK[31 - i];
-	}
+	des_reversekey(ESK, SK);
 	size_t textsz = 0;
 	const uint8_t *text = (const uint8_t *)luaL_checklstring(L, 2, &textsz);
 	if ((textsz & 7) || textsz == 0) {
@@ -471,7 +481,6 @@ lhashkey(lua_State *L) {
 
 static int
 ltohex(lua_State *L) {
-	static char hex[] = "0123456789abcdef";
 	size_t sz = 0;
 	const uint8_t * text = (const uint8_t *)luaL_checklstring(L, 1, &sz);
 	char tmp[SMALL_CHUNK];
@@ -479,12 +488,7 @@ ltohex(lua_State *L) {
 	if (sz > SMALL_CHUNK/2) {
 		buffer = lua_newuserdata(L, sz * 2);
 	}
-	int i;
-	for (i=0;i<sz;i++) {
-		buffer[i*2] = hex[text[i] >> 4];
-		buffer[i*2+1] = hex[text[i] & 0xf];
-	}
-	lua_pushlstring(L, buffer, sz * 2);
+	lua_pushlstring(L, buffer, crypt_hexencode(text, sz, buffer));
 	return 1;
 }
 
@@ -723,44 +727,15 @@ ldhexchange(lua_State *L) {
 
 static int
 lb64encode(lua_State *L) {
-	static const char* encoding = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 	size_t sz = 0;
 	const uint8_t * text = (const uint8_t *)luaL_checklstring(L, 1, &sz);
-	int encode_sz = (sz + 2)/3*4;
+	size_t encode_sz = (sz + 2)/3*4;
 	char tmp[SMALL_CHUNK];
 	char *buffer = tmp;
 	if (encode_sz > SMALL_CHUNK) {
 		buffer = lua_newuserdata(L, encode_sz);
 	}
-	int i,j;
-	j=0;
-	for (i=0;i<(int)sz-2;i+=3) {
-		uint32_t v = text[i] << 16 | text[i+1] << 8 | text[i+2];
-		buffer[j] = encoding[v >> 18];
-		buffer[j+1] = encoding[(v >> 12) & 0x3f];
-		buffer[j+2] = encoding[(v >> 6) & 0x3f];
-		buffer[j+3] = encoding[(v) & 0x3f];
-		j+=4;
-	}
-	int padding = sz-i;
-	uint32_t v;
-	switch(padding) {
-	case 1 :
-		v = text[i];
-		buffer[j] = encoding[v >> 2];
-		buffer[j+1] = encoding[(v & 3) << 4];
-		buffer[j+2] = '=';
-		buffer[j+3] = '=';
-		break;
-	case 2 :
-		v = text[i] << 8 | text[i+1];
-		buffer[j] = encoding[v >> 10];
-		buffer[j+1] = encoding[(v >> 4) & 0x3f];
-		buffer[j+2] = encoding[(v & 0xf) << 2];
-		buffer[j+3] = '=';
-		break;
-	}
-	lua_pushlstring(L, buffer, encode_sz);
+	lua_pushlstring(L, buffer, crypt_b64encode(text, sz, buffer));
 	return 1;
 }
 
@@ -781,15 +756,17 @@ static int
 lb64decode(lua_State *L) {
 	size_t sz = 0;
 	const uint8_t * text = (const uint8_t *)luaL_checklstring(L, 1, &sz);
-	int decode_sz = (sz+3)/4*3;
+	int decode_sz = (sz+3)/4*3 + 4;	/* the fast path stores 4 bytes past its output */
 	char tmp[SMALL_CHUNK];
 	char *buffer = tmp;
 	if (decode_sz > SMALL_CHUNK) {
 		buffer = lua_newuserdata(L, decode_sz);
 	}
 	int i,j;
-	int output = 0;
-	for (i=0;i<sz;) {
+	size_t fast;
+	i = crypt_b64decode_fast(text, sz, (uint8_t *)buffer, &fast);
+	int output = fast;
+	while (i<sz) {
 		int padding = 0;
 		int c[4];
 		for (j=0;j<4;) {
@@ -841,10 +818,480 @@ lb64decode(lua_State *L) {
 	return 1;
 }
 
+// hashes and checksums, see lcrypthash.c
+
+#define CRYPT_HASH "crypt.hash"
+#define CRYPT_CODEC "crypt.codec"
+
+// files are read in chunks of this size
+#define READ_CHUNK (256 * 1024)
+
+typedef void (*feeder)(lua_State *L, void *ud, const uint8_t *p, size_t sz);
+
+/*
+** Passes the bytes of argument 'idx' to 'f': a string, a string buffer,
+** a mapped buffer or an open file, which is read to its end in large
+** chunks without creating Lua strings.
+*/
+static void
+feed(lua_State *L, int idx, feeder f, void *ud) {
+	luaL_Stream *fs = (luaL_Stream *)luaL_testudata(L, idx, LUA_FILEHANDLE);
+	if (fs != NULL) {
+		if (fs->closef == NULL) {
+			luaL_argerror(L, idx, "attempt to use a closed file");
+		}
+		uint8_t *buffer = lua_newuserdatauv(L, READ_CHUNK, 0);
+		size_t n;
+		while ((n = fread(buffer, 1, READ_CHUNK, fs->f)) > 0) {
+			f(L, ud, buffer, n);
+		}
+		if (ferror(fs->f)) {
+			luaL_error(L, "read error: %s", strerror(errno));
+		}
+		lua_pop(L, 1);
+	} else {
+		size_t sz = 0;
+		const char *text = luaL_checklbytes(L, idx, &sz);
+		f(L, ud, (const uint8_t *)text, sz);
+	}
+}
+
+// hash contexts: crypt.sha256():update(chunk):update(chunk):digest()
+
+enum { HASH_SHA256, HASH_BLAKE3, HASH_CRC32C, HASH_XXH3 };
+
+typedef struct HashCtx {
+	int kind;
+	union {
+		crypt_sha256 sha256;
+		crypt_blake3_ctx blake3;
+		crypt_xxh3_ctx xxh3;
+		uint32_t crc;
+	} u;
+} HashCtx;
+
+static int
+newhash(lua_State *L, int kind) {
+	HashCtx *h = (HashCtx *)lua_newuserdatauv(L, sizeof(HashCtx), 0);
+	h->kind = kind;
+	switch (kind) {
+	case HASH_SHA256:
+		crypt_sha256_init(&h->u.sha256);
+		break;
+	case HASH_BLAKE3:
+		crypt_blake3_init(&h->u.blake3);
+		break;
+	case HASH_CRC32C:
+		h->u.crc = (uint32_t)luaL_optinteger(L, 2, 0);
+		break;
+	case HASH_XXH3:
+		crypt_xxh3_init(&h->u.xxh3, (uint64_t)luaL_optinteger(L, 2, 0));
+		break;
+	}
+	luaL_setmetatable(L, CRYPT_HASH);
+	return 1;
+}
+
+static void
+hashfeed(lua_State *L, void *ud, const uint8_t *p, size_t sz) {
+	HashCtx *h = (HashCtx *)ud;
+	(void)L;
+	switch (h->kind) {
+	case HASH_SHA256:
+		crypt_sha256_update(&h->u.sha256, p, sz);
+		break;
+	case HASH_BLAKE3:
+		crypt_blake3_update(&h->u.blake3, p, sz);
+		break;
+	case HASH_CRC32C:
+		h->u.crc = crypt_crc32c(h->u.crc, p, sz);
+		break;
+	case HASH_XXH3:
+		crypt_xxh3_update(&h->u.xxh3, p, sz);
+		break;
+	}
+}
+
+static int
+lhashupdate(lua_State *L) {
+	HashCtx *h = (HashCtx *)luaL_checkudata(L, 1, CRYPT_HASH);
+	feed(L, 2, hashfeed, h);
+	lua_settop(L, 1);
+	return 1;
+}
+
+// digest([n]) may be called any number of times, also between updates
+static int
+lhashdigest(lua_State *L) {
+	HashCtx *h = (HashCtx *)luaL_checkudata(L, 1, CRYPT_HASH);
+	switch (h->kind) {
+	case HASH_SHA256: {
+		crypt_sha256 c = h->u.sha256;
+		uint8_t digest[32];
+		crypt_sha256_final(&c, digest);
+		lua_pushlstring(L, (const char *)digest, sizeof(digest));
+		break;
+	}
+	case HASH_BLAKE3: {
+		lua_Integer outlen = luaL_optinteger(L, 2, 32);
+		luaL_argcheck(L, outlen > 0 && outlen <= 0x10000, 2, "output length out of range");
+		char tmp[SMALL_CHUNK];
+		char *buffer = tmp;
+		if (outlen > SMALL_CHUNK) {
+			buffer = lua_newuserdata(L, outlen);
+		}
+		crypt_blake3_final(&h->u.blake3, (uint8_t *)buffer, outlen);
+		lua_pushlstring(L, buffer, outlen);
+		break;
+	}
+	case HASH_CRC32C:
+		lua_pushinteger(L, h->u.crc);
+		break;
+	case HASH_XXH3:
+		lua_pushinteger(L, (lua_Integer)crypt_xxh3_digest(&h->u.xxh3));
+		break;
+	}
+	return 1;
+}
+
+// sha256(data) hashes data; sha256() returns a context, as the others
+static int
+lsha256(lua_State *L) {
+	if (lua_isnoneornil(L, 1)) {
+		return newhash(L, HASH_SHA256);
+	}
+	size_t sz = 0;
+	const char *text = luaL_checklbytes(L, 1, &sz);
+	crypt_sha256 c;
+	uint8_t digest[32];
+	crypt_sha256_init(&c);
+	crypt_sha256_update(&c, text, sz);
+	crypt_sha256_final(&c, digest);
+	lua_pushlstring(L, (const char *)digest, sizeof(digest));
+	return 1;
+}
+
+static int
+lblake3(lua_State *L) {
+	if (lua_isnoneornil(L, 1)) {
+		return newhash(L, HASH_BLAKE3);
+	}
+	size_t sz = 0;
+	const char *text = luaL_checklbytes(L, 1, &sz);
+	lua_Integer outlen = luaL_optinteger(L, 2, 32);
+	luaL_argcheck(L, outlen > 0 && outlen <= 0x10000, 2, "output length out of range");
+	char tmp[SMALL_CHUNK];
+	char *buffer = tmp;
+	if (outlen > SMALL_CHUNK) {
+		buffer = lua_newuserdata(L, outlen);
+	}
+	crypt_blake3(text, sz, (uint8_t *)buffer, outlen);
+	lua_pushlstring(L, buffer, outlen);
+	return 1;
+}
+
+static int
+lcrc32c(lua_State *L) {
+	if (lua_isnoneornil(L, 1)) {
+		return newhash(L, HASH_CRC32C);
+	}
+	size_t sz = 0;
+	const char *text = luaL_checklbytes(L, 1, &sz);
+	uint32_t crc = (uint32_t)luaL_optinteger(L, 2, 0);
+	lua_pushinteger(L, crypt_crc32c(crc, text, sz));
+	return 1;
+}
+
+static int
+lxxh3(lua_State *L) {
+	if (lua_isnoneornil(L, 1)) {
+		return newhash(L, HASH_XXH3);
+	}
+	size_t sz = 0;
+	const char *text = luaL_checklbytes(L, 1, &sz);
+	uint64_t seed = (uint64_t)luaL_optinteger(L, 2, 0);
+	lua_pushinteger(L, (lua_Integer)crypt_xxh3(text, sz, seed));
+	return 1;
+}
+
+// streaming encoders: update(chunk) returns the output so far, final() the rest
+
+enum { CODEC_BASE64, CODEC_HEX, CODEC_DESENC, CODEC_DESDEC };
+
+typedef struct Codec {
+	int kind;
+	int finished;
+	int cbc;
+	int taillen;
+	uint8_t tail[8];	// bytes waiting for a complete group
+	uint8_t iv[8];
+	uint32_t SK[32];
+} Codec;
+
+typedef struct CodecOut {
+	Codec *c;
+	luaL_StrBuf *sb;
+} CodecOut;
+
+static Codec *
+newcodec(lua_State *L, int kind) {
+	Codec *c = (Codec *)lua_newuserdatauv(L, sizeof(Codec), 0);
+	memset(c, 0, sizeof(Codec));
+	c->kind = kind;
+	luaL_setmetatable(L, CRYPT_CODEC);
+	return c;
+}
+
+static void
+des_block(Codec *c, const uint8_t *in, uint8_t *out) {
+	int i;
+	if (c->kind == CODEC_DESENC) {
+		uint8_t x[8];
+		for (i = 0; i < 8; i++) {
+			x[i] = in[i] ^ c->iv[i];
+		}
+		des_crypt(c->SK, x, out);
+		if (c->cbc) {
+			memcpy(c->iv, out, 8);
+		}
+	} else {
+		uint8_t next[8];
+		memcpy(next, in, 8);
+		des_crypt(c->SK, in, out);
+		for (i = 0; i < 8; i++) {
+			out[i] ^= c->iv[i];
+		}
+		if (c->cbc) {
+			memcpy(c->iv, next, 8);
+		}
+	}
+}
+
+static void
+codecfeed(lua_State *L, void *ud, const uint8_t *p, size_t sz) {
+	Codec *c = ((CodecOut *)ud)->c;
+	luaL_StrBuf *sb = ((CodecOut *)ud)->sb;
+	switch (c->kind) {
+	case CODEC_HEX: {
+		char *out = luaL_strbufprep(L, sb, sz * 2);
+		luaL_strbufaddsize(sb, crypt_hexencode(p, sz, out));
+		break;
+	}
+	case CODEC_BASE64: {
+		while (c->taillen > 0 && c->taillen < 3 && sz > 0) {
+			c->tail[c->taillen++] = *p++;
+			sz--;
+		}
+		if (c->taillen == 3) {
+			luaL_strbufaddsize(sb, crypt_b64encode(c->tail, 3, luaL_strbufprep(L, sb, 4)));
+			c->taillen = 0;
+		}
+		size_t n = sz / 3 * 3;
+		if (n > 0) {
+			luaL_strbufaddsize(sb, crypt_b64encode(p, n, luaL_strbufprep(L, sb, n / 3 * 4)));
+		}
+		memcpy(c->tail + c->taillen, p + n, sz - n);
+		c->taillen += sz - n;
+		break;
+	}
+	default: {	// DES: the decoder keeps the last block back for its padding
+		size_t keep = c->kind == CODEC_DESDEC ? 1 : 0;
+		while (sz > 0) {
+			if (c->taillen == 8) {
+				des_block(c, c->tail, (uint8_t *)luaL_strbufprep(L, sb, 8));
+				luaL_strbufaddsize(sb, 8);
+				c->taillen = 0;
+			}
+			if (c->taillen == 0 && sz >= 8 + keep) {
+				size_t n = (sz - keep) & ~(size_t)7, i;
+				uint8_t *out = (uint8_t *)luaL_strbufprep(L, sb, n);
+				for (i = 0; i < n; i += 8) {
+					des_block(c, p + i, out + i);
+				}
+				luaL_strbufaddsize(sb, n);
+				p += n;
+				sz -= n;
+			}
+			while (c->taillen < 8 && sz > 0) {
+				c->tail[c->taillen++] = *p++;
+				sz--;
+			}
+			if (c->taillen == 8 && !keep) {
+				des_block(c, c->tail, (uint8_t *)luaL_strbufprep(L, sb, 8));
+				luaL_strbufaddsize(sb, 8);
+				c->taillen = 0;
+			}
+		}
+		break;
+	}
+	}
+}
+
+static Codec *
+checkcodec(lua_State *L) {
+	Codec *c = (Codec *)luaL_checkudata(L, 1, CRYPT_CODEC);
+	if (c->finished) {
+		luaL_error(L, "encoder already finished");
+	}
+	return c;
+}
+
+static int
+pushcodecout(lua_State *L, luaL_StrBuf *sb) {
+	lua_pushlstring(L, luaL_strbufaddr(sb), luaL_strbuflen(sb));
+	luaL_strbuffree(L, sb);
+	return 1;
+}
+
+static int
+lcodecupdate(lua_State *L) {
+	CodecOut o;
+	o.c = checkcodec(L);
+	o.sb = luaL_newstrbuf(L, 0);
+	feed(L, 2, codecfeed, &o);
+	return pushcodecout(L, o.sb);
+}
+
+static int
+lcodecfinal(lua_State *L) {
+	Codec *c = checkcodec(L);
+	luaL_StrBuf *sb = luaL_newstrbuf(L, 16);
+	c->finished = 1;
+	switch (c->kind) {
+	case CODEC_BASE64:
+		luaL_strbufaddsize(sb, crypt_b64encode(c->tail, c->taillen, luaL_strbufprep(L, sb, 4)));
+		break;
+	case CODEC_DESENC: {	// same padding as desencode
+		int j;
+		for (j = c->taillen; j < 8; j++) {
+			c->tail[j] = j == c->taillen ? 0x80 : 0;
+		}
+		des_block(c, c->tail, (uint8_t *)luaL_strbufprep(L, sb, 8));
+		luaL_strbufaddsize(sb, 8);
+		break;
+	}
+	case CODEC_DESDEC: {
+		uint8_t out[8];
+		int i, padding = 1;
+		if (c->taillen != 8) {
+			return luaL_error(L, "Invalid des crypt text length");
+		}
+		des_block(c, c->tail, out);
+		for (i = 7; i >= 0; i--) {
+			if (out[i] == 0) {
+				padding++;
+			} else if (out[i] == 0x80) {
+				break;
+			} else {
+				return luaL_error(L, "Invalid des crypt text");
+			}
+		}
+		if (padding > 8) {
+			return luaL_error(L, "Invalid des crypt text");
+		}
+		luaL_strbufaddlstring(L, sb, (const char *)out, 8 - padding);
+		break;
+	}
+	}
+	return pushcodecout(L, sb);
+}
+
+static int
+lb64encoder(lua_State *L) {
+	newcodec(L, CODEC_BASE64);
+	return 1;
+}
+
+static int
+lhexencoder(lua_State *L) {
+	newcodec(L, CODEC_HEX);
+	return 1;
+}
+
+// desencoder(key [, iv]): ECB like desencode, or CBC when an iv is given
+static int
+newdes(lua_State *L, int kind) {
+	uint32_t SK[32];
+	size_t ivsz = 0;
+	const char *iv = luaL_optlstring(L, 2, NULL, &ivsz);
+	des_key(L, SK);
+	if (iv != NULL && ivsz != 8) {
+		return luaL_error(L, "Invalid iv size %d, need 8 bytes", (int)ivsz);
+	}
+	Codec *c = newcodec(L, kind);
+	if (kind == CODEC_DESDEC) {
+		des_reversekey(SK, c->SK);
+	} else {
+		memcpy(c->SK, SK, sizeof(SK));
+	}
+	if (iv != NULL) {
+		c->cbc = 1;
+		memcpy(c->iv, iv, 8);
+	}
+	return 1;
+}
+
+static int
+ldesencoder(lua_State *L) {
+	return newdes(L, CODEC_DESENC);
+}
+
+static int
+ldesdecoder(lua_State *L) {
+	return newdes(L, CODEC_DESDEC);
+}
+
+static void
+createmeta(lua_State *L, const char *name, const luaL_Reg *methods) {
+	luaL_newmetatable(L, name);
+	lua_newtable(L);
+	luaL_setfuncs(L, methods, 0);
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+}
+
+/*
+** accel([on]): switches the CPU specific paths on or off (off gives the
+** portable code, for comparison) and returns the features in use.
+*/
+static int
+laccel(lua_State *L) {
+	static const char *const names[] = { "ssse3", "sse4.1", "sse4.2", "avx2", "sha" };
+	int f, i, n = 0;
+	if (lua_isnoneornil(L, 1))
+		f = crypt_features();
+	else
+		f = crypt_setaccel(lua_toboolean(L, 1));
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (i = 0; i < 5; i++) {
+		if (f & (1 << i)) {
+			if (n++ > 0)
+				luaL_addchar(&b, ' ');
+			luaL_addstring(&b, names[i]);
+		}
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
 int
 luaopen_crypt(lua_State *L) {
 	luaL_checkversion(L);
 	srandom(time(NULL));
+	crypt_initcpu();
+	luaL_Reg hashmeth[] = {
+		{ "update", lhashupdate },
+		{ "digest", lhashdigest },
+		{ NULL, NULL },
+	};
+	luaL_Reg codecmeth[] = {
+		{ "update", lcodecupdate },
+		{ "final", lcodecfinal },
+		{ NULL, NULL },
+	};
+	createmeta(L, CRYPT_HASH, hashmeth);
+	createmeta(L, CRYPT_CODEC, codecmeth);
 	luaL_Reg l[] = {
 		{ "hashkey", lhashkey },
 		{ "randomkey", lrandomkey },
@@ -857,6 +1304,15 @@ luaopen_crypt(lua_State *L) {
 		{ "dhsecret", ldhsecret },
 		{ "base64encode", lb64encode },
 		{ "base64decode", lb64decode },
+		{ "sha256", lsha256 },
+		{ "blake3", lblake3 },
+		{ "crc32c", lcrc32c },
+		{ "xxh3", lxxh3 },
+		{ "accel", laccel },
+		{ "base64encoder", lb64encoder },
+		{ "hexencoder", lhexencoder },
+		{ "desencoder", ldesencoder },
+		{ "desdecoder", ldesdecoder },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
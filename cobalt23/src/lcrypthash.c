@@ -0,0 +1,1276 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+/*
+** Hashes, checksums and encoders for the crypt library. Every function
+** has a portable implementation; on x86 the faster paths are compiled
+** with per-function target attributes and picked at run time from the
+** features 'crypt_initcpu' finds, so one binary runs everywhere.
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "lcrypthash.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRYPT_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#define TARGET(t) __attribute__((target(t)))
+#endif
+
+#if defined(__GNUC__)
+#define CRYPT_VECTOR /* GCC/Clang vector extensions */
+#endif
+
+static int cpu_detected = 0; /* features the CPU has */
+static int cpu_active = 0;   /* features in use */
+static int accel_on = 1;     /* also covers the baseline vector paths */
+
+static uint32_t crc_table[8][256];
+
+static void
+crc_inittable(void) {
+	uint32_t i, j, c;
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c >> 1) ^ (0x82F63B78 & (0 - (c & 1)));
+		crc_table[0][i] = c;
+	}
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			crc_table[j][i] = (crc_table[j-1][i] >> 8) ^ crc_table[0][crc_table[j-1][i] & 0xff];
+}
+
+void
+crypt_initcpu(void) {
+#if defined(CRYPT_X86)
+	unsigned a, b, c, d;
+	int f = 0;
+	if (__get_cpuid(1, &a, &b, &c, &d)) {
+		if (c & bit_SSSE3) f |= CRYPT_SSSE3;
+		if (c & bit_SSE4_1) f |= CRYPT_SSE41;
+		if (c & bit_SSE4_2) f |= CRYPT_SSE42;
+		if ((c & bit_OSXSAVE) && (c & bit_AVX) && __get_cpuid_max(0, NULL) >= 7) {
+			unsigned lo, hi;
+			__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			__cpuid_count(7, 0, a, b, c, d);
+			if ((lo & 6) == 6 && (b & (1u << 5))) f |= CRYPT_AVX2;
+		}
+		if (__get_cpuid_max(0, NULL) >= 7) {
+			__cpuid_count(7, 0, a, b, c, d);
+			if (b & (1u << 29)) f |= CRYPT_SHA;
+		}
+	}
+	cpu_detected = cpu_active = f;
+#endif
+	if (crc_table[0][1] == 0)
+		crc_inittable();
+}
+
+int
+crypt_setaccel(int on) {
+	accel_on = on;
+	cpu_active = on ? cpu_detected : 0;
+	return cpu_active;
+}
+
+int
+crypt_features(void) {
+	return cpu_active;
+}
+
+static inline uint32_t
+rd32(const uint8_t *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t
+rd64(const uint8_t *p) {
+	return (uint64_t)rd32(p) | (uint64_t)rd32(p + 4) << 32;
+}
+
+static inline void
+wr32(uint8_t *p, uint32_t v) {
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+/*
+** {======================================================
+** SHA-256
+** =======================================================
+*/
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha256_blocks_c(uint32_t h[8], const uint8_t *p, size_t n) {
+	uint32_t w[64];
+	int i;
+	for (; n > 0; n--, p += 64) {
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+		uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+		for (i = 0; i < 16; i++)
+			w[i] = (uint32_t)p[4*i] << 24 | (uint32_t)p[4*i+1] << 16 | (uint32_t)p[4*i+2] << 8 | p[4*i+3];
+		for (; i < 64; i++) {
+			uint32_t s0 = ROR32(w[i-15], 7) ^ ROR32(w[i-15], 18) ^ (w[i-15] >> 3);
+			uint32_t s1 = ROR32(w[i-2], 17) ^ ROR32(w[i-2], 19) ^ (w[i-2] >> 10);
+			w[i] = w[i-16] + s0 + w[i-7] + s1;
+		}
+		for (i = 0; i < 64; i++) {
+			uint32_t t1 = k + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+			uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			k = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+	}
+}
+
+#if defined(CRYPT_X86)
+/* SHA extensions: two rounds per 'sha256rnds2', state kept as ABEF/CDGH */
+TARGET("sha,sse4.1,ssse3") static void
+sha256_blocks_shani(uint32_t h[8], const uint8_t *p, size_t n) {
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i s0, s1, tmp, msg, w[4];
+	int j;
+#if defined(__AVX__)
+	_mm256_zeroupper(); /* the SHA instructions are legacy SSE encoded */
+#endif
+	tmp = _mm_loadu_si128((const __m128i *)&h[0]);
+	s1 = _mm_loadu_si128((const __m128i *)&h[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);
+	s1 = _mm_shuffle_epi32(s1, 0x1B);
+	s0 = _mm_alignr_epi8(tmp, s1, 8);
+	s1 = _mm_blend_epi16(s1, tmp, 0xF0);
+	for (; n > 0; n--, p += 64) {
+		__m128i abef = s0, cdgh = s1;
+		for (j = 0; j < 16; j++) {
+			if (j < 4)
+				w[j] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16*j)), mask);
+			else {
+				tmp = _mm_sha256msg1_epu32(w[j & 3], w[(j + 1) & 3]);
+				tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(w[(j - 1) & 3], w[(j - 2) & 3], 4));
+				w[j & 3] = _mm_sha256msg2_epu32(tmp, w[(j - 1) & 3]);
+			}
+			msg = _mm_add_epi32(w[j & 3], _mm_loadu_si128((const __m128i *)&sha256_k[4*j]));
+			s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			s0 = _mm_sha256rnds2_epu32(s0, s1, msg);
+		}
+		s0 = _mm_add_epi32(s0, abef);
+		s1 = _mm_add_epi32(s1, cdgh);
+	}
+	tmp = _mm_shuffle_epi32(s0, 0x1B);
+	s1 = _mm_shuffle_epi32(s1, 0xB1);
+	s0 = _mm_blend_epi16(tmp, s1, 0xF0);
+	s1 = _mm_alignr_epi8(s1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&h[0], s0);
+	_mm_storeu_si128((__m128i *)&h[4], s1);
+}
+#endif
+
+static void
+sha256_blocks(uint32_t h[8], const uint8_t *p, size_t n) {
+#if defined(CRYPT_X86)
+	if ((cpu_active & (CRYPT_SHA | CRYPT_SSE41)) == (CRYPT_SHA | CRYPT_SSE41)) {
+		sha256_blocks_shani(h, p, n);
+		return;
+	}
+#endif
+	sha256_blocks_c(h, p, n);
+}
+
+void
+crypt_sha256_init(crypt_sha256 *c) {
+	memcpy(c->h, sha256_iv, sizeof(c->h));
+	c->len = 0;
+}
+
+void
+crypt_sha256_update(crypt_sha256 *c, const void *data, size_t len) {
+	const uint8_t *p = (const uint8_t *)data;
+	size_t used = c->len & 63;
+	c->len += len;
+	if (used > 0) {
+		size_t n = 64 - used;
+		if (len < n) {
+			memcpy(c->buf + used, p, len);
+			return;
+		}
+		memcpy(c->buf + used, p, n);
+		sha256_blocks(c->h, c->buf, 1);
+		p += n;
+		len -= n;
+	}
+	if (len >= 64) {
+		sha256_blocks(c->h, p, len / 64);
+		p += len & ~(size_t)63;
+		len &= 63;
+	}
+	memcpy(c->buf, p, len);
+}
+
+void
+crypt_sha256_final(crypt_sha256 *c, uint8_t out[32]) {
+	uint64_t bits = c->len * 8;
+	size_t used = c->len & 63;
+	int i;
+	c->buf[used++] = 0x80;
+	if (used > 56) {
+		memset(c->buf + used, 0, 64 - used);
+		sha256_blocks(c->h, c->buf, 1);
+		used = 0;
+	}
+	memset(c->buf + used, 0, 56 - used);
+	for (i = 0; i < 8; i++)
+		c->buf[56 + i] = (uint8_t)(bits >> (56 - 8*i));
+	sha256_blocks(c->h, c->buf, 1);
+	for (i = 0; i < 8; i++) {
+		out[4*i] = c->h[i] >> 24;
+		out[4*i+1] = c->h[i] >> 16;
+		out[4*i+2] = c->h[i] >> 8;
+		out[4*i+3] = c->h[i];
+	}
+}
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** CRC-32C
+** =======================================================
+*/
+
+static uint32_t
+crc32c_c(uint32_t crc, const uint8_t *p, size_t len) {
+	crc = ~crc;
+	while (len > 0 && ((uintptr_t)p & 7) != 0) {
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+	for (; len >= 8; len -= 8, p += 8) { /* slicing by 8 */
+		uint32_t lo = rd32(p) ^ crc, hi = rd32(p + 4);
+		crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+		      crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+		      crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+		      crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+	}
+	while (len-- > 0)
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+#if defined(CRYPT_X86)
+TARGET("sse4.2") static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len) {
+	uint32_t c = ~crc;
+	while (len > 0 && ((uintptr_t)p & 7) != 0) {
+		c = _mm_crc32_u8(c, *p++);
+		len--;
+	}
+#if defined(__x86_64__)
+	{
+		uint64_t c64 = c;
+		for (; len >= 8; len -= 8, p += 8) {
+			uint64_t v;
+			memcpy(&v, p, 8);
+			c64 = _mm_crc32_u64(c64, v);
+		}
+		c = (uint32_t)c64;
+	}
+#endif
+	for (; len >= 4; len -= 4, p += 4) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		c = _mm_crc32_u32(c, v);
+	}
+	while (len-- > 0)
+		c = _mm_crc32_u8(c, *p++);
+	return ~c;
+}
+#endif
+
+uint32_t
+crypt_crc32c(uint32_t crc, const void *data, size_t len) {
+#if defined(CRYPT_X86)
+	if (cpu_active & CRYPT_SSE42)
+		return crc32c_sse42(crc, (const uint8_t *)data, len);
+#endif
+	if (crc_table[0][1] == 0)
+		crc_inittable();
+	return crc32c_c(crc, (const uint8_t *)data, len);
+}
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** XXH3 (64-bit)
+** =======================================================
+*/
+
+#define XP32_1 0x9E3779B1U
+#define XP32_2 0x85EBCA77U
+#define XP32_3 0xC2B2AE3DU
+#define XP64_1 0x9E3779B185EBCA87ULL
+#define XP64_2 0xC2B2AE3D27D4EB4FULL
+#define XP64_3 0x165667B19E3779F9ULL
+#define XP64_4 0x85EBCA77C2B2AE63ULL
+#define XP64_5 0x27D4EB2F165667C5ULL
+
+#define XSECRET_SIZE 192
+#define XSTRIPE 64
+
+static const uint8_t xxh_secret[XSECRET_SIZE] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline uint64_t
+mul128_fold64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 r = (unsigned __int128)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t lolo = (a & 0xffffffff) * (b & 0xffffffff);
+	uint64_t hilo = (a >> 32) * (b & 0xffffffff);
+	uint64_t lohi = (a & 0xffffffff) * (b >> 32);
+	uint64_t hihi = (a >> 32) * (b >> 32);
+	uint64_t cross = (lolo >> 32) + (hilo & 0xffffffff) + lohi;
+	uint64_t upper = (hilo >> 32) + (cross >> 32) + hihi;
+	uint64_t lower = (cross << 32) | (lolo & 0xffffffff);
+	return lower ^ upper;
+#endif
+}
+
+static inline uint64_t
+xxh64_avalanche(uint64_t h) {
+	h ^= h >> 33;
+	h *= XP64_2;
+	h ^= h >> 29;
+	h *= XP64_3;
+	return h ^ (h >> 32);
+}
+
+static inline uint64_t
+xxh3_avalanche(uint64_t h) {
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	return h ^ (h >> 32);
+}
+
+static inline uint64_t
+xxh3_rrmxmx(uint64_t h, uint64_t len) {
+	h ^= ((h << 49) | (h >> 15)) ^ ((h << 24) | (h >> 40));
+	h *= 0x9FB21C651E98DF25ULL;
+	h ^= (h >> 35) + len;
+	h *= 0x9FB21C651E98DF25ULL;
+	return h ^ (h >> 28);
+}
+
+static inline uint64_t
+xxh3_mix16(const uint8_t *p, const uint8_t *s, uint64_t seed) {
+	return mul128_fold64(rd64(p) ^ (rd64(s) + seed), rd64(p + 8) ^ (rd64(s + 8) - seed));
+}
+
+static uint64_t
+xxh3_short(const uint8_t *p, size_t len, uint64_t seed) {
+	const uint8_t *s = xxh_secret;
+	if (len > 8) {
+		uint64_t lo = rd64(p) ^ ((rd64(s + 24) ^ rd64(s + 32)) + seed);
+		uint64_t hi = rd64(p + len - 8) ^ ((rd64(s + 40) ^ rd64(s + 48)) - seed);
+		return xxh3_avalanche(len + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi));
+	}
+	else if (len >= 4) {
+		uint64_t in64, flip;
+		seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+		in64 = rd32(p + len - 4) + ((uint64_t)rd32(p) << 32);
+		flip = (rd64(s + 8) ^ rd64(s + 16)) - seed;
+		return xxh3_rrmxmx(in64 ^ flip, len);
+	}
+	else if (len > 0) {
+		uint32_t combo = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24) |
+		                 p[len - 1] | ((uint32_t)len << 8);
+		return xxh64_avalanche(combo ^ ((uint64_t)(rd32(s) ^ rd32(s + 4)) + seed));
+	}
+	return xxh64_avalanche(seed ^ rd64(s + 56) ^ rd64(s + 64));
+}
+
+static uint64_t
+xxh3_medium(const uint8_t *p, size_t len, uint64_t seed) {
+	const uint8_t *s = xxh_secret;
+	uint64_t acc = len * XP64_1;
+	if (len <= 128) {
+		if (len > 32) {
+			if (len > 64) {
+				if (len > 96) {
+					acc += xxh3_mix16(p + 48, s + 96, seed);
+					acc += xxh3_mix16(p + len - 64, s + 112, seed);
+				}
+				acc += xxh3_mix16(p + 32, s + 64, seed);
+				acc += xxh3_mix16(p + len - 48, s + 80, seed);
+			}
+			acc += xxh3_mix16(p + 16, s + 32, seed);
+			acc += xxh3_mix16(p + len - 32, s + 48, seed);
+		}
+		acc += xxh3_mix16(p, s, seed);
+		acc += xxh3_mix16(p + len - 16, s + 16, seed);
+	}
+	else {
+		size_t i, rounds = len / 16;
+		for (i = 0; i < 8; i++)
+			acc += xxh3_mix16(p + 16*i, s + 16*i, seed);
+		acc = xxh3_avalanche(acc);
+		for (; i < rounds; i++)
+			acc += xxh3_mix16(p + 16*i, s + 16*(i - 8) + 3, seed);
+		acc += xxh3_mix16(p + len - 16, s + 136 - 17, seed);
+	}
+	return xxh3_avalanche(acc);
+}
+
+/* 'n' stripes of 64 bytes; the secret advances 8 bytes per stripe */
+static void
+xxh3_accumulate_c(uint64_t acc[8], const uint8_t *p, const uint8_t *s, size_t n) {
+	size_t k;
+	int i;
+	for (k = 0; k < n; k++, p += XSTRIPE, s += 8)
+		for (i = 0; i < 8; i++) {
+			uint64_t v = rd64(p + 8*i), key = v ^ rd64(s + 8*i);
+			acc[i ^ 1] += v;
+			acc[i] += (key & 0xffffffff) * (key >> 32);
+		}
+}
+
+static void
+xxh3_scramble_c(uint64_t acc[8], const uint8_t *s) {
+	int i;
+	for (i = 0; i < 8; i++) {
+		uint64_t a = acc[i];
+		a ^= a >> 47;
+		a ^= rd64(s + 8*i);
+		acc[i] = a * XP32_1;
+	}
+}
+
+#if defined(CRYPT_X86) && defined(__SSE2__)
+static void
+xxh3_accumulate_sse2(uint64_t acc[8], const uint8_t *p, const uint8_t *s, size_t n) {
+	__m128i a[4];
+	size_t k;
+	int i;
+	for (i = 0; i < 4; i++)
+		a[i] = _mm_loadu_si128((const __m128i *)acc + i);
+	for (k = 0; k < n; k++, p += XSTRIPE, s += 8)
+		for (i = 0; i < 4; i++) {
+			__m128i v = _mm_loadu_si128((const __m128i *)p + i);
+			__m128i key = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)s + i));
+			__m128i prod = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+			a[i] = _mm_add_epi64(a[i], _mm_add_epi64(prod, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))));
+		}
+	for (i = 0; i < 4; i++)
+		_mm_storeu_si128((__m128i *)acc + i, a[i]);
+}
+
+static void
+xxh3_scramble_sse2(uint64_t acc[8], const uint8_t *s) {
+	const __m128i prime = _mm_set1_epi32((int)XP32_1);
+	int i;
+	for (i = 0; i < 4; i++) {
+		__m128i a = _mm_loadu_si128((const __m128i *)acc + i);
+		__m128i key = _mm_xor_si128(_mm_xor_si128(a, _mm_srli_epi64(a, 47)),
+		                            _mm_loadu_si128((const __m128i *)s + i));
+		__m128i lo = _mm_mul_epu32(key, prime);
+		__m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+		_mm_storeu_si128((__m128i *)acc + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+	}
+}
+#endif
+
+#if defined(CRYPT_X86)
+TARGET("avx2") static void
+xxh3_accumulate_avx2(uint64_t acc[8], const uint8_t *p, const uint8_t *s, size_t n) {
+	__m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+	__m256i a1 = _mm256_loadu_si256((const __m256i *)acc + 1);
+	size_t k;
+	for (k = 0; k < n; k++, p += XSTRIPE, s += 8) {
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)p);
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)p + 1);
+		__m256i k0 = _mm256_xor_si256(v0, _mm256_loadu_si256((const __m256i *)s));
+		__m256i k1 = _mm256_xor_si256(v1, _mm256_loadu_si256((const __m256i *)s + 1));
+		__m256i p0 = _mm256_mul_epu32(k0, _mm256_shuffle_epi32(k0, _MM_SHUFFLE(0, 3, 0, 1)));
+		__m256i p1 = _mm256_mul_epu32(k1, _mm256_shuffle_epi32(k1, _MM_SHUFFLE(0, 3, 0, 1)));
+		a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(v0, _MM_SHUFFLE(1, 0, 3, 2))));
+		a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(v1, _MM_SHUFFLE(1, 0, 3, 2))));
+	}
+	_mm256_storeu_si256((__m256i *)acc, a0);
+	_mm256_storeu_si256((__m256i *)acc + 1, a1);
+}
+
+TARGET("avx2") static void
+xxh3_scramble_avx2(uint64_t acc[8], const uint8_t *s) {
+	const __m256i prime = _mm256_set1_epi32((int)XP32_1);
+	int i;
+	for (i = 0; i < 2; i++) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)acc + i);
+		__m256i key = _mm256_xor_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 47)),
+		                               _mm256_loadu_si256((const __m256i *)s + i));
+		__m256i lo = _mm256_mul_epu32(key, prime);
+		__m256i hi = _mm256_mul_epu32(_mm256_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+		_mm256_storeu_si256((__m256i *)acc + i, _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+	}
+}
+#endif
+
+typedef void (*xxh3accumulate)(uint64_t *, const uint8_t *, const uint8_t *, size_t);
+typedef void (*xxh3scramble)(uint64_t *, const uint8_t *);
+
+static void
+xxh3_kernels(xxh3accumulate *accumulate, xxh3scramble *scramble) {
+	*accumulate = xxh3_accumulate_c;
+	*scramble = xxh3_scramble_c;
+#if defined(CRYPT_X86)
+	if (cpu_active & CRYPT_AVX2) {
+		*accumulate = xxh3_accumulate_avx2;
+		*scramble = xxh3_scramble_avx2;
+	}
+#if defined(__SSE2__)
+	else if (accel_on) {
+		*accumulate = xxh3_accumulate_sse2;
+		*scramble = xxh3_scramble_sse2;
+	}
+#endif
+#endif
+}
+
+static const uint64_t xxh3_initacc[8] = {
+	XP32_3, XP64_1, XP64_2, XP64_3, XP64_4, XP32_2, XP64_5, XP32_1
+};
+
+static uint64_t
+xxh3_merge(const uint64_t acc[8], const uint8_t *s, uint64_t len) {
+	uint64_t result = len * XP64_1;
+	int i;
+	for (i = 0; i < 4; i++)
+		result += mul128_fold64(acc[2*i] ^ rd64(s + 11 + 16*i), acc[2*i+1] ^ rd64(s + 11 + 16*i + 8));
+	return xxh3_avalanche(result);
+}
+
+static uint64_t
+xxh3_long(const uint8_t *p, size_t len, const uint8_t *s) {
+	xxh3accumulate accumulate;
+	xxh3scramble scramble;
+	uint64_t acc[8];
+	const size_t nstripes = (XSECRET_SIZE - XSTRIPE) / 8;
+	const size_t blocklen = XSTRIPE * nstripes;
+	size_t nblocks = (len - 1) / blocklen, b;
+	xxh3_kernels(&accumulate, &scramble);
+	memcpy(acc, xxh3_initacc, sizeof(acc));
+	for (b = 0; b < nblocks; b++) {
+		accumulate(acc, p + b * blocklen, s, nstripes);
+		scramble(acc, s + XSECRET_SIZE - XSTRIPE);
+	}
+	accumulate(acc, p + nblocks * blocklen, s, ((len - 1) - blocklen * nblocks) / XSTRIPE);
+	accumulate(acc, p + len - XSTRIPE, s + XSECRET_SIZE - XSTRIPE - 7, 1);
+	return xxh3_merge(acc, s, len);
+}
+
+static void
+xxh3_secret(uint8_t secret[XSECRET_SIZE], uint64_t seed) {
+	int i;
+	for (i = 0; i < XSECRET_SIZE / 16; i++) {
+		uint64_t lo = rd64(xxh_secret + 16*i) + seed;
+		uint64_t hi = rd64(xxh_secret + 16*i + 8) - seed;
+		wr32(secret + 16*i, (uint32_t)lo);
+		wr32(secret + 16*i + 4, (uint32_t)(lo >> 32));
+		wr32(secret + 16*i + 8, (uint32_t)hi);
+		wr32(secret + 16*i + 12, (uint32_t)(hi >> 32));
+	}
+}
+
+uint64_t
+crypt_xxh3(const void *data, size_t len, uint64_t seed) {
+	const uint8_t *p = (const uint8_t *)data;
+	if (len <= 16)
+		return xxh3_short(p, len, seed);
+	else if (len <= 240)
+		return xxh3_medium(p, len, seed);
+	else if (seed == 0)
+		return xxh3_long(p, len, xxh_secret);
+	else { /* derive a secret from the seed */
+		uint8_t secret[XSECRET_SIZE];
+		xxh3_secret(secret, seed);
+		return xxh3_long(p, len, secret);
+	}
+}
+
+/*
+** Streaming XXH3. A stripe is consumed only once more input follows it,
+** as the one-shot loop leaves the stripe holding the last byte for the
+** final step; inputs of up to 240 bytes stay in the buffer and take the
+** one-shot paths.
+*/
+
+void
+crypt_xxh3_init(crypt_xxh3_ctx *c, uint64_t seed) {
+	memcpy(c->acc, xxh3_initacc, sizeof(c->acc));
+	c->seed = seed;
+	c->total = 0;
+	c->nstripes = 0;
+	c->buflen = 0;
+	if (seed == 0)
+		memcpy(c->secret, xxh_secret, XSECRET_SIZE);
+	else
+		xxh3_secret(c->secret, seed);
+}
+
+static void
+xxh3_consume(uint64_t acc[8], size_t *nstripes, const uint8_t *p, size_t n,
+             const uint8_t *s, xxh3accumulate accumulate, xxh3scramble scramble) {
+	while (n > 0) {
+		size_t m = (XSECRET_SIZE - XSTRIPE) / 8 - *nstripes;
+		if (m > n)
+			m = n;
+		accumulate(acc, p, s + *nstripes * 8, m);
+		p += m * XSTRIPE;
+		n -= m;
+		*nstripes += m;
+		if (*nstripes == (XSECRET_SIZE - XSTRIPE) / 8) { /* end of a block */
+			scramble(acc, s + XSECRET_SIZE - XSTRIPE);
+			*nstripes = 0;
+		}
+	}
+}
+
+void
+crypt_xxh3_update(crypt_xxh3_ctx *c, const void *data, size_t len) {
+	const uint8_t *p = (const uint8_t *)data;
+	xxh3accumulate accumulate;
+	xxh3scramble scramble;
+	xxh3_kernels(&accumulate, &scramble);
+	c->total += len;
+	while (len > 0) {
+		size_t n;
+		if (c->buflen == 0 && len > sizeof(c->buf)) { /* straight from the input */
+			n = (len - 1) / XSTRIPE;
+			xxh3_consume(c->acc, &c->nstripes, p, n, c->secret, accumulate, scramble);
+			memcpy(c->last, p + (n - 1) * XSTRIPE, XSTRIPE);
+			p += n * XSTRIPE;
+			len -= n * XSTRIPE;
+		}
+		n = sizeof(c->buf) - c->buflen;
+		if (n > len)
+			n = len;
+		memcpy(c->buf + c->buflen, p, n);
+		c->buflen += n;
+		p += n;
+		len -= n;
+		if (len > 0) { /* full buffer with more input behind it */
+			xxh3_consume(c->acc, &c->nstripes, c->buf, c->buflen / XSTRIPE, c->secret, accumulate, scramble);
+			memcpy(c->last, c->buf + c->buflen - XSTRIPE, XSTRIPE);
+			c->buflen = 0;
+		}
+	}
+}
+
+uint64_t
+crypt_xxh3_digest(const crypt_xxh3_ctx *c) {
+	xxh3accumulate accumulate;
+	xxh3scramble scramble;
+	uint64_t acc[8];
+	size_t nstripes = c->nstripes, n;
+	uint8_t last[XSTRIPE];
+	if (c->total <= 240)
+		return crypt_xxh3(c->buf, c->total, c->seed);
+	xxh3_kernels(&accumulate, &scramble);
+	memcpy(acc, c->acc, sizeof(acc));
+	n = (c->buflen - 1) / XSTRIPE; /* stripes with more input behind them */
+	xxh3_consume(acc, &nstripes, c->buf, n, c->secret, accumulate, scramble);
+	if (c->buflen >= XSTRIPE)
+		memcpy(last, c->buf + c->buflen - XSTRIPE, XSTRIPE);
+	else { /* the last stripe starts in the previous one */
+		memcpy(last, c->last + c->buflen, XSTRIPE - c->buflen);
+		memcpy(last + XSTRIPE - c->buflen, c->buf, c->buflen);
+	}
+	accumulate(acc, last, c->secret + XSECRET_SIZE - XSTRIPE - 7, 1);
+	return xxh3_merge(acc, c->secret, c->total);
+}
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** BLAKE3
+** =======================================================
+*/
+
+#define B3_CHUNK 1024
+#define B3_CHUNK_START 1
+#define B3_CHUNK_END 2
+#define B3_PARENT 4
+#define B3_ROOT 8
+
+/* subtrees at least this large are split across threads */
+#define B3_PARALLEL_MIN (256 * 1024)
+#define B3_MAXDEPTH 4
+
+static const uint8_t b3_sched[7][16] = {
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+	{2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+	{3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+	{10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+	{12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+	{9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+	{11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+#define B3G(v, a, b, c, d, x, y) { \
+	v[a] = v[a] + v[b] + (x); v[d] = ROR32(v[d] ^ v[a], 16); \
+	v[c] = v[c] + v[d]; v[b] = ROR32(v[b] ^ v[c], 12); \
+	v[a] = v[a] + v[b] + (y); v[d] = ROR32(v[d] ^ v[a], 8); \
+	v[c] = v[c] + v[d]; v[b] = ROR32(v[b] ^ v[c], 7); }
+
+#define B3ROUND(v, m, s) { \
+	B3G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]); B3G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]); \
+	B3G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]); B3G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]); \
+	B3G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]); B3G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]); \
+	B3G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]); B3G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]); }
+
+static void
+b3_compress(const uint32_t cv[8], const uint8_t block[64], uint8_t blen,
+            uint64_t counter, uint8_t flags, uint32_t out[16]) {
+	uint32_t m[16], v[16];
+	int i;
+	for (i = 0; i < 16; i++)
+		m[i] = rd32(block + 4*i);
+	for (i = 0; i < 8; i++)
+		v[i] = cv[i];
+	for (i = 0; i < 4; i++)
+		v[8 + i] = sha256_iv[i];
+	v[12] = (uint32_t)counter;
+	v[13] = (uint32_t)(counter >> 32);
+	v[14] = blen;
+	v[15] = flags;
+	for (i = 0; i < 7; i++)
+		B3ROUND(v, m, b3_sched[i]);
+	for (i = 0; i < 8; i++) {
+		out[i] = v[i] ^ v[i + 8];
+		out[i + 8] = v[i + 8] ^ cv[i];
+	}
+}
+
+/* the last compression of a node, kept so the root can be extended */
+typedef struct b3output {
+	uint32_t cv[8];
+	uint8_t block[64];
+	uint8_t blen;
+	uint8_t flags;
+	uint64_t counter;
+} b3output;
+
+static void
+b3_chunk(const uint8_t *in, size_t len, uint64_t counter, b3output *o) {
+	size_t nblocks = len == 0 ? 1 : (len + 63) / 64, b;
+	uint32_t out[16];
+	memcpy(o->cv, sha256_iv, sizeof(o->cv));
+	for (b = 0; b + 1 < nblocks; b++, in += 64) {
+		b3_compress(o->cv, in, 64, counter, b == 0 ? B3_CHUNK_START : 0, out);
+		memcpy(o->cv, out, sizeof(o->cv));
+	}
+	len -= b * 64;
+	memset(o->block, 0, sizeof(o->block));
+	memcpy(o->block, in, len);
+	o->blen = (uint8_t)len;
+	o->counter = counter;
+	o->flags = B3_CHUNK_END | (nblocks == 1 ? B3_CHUNK_START : 0);
+}
+
+static void
+b3_parent(const uint32_t left[8], const uint32_t right[8], b3output *o) {
+	int i;
+	memcpy(o->cv, sha256_iv, sizeof(o->cv));
+	for (i = 0; i < 8; i++) {
+		wr32(o->block + 4*i, left[i]);
+		wr32(o->block + 32 + 4*i, right[i]);
+	}
+	o->blen = 64;
+	o->counter = 0;
+	o->flags = B3_PARENT;
+}
+
+static void
+b3_outputcv(const b3output *o, uint32_t cv[8]) {
+	uint32_t out[16];
+	b3_compress(o->cv, o->block, o->blen, o->counter, o->flags, out);
+	memcpy(cv, out, 8 * sizeof(uint32_t));
+}
+
+#if defined(CRYPT_VECTOR)
+typedef uint32_t b3v8 __attribute__((vector_size(32)));
+
+#define ROR8(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define B3VG(v, a, b, c, d, x, y) { \
+	v[a] = v[a] + v[b] + (x); v[d] = ROR8(v[d] ^ v[a], 16); \
+	v[c] = v[c] + v[d]; v[b] = ROR8(v[b] ^ v[c], 12); \
+	v[a] = v[a] + v[b] + (y); v[d] = ROR8(v[d] ^ v[a], 8); \
+	v[c] = v[c] + v[d]; v[b] = ROR8(v[b] ^ v[c], 7); }
+
+/*
+** Hashes 8 whole consecutive chunks at once, one chunk per vector
+** lane, and stores their chaining values.
+*/
+static inline __attribute__((always_inline)) void
+b3_hash8_body(const uint8_t *in, uint64_t counter, uint32_t cvs[8][8]) {
+	b3v8 h[8], v[16], m[16], lo, hi;
+	int b, i, l, r;
+	for (i = 0; i < 8; i++)
+		for (l = 0; l < 8; l++)
+			h[i][l] = sha256_iv[i];
+	for (l = 0; l < 8; l++) {
+		lo[l] = (uint32_t)(counter + l);
+		hi[l] = (uint32_t)((counter + l) >> 32);
+	}
+	for (b = 0; b < 16; b++) {
+		uint32_t flags = (b == 0 ? B3_CHUNK_START : 0) | (b == 15 ? B3_CHUNK_END : 0);
+		for (i = 0; i < 16; i++)
+			for (l = 0; l < 8; l++)
+				m[i][l] = rd32(in + l * B3_CHUNK + b * 64 + 4 * i);
+		for (i = 0; i < 8; i++)
+			v[i] = h[i];
+		for (i = 0; i < 4; i++)
+			for (l = 0; l < 8; l++)
+				v[8 + i][l] = sha256_iv[i];
+		v[12] = lo;
+		v[13] = hi;
+		for (l = 0; l < 8; l++) {
+			v[14][l] = 64;
+			v[15][l] = flags;
+		}
+		for (r = 0; r < 7; r++) {
+			const uint8_t *s = b3_sched[r];
+			B3VG(v, 0, 4, 8, 12, m[s[0]], m[s[1]]); B3VG(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+			B3VG(v, 2, 6, 10, 14, m[s[4]], m[s[5]]); B3VG(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+			B3VG(v, 0, 5, 10, 15, m[s[8]], m[s[9]]); B3VG(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+			B3VG(v, 2, 7, 8, 13, m[s[12]], m[s[13]]); B3VG(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+		}
+		for (i = 0; i < 8; i++)
+			h[i] = v[i] ^ v[i + 8];
+	}
+	for (l = 0; l < 8; l++)
+		for (i = 0; i < 8; i++)
+			cvs[l][i] = h[i][l];
+}
+
+static void
+b3_hash8_vec(const uint8_t *in, uint64_t counter, uint32_t cvs[8][8]) {
+	b3_hash8_body(in, counter, cvs);
+}
+
+#if defined(CRYPT_X86)
+TARGET("avx2") static void
+b3_hash8_avx2(const uint8_t *in, uint64_t counter, uint32_t cvs[8][8]) {
+	b3_hash8_body(in, counter, cvs);
+}
+#endif
+#endif
+
+typedef void (*b3hash8)(const uint8_t *, uint64_t, uint32_t [8][8]);
+
+typedef struct b3job {
+	const uint8_t *in;
+	size_t len;
+	uint64_t counter;
+	b3hash8 hash8;
+	int depth;
+	uint32_t cv[8];
+} b3job;
+
+/* length of the left subtree: the largest power-of-two number of chunks that leaves some input */
+static size_t
+b3_leftlen(size_t len) {
+	size_t full = (len - 1) / B3_CHUNK, p = 1;
+	while (p * 2 <= full)
+		p *= 2;
+	return p * B3_CHUNK;
+}
+
+static void b3_subtree(b3job *j);
+
+static void *
+b3_thread(void *arg) {
+	b3_subtree((b3job *)arg);
+	return NULL;
+}
+
+/* computes the two children of a subtree larger than one chunk */
+static void
+b3_children(b3job *j, uint32_t left[8], uint32_t right[8]) {
+	size_t ll = b3_leftlen(j->len);
+	b3job l = {j->in, ll, j->counter, j->hash8, j->depth - 1, {0}};
+	b3job r = {j->in + ll, j->len - ll, j->counter + ll / B3_CHUNK, j->hash8, j->depth - 1, {0}};
+	pthread_t th;
+	if (j->depth > 0 && j->len >= 2 * B3_PARALLEL_MIN &&
+	    pthread_create(&th, NULL, b3_thread, &l) == 0) {
+		b3_subtree(&r);
+		pthread_join(th, NULL);
+	}
+	else {
+		b3_subtree(&l);
+		b3_subtree(&r);
+	}
+	memcpy(left, l.cv, sizeof(l.cv));
+	memcpy(right, r.cv, sizeof(r.cv));
+}
+
+static void
+b3_subtree(b3job *j) {
+	b3output o;
+	if (j->len <= B3_CHUNK)
+		b3_chunk(j->in, j->len, j->counter, &o);
+	else if (j->hash8 != NULL && j->len == 8 * B3_CHUNK) {
+		uint32_t cvs[8][8];
+		int n, i;
+		j->hash8(j->in, j->counter, cvs);
+		for (n = 8; n > 1; n /= 2) /* a perfect tree of 8 leaves */
+			for (i = 0; i < n / 2; i++) {
+				b3_parent(cvs[2*i], cvs[2*i+1], &o);
+				b3_outputcv(&o, cvs[i]);
+			}
+		memcpy(j->cv, cvs[0], sizeof(j->cv));
+		return;
+	}
+	else {
+		uint32_t left[8], right[8];
+		b3_children(j, left, right);
+		b3_parent(left, right, &o);
+	}
+	b3_outputcv(&o, j->cv);
+}
+
+static int
+b3_maxdepth(void) {
+	long n = 1;
+	int d = 0;
+#if defined(_SC_NPROCESSORS_ONLN)
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	while (d < B3_MAXDEPTH && (2L << d) <= n)
+		d++;
+	return d;
+}
+
+static b3hash8
+b3_gethash8(void) {
+	b3hash8 hash8 = NULL;
+#if defined(CRYPT_VECTOR)
+	if (accel_on)
+		hash8 = b3_hash8_vec;
+#if defined(CRYPT_X86)
+	if (cpu_active & CRYPT_AVX2)
+		hash8 = b3_hash8_avx2;
+#endif
+#endif
+	return hash8;
+}
+
+static void
+b3_root(const b3output *o, uint8_t *out, size_t outlen) {
+	uint64_t counter;
+	for (counter = 0; outlen > 0; counter++) { /* root output blocks */
+		uint32_t w[16];
+		uint8_t block[64];
+		size_t n = outlen < 64 ? outlen : 64;
+		int i;
+		b3_compress(o->cv, o->block, o->blen, counter, o->flags | B3_ROOT, w);
+		for (i = 0; i < 16; i++)
+			wr32(block + 4*i, w[i]);
+		memcpy(out, block, n);
+		out += n;
+		outlen -= n;
+	}
+}
+
+void
+crypt_blake3(const void *data, size_t len, uint8_t *out, size_t outlen) {
+	b3job j = {(const uint8_t *)data, len, 0, NULL, 0, {0}};
+	b3output o;
+	j.hash8 = b3_gethash8();
+	if (len <= B3_CHUNK)
+		b3_chunk(j.in, len, 0, &o);
+	else {
+		uint32_t left[8], right[8];
+		if (len >= 2 * B3_PARALLEL_MIN)
+			j.depth = b3_maxdepth();
+		b3_children(&j, left, right);
+		b3_parent(left, right, &o);
+	}
+	b3_root(&o, out, outlen);
+}
+
+/*
+** Streaming BLAKE3: the current chunk plus a stack with the chaining
+** values of the complete subtrees to its left. The last chunk is kept
+** open until the digest, which must mark it (or the top parent) as root.
+*/
+
+static void
+b3_resetchunk(crypt_blake3_ctx *c) {
+	memcpy(c->cv, sha256_iv, sizeof(c->cv));
+	c->buflen = 0;
+	c->blocks = 0;
+}
+
+void
+crypt_blake3_init(crypt_blake3_ctx *c) {
+	b3_resetchunk(c);
+	c->counter = 0;
+	c->stacklen = 0;
+}
+
+/* adds the chaining value of chunk number 'total' - 1, merging full subtrees */
+static void
+b3_pushcv(crypt_blake3_ctx *c, uint32_t cv[8], uint64_t total) {
+	for (; (total & 1) == 0; total >>= 1) {
+		b3output o;
+		b3_parent(c->stack[--c->stacklen], cv, &o);
+		b3_outputcv(&o, cv);
+	}
+	memcpy(c->stack[c->stacklen++], cv, 8 * sizeof(uint32_t));
+}
+
+static void
+b3_chunkoutput(const crypt_blake3_ctx *c, b3output *o) {
+	memcpy(o->cv, c->cv, sizeof(o->cv));
+	memset(o->block, 0, sizeof(o->block));
+	memcpy(o->block, c->buf, c->buflen);
+	o->blen = c->buflen;
+	o->counter = c->counter;
+	o->flags = B3_CHUNK_END | (c->blocks == 0 ? B3_CHUNK_START : 0);
+}
+
+void
+crypt_blake3_update(crypt_blake3_ctx *c, const void *data, size_t len) {
+	const uint8_t *p = (const uint8_t *)data;
+	b3hash8 hash8 = b3_gethash8();
+	while (len > 0) {
+		size_t used = c->blocks * 64 + c->buflen, n;
+		if (used == B3_CHUNK) { /* close the chunk, more input follows */
+			b3output o;
+			uint32_t cv[8];
+			b3_chunkoutput(c, &o);
+			b3_outputcv(&o, cv);
+			b3_pushcv(c, cv, ++c->counter);
+			b3_resetchunk(c);
+			used = 0;
+		}
+		if (used == 0 && hash8 != NULL && len > 8 * B3_CHUNK) {
+			uint32_t cvs[8][8];
+			int i;
+			hash8(p, c->counter, cvs);
+			for (i = 0; i < 8; i++)
+				b3_pushcv(c, cvs[i], ++c->counter);
+			p += 8 * B3_CHUNK;
+			len -= 8 * B3_CHUNK;
+			continue;
+		}
+		for (n = B3_CHUNK - used; n > 0 && len > 0; ) {
+			size_t m;
+			if (c->buflen == 64) { /* compress only blocks known not to be last */
+				uint32_t out[16];
+				b3_compress(c->cv, c->buf, 64, c->counter, c->blocks == 0 ? B3_CHUNK_START : 0, out);
+				memcpy(c->cv, out, sizeof(c->cv));
+				c->blocks++;
+				c->buflen = 0;
+			}
+			m = 64 - c->buflen;
+			if (m > n)
+				m = n;
+			if (m > len)
+				m = len;
+			memcpy(c->buf + c->buflen, p, m);
+			c->buflen += m;
+			p += m;
+			len -= m;
+			n -= m;
+		}
+	}
+}
+
+void
+crypt_blake3_final(const crypt_blake3_ctx *c, uint8_t *out, size_t outlen) {
+	b3output o;
+	int i = c->stacklen;
+	b3_chunkoutput(c, &o);
+	while (i > 0) {
+		uint32_t cv[8];
+		b3_outputcv(&o, cv);
+		b3_parent(c->stack[--i], cv, &o);
+	}
+	b3_root(&o, out, outlen);
+}
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** base64 and hex
+** =======================================================
+*/
+
+static const char b64chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#if defined(CRYPT_X86)
+/* 12 input bytes become 16 characters per step (needs 16 readable bytes) */
+TARGET("ssse3") static size_t
+b64encode_ssse3(const uint8_t *in, size_t len, char *out) {
+	const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	size_t done = 0;
+	for (; len - done >= 16; done += 12, out += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+		__m128i t0, t1, idx;
+		v = _mm_shuffle_epi8(v, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+		t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+		v = _mm_or_si128(t0, t1); /* 6-bit indices */
+		idx = _mm_subs_epu8(v, _mm_set1_epi8(51));
+		idx = _mm_sub_epi8(idx, _mm_cmpgt_epi8(v, _mm_set1_epi8(25)));
+		_mm_storeu_si128((__m128i *)out, _mm_add_epi8(v, _mm_shuffle_epi8(lut, idx)));
+	}
+	return done;
+}
+
+TARGET("ssse3") static size_t
+b64decode_ssse3(const uint8_t *in, size_t len, uint8_t *out) {
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	                                     0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+	                                     0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2F);
+	size_t done = 0;
+	for (; len - done >= 16; done += 16, out += 12) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+		__m128i hin = _mm_and_si128(_mm_srli_epi32(v, 4), mask_2f);
+		__m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, _mm_and_si128(v, mask_2f)),
+		                            _mm_shuffle_epi8(lut_hi, hin));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF)
+			break; /* padding or a character to skip: leave it to the scalar loop */
+		v = _mm_add_epi8(v, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(v, mask_2f), hin)));
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storeu_si128((__m128i *)out, v);
+	}
+	return done;
+}
+
+TARGET("ssse3") static size_t
+hexencode_ssse3(const uint8_t *in, size_t len, char *out) {
+	const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+	                                  '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m128i low = _mm_set1_epi8(0x0f);
+	size_t done = 0;
+	for (; len - done >= 16; done += 16, out += 32) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+		__m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), low));
+		__m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, low));
+		_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	return done;
+}
+#endif
+
+size_t
+crypt_b64encode(const uint8_t *in, size_t len, char *out) {
+	size_t i = 0;
+	char *o = out;
+#if defined(CRYPT_X86)
+	if (cpu_active & CRYPT_SSSE3) {
+		i = b64encode_ssse3(in, len, out);
+		o += i / 3 * 4;
+	}
+#endif
+	for (; i + 2 < len; i += 3, o += 4) {
+		uint32_t v = in[i] << 16 | in[i+1] << 8 | in[i+2];
+		o[0] = b64chars[v >> 18];
+		o[1] = b64chars[(v >> 12) & 0x3f];
+		o[2] = b64chars[(v >> 6) & 0x3f];
+		o[3] = b64chars[v & 0x3f];
+	}
+	if (len - i == 1) {
+		o[0] = b64chars[in[i] >> 2];
+		o[1] = b64chars[(in[i] & 3) << 4];
+		o[2] = o[3] = '=';
+		o += 4;
+	}
+	else if (len - i == 2) {
+		uint32_t v = in[i] << 8 | in[i+1];
+		o[0] = b64chars[v >> 10];
+		o[1] = b64chars[(v >> 4) & 0x3f];
+		o[2] = b64chars[(v & 0xf) << 2];
+		o[3] = '=';
+		o += 4;
+	}
+	return o - out;
+}
+
+size_t
+crypt_b64decode_fast(const uint8_t *in, size_t len, uint8_t *out, size_t *outlen) {
+	size_t n = 0;
+#if defined(CRYPT_X86)
+	if (cpu_active & CRYPT_SSSE3)
+		n = b64decode_ssse3(in, len, out);
+#endif
+	*outlen = n / 4 * 3;
+	return n;
+}
+
+size_t
+crypt_hexencode(const uint8_t *in, size_t len, char *out) {
+	static const char hex[] = "0123456789abcdef";
+	size_t i = 0;
+#if defined(CRYPT_X86)
+	if (cpu_active & CRYPT_SSSE3)
+		i = hexencode_ssse3(in, len, out);
+#endif
+	for (; i < len; i++) {
+		out[i*2] = hex[in[i] >> 4];
+		out[i*2+1] = hex[in[i] & 0xf];
+	}
+	return len * 2;
+}
+
+/* }====================================================== */
@@ -0,0 +1,100 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+
+#if !defined(lcrypthash_h)
+#define lcrypthash_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cobalt.h"
+
+/*
+** CPU features used by the accelerated paths. They are detected once
+** by 'crypt_initcpu'; 'crypt_setaccel(0)' falls back to the portable
+** code everywhere, which is what benchmarks compare against.
+*/
+#define CRYPT_SSSE3 0x01
+#define CRYPT_SSE41 0x02
+#define CRYPT_SSE42 0x04
+#define CRYPT_AVX2  0x08
+#define CRYPT_SHA   0x10
+
+LUAI_FUNC void crypt_initcpu(void);
+LUAI_FUNC int crypt_setaccel(int on);
+LUAI_FUNC int crypt_features(void);
+
+/* SHA-256 */
+typedef struct crypt_sha256 {
+	uint32_t h[8];
+	uint64_t len;
+	uint8_t buf[64];
+} crypt_sha256;
+
+LUAI_FUNC void crypt_sha256_init(crypt_sha256 *c);
+LUAI_FUNC void crypt_sha256_update(crypt_sha256 *c, const void *data, size_t len);
+LUAI_FUNC void crypt_sha256_final(crypt_sha256 *c, uint8_t out[32]);
+
+/* CRC-32C (Castagnoli); 'crc' is the result for the preceding data */
+LUAI_FUNC uint32_t crypt_crc32c(uint32_t crc, const void *data, size_t len);
+
+/* XXH3, 64-bit variant */
+typedef struct crypt_xxh3_ctx {
+	uint64_t acc[8];
+	uint64_t seed;
+	uint64_t total;
+	size_t nstripes; /* stripes consumed in the current block */
+	size_t buflen;
+	uint8_t secret[192];
+	uint8_t buf[256];
+	uint8_t last[64]; /* the stripe consumed last */
+} crypt_xxh3_ctx;
+
+LUAI_FUNC uint64_t crypt_xxh3(const void *data, size_t len, uint64_t seed);
+LUAI_FUNC void crypt_xxh3_init(crypt_xxh3_ctx *c, uint64_t seed);
+LUAI_FUNC void crypt_xxh3_update(crypt_xxh3_ctx *c, const void *data, size_t len);
+LUAI_FUNC uint64_t crypt_xxh3_digest(const crypt_xxh3_ctx *c);
+
+/* BLAKE3 with an extendable output of 'outlen' bytes */
+typedef struct crypt_blake3_ctx {
+	uint32_t cv[8]; /* current chunk */
+	uint64_t counter;
+	uint8_t buf[64];
+	uint8_t buflen;
+	uint8_t blocks;
+	uint8_t stacklen;
+	uint32_t stack[54][8];
+} crypt_blake3_ctx;
+
+LUAI_FUNC void crypt_blake3(const void *data, size_t len, uint8_t *out,
+                            size_t outlen);
+LUAI_FUNC void crypt_blake3_init(crypt_blake3_ctx *c);
+LUAI_FUNC void crypt_blake3_update(crypt_blake3_ctx *c, const void *data, size_t len);
+LUAI_FUNC void crypt_blake3_final(const crypt_blake3_ctx *c, uint8_t *out,
+                                  size_t outlen);
+
+/* base64 and hex; 'out' needs room for the encoded size */
+LUAI_FUNC size_t crypt_b64encode(const uint8_t *in, size_t len, char *out);
+LUAI_FUNC size_t crypt_hexencode(const uint8_t *in, size_t len, char *out);
+
+/*
+** Decodes the longest prefix of 'in' made of complete 4-character
+** groups without padding or invalid characters, 16 at a time; returns
+** the number of characters consumed and sets '*outlen'. 'out' needs 4
+** bytes of slack beyond the decoded size.
+*/
+LUAI_FUNC size_t crypt_b64decode_fast(const uint8_t *in, size_t len,
+                                      uint8_t *out, size_t *outlen);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -11,6 +11,7 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <vector>
 #include <stack>
@@ -20,6 +21,8 @@
 #include "lcode.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lprefix.h"
@@ -121,6 +124,7 @@ LUA_API void lua_sethook(lua_State *L, lua_Hook func, int mask, int count) {
     mask = 0;
     func = NULL;
   }
+  mask |= L->hookmask & LUAI_MASKPROFILE; /* hooks do not stop the profiler */
   L->hook = func;
   L->basehookcount = count;
   resethookcount(L);
@@ -128,6 +132,102 @@ LUA_API void lua_sethook(lua_State *L, lua_Hook func, int mask, int count) {
   if (mask) settraps(L->ci); /* to trace inside 'luaV_execute' */
 }
 
+/*
+** {======================================================
+** Profiler
+**
+** While on, every Lua function counts its calls ('ncalls'), backward
+** jumps ('nloops') and, for each test instruction, how often the jump
+** after it was taken or skipped ('branches'). Counting happens in
+** 'luaG_traceexec', so the profiler runs with the same overhead as a
+** line hook. The first closure of every counted function is anchored
+** in the registry so that the counts survive until they are dumped.
+** =======================================================
+*/
+
+static void profileanchor(lua_State *L, TValue *func) {
+  TString *key = luaS_new(L, LUA_PROFILE_TABLE);
+  const TValue *t = luaH_getstr(hvalue(&G(L)->l_registry), key);
+  if (ttistable(t)) {
+    Table *h = hvalue(t);
+    luaH_setint(L, h, luaH_getn(h) + 1, func);
+    luaC_barrierback(L, obj2gco(h), func);
+  }
+}
+
+void luaG_profilecall(lua_State *L, CallInfo *ci) {
+  Proto *p = ci_func(ci)->p;
+  if (p->ncalls++ == 0 && p->nloops == 0) profileanchor(L, s2v(ci->func));
+}
+
+/* count the move from 'L->oldpc' to 'npci' */
+static void profileexec(lua_State *L, CallInfo *ci, Proto *p, int npci) {
+  int oldpc = (L->oldpc < p->sizecode) ? L->oldpc : 0;
+  if (npci == oldpc) return; /* entering the function */
+  if (npci < oldpc) {        /* jump back (loop)? */
+    if (p->nloops++ == 0 && p->ncalls == 0) profileanchor(L, s2v(ci->func));
+  }
+  if (testTMode(GET_OPCODE(p->code[oldpc]))) {
+    if (p->branches == NULL) {
+      p->branches = luaM_newvector(L, 2 * p->sizecode, l_uint32);
+      memset(p->branches, 0, 2 * p->sizecode * sizeof(l_uint32));
+    }
+    /* a test either skips its jump or goes to the jump's target */
+    p->branches[2 * oldpc + (npci == oldpc + 2)]++;
+  }
+}
+
+LUA_API void lua_setprofile(lua_State *L, int on) {
+  if (on) {
+    if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_PROFILE_TABLE) != LUA_TTABLE) {
+      lua_newtable(L);
+      lua_setfield(L, LUA_REGISTRYINDEX, LUA_PROFILE_TABLE);
+    }
+    lua_pop(L, 1);
+    L->hookmask |= LUAI_MASKPROFILE;
+    settraps(L->ci); /* to trace inside 'luaV_execute' */
+  } else {
+    L->hookmask &= ~LUAI_MASKPROFILE;
+  }
+}
+
+/*
+** Writes the counts as text, one line per function ("f linedefined calls
+** loops source") followed by one line per test that ran ("b pc jumps
+** skips"). Functions not loaded from a named chunk are left out.
+*/
+LUA_API int lua_dumpprofile(lua_State *L, lua_Writer writer, void *data) {
+  char buff[100];
+  int status = 0;
+  if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_PROFILE_TABLE) == LUA_TTABLE) {
+    lua_Unsigned n = lua_rawlen(L, -1);
+    for (lua_Unsigned i = 1; i <= n && status == 0; i++) {
+      lua_rawgeti(L, -1, i);
+      const Proto *p = clLvalue(s2v(L->top - 1))->p;
+      const char *source = p->source ? getstr(p->source) : "=?";
+      lua_pop(L, 1);
+      if (*source != '@' && *source != '=') continue;
+      int len = snprintf(buff, sizeof(buff), "f %d %llu %llu ", p->linedefined,
+                         (unsigned long long)p->ncalls,
+                         (unsigned long long)p->nloops);
+      status = writer(L, buff, len, data);
+      if (status == 0) status = writer(L, source, strlen(source), data);
+      if (status == 0) status = writer(L, "\n", 1, data);
+      for (int pc = 0; p->branches && pc < p->sizecode && status == 0; pc++) {
+        l_uint32 jumps = p->branches[2 * pc], skips = p->branches[2 * pc + 1];
+        if (jumps == 0 && skips == 0) continue;
+        len = snprintf(buff, sizeof(buff), "b %d %lu %lu\n", pc,
+                       (unsigned long)jumps, (unsigned long)skips);
+        status = writer(L, buff, len, data);
+      }
+    }
+  }
+  lua_pop(L, 1);
+  return status;
+}
+
+/* }====================================================== */
+
 LUA_API lua_Hook lua_gethook(lua_State *L) { return L->hook; }
 
 LUA_API int lua_gethookmask(lua_State *L) { return L->hookmask; }
@@ -840,12 +940,17 @@ int luaG_traceexec(lua_State *L, const Instruction *pc) {
   lu_byte mask = L->hookmask;
   const Proto *p = ci_func(ci)->p;
   int counthook;
-  if (!(mask & (LUA_MASKLINE | LUA_MASKCOUNT))) { /* no hooks? */
-    ci->u.l.trap = 0;                             /* don't need to stop again */
-    return 0;                                     /* turn off 'trap' */
+  if (!(mask & (LUA_MASKLINE | LUA_MASKCOUNT | LUAI_MASKPROFILE))) {
+    ci->u.l.trap = 0; /* no hooks; don't need to stop again */
+    return 0;         /* turn off 'trap' */
   }
   pc++;                 /* reference is always next instruction */
   ci->u.l.savedpc = pc; /* save 'pc' */
+  if (mask & LUAI_MASKPROFILE) {
+    int npci = pcRel(pc, p);
+    profileexec(L, ci, ci_func(ci)->p, npci);
+    if (!(mask & LUA_MASKLINE)) L->oldpc = npci; /* else done below */
+  }
   counthook = (--L->hookcount == 0 && (mask & LUA_MASKCOUNT));
   if (counthook)
     resethookcount(L); /* reset count */
@@ -20,6 +20,12 @@ extern "C" {
 
 #define resethookcount(L) (L->hookcount = L->basehookcount)
 
+/* 'hookmask' bit set while the profiler (lua_setprofile) is on */
+#define LUAI_MASKPROFILE (1 << 6)
+
+/* registry table anchoring the closures of profiled functions */
+#define LUA_PROFILE_TABLE "_PROFILE"
+
 /*
 ** mark for entries in 'lineinfo' array that has absolute information in
 ** 'abslineinfo' array
@@ -55,6 +61,7 @@ LUAI_FUNC const char *luaG_addinfo(lua_State *L, const char *msg, TString *src,
                                    int line);
 LUAI_FUNC l_noret luaG_errormsg(lua_State *L);
 LUAI_FUNC int luaG_traceexec(lua_State *L, const Instruction *pc);
+LUAI_FUNC void luaG_profilecall(lua_State *L, CallInfo *ci);
 
 #endif
 
@@ -329,6 +329,7 @@ void luaD_hook(lua_State *L, int event, int line, int ftransfer,
 */
 void luaD_hookcall(lua_State *L, CallInfo *ci) {
   L->oldpc = 0;                     /* set 'oldpc' for new function */
+  if (L->hookmask & LUAI_MASKPROFILE) luaG_profilecall(L, ci);
   if (L->hookmask & LUA_MASKCALL) { /* is call hook on? */
     int event = (ci->callstatus & CIST_TAIL) ? LUA_HOOKTAILCALL : LUA_HOOKCALL;
     Proto *p = ci_func(ci)->p;
@@ -154,7 +154,6 @@ returning: /* trap already set */
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
-        StkId ra = RA(i);
         const TValue *slot;
         TValue *rb = vRB(i);
         TValue *rc = vRC(i);
@@ -200,8 +199,7 @@ returning: /* trap already set */
         TString *key = tsvalue(rb); /* key must be a string */
         
         /* verify locks */
-        Table *t = hvalue(upval);
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(upval) && hvalue(upval)->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
@@ -217,8 +215,7 @@ returning: /* trap already set */
         lua_Unsigned n;
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (ttisinteger(rb) /* fast track for integers? */
@@ -236,8 +233,7 @@ returning: /* trap already set */
         TValue *rc = RKC(i);
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (luaV_fastgeti(L, s2v(ra), c, slot)) {
@@ -539,7 +535,6 @@ returning: /* trap already set */
         vmbreak;
       }
       vmcase(OP_TESTSET) {
-        StkId ra = RA(i);
         TValue *rb = vRB(i);
         if (GETARG_C(i) == NULL_COALESCE) { /* R(C) is used as an identifier, as it was previously unused. */
           if (ttisnil(rb)) {
@@ -562,6 +557,31 @@ returning: /* trap already set */
         }
         vmbreak;
       }
+      vmcase(OP_JMPTAB) {
+        TValue *rv = s2v(ra);
+        lua_Integer n;
+        lua_Unsigned e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (tointegerns(rv, &n)) {
+          n = l_castU2S(l_castS2U(n) - l_castS2U(ivalue(&k[GETARG_Ax(*pc)])));
+          if (l_castS2U(n) < e) e = l_castS2U(n);
+        }
+        pc += 1 + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
+      vmcase(OP_JMPSTR) {
+        TValue *rv = s2v(ra);
+        int e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (ttisstring(rv)) {
+          const TValue *slot = luaH_get(cl->p->jumptabs[GETARG_Ax(*pc)], rv);
+          if (ttisinteger(slot)) e = cast_int(ivalue(slot));
+        }
+        pc += 1 + GETARG_Bx(i) + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
       vmcase(OP_CALL) {
         CallInfo *newci;
         int b = GETARG_B(i);
@@ -819,6 +839,15 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
   trap = L->hookmask;
  returning:  /* trap already set */
   cl = clLvalue(s2v(ci->func));
+#if AOT
+  if (l_unlikely(cl->p->aot_implementation != NULL)) {
+    /* compiled by cobaltaot; it returns the next frame to run */
+    ci = cl->p->aot_implementation(L, ci);
+    if (ci == NULL)
+      return;  /* end this frame */
+    goto startfunc;
+  }
+#endif
   k = cl->p->k;
   pc = ci->u.l.savedpc;
   if (l_unlikely(trap)) {
@@ -906,15 +935,25 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *upval = cl->upvals[GETARG_B(i)]->v;
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
+        LookupCache *lc = NULL;
+        if (cl->p->lcacheidx != NULL && cl->p->lcacheidx[pcRel(pc, cl->p)]) {
+          lc = &cl->p->lcache[cl->p->lcacheidx[pcRel(pc, cl->p)] - 1];
+          if (ttistable(upval) && !trap &&
+              (slot = luaV_cachedslot(lc, hvalue(upval))) != NULL) {
+            setobj2s(L, ra, slot);
+            pc += lc->pair;  /* skip the OP_GETFIELD it also covers */
+            vmbreak;
+          }
+        }
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
           setobj2s(L, ra, slot);
+          if (lc != NULL) luaV_fillcache(L, lc, hvalue(upval), slot, pc, k);
         }
         else
           Protect(luaV_finishget(L, upval, rc, ra, slot));
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
-        StkId ra = RA(i);
         const TValue *slot;
         TValue *rb = vRB(i);
         TValue *rc = vRC(i);
@@ -962,8 +1001,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TString *key = tsvalue(rb);  /* key must be a string */
 
         /* verify locks */
-        Table *t = hvalue(upval);
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(upval) && hvalue(upval)->locked))
           luaG_runerror(L, "attempt to modify locked table.");
 
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
@@ -980,8 +1018,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lua_Unsigned n;
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (ttisinteger(rb)  /* fast track for integers? */
@@ -999,8 +1036,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = RKC(i);
 
         /* verify locks */
-        Table *t = hvalue(s2v(ra));
-        if (l_unlikely(t->locked))
+        if (l_unlikely(ttistable(s2v(ra)) && hvalue(s2v(ra))->locked))
           luaG_runerror(L, "attempt to modify locked table.");
         
         if (luaV_fastgeti(L, s2v(ra), c, slot)) {
@@ -1308,7 +1344,6 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_TESTSET) {
-        StkId ra = RA(i);
         TValue *rb = vRB(i);
         if (GETARG_C(i) == NULL_COALESCE) { /* R(C) is used as an identifier, as it was previously unused. */
           if (ttisnil(rb)) {
@@ -1331,6 +1366,31 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         vmbreak;
       }
+      vmcase(OP_JMPTAB) {
+        TValue *rv = s2v(ra);
+        lua_Integer n;
+        lua_Unsigned e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (tointegerns(rv, &n)) {
+          n = l_castU2S(l_castS2U(n) - l_castS2U(ivalue(&k[GETARG_Ax(*pc)])));
+          if (l_castS2U(n) < e) e = l_castS2U(n);
+        }
+        pc += 1 + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
+      vmcase(OP_JMPSTR) {
+        TValue *rv = s2v(ra);
+        int e = GETARG_Bx(i);  /* last entry, unless one is selected */
+        if (ttisstring(rv)) {
+          const TValue *slot = luaH_get(cl->p->jumptabs[GETARG_Ax(*pc)], rv);
+          if (ttisinteger(slot)) e = cast_int(ivalue(slot));
+        }
+        pc += 1 + GETARG_Bx(i) + e;  /* go to the entry */
+        i = *pc;
+        dojump(ci, i, 1);
+        vmbreak;
+      }
       vmcase(OP_CALL) {
         CallInfo *newci;
         int b = GETARG_B(i);
@@ -10,6 +10,7 @@
 #include "lfunc.h"
 
 #include <stddef.h>
+#include <string.h>
 
 #include "cobalt.h"
 #include "ldebug.h"
@@ -17,8 +18,10 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lprefix.h"
 #include "lstate.h"
+#include "ltable.h"
 
 CClosure *luaF_newCclosure(lua_State *L, int nupvals) {
   GCObject *o = luaC_newobj(L, LUA_VCCL, sizeCclosure(nupvals));
@@ -258,9 +261,89 @@ Proto *luaF_newproto(lua_State *L) {
   f->lastlinedefined = 0;
   f->source = NULL;
   f->aot_implementation = NULL;
+  f->ncalls = 0;
+  f->nloops = 0;
+  f->branches = NULL;
+  f->lcache = NULL;
+  f->lcacheidx = NULL;
+  f->sizelcache = 0;
+  f->jumptabs = NULL;
+  f->sizejumptabs = 0;
+  f->cache = NULL;
   return f;
 }
 
+/*
+** Give each OP_GETTABUP that runs in a loop of 'f' a lookup cache (see
+** 'luaV_fillcache'), up to 255 of them. An instruction runs in a loop
+** when it lies between a backward jump and that jump's target.
+*/
+void luaF_initcache(lua_State *L, Proto *f) {
+  int pc, n = 0;
+  lu_byte *idx = luaM_newvector(L, f->sizecode, lu_byte);
+  memset(idx, 0, f->sizecode);
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    int target;
+    switch (GET_OPCODE(i)) {
+      case OP_JMP: target = pc + 1 + GETARG_sJ(i); break;
+      case OP_FORLOOP: case OP_TFORLOOP: target = pc + 1 - GETARG_Bx(i); break;
+      default: continue;
+    }
+    for (; target < pc; target++)
+      if (GET_OPCODE(f->code[target]) == OP_GETTABUP) idx[target] = 1;
+  }
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (idx[pc] && n < UCHAR_MAX) idx[pc] = cast_byte(++n);
+    else idx[pc] = 0;
+  }
+  if (n == 0) {
+    luaM_freearray(L, idx, f->sizecode);
+    return;
+  }
+  f->lcacheidx = idx; /* set first so that 'luaF_freeproto' frees it */
+  f->lcache = luaM_newvector(L, n, LookupCache);
+  f->sizelcache = n;
+  while (n-- > 0) {
+    f->lcache[n].env = NULL;
+    f->lcache[n].pair = 0;
+  }
+}
+
+/*
+** Build the tables the OP_JMPSTRs of 'f' look their strings up in,
+** from the keys listed after each of them. Each string maps to the
+** entry it selects, the first one when it is listed more than once.
+*/
+void luaF_initjumptabs(lua_State *L, Proto *f) {
+  int pc, n = 0;
+  for (pc = 0; pc < f->sizecode; pc++)
+    if (GET_OPCODE(f->code[pc]) == OP_JMPSTR &&
+        GETARG_Ax(f->code[pc + 1]) >= n)
+      n = GETARG_Ax(f->code[pc + 1]) + 1;
+  if (n == 0) return;
+  f->jumptabs = luaM_newvector(L, n, Table *);
+  for (pc = 0; pc < n; pc++) f->jumptabs[pc] = NULL;
+  f->sizejumptabs = n;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    Table *t;
+    int e;
+    if (GET_OPCODE(i) != OP_JMPSTR) continue;
+    t = luaH_new(L);
+    f->jumptabs[GETARG_Ax(f->code[pc + 1])] = t;
+    luaC_objbarrier(L, f, t);
+    for (e = 0; e < GETARG_Bx(i); e++) {
+      const TValue *key = &f->k[GETARG_Ax(f->code[pc + 2 + e])];
+      TValue v;
+      if (!isempty(luaH_get(t, key))) continue;
+      setivalue(&v, e);
+      luaH_set(L, t, key, &v);
+      luaC_barrierback(L, obj2gco(t), key);
+    }
+  }
+}
+
 void luaF_freeproto(lua_State *L, Proto *f) {
   luaM_freearray(L, f->code, f->sizecode);
   luaM_freearray(L, f->p, f->sizep);
@@ -269,6 +352,10 @@ void luaF_freeproto(lua_State *L, Proto *f) {
   luaM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
+  if (f->branches != NULL) luaM_freearray(L, f->branches, 2 * f->sizecode);
+  if (f->lcacheidx != NULL) luaM_freearray(L, f->lcacheidx, f->sizecode);
+  luaM_freearray(L, f->lcache, f->sizelcache);
+  luaM_freearray(L, f->jumptabs, f->sizejumptabs);
   luaM_free(L, f);
 }
 
@@ -324,6 +324,7 @@ static void reallymarkobject(global_State *g, GCObject *o) {
 static void markmt(global_State *g) {
   int i;
   for (i = 0; i < LUA_NUMTAGS; i++) markobjectN(g, g->mt[i]);
+  markvalue(g, &g->table_mt); /* default metatable of new tables */
 }
 
 /*
@@ -559,7 +560,11 @@ static int traverseproto(global_State *g, Proto *f) {
     markobjectN(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++) /* mark local-variable names */
     markobjectN(g, f->locvars[i].varname);
-  return 1 + f->sizek + f->sizeupvalues + f->sizep + f->sizelocvars;
+  for (i = 0; i < f->sizejumptabs; i++) /* mark jump tables */
+    markobjectN(g, f->jumptabs[i]);
+  markobjectN(g, f->cache);
+  return 2 + f->sizek + f->sizeupvalues + f->sizep + f->sizelocvars +
+         f->sizejumptabs;
 }
 
 static int traverseCclosure(global_State *g, CClosure *cl) {
@@ -629,7 +629,7 @@ static int g_write(lua_State *L, FILE *f, int arg) {
       status = status && (len > 0);
     } else {
       size_t l;
-      const char *s = luaL_checklstring(L, arg, &l);
+      const char *s = luaL_checklbytes(L, arg, &l); /* strings or buffers */
       status = status && (fwrite(s, sizeof(char), l, f) == l);
     }
   }
@@ -685,14 +685,130 @@ static int f_flush(lua_State *L) {
   return luaL_fileresult(L, fflush(tofile(L)) == 0, NULL);
 }
 
+/*
+** {======================================================
+** Mapped buffers: read-only views of a whole file, backed by
+** 'mmap' so that large inputs are neither copied nor kept in the
+** garbage-collected heap.
+** =======================================================
+*/
+
+#if defined(LUA_USE_POSIX) /* { */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int l_mapfile(const char *fname, luaL_Mapped *m) {
+  struct stat st;
+  void *p;
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) != 0) {
+    int en = errno;
+    close(fd);
+    errno = en;
+    return 0;
+  }
+  if (st.st_size == 0) { /* 'mmap' rejects empty ranges */
+    close(fd);
+    m->data = "";
+    m->len = 0;
+    return 1;
+  }
+  p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); /* the mapping keeps its own reference to the file */
+  if (p == MAP_FAILED) return 0;
+  m->data = (const char *)p;
+  m->len = (size_t)st.st_size;
+  return 1;
+}
+
+#define l_unmapfile(m) \
+  ((m)->len > 0 ? (void)munmap((void *)(m)->data, (m)->len) : (void)0)
+
+#else /* }{ */
+
+/* ISO C definitions */
+#define l_mapfile(fname, m) ((void)fname, (void)m, errno = ENOSYS, 0)
+#define l_unmapfile(m) ((void)m)
+
+#endif /* } */
+
+#define tomapped(L) ((luaL_Mapped *)luaL_checkudata(L, 1, LUA_MAPHANDLE))
+
+static int io_map(lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  luaL_Mapped *m = (luaL_Mapped *)lua_newuserdatauv(L, sizeof(luaL_Mapped), 0);
+  m->data = NULL; /* mark as 'closed' until the mapping succeeds */
+  m->len = 0;
+  m->pins = 0;
+  luaL_setmetatable(L, LUA_MAPHANDLE);
+  return l_mapfile(filename, m) ? 1 : luaL_fileresult(L, 0, filename);
+}
+
+static int m_close(lua_State *L) {
+  luaL_Mapped *m = tomapped(L);
+  if (l_unlikely(m->pins > 0)) /* someone is still reading it? */
+    return luaL_error(L, "mapped buffer is in use");
+  if (m->data != NULL) {
+    l_unmapfile(m);
+    m->data = NULL;
+    m->len = 0;
+  }
+  return 0;
+}
+
+static int m_len(lua_State *L) {
+  size_t l;
+  luaL_checklbytes(L, 1, &l);
+  lua_pushinteger(L, (lua_Integer)l);
+  return 1;
+}
+
+static int m_tostring(lua_State *L) {
+  luaL_Mapped *m = tomapped(L);
+  if (m->data == NULL)
+    lua_pushliteral(L, "mapped buffer (closed)");
+  else
+    lua_pushfstring(L, "mapped buffer (%p)", m->data);
+  return 1;
+}
+
+/*
+** methods for mapped buffers; the string library adds its read-only
+** functions ('sub', 'byte', 'find', ...) to the same table (see
+** 'luaL_mapmethods')
+*/
+static const luaL_Reg mapmeth[] = {{"close", m_close}, {NULL, NULL}};
+
+static const luaL_Reg mapmetameth[] = {{"__len", m_len},
+                                       {"__gc", m_close},
+                                       {"__close", m_close},
+                                       {"__tostring", m_tostring},
+                                       {NULL, NULL}};
+
+static void createmapmeta(lua_State *L) {
+  luaL_newmetatable(L, LUA_MAPHANDLE); /* 'string' may have created it */
+  luaL_setfuncs(L, mapmetameth, 0);
+  lua_pop(L, 1);
+  luaL_mapmethods(L);
+  luaL_setfuncs(L, mapmeth, 0);
+  lua_pop(L, 1);
+}
+
+/* }====================================================== */
+
 /*
 ** functions for 'io' library
 */
 static const luaL_Reg iolib[] = {
-    {"close", io_close}, {"flush", io_flush}, {"input", io_input},
-    {"lines", io_lines}, {"open", io_open},   {"output", io_output},
-    {"popen", io_popen}, {"read", io_read},   {"tmpfile", io_tmpfile},
-    {"type", io_type},   {"write", io_write}, {NULL, NULL}};
+    {"close", io_close},     {"flush", io_flush}, {"input", io_input},
+    {"lines", io_lines},     {"map", io_map},     {"open", io_open},
+    {"output", io_output},   {"popen", io_popen}, {"read", io_read},
+    {"tmpfile", io_tmpfile}, {"type", io_type},   {"write", io_write},
+    {NULL, NULL}};
 
 /*
 ** methods for file handles
@@ -746,6 +862,7 @@ static void createstdfile(lua_State *L, FILE *f, const char *k,
 LUAMOD_API int luaopen_io(lua_State *L) {
   luaL_newlib(L, iolib); /* new module */
   createmeta(L);
+  createmapmeta(L);
   /* create (and set) default files */
   createstdfile(L, stdin, IO_INPUT, "stdin");
   createstdfile(L, stdout, IO_OUTPUT, "stdout");
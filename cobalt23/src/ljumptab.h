@@ -46,6 +46,7 @@ static const void *const disptab[NUM_OPCODES] = {
     &&L_OP_RETURN1,  &&L_OP_FORLOOP,    &&L_OP_FORPREP,    &&L_OP_TFORPREP,
     &&L_OP_TFORCALL, &&L_OP_TFORLOOP,   &&L_OP_SETLIST,    &&L_OP_CLOSURE,
     &&L_OP_DEFER,
-    &&L_OP_VARARG,   &&L_OP_VARARGPREP, &&L_OP_EXTRAARG
+    &&L_OP_VARARG,   &&L_OP_VARARGPREP, &&L_OP_EXTRAARG,
+    &&L_OP_JMPTAB,   &&L_OP_JMPSTR
 
 };
@@ -28,6 +28,10 @@
 #include "ltable.h"
 #include "lzio.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define next(ls) (ls->current = zgetc(ls->z))
 
 #define currIsNewline(ls) (ls->current == '\n' || ls->current == '\r')
@@ -63,6 +67,112 @@ static void save(LexState *ls, int c) {
   b->buffer[luaZ_bufflen(b)++] = cast_char(c);
 }
 
+/*
+** {======================================================
+** Bulk scanning
+** =======================================================
+*/
+
+/*
+** 'ls->current' is the character just before 'ls->z->p'. The functions
+** below measure runs of characters among those already in the ZIO
+** buffer, sixteen at a time with SSE2, so that identifiers, spaces,
+** comments and string bodies are consumed a run at a time instead of
+** through 'next'. A run stops at the end of the buffer; the caller's
+** loop then goes on after 'next' refills it.
+*/
+
+/* length of the run of identifier characters at 'p' */
+static size_t spanalnum(const char *p, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i lo0 = _mm_set1_epi8('0' - 1), hi9 = _mm_set1_epi8('9' + 1);
+  const __m128i loa = _mm_set1_epi8('a' - 1), hiz = _mm_set1_epi8('z' + 1);
+  const __m128i lower = _mm_set1_epi8(0x20), under = _mm_set1_epi8('_');
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i l = _mm_or_si128(v, lower); /* ASCII letters in lower case */
+    __m128i m = _mm_or_si128(
+        _mm_and_si128(_mm_cmpgt_epi8(v, lo0), _mm_cmplt_epi8(v, hi9)),
+        _mm_or_si128(
+            _mm_and_si128(_mm_cmpgt_epi8(l, loa), _mm_cmplt_epi8(l, hiz)),
+            _mm_cmpeq_epi8(v, under)));
+    unsigned int mask = ~(unsigned int)_mm_movemask_epi8(m) & 0xFFFF;
+    if (mask != 0) { /* the run ends in this block (or goes non-ASCII)? */
+      i += __builtin_ctz(mask);
+      break;
+    }
+  }
+#endif
+  while (i < n && lislalnum(cast_uchar(p[i]))) i++;
+  return i;
+}
+
+/* length of the run of blanks (' ' and '\t') at 'p' */
+static size_t spanblank(const char *p, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    unsigned int mask = ~(unsigned int)_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab))) & 0xFFFF;
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#endif
+  while (i < n && (p[i] == ' ' || p[i] == '\t')) i++;
+  return i;
+}
+
+/* length of the run at 'p' without any of the characters 'a' to 'd' */
+static size_t spanuntil(const char *p, size_t n, char a, char b, char c,
+                        char d) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+  const __m128i vc = _mm_set1_epi8(c), vd = _mm_set1_epi8(d);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd))));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < n; i++) {
+    char ch = p[i];
+    if (ch == a || ch == b || ch == c || ch == d) break;
+  }
+  return i;
+}
+
+/* skips 'ls->current' and the 'n' characters after it */
+static void skipspan(LexState *ls, size_t n) {
+  ls->z->p += n;
+  ls->z->n -= n;
+  next(ls);
+}
+
+/* saves 'ls->current' and the 'n' characters after it */
+static void savespan(LexState *ls, size_t n) {
+  Mbuffer *b = ls->buff;
+  save(ls, ls->current);
+  if (luaZ_bufflen(b) + n > luaZ_sizebuffer(b)) {
+    size_t newsize = luaZ_sizebuffer(b);
+    while (luaZ_bufflen(b) + n > newsize) {
+      if (newsize >= MAX_SIZE / 2)
+        lexerror(ls, "lexical element too long", 0, "llong");
+      newsize *= 2;
+    }
+    luaZ_resizebuffer(ls->L, b, newsize);
+  }
+  memcpy(b->buffer + luaZ_bufflen(b), ls->z->p, n);
+  luaZ_bufflen(b) += n;
+  skipspan(ls, n);
+}
+
+/* }====================================================== */
+
 void luaX_init(lua_State *L) {
   int i;
   TString *e = luaS_newliteral(L, LUA_ENV); /* create env name */
@@ -383,10 +493,11 @@ static void read_long_string(LexState *ls, SemInfo *seminfo, size_t sep) {
         break;
       }
       default: {
+        size_t n = spanuntil(ls->z->p, ls->z->n, ']', '\n', '\r', ']');
         if (seminfo)
-          save_and_next(ls);
+          savespan(ls, n);
         else
-          next(ls);
+          skipspan(ls, n);
       }
     }
   }
@@ -681,7 +792,8 @@ static void read_string(LexState *ls, int del, SemInfo *seminfo) {
         break;
       }
       default:
-        save_and_next(ls);
+        savespan(ls, spanuntil(ls->z->p, ls->z->n, cast_char(del), '\\',
+                               '\n', '\r'));
     }
   }
   save_and_next(ls); /* skip delimiter */
@@ -703,15 +815,16 @@ int llex(LexState *ls, SemInfo *seminfo) {
       case '\f':
       case '\t':
       case '\v': { /* spaces */
-        next(ls);
+        skipspan(ls, spanblank(ls->z->p, ls->z->n));
         break;
       }
       case '/': { /* '//' (comment) */
         next(ls);
         // short comment
         if (ls->current == '/') {
-          while (!currIsNewline(ls) && ls->current != EOZ)
-            next(ls); /* skip until end of line (or end of file) */
+          while (!currIsNewline(ls) && ls->current != EOZ) /* skip line */
+            skipspan(ls,
+                     spanuntil(ls->z->p, ls->z->n, '\n', '\r', '\n', '\r'));
           break;
           // long comment
         } else if (ls->current == '*') {
@@ -751,8 +864,10 @@ int llex(LexState *ls, SemInfo *seminfo) {
                 inclinenumber(ls);
                 break;
               }
-              default:
-                next(ls);
+              default: /* skip to the next character that matters */
+                skipspan(ls, eq_follow
+                    ? spanuntil(ls->z->p, ls->z->n, '=', '\n', '\r', '=')
+                    : spanuntil(ls->z->p, ls->z->n, '*', '/', '\n', '\r'));
             }
           }
         } else {
@@ -911,7 +1026,7 @@ int llex(LexState *ls, SemInfo *seminfo) {
         if (lislalpha(ls->current)) { /* identifier or reserved word? */
           TString *ts;
           do {
-            save_and_next(ls);
+            savespan(ls, spanalnum(ls->z->p, ls->z->n));
           } while (lislalnum(ls->current));
           ts =
               luaX_newstring(ls, luaZ_buffer(ls->buff), luaZ_bufflen(ls->buff));
@@ -100,7 +100,7 @@ enum RESERVED {
 };
 
 /* number of reserved words */
-#define NUM_RESERVED (cast_int(TK_WHILE - FIRST_RESERVED))
+#define NUM_RESERVED (cast_int(TK_WHILE - FIRST_RESERVED + 1))
 
 typedef union {
   lua_Number r;
@@ -147,6 +147,7 @@ typedef struct LexState {
   /** configurations */
   bool strict_type_config=false;
   bool check_type=false;
+  int optimize=0; /* level of 'luaK_optimize', 0 to skip it */
 
   /** methods */
   [[nodiscard]] TString* getParentClass() const noexcept {
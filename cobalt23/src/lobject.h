@@ -548,6 +548,23 @@ typedef struct AbsLineInfo {
   int line;
 } AbsLineInfo;
 
+/*
+** Cache of a global lookup made in a loop: the slot of table 'env' where
+** 'OP_GETTABUP' found its value and, with 'pair', the slot of table 'tab'
+** (the value in the first slot) where the 'OP_GETFIELD' after it found
+** its own. Slots are read when the cache is used, so stores do not affect
+** it; it is valid while the shapes of the tables are the ones recorded.
+*/
+typedef struct LookupCache {
+  struct Table *env; /* NULL if never filled */
+  struct Table *tab;
+  const TValue *slot;
+  const TValue *fslot;
+  lu_mem envshape;
+  lu_mem tabshape;
+  lu_byte pair;
+} LookupCache;
+
 /*
 ** AOT implementation
 */
@@ -581,6 +598,15 @@ typedef struct Proto {
   TString *source; /* used for debug information */
   GCObject *gclist;
   AotCompiledFunction aot_implementation; /* used in AOT C compiler */
+  lu_mem ncalls;      /* profiling: number of calls */
+  lu_mem nloops;      /* profiling: number of backward jumps */
+  l_uint32 *branches; /* profiling: jumps and skips of each test, or NULL */
+  LookupCache *lcache; /* caches of the global lookups in loops, or NULL */
+  lu_byte *lcacheidx;  /* 1 + cache used by each instruction, or 0 */
+  int sizelcache;
+  struct Table **jumptabs; /* entry of each string for the OP_JMPSTRs */
+  int sizejumptabs;
+  struct LClosure *cache; /* closure shared by all instances (no upvalues) */
 } Proto;
 
 /* }================================================================== */
@@ -754,6 +780,16 @@ typedef union Node {
 #define setrealasize(t) ((t)->flags &= cast_byte(~BITRAS))
 #define setnorealasize(t) ((t)->flags |= BITRAS)
 
+/*
+** Tables read by a lookup cache (see 'luaV_fillcache') are 'watched'. A
+** watched table takes a new 'shape' whenever its nodes may move; shapes
+** come from 'shapestamp' in the global state, so they are never reused,
+** not even by a table allocated where a freed one was.
+*/
+#define BITWATCH (1 << 6)
+#define iswatched(t) ((t)->flags & BITWATCH)
+#define setwatched(t) ((t)->flags |= BITWATCH)
+
 typedef struct Table {
   CommonHeader;
   lu_byte flags;       /* 1<<p means tagmethod(p) is not present */
@@ -765,6 +801,7 @@ typedef struct Table {
   struct Table *metatable;
   GCObject *gclist;
   int locked; /* for locked tables */
+  lu_mem shape; /* layout of 'node' while watched, 0 before */
 } Table;
 
 /*
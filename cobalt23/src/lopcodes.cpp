@@ -182,4 +182,8 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
     opmode(0, 0, 1, 0, 1, iABC) /* OP_VARARGPREP */
     ,
     opmode(0, 0, 0, 0, 0, iAx) /* OP_EXTRAARG */
+    ,
+    opmode(0, 0, 0, 0, 0, iABx) /* OP_JMPTAB */
+    ,
+    opmode(0, 0, 0, 0, 0, iABx) /* OP_JMPSTR */
 };
@@ -313,11 +313,16 @@ typedef enum {
 
   OP_VARARGPREP, /*A	(adjust vararg parameters)			*/
 
-  OP_EXTRAARG /*	Ax	extra (larger) argument for previous opcode
+  OP_EXTRAARG, /*	Ax	extra (larger) argument for previous opcode
                */
+
+  /* opcodes added after the chunk format was fixed go here, so that
+     precompiled chunks keep their opcode numbers */
+  OP_JMPTAB, /*	A Bx	take entry R[A] - K[extra arg] of the jump table (*) */
+  OP_JMPSTR  /*	A Bx	take the entry of string R[A] in the jump table (*) */
 } OpCode;
 
-#define NUM_OPCODES ((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES ((int)(OP_JMPSTR) + 1)
 
 /*===========================================================================
   Notes:
@@ -370,6 +375,16 @@ typedef enum {
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) OP_JMPTAB and OP_JMPSTR are followed by a jump table of Bx + 1
+  OP_JMPs; they jump to where the selected entry jumps, or to where the
+  last entry jumps when no entry is selected. For OP_JMPTAB, the next
+  instruction is an OP_EXTRAARG with the constant index of the integer
+  that selects the first entry, and the table follows it. For
+  OP_JMPSTR, the next instruction is an OP_EXTRAARG with the index of
+  the table in 'jumptabs' of the function, then come Bx OP_EXTRAARGs
+  with the constant index of the string that selects each entry, and
+  then the table.
+
 ===========================================================================*/
 
 /*
@@ -399,6 +414,9 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 /* "in top" (uses top from previous instruction) */
 #define isIT(i) (testITMode(GET_OPCODE(i)) && GETARG_B(i) == 0)
 
+/* offset from an OP_JMPTAB or OP_JMPSTR to the first entry of its table */
+#define jmptabfirst(i) (GET_OPCODE(i) == OP_JMPSTR ? 2 + GETARG_Bx(i) : 2)
+
 #define opmode(mm, ot, it, t, a, m) \
   (((mm) << 7) | ((ot) << 6) | ((it) << 5) | ((t) << 4) | ((a) << 3) | (m))
 
@@ -60,6 +60,7 @@ typedef struct BlockCnt {
 #define FSCOPE_DOWHILELOOP 0x04 /* Scope is a (breakable) do while in loop. */
 #define LOOP_HAS_BREAK 0x08
 #define LOOP_HAS_CONTINUE 0x10
+#define FSCOPE_SWITCH 0x20      /* Scope is a (breakable) switch. */
 
 #define LABEL_BREAK "break"
 #define LABEL_CONTINUE "continue"
@@ -152,6 +153,24 @@ static TString *str_checkname(LexState *ls) {
   return ts;
 }
 
+/* whether the current token is a reserved word */
+#define reservedtoken(ls) \
+  ((ls)->t.token >= FIRST_RESERVED && \
+   (ls)->t.token < FIRST_RESERVED + NUM_RESERVED)
+
+/*
+** Field names may be reserved words ('t.parent', '{ end = 1 }'): the
+** lexer keeps the word's string in 'seminfo' like it does for names.
+*/
+static TString *str_checkfield(LexState *ls) {
+  TString *ts;
+  if (!reservedtoken(ls))
+    return str_checkname(ls);
+  ts = ls->t.seminfo.ts;
+  luaX_next(ls);
+  return ts;
+}
+
 static TString *checkextends (LexState *ls) {
   TString *parent = nullptr;
   if (ls->t.token == TK_EXTENDS) {
@@ -173,6 +192,7 @@ static void codestring(expdesc *e, TString *s) {
   e->f = e->t = NO_JUMP;
   e->k = VKSTR;
   e->u.strval = s;
+  e->allowArrow = true; /* a bare name may always be called with '->' */
 }
 
 static void codename(LexState *ls, expdesc *e) {
@@ -863,6 +883,7 @@ static void close_func(LexState *ls) {
   leaveblock(fs);
   lua_assert(fs->bl == NULL);
   luaK_finish(fs);
+  if (ls->optimize > 0) luaK_optimize(fs, ls->optimize);
   luaM_shrinkvector(L, f->code, f->sizecode, fs->pc, Instruction);
   luaM_shrinkvector(L, f->lineinfo, f->sizelineinfo, fs->pc, ls_byte);
   luaM_shrinkvector(L, f->abslineinfo, f->sizeabslineinfo, fs->nabslineinfo,
@@ -871,6 +892,8 @@ static void close_func(LexState *ls) {
   luaM_shrinkvector(L, f->p, f->sizep, fs->np, Proto *);
   luaM_shrinkvector(L, f->locvars, f->sizelocvars, fs->ndebugvars, LocVar);
   luaM_shrinkvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
+  luaF_initcache(L, f);
+  luaF_initjumptabs(L, f);
   ls->fs = fs->prev;
   luaC_checkGC(L);
 }
@@ -887,6 +910,8 @@ static void close_func(LexState *ls) {
 static int block_follow(LexState *ls /*, int dowhile*/) {
   switch (ls->t.token) {
     case TK_ELSE:
+    case TK_CASE:
+    case TK_DEFAULT:
     case '}':
     case TK_EOS:
       return 1;
@@ -927,7 +952,7 @@ static void fieldsel(LexState *ls, expdesc *v) {
   expdesc key;
   luaK_exp2anyregup(fs, v);
   luaX_next(ls); /* skip the dot or colon */
-  codename(ls, &key);
+  codestring(&key, str_checkfield(ls));
   luaK_indexed(fs, v, &key);
 }
 
@@ -964,9 +989,9 @@ static void recfield(LexState *ls, ConsControl *cc) {
   FuncState *fs = ls->fs;
   int reg = ls->fs->freereg;
   expdesc tab, key, val;
-  if (ls->t.token == TK_NAME) {
+  if (ls->t.token == TK_NAME || reservedtoken(ls)) {
     checklimit(fs, cc->nh, MAX_INT, "items in a constructor");
-    codename(ls, &key);
+    codestring(&key, str_checkfield(ls));
   } else if (ls->t.token == TK_STRING) {
     sindex(ls, &key);
   } else /* ls->t.token == '[' */
@@ -1088,6 +1113,13 @@ static void field(LexState *ls, ConsControl *cc) {
       break;
     }
     default: {
+      if (reservedtoken(ls)) { /* a reserved word used as a key? */
+        int ntk = luaX_lookahead(ls);
+        if (ntk == '=' || ntk == ':') {
+          recfield(ls, cc);
+          break;
+        }
+      }
       listfield(ls, cc);
       break;
     }
@@ -1683,6 +1715,9 @@ static void suffixedexp(LexState *ls, expdesc *v) {
   for (;;) {
     switch (ls->t.token) {
       case '?': {  /* safe navigation */
+        int ntk = luaX_lookahead(ls);
+        if (ntk != '.' && ntk != '[')
+          return;  /* a conditional ('?' exp ':' exp); see 'expr' */
         luaX_next(ls); /* skip '?' */
         
         safe_navigation(ls, v);
@@ -2203,7 +2238,7 @@ static void continuestat(LexState *ls) {
   BlockCnt *bl = ls->fs->bl;
   int line = ls->linenumber;
   luaX_next(ls); /* skip continue */
-  while (bl && !bl->isloop) {
+  while (bl && !(bl->isloop & FSCOPE_LOOP)) { /* switches do not continue */
     bl = bl->previous;
   }
   if (!bl) luaX_syntaxerror(ls, "no loop to continue");
@@ -2559,6 +2594,169 @@ static void ifstat(LexState *ls /*, int line*/) {
   luaK_patchtohere(fs, escapelist); /* patch escape list to 'if' end */
 }
 
+/* minimum number of cases for a switch to be dispatched by a jump table */
+#define SWITCH_MINTABLE 3
+
+typedef struct SwitchCase {
+  int line;    /* line of the case */
+  int isconst; /* true if the case value is the constant 'v' */
+  TValue v;
+  int test;    /* position of the test of a non-constant case */
+  int miss;    /* jumps out of that test when it fails */
+  int body;    /* position of the case body */
+} SwitchCase;
+
+static void constexp(expdesc *e, const TValue *v) {
+  init_exp(e, VNIL, 0);
+  switch (ttypetag(v)) {
+    case LUA_VNUMINT: e->k = VKINT; e->u.ival = ivalue(v); break;
+    case LUA_VNUMFLT: e->k = VKFLT; e->u.nval = fltvalue(v); break;
+    case LUA_VFALSE: e->k = VFALSE; break;
+    case LUA_VTRUE: e->k = VTRUE; break;
+    case LUA_VSHRSTR:
+    case LUA_VLNGSTR: codestring(e, tsvalue(v)); break;
+    default: lua_assert(ttisnil(v)); break;
+  }
+}
+
+/*
+** Code the dispatch of a switch over register 'reg'. When there are
+** enough cases, all constant and either all strings or all integers
+** packed closely enough, it is a jump table; otherwise it tests the
+** cases in order. Cases not taken go to 'deflt' or, without a default,
+** join 'escape'.
+*/
+static void switchdispatch(FuncState *fs, int reg,
+                           const std::vector<SwitchCase> &cases, int deflt,
+                           int *escape) {
+  int n = cast_int(cases.size());
+  int nint = 0, nstr = 0;
+  lua_Integer lo = 0, hi = 0;
+  for (const SwitchCase &c : cases) {
+    if (!c.isconst) {
+      nint = nstr = 0;
+      break;
+    }
+    if (ttisinteger(&c.v)) {
+      lua_Integer x = ivalue(&c.v);
+      if (nint == 0 || x < lo) lo = x;
+      if (nint == 0 || x > hi) hi = x;
+      nint++;
+    }
+    else if (ttisstring(&c.v))
+      nstr++;
+  }
+  if (n >= SWITCH_MINTABLE && nint == n &&
+      l_castS2U(hi) - l_castS2U(lo) < l_castS2U(2 * n) &&
+      l_castS2U(hi) - l_castS2U(lo) < MAXARG_Bx) {
+    int size = cast_int(l_castS2U(hi) - l_castS2U(lo)) + 1;
+    int first = luaK_jumptable(fs, reg, lo, NULL, size);
+    for (int e = 0; e <= size; e++) {
+      int target = deflt;
+      for (const SwitchCase &c : cases) {
+        if (e < size && l_castS2U(ivalue(&c.v)) - l_castS2U(lo) ==
+                            cast(lua_Unsigned, e)) {
+          target = c.body;  /* first case with this value */
+          break;
+        }
+      }
+      if (target == NO_JUMP) luaK_concat(fs, escape, first + e);
+      else luaK_patchlist(fs, first + e, target);
+    }
+  }
+  else if (n >= SWITCH_MINTABLE && nstr == n && n <= MAXARG_Bx) {
+    std::vector<TString *> keys;
+    for (const SwitchCase &c : cases) keys.push_back(tsvalue(&c.v));
+    int first = luaK_jumptable(fs, reg, 0, keys.data(), n);
+    for (int e = 0; e < n; e++) luaK_patchlist(fs, first + e, cases[e].body);
+    if (deflt == NO_JUMP) luaK_concat(fs, escape, first + n);
+    else luaK_patchlist(fs, first + n, deflt);
+  }
+  else {
+    for (const SwitchCase &c : cases) {
+      if (c.isconst) {
+        expdesc r, v;
+        init_exp(&r, VNONRELOC, reg);
+        constexp(&v, &c.v);
+        luaK_infix(fs, OPR_EQ, &r);
+        luaK_posfix(fs, OPR_EQ, &r, &v, c.line);
+        luaK_goiffalse(fs, &r);
+        luaK_patchlist(fs, r.t, c.body);
+      }
+      else {
+        luaK_jumpto(fs, c.test);
+        luaK_patchtohere(fs, c.miss);
+      }
+    }
+    if (deflt != NO_JUMP) luaK_jumpto(fs, deflt);
+  }
+}
+
+static void switchstat(LexState *ls, int line) {
+  /* switchstat -> SWITCH ( exp ) '{' { CASE exp ':' statlist |
+                                        DEFAULT ':' statlist } '}' */
+  FuncState *fs = ls->fs;
+  BlockCnt bl;
+  std::vector<SwitchCase> cases;
+  int deflt = NO_JUMP;
+  int escape, dispatch;
+  int reg;
+  luaX_next(ls); /* skip SWITCH */
+  enterblock(fs, &bl, FSCOPE_SWITCH);
+  reg = fs->freereg;
+  new_localvarliteral(ls, "(switch)");
+  checknext(ls, '(');
+  exp1(ls);
+  checknext(ls, ')');
+  adjustlocalvars(ls, 1);
+  dispatch = luaK_jump(fs); /* the dispatch follows the cases */
+  checknext(ls, '{');
+  while (ls->t.token == TK_CASE || ls->t.token == TK_DEFAULT) {
+    BlockCnt cbl;
+    if (testnext(ls, TK_DEFAULT)) {
+      if (deflt != NO_JUMP)
+        luaX_syntaxerror(ls, "multiple 'default' cases in switch");
+      checknext(ls, ':');
+      deflt = luaK_getlabel(fs);
+    }
+    else {
+      SwitchCase c;
+      expdesc e;
+      int skip = luaK_jump(fs); /* falling into the case skips its test */
+      c.line = ls->linenumber;
+      luaX_next(ls); /* skip CASE */
+      expr(ls, &e);
+      c.isconst = (fs->pc == skip + 1 && luaK_exp2const(fs, &e, &c.v));
+      if (c.isconst) {
+        luaK_removejump(fs); /* the 'skip' jump */
+        c.test = c.miss = NO_JUMP;
+      }
+      else {
+        expdesc r;
+        c.test = skip + 1;
+        init_exp(&r, VNONRELOC, reg);
+        luaK_infix(fs, OPR_EQ, &r);
+        luaK_posfix(fs, OPR_EQ, &r, &e, c.line);
+        luaK_goiftrue(fs, &r);
+        c.miss = r.f;
+        luaK_patchtohere(fs, skip);
+      }
+      checknext(ls, ':');
+      c.body = luaK_getlabel(fs);
+      cases.push_back(c);
+    }
+    enterblock(fs, &cbl, 0);
+    statlist(ls);
+    leaveblock(fs);
+  }
+  check_match(ls, '}', TK_SWITCH, line);
+  escape = luaK_jump(fs); /* the last case leaves over the dispatch */
+  luaK_patchtohere(fs, dispatch);
+  switchdispatch(fs, reg, cases, deflt, &escape);
+  luaK_patchtohere(fs, escape);
+  leaveblock(fs); /* 'break's come to here */
+}
+
 static void localfunc (LexState *ls) {
   expdesc b;
   FuncState *fs = ls->fs;
@@ -3068,6 +3266,9 @@ static void statement(LexState *ls) {
         if (value == 1) ls->check_type = true;
         else if (value == 0) ls->check_type = false;
         else luaX_syntaxerror(ls, "typecheck must be true, false, 0, or 1", "config");
+      } else if ((std::string)name->contents == "optimize"){
+        if (value >= 0 && value <= 2) ls->optimize = value;
+        else luaX_syntaxerror(ls, "optimize must be 0, 1, or 2", "config");
       }else{
         luaX_syntaxerror(ls, "unknown config option", "config");
       }
@@ -3077,6 +3278,10 @@ static void statement(LexState *ls) {
       dowhilestat(ls, line);
       break;
     }
+    case TK_SWITCH: { /* stat -> switchstat */
+      switchstat(ls, line);
+      break;
+    }
     case TK_FUNCTION: { /* stat -> funcstat */
       funcstat(ls, line);
       break;
@@ -3284,6 +3489,7 @@ LClosure *luaY_parser(lua_State *L, ZIO *z, Mbuffer *buff, Dyndata *dyd,
   luaC_objbarrier(L, funcstate.f, funcstate.f->source);
   lexstate.buff = buff;
   lexstate.dyd = dyd;
+  lexstate.optimize = G(L)->optlevel;
   dyd->actvar.n = dyd->gt.n = dyd->label.n = 0;
   luaX_setinput(L, &lexstate, z, funcstate.f->source, firstchar);
   mainfunc(&lexstate, &funcstate);
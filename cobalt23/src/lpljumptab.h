@@ -0,0 +1,27 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+
+static const void *const pdisptab[IEmpty + 1] = {
+
+#if 0
+** you can update the following list with this command:
+**
+**  sed -n '/^  I[A-Z]/!d; s/^  I/\&\&L_I/ ; s/,.*/,/ ; s/ *\/.*// ; p'  lplvm.h
+**
+#endif
+
+    &&L_IAny,           &&L_IChar,         &&L_ISet,
+    &&L_ITestAny,       &&L_ITestChar,     &&L_ITestSet,
+    &&L_ISpan,          &&L_IUTFR,         &&L_IBehind,
+    &&L_IRet,           &&L_IEnd,          &&L_IChoice,
+    &&L_IPredChoice,    &&L_IJmp,          &&L_ICall,
+    &&L_IOpenCall,      &&L_ICommit,       &&L_IPartialCommit,
+    &&L_IBackCommit,    &&L_IFailTwice,    &&L_IFail,
+    &&L_IGiveup,        &&L_IFullCapture,  &&L_IOpenCapture,
+    &&L_ICloseCapture,  &&L_ICloseRunTime, &&L_IThrow,
+    &&L_IThrowRec,      &&L_IEmpty
+
+};
@@ -0,0 +1,92 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+
+#include "lplnative.h"
+
+#include "cobalt.h"
+#include "lauxlib.h"
+#include "lplcode.h"
+#include "lpltypes.h"
+
+#if LPEG_NATIVE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define getoffset(p) (((p) + 1)->offset)
+
+/* the FFI has its own copy of the encoder */
+#define DASM_FDEF static
+#include "asm/dasm_proto.h"
+#include "asm/dasm_x86.h"
+
+#include "lplnative_x64.h"
+
+/*
+** Translate the 'n' instructions of 'code' into machine code. The
+** code keeps pointers to the charsets in 'code', which must outlive it.
+*/
+NativeCode *lpn_compile(lua_State *L, Instruction *code, int n) {
+  dasm_State *d;
+  void *globals[LPN__MAX];
+  NativeCode *nc;
+  size_t head, size;
+  void *mem;
+  int pc, err;
+  dasm_init(&d, DASM_MAXSECTION);
+  dasm_setupglobal(&d, globals, LPN__MAX);
+  dasm_growpc(&d, n);
+  dasm_setup(&d, lpn_actions);
+  emitcommon(&d);
+  emitcode(&d, code, n);
+  if ((err = dasm_link(&d, &size)) != 0) {
+    dasm_free(&d);
+    luaL_error(L, "cannot compile pattern to machine code (error %x)", err);
+  }
+  head = (offsetof(NativeCode, addr) + n * sizeof(unsigned int) + 15) & ~15u;
+  size += head;
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  if (mem == MAP_FAILED) {
+    dasm_free(&d);
+    luaL_error(L, "not enough memory for machine code");
+  }
+  if ((err = dasm_encode(&d, (char *)mem + head)) != 0) {
+    dasm_free(&d);
+    munmap(mem, size);
+    luaL_error(L, "cannot compile pattern to machine code (error %x)", err);
+  }
+  nc = (NativeCode *)mem;
+  nc->size = size;
+  nc->run = (int (*)(NState *, const void *))globals[LPN_run];
+  nc->giveup = globals[LPN_giveup];
+  for (pc = 0; pc < n; pc++) {
+    int ofs = dasm_getpclabel(&d, pc);
+    nc->addr[pc] = (ofs < 0) ? 0 : (unsigned int)(head + ofs);
+  }
+  dasm_free(&d);
+  if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, size);
+    luaL_error(L, "cannot make machine code executable");
+  }
+  return nc;
+}
+
+void lpn_free(NativeCode *nc) { munmap(nc, nc->size); }
+
+#else
+
+NativeCode *lpn_compile(lua_State *L, Instruction *code, int n) {
+  (void)code;
+  (void)n;
+  luaL_error(L, "native compilation not supported on this platform");
+  return NULL;
+}
+
+void lpn_free(NativeCode *nc) { (void)nc; }
+
+#endif
@@ -0,0 +1,86 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+
+#if !defined(lplnative_h)
+#define lplnative_h
+
+#include "lplcap.h"
+#include "lplvm.h"
+
+/*
+** Patterns can be compiled to machine code for x86-64 with the System V
+** calling convention; everywhere else 'lpeg.compile(p, "native")'
+** raises an error.
+*/
+#if !defined(LPEG_NATIVE)
+#if (defined(__x86_64__) || defined(__amd64__)) && !defined(_WIN32)
+#define LPEG_NATIVE 1
+#else
+#define LPEG_NATIVE 0
+#endif
+#endif
+
+/*
+** State of a native match, in memory whenever the machine code is not
+** running. Machine code handles the frequent instructions itself and
+** leaves, with one of the NEXIT codes, for 'nativematch' to do the
+** rest: the instructions that may call Lua or raise errors run in C,
+** so that no error ever unwinds through machine code.
+*/
+typedef struct NState {
+  const char *s;       /* current position */
+  const char *e;       /* end of the subject */
+  const char *o;       /* start of the subject */
+  Stack *stack;        /* first empty slot in the backtrack stack */
+  Stack *stacklimit;
+  Capture *capture;
+  int captop;          /* first empty slot in captures */
+  int capsize;
+  int ndyncap;         /* number of dynamic captures (in Lua stack) */
+  int insidepred;      /* labeled failure */
+  int labelf;          /* labeled failure */
+  int pc;              /* instruction to run in C or to resume at */
+  const char *sfail;   /* labeled failure */
+} NState;
+
+/* why machine code left */
+#define NEXIT_END 0     /* match succeeded; result in 's' */
+#define NEXIT_GIVEUP 1  /* match failed */
+#define NEXIT_STEP 2    /* run instruction 'pc' in C */
+#define NEXIT_FAIL 3    /* backtrack in C (there are dynamic captures) */
+#define NEXIT_CAPTURE 4 /* grow the capture list and resume at 'pc' */
+
+/*
+** Machine code of a pattern, in a mapping of 'size' bytes that starts
+** with this header. 'run' loads the state from 'ns' and jumps to 'at',
+** which is either the code of an instruction ('addr') or an address
+** saved in the backtrack stack.
+*/
+typedef struct NativeCode {
+  size_t size;
+  int (*run)(NState *ns, const void *at);
+  const void *giveup; /* bottom of the backtrack stack */
+  unsigned int addr[1]; /* offset of the code of each instruction */
+} NativeCode;
+
+#define nataddr(nc, pc) ((const void *)((const char *)(nc) + (nc)->addr[pc]))
+
+LUAI_FUNC NativeCode *lpn_compile(lua_State *L, Instruction *code, int n);
+LUAI_FUNC void lpn_free(NativeCode *nc);
+LUAI_FUNC const char *nativematch(lua_State *L, const char *o, const char *s,
+                                  const char *e, Instruction *op,
+                                  NativeCode *nc, Capture *capture, int ptop,
+                                  short *labelf, const char **sfail);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,464 @@
+/*
+** This file has been pre-processed with cobalt's dynASM fork.
+** http://github.com/cobalt-lang/cobalt
+** cobaltASM version 23, cobaltASM x64 version 1.4.0
+** DO NOT EDIT! The original file is in "../src/lplnative.dasc".
+*/
+
+#line 1 "../src/lplnative.dasc"
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+
+/*
+** Machine code for LPeg patterns (see lplnative.h). To regenerate
+** lplnative_x64.h, from the 'lib' directory:
+**
+**   cobalt asm/init.cobalt -D X64 -o ../src/lplnative_x64.h ../src/lplnative.dasc
+*/
+
+//|.arch x64
+#if DASM_VERSION != 2300
+#error "Version mismatch between cobaltASM and included encoding engine"
+#endif
+#line 14 "../src/lplnative.dasc"
+//|.section code
+#define DASM_SECTION_CODE	0
+#define DASM_MAXSECTION		1
+#line 15 "../src/lplnative.dasc"
+//|.actionlist lpn_actions
+static const unsigned char lpn_actions[816] = {
+  254,0,248,10,85,83,65.0,84,65.0,85,65.0,86,65.0,87,72.0,131.0,252,236.0,8,
+  73.0,137.0,252,254.0,73.0,139.0,158.0,233,77.0,139.0,166.0,233,77.0,139.0,
+  174.0,233,69.0,139.0,190.0,233,73.0,139.0,174.0,233,252,255.0,230.0,248,11,
+  73.0,137.0,158.0,233,77.0,137.0,174.0,233,69.0,137.0,190.0,233,72.0,131.0,
+  196.0,8,65.0,95,65.0,94,65.0,93,65.0,92,91,93,195,248,12,184,237,252,233,
+  244,11,248,13,65.0,199.0,134.0,233,237,73.0,59.0,158.0,233,15.0,134.0,244,
+  14,255,73.0,137.0,158.0,233,248,14,65.0,131.0,190.0,233,0,15.0,133.0,244,
+  248,248,1,73.0,129.0,252,237.0,239,73.0,139.0,157.0,233,72.0,133.0,219.0,
+  15.0,132.0,244,1,69.0,139.0,189.0,233,65.0,15.0,182.0,133.0,233,65.0,137.0,
+  134.0,233,65.0,252,255.0,165.0,233,248,2,184,237,252,233,244,11,255,249,255,
+  76.0,57.0,227.0,15.0,131.0,244,13,72.0,131.0,195.0,1,255,76.0,57.0,227.0,
+  15.0,131.0,244,13,128.0,59.0,235,15.0,133.0,244,13,72.0,131.0,195.0,1,255,
+  76.0,57.0,227.0,15.0,131.0,244,13,15.0,182.0,3.0,72.0,186.0,237,237,137.0,
+  193.0,193.0,252,233.0,3,15.0,182.0,12.0,10.0,131.0,224.0,7,15.0,163.0,193.0,
+  15.0,131.0,244,13,72.0,131.0,195.0,1,255,76.0,57.0,227.0,15.0,131.0,245,255,
+  76.0,57.0,227.0,15.0,131.0,245,128.0,59.0,235,15.0,133.0,245,255,76.0,57.0,
+  227.0,15.0,131.0,245,15.0,182.0,3.0,72.0,186.0,237,237,137.0,193.0,193.0,
+  252,233.0,3,15.0,182.0,12.0,10.0,131.0,224.0,7,15.0,163.0,193.0,15.0,131.0,
+  245,255,72.0,186.0,237,237,248,1,76.0,57.0,227.0,15.0,131.0,244,248,15.0,
+  182.0,3.0,137.0,193.0,193.0,252,233.0,3,15.0,182.0,12.0,10.0,131.0,224.0,
+  7,15.0,163.0,193.0,15.0,131.0,244,248,72.0,131.0,195.0,1,252,233,244,1,248,
+  2,255,72.0,137.0,216.0,73.0,43.0,134.0,233,72.0,129.0,252,248.0,239,15.0,
+  140.0,244,13,72.0,129.0,252,235.0,239,255,73.0,129.0,252,237.0,239,65.0,252,
+  255.0,165.0,233,255,73.0,105.0,199.0,239,72.0,1.0,232.0,198.0,128.0,233,235,
+  72.0,199.0,128.0,233,0.0,0.0,0.0,0.0,184,237,252,233,244,11,255,77.0,59.0,
+  174.0,233,15.0,130.0,244,247,65.0,199.0,134.0,233,237,184,237,252,233,244,
+  11,248,1,72.0,141.0,5.0,245,73.0,137.0,133.0,233,73.0,137.0,157.0,233,69.0,
+  137.0,189.0,233,65.0,139.0,134.0,233,65.0,136.0,133.0,233,255,65.0,198.0,
+  133.0,233,0,73.0,129.0,197.0,239,255,65.0,198.0,133.0,233,1,73.0,129.0,197.0,
+  239,65.0,199.0,134.0,233,237,255,252,233,245,255,77.0,59.0,174.0,233,15.0,
+  130.0,244,247,65.0,199.0,134.0,233,237,184,237,252,233,244,11,248,1,73.0,
+  199.0,133.0,233,0.0,0.0,0.0,0.0,72.0,141.0,5.0,245,73.0,137.0,133.0,233,73.0,
+  129.0,197.0,239,252,233,245,255,73.0,129.0,252,237.0,239,252,233,245,255,
+  73.0,129.0,252,237.0,239,73.0,137.0,157.0,233,69.0,137.0,189.0,233,73.0,129.0,
+  197.0,239,252,233,245,255,65.0,131.0,190.0,233,0,15.0,132.0,244,247,65.0,
+  199.0,134.0,233,237,184,237,252,233,244,11,248,1,73.0,129.0,252,237.0,239,
+  73.0,139.0,157.0,233,65.0,15.0,182.0,133.0,233,65.0,137.0,134.0,233,69.0,
+  139.0,189.0,233,252,233,245,255,73.0,129.0,252,237.0,239,252,233,244,13,255,
+  252,233,244,12,255,73.0,105.0,199.0,239,72.0,1.0,232.0,72.0,137.0,217.0,72.0,
+  129.0,252,233.0,239,72.0,137.0,136.0,233,198.0,128.0,233,235,102,199.0,128.0,
+  233,236,198.0,128.0,233,235,65.0,131.0,199.0,1,69.0,59.0,190.0,233,15.0,140.0,
+  244,255,65.0,199.0,134.0,233,237,184,237,252,233,244,11,248,9,255,73.0,105.0,
+  199.0,239,72.0,1.0,232.0,72.0,137.0,152.0,233,198.0,128.0,233,0,102,199.0,
+  128.0,233,236,198.0,128.0,233,235,65.0,131.0,199.0,1,69.0,59.0,190.0,233,
+  15.0,140.0,244,255,65.0,199.0,134.0,233,237,184,237,252,233,244,11,248,9,
+  255,73.0,105.0,199.0,239,72.0,1.0,232.0,72.0,141.0,136.0,233,128.0,185.0,
+  233,0,15.0,133.0,244,248,72.0,137.0,218.0,72.0,43.0,145.0,233,72.0,129.0,
+  252,250.0,239,15.0,141.0,244,248,131.0,194.0,1,136.0,145.0,233,252,233,244,
+  249,248,2,198.0,128.0,233,1,72.0,137.0,152.0,233,102,199.0,128.0,233,236,
+  198.0,128.0,233,235,255,65.0,131.0,199.0,1,69.0,59.0,190.0,233,15.0,140.0,
+  244,255,65.0,199.0,134.0,233,237,184,237,252,233,244,11,248,9,248,3,255,65.0,
+  199.0,134.0,233,237,184,237,252,233,244,11,255
+};
+
+#line 16 "../src/lplnative.dasc"
+//|.globals LPN_
+enum {
+  LPN_run,
+  LPN_leave,
+  LPN_giveup,
+  LPN_failhere,
+  LPN_fail,
+  LPN__MAX
+};
+#line 17 "../src/lplnative.dasc"
+
+//|// registers that live across instructions (all callee-saved)
+//|.define S, rbx          // current position
+//|.define E, r12          // end of the subject
+//|.define STK, r13        // first empty slot in the backtrack stack
+//|.define NS, r14         // the NState
+//|.define CAPTOP, r15d    // first empty slot in captures
+//|.define CAPTOPq, r15
+//|.define CAP, rbp        // the capture list
+
+//|.type NSTATE, NState, NS
+#define Dt1(_V) (int)(ptrdiff_t)&(((NState *)0)_V)
+#line 28 "../src/lplnative.dasc"
+//|.type STACK, Stack, STK
+#define Dt2(_V) (int)(ptrdiff_t)&(((Stack *)0)_V)
+#line 29 "../src/lplnative.dasc"
+//|.type CAPT, Capture
+#define Dt3(_V) (int)(ptrdiff_t)&(((Capture *)0)_V)
+#line 30 "../src/lplnative.dasc"
+
+//|// leave for 'nativematch' to run instruction 'pc' in C
+//|.macro stepexit, pc
+//|  mov dword NSTATE->pc, pc
+//|  mov eax, NEXIT_STEP
+//|  jmp ->leave
+//|.endmacro
+
+//|// carry flag := whether byte 'eax' is in the set at 'rdx' (clobbers ecx)
+//|.macro testset
+//|  mov ecx, eax
+//|  shr ecx, 3
+//|  movzx ecx, byte [rdx+rcx]
+//|  and eax, 7
+//|  bt ecx, eax
+//|.endmacro
+
+//|// rax := address of capture 'captop'
+//|.macro capslot
+//|  imul rax, CAPTOPq, #CAPT
+//|  add rax, CAP
+//|.endmacro
+
+//|// finish the capture at 'rax' and make room for the next one; 'next'
+//|// is the instruction to resume at after the list grows
+//|.macro pushcapture, key, kind, next
+//|  mov word CAPT:rax->idx, key
+//|  mov byte CAPT:rax->kind, kind
+//|  add CAPTOP, 1
+//|  cmp CAPTOP, NSTATE->capsize
+//|  jl >9
+//|  mov dword NSTATE->pc, next
+//|  mov eax, NEXIT_CAPTURE
+//|  jmp ->leave
+//|9:
+//|.endmacro
+
+/*
+** Code shared by all instructions: entry and exit, and backtracking.
+*/
+static void emitcommon(Dst_DECL) {
+  //|.code
+  dasm_put(Dst, 0);
+#line 72 "../src/lplnative.dasc"
+  //|->run:
+  //|  push rbp
+  //|  push rbx
+  //|  push r12
+  //|  push r13
+  //|  push r14
+  //|  push r15
+  //|  sub rsp, 8
+  //|  mov NS, rdi
+  //|  mov S, NSTATE->s
+  //|  mov E, NSTATE->e
+  //|  mov STK, NSTATE->stack
+  //|  mov CAPTOP, NSTATE->captop
+  //|  mov CAP, NSTATE->capture
+  //|  jmp rsi
+  //|
+  //|->leave:
+  //|  mov NSTATE->s, S
+  //|  mov NSTATE->stack, STK
+  //|  mov NSTATE->captop, CAPTOP
+  //|  add rsp, 8
+  //|  pop r15
+  //|  pop r14
+  //|  pop r13
+  //|  pop r12
+  //|  pop rbx
+  //|  pop rbp
+  //|  ret
+  //|
+  //|->giveup:
+  //|  mov eax, NEXIT_GIVEUP
+  //|  jmp ->leave
+  //|
+  //|// a failing instruction: record the farthest failure
+  //|->failhere:
+  //|  mov dword NSTATE->labelf, LFAIL
+  //|  cmp S, NSTATE->sfail
+  //|  jbe ->fail
+  //|  mov NSTATE->sfail, S
+  dasm_put(Dst, 2, Dt1(->s), Dt1(->e), Dt1(->stack), Dt1(->captop), Dt1(->capture), Dt1(->s), Dt1(->stack), Dt1(->captop), NEXIT_GIVEUP, Dt1(->labelf), LFAIL, Dt1(->sfail));
+#line 111 "../src/lplnative.dasc"
+  //|->fail:
+  //|  cmp dword NSTATE->ndyncap, 0
+  //|  jne >2
+  //|1:
+  //|  sub STK, #STACK
+  //|  mov S, STACK->s
+  //|  test S, S
+  //|  jz <1
+  //|  mov CAPTOP, STACK->caplevel
+  //|  movzx eax, byte STACK->labenv
+  //|  mov NSTATE->insidepred, eax
+  //|  jmp aword STACK->p
+  //|2:
+  //|  mov eax, NEXIT_FAIL
+  //|  jmp ->leave
+  dasm_put(Dst, 99, Dt1(->sfail), Dt1(->ndyncap), sizeof(Stack), Dt2(->s), Dt2(->caplevel), Dt2(->labenv), Dt1(->insidepred), Dt2(->p), NEXIT_FAIL);
+#line 126 "../src/lplnative.dasc"
+}
+
+/*
+** Code for the 'n' instructions of 'op'; instruction 'pc' starts at
+** label '=>pc'.
+*/
+static void emitcode(Dst_DECL, const Instruction *op, int n) {
+  int pc;
+  for (pc = 0; pc < n; pc += sizei(op + pc)) {
+    const Instruction *p = op + pc;
+    int aux = p->i.aux, key = p->i.key, kind = getkind(p), off = getoff(p);
+    int target = sizei(p) > 1 ? pc + getoffset(p) : pc;
+    uintptr_t set;
+    //|=>pc:
+    dasm_put(Dst, 159, pc);
+#line 140 "../src/lplnative.dasc"
+    switch ((Opcode)p->i.code) {
+      case IAny:
+        //|  cmp S, E
+        //|  jae ->failhere
+        //|  add S, 1
+        dasm_put(Dst, 161);
+#line 145 "../src/lplnative.dasc"
+        break;
+      case IChar:
+        //|  cmp S, E
+        //|  jae ->failhere
+        //|  cmp byte [S], aux
+        //|  jne ->failhere
+        //|  add S, 1
+        dasm_put(Dst, 173, aux);
+#line 152 "../src/lplnative.dasc"
+        break;
+      case ISet:
+        set = (uintptr_t)(p + 1)->buff;
+        //|  cmp S, E
+        //|  jae ->failhere
+        //|  movzx eax, byte [S]
+        //|  mov64 rdx, set
+        //|  testset
+        //|  jnc ->failhere
+        //|  add S, 1
+        dasm_put(Dst, 192, (unsigned int)(set), (unsigned int)((set)>>32));
+#line 162 "../src/lplnative.dasc"
+        break;
+      case ITestAny:
+        //|  cmp S, E
+        //|  jae =>target
+        dasm_put(Dst, 231, target);
+#line 166 "../src/lplnative.dasc"
+        break;
+      case ITestChar:
+        //|  cmp S, E
+        //|  jae =>target
+        //|  cmp byte [S], aux
+        //|  jne =>target
+        dasm_put(Dst, 238, target, aux, target);
+#line 172 "../src/lplnative.dasc"
+        break;
+      case ITestSet:
+        set = (uintptr_t)(p + 2)->buff;
+        //|  cmp S, E
+        //|  jae =>target
+        //|  movzx eax, byte [S]
+        //|  mov64 rdx, set
+        //|  testset
+        //|  jnc =>target
+        dasm_put(Dst, 251, target, (unsigned int)(set), (unsigned int)((set)>>32), target);
+#line 181 "../src/lplnative.dasc"
+        break;
+      case ISpan:
+        set = (uintptr_t)(p + 1)->buff;
+        //|  mov64 rdx, set
+        //|1:
+        //|  cmp S, E
+        //|  jae >2
+        //|  movzx eax, byte [S]
+        //|  testset
+        //|  jnc >2
+        //|  add S, 1
+        //|  jmp <1
+        //|2:
+        dasm_put(Dst, 284, (unsigned int)(set), (unsigned int)((set)>>32));
+#line 194 "../src/lplnative.dasc"
+        break;
+      case IBehind:
+        //|  mov rax, S
+        //|  sub rax, NSTATE->o
+        //|  cmp rax, aux
+        //|  jl ->failhere
+        //|  sub S, aux
+        dasm_put(Dst, 331, Dt1(->o), aux, aux);
+#line 201 "../src/lplnative.dasc"
+        break;
+      case IRet:
+        //|  sub STK, #STACK
+        //|  jmp aword STACK->p
+        dasm_put(Dst, 353, sizeof(Stack), Dt2(->p));
+#line 205 "../src/lplnative.dasc"
+        break;
+      case IEnd:
+        //|  capslot
+        //|  mov byte CAPT:rax->kind, Cclose
+        //|  mov aword CAPT:rax->s, 0
+        //|  mov eax, NEXIT_END
+        //|  jmp ->leave
+        dasm_put(Dst, 364, sizeof(Capture), Dt3(->kind), Cclose, Dt3(->s), NEXIT_END);
+#line 212 "../src/lplnative.dasc"
+        break;
+      case IChoice:
+      case IPredChoice:
+        //|  cmp STK, NSTATE->stacklimit
+        //|  jb >1
+        //|  stepexit pc
+        //|1:
+        //|  lea rax, [=>target]
+        //|  mov STACK->p, rax
+        //|  mov STACK->s, S
+        //|  mov STACK->caplevel, CAPTOP
+        //|  mov eax, NSTATE->insidepred
+        //|  mov STACK->labenv, al
+        dasm_put(Dst, 390, Dt1(->stacklimit), Dt1(->pc), pc, NEXIT_STEP, target, Dt2(->p), Dt2(->s), Dt2(->caplevel), Dt1(->insidepred), Dt2(->labenv));
+#line 225 "../src/lplnative.dasc"
+        if (p->i.code == IChoice) {
+          //|  mov byte STACK->predchoice, 0
+          //|  add STK, #STACK
+          dasm_put(Dst, 436, Dt2(->predchoice), sizeof(Stack));
+#line 228 "../src/lplnative.dasc"
+        } else {
+          //|  mov byte STACK->predchoice, 1
+          //|  add STK, #STACK
+          //|  mov dword NSTATE->insidepred, INPRED
+          dasm_put(Dst, 446, Dt2(->predchoice), sizeof(Stack), Dt1(->insidepred), INPRED);
+#line 232 "../src/lplnative.dasc"
+        }
+        break;
+      case IJmp:
+        //|  jmp =>target
+        dasm_put(Dst, 461, target);
+#line 236 "../src/lplnative.dasc"
+        break;
+      case ICall:
+        //|  cmp STK, NSTATE->stacklimit
+        //|  jb >1
+        //|  stepexit pc
+        //|1:
+        //|  mov aword STACK->s, 0
+        //|  lea rax, [=>pc + 2]
+        //|  mov STACK->p, rax
+        //|  add STK, #STACK
+        //|  jmp =>target
+        dasm_put(Dst, 465, Dt1(->stacklimit), Dt1(->pc), pc, NEXIT_STEP, Dt2(->s), pc + 2, Dt2(->p), sizeof(Stack), target);
+#line 247 "../src/lplnative.dasc"
+        break;
+      case ICommit:
+        //|  sub STK, #STACK
+        //|  jmp =>target
+        dasm_put(Dst, 510, sizeof(Stack), target);
+#line 251 "../src/lplnative.dasc"
+        break;
+      case IPartialCommit:
+        //|  sub STK, #STACK
+        //|  mov STACK->s, S
+        //|  mov STACK->caplevel, CAPTOP
+        //|  add STK, #STACK
+        //|  jmp =>target
+        dasm_put(Dst, 519, sizeof(Stack), Dt2(->s), Dt2(->caplevel), sizeof(Stack), target);
+#line 258 "../src/lplnative.dasc"
+        break;
+      case IBackCommit:
+        //|  cmp dword NSTATE->ndyncap, 0
+        //|  je >1
+        //|  stepexit pc
+        //|1:
+        //|  sub STK, #STACK
+        //|  mov S, STACK->s
+        //|  movzx eax, byte STACK->labenv
+        //|  mov NSTATE->insidepred, eax
+        //|  mov CAPTOP, STACK->caplevel
+        //|  jmp =>target
+        dasm_put(Dst, 540, Dt1(->ndyncap), Dt1(->pc), pc, NEXIT_STEP, sizeof(Stack), Dt2(->s), Dt2(->labenv), Dt1(->insidepred), Dt2(->caplevel), target);
+#line 270 "../src/lplnative.dasc"
+        break;
+      case IFailTwice:
+        //|  sub STK, #STACK
+        //|  jmp ->failhere
+        dasm_put(Dst, 588, sizeof(Stack));
+#line 274 "../src/lplnative.dasc"
+        break;
+      case IFail:
+        //|  jmp ->failhere
+        dasm_put(Dst, 593);
+#line 277 "../src/lplnative.dasc"
+        break;
+      case IGiveup:
+        //|  jmp ->giveup
+        dasm_put(Dst, 598);
+#line 280 "../src/lplnative.dasc"
+        break;
+      case IFullCapture:
+        //|  capslot
+        //|  mov rcx, S
+        //|  sub rcx, off
+        //|  mov CAPT:rax->s, rcx
+        //|  mov byte CAPT:rax->siz, off + 1
+        //|  pushcapture key, kind, pc + 1
+        dasm_put(Dst, 603, sizeof(Capture), off, Dt3(->s), Dt3(->siz), off + 1, Dt3(->idx), key, Dt3(->kind), kind, Dt1(->capsize), Dt1(->pc), pc + 1, NEXIT_CAPTURE);
+#line 288 "../src/lplnative.dasc"
+        break;
+      case IOpenCapture:
+        //|  capslot
+        //|  mov CAPT:rax->s, S
+        //|  mov byte CAPT:rax->siz, 0
+        //|  pushcapture key, kind, pc + 1
+        dasm_put(Dst, 661, sizeof(Capture), Dt3(->s), Dt3(->siz), Dt3(->idx), key, Dt3(->kind), kind, Dt1(->capsize), Dt1(->pc), pc + 1, NEXIT_CAPTURE);
+#line 294 "../src/lplnative.dasc"
+        break;
+      case ICloseCapture:
+        //|  capslot
+        //|  lea rcx, [rax - #CAPT]
+        //|  cmp byte CAPT:rcx->siz, 0
+        //|  jne >2
+        //|  mov rdx, S
+        //|  sub rdx, CAPT:rcx->s
+        //|  cmp rdx, UCHAR_MAX
+        //|  jge >2
+        //|  add edx, 1
+        //|  mov CAPT:rcx->siz, dl
+        //|  jmp >3
+        //|2:
+        //|  mov byte CAPT:rax->siz, 1
+        //|  mov CAPT:rax->s, S
+        //|  pushcapture key, kind, pc + 1
+        dasm_put(Dst, 711, sizeof(Capture), - sizeof(Capture), Dt3(->siz), Dt3(->s), UCHAR_MAX, Dt3(->siz), Dt3(->siz), Dt3(->s), Dt3(->idx), key, Dt3(->kind), kind);
+#line 311 "../src/lplnative.dasc"
+        //|3:
+        dasm_put(Dst, 776, Dt1(->capsize), Dt1(->pc), pc + 1, NEXIT_CAPTURE);
+#line 312 "../src/lplnative.dasc"
+        break;
+      default: /* IUTFR, ICloseRunTime, IThrow, IThrowRec, ... */
+        //|  stepexit pc
+        dasm_put(Dst, 804, Dt1(->pc), pc, NEXIT_STEP);
+#line 315 "../src/lplnative.dasc"
+        break;
+    }
+  }
+}
@@ -14,6 +14,7 @@
 #include "lauxlib.h"
 #include "lplcap.h"
 #include "lplcode.h"
+#include "lplnative.h"
 #include "lpltypes.h"
 #include "lualib.h"
 
@@ -363,6 +364,7 @@ static TTree *newtree(lua_State *L, int len) {
   lua_setmetatable(L, -2);
   p->code = NULL;
   p->codesize = 0;
+  p->native = NULL;
   return p->tree;
 }
 
@@ -1172,6 +1174,25 @@ static int lp_printcode(lua_State *L) {
   return 0;
 }
 
+/*
+** Compile a pattern ahead of its first match, so that hot patterns
+** do not pay for code generation inside the matching loop. Mode "vm"
+** (the default) generates code for the interpreter; mode "native"
+** also translates that code into machine code (see lplnative.h).
+** Returns the pattern itself.
+*/
+static int lp_compile(lua_State *L) {
+  static const char *const modes[] = {"vm", "native", NULL};
+  Pattern *p = (getpatt(L, 1, NULL), getpattern(L, 1));
+  int native = luaL_checkoption(L, 2, "vm", modes);
+  if (p->code == NULL) /* not compiled yet? */
+    prepcompile(L, p, 1);
+  if (native && p->native == NULL)
+    p->native = lpn_compile(L, p->code, p->codesize);
+  lua_settop(L, 1);
+  return 1;
+}
+
 /*
 ** Get the initial position for the match, interpreting negative
 ** values from the end of the subject
@@ -1194,13 +1215,13 @@ static size_t initposition(lua_State *L, size_t len) {
 /*
 ** Main match function
 */
-static int lp_match(lua_State *L) {
+static int domatch(lua_State *L) {
   Capture capture[INITCAPSIZE];
   const char *r;
   size_t l;
   Pattern *p = (getpatt(L, 1, NULL), getpattern(L, 1));
   Instruction *code = (p->code != NULL) ? p->code : prepcompile(L, p, 1);
-  const char *s = luaL_checklstring(L, SUBJIDX, &l);
+  const char *s = luaL_checklbytes(L, SUBJIDX, &l);
   size_t i = initposition(L, l);
   int ptop = lua_gettop(L);
   short labelf;                      /* labeled failure */
@@ -1208,8 +1229,12 @@ static int lp_match(lua_State *L) {
   lua_pushnil(L);                    /* initialize subscache */
   lua_pushlightuserdata(L, capture); /* initialize caplistidx */
   lua_getuservalue(L, 1);            /* initialize penvidx */
-  r = match(L, s, s + i, s + l, code, capture, ptop, &labelf,
-            &sfail); /* labeled failure */
+  if (p->native != NULL)
+    r = nativematch(L, s, s + i, s + l, code, p->native, capture, ptop,
+                    &labelf, &sfail);
+  else
+    r = match(L, s, s + i, s + l, code, capture, ptop, &labelf,
+              &sfail); /* labeled failure */
   if (r == NULL) {   /* labeled failure begin */
     lua_pushnil(L);
     if (labelf) {
@@ -1229,6 +1254,31 @@ static int lp_match(lua_State *L) {
   return getcaptures(L, s, r, ptop);
 }
 
+/*
+** LPeg keeps a raw pointer to the subject for the whole match, and
+** runtime and function captures may run arbitrary code meanwhile. A
+** buffer subject is pinned so that such code cannot unmap or move its
+** bytes; the match runs in protected mode so the pin is always dropped.
+*/
+static int lp_match(lua_State *L) {
+  int *pins = luaL_lbytespins(L, SUBJIDX);
+  int status;
+  if (pins == NULL) /* a string or an invalid subject? */
+    return domatch(L);
+  getpatt(L, 1, NULL); /* check arguments here, where errors name 'match' */
+  luaL_checklbytes(L, SUBJIDX, NULL); /* no pins on closed buffers */
+  luaL_optinteger(L, SUBJIDX + 1, 1);
+  lua_pushvalue(L, SUBJIDX); /* keep the buffer alive until unpinned */
+  lua_insert(L, 1);
+  lua_pushcfunction(L, domatch);
+  lua_insert(L, 2);
+  (*pins)++;
+  status = lua_pcall(L, lua_gettop(L) - 2, LUA_MULTRET, 0);
+  (*pins)--;
+  if (status != LUA_OK) lua_error(L);
+  return lua_gettop(L) - 1;
+}
+
 /*
 ** {======================================================
 ** Library creation and functions not related to matching
@@ -1257,6 +1307,10 @@ static int lp_type(lua_State *L) {
 int lp_gc(lua_State *L) {
   Pattern *p = getpattern(L, 1);
   realloccode(L, p, 0); /* delete code block */
+  if (p->native != NULL) {
+    lpn_free(p->native);
+    p->native = NULL;
+  }
   return 0;
 }
 
@@ -1292,6 +1346,7 @@ static int lp_locale(lua_State *L) {
 
 static struct luaL_Reg pattreg[] = {{"ptree", lp_printtree},
                                     {"pcode", lp_printcode},
+                                    {"compile", lp_compile},
                                     {"match", lp_match},
                                     {"B", lp_behind},
                                     {"V", lp_V},
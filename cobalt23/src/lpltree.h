@@ -70,6 +70,7 @@ typedef struct TTree {
 typedef struct Pattern {
   union Instruction *code;
   int codesize;
+  struct NativeCode *native; /* machine code, if compiled to it */
   TTree tree[1];
 } Pattern;
 
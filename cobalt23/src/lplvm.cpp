@@ -12,6 +12,7 @@
 #include "cobalt.h"
 #include "lauxlib.h"
 #include "lplcap.h"
+#include "lplnative.h"
 #include "lpltypes.h"
 
 /* initial size for call/backtrack stack */
@@ -21,6 +22,29 @@
 
 #define getoffset(p) (((p) + 1)->offset)
 
+/*
+** By default, dispatch instructions through a jump table on gcc and
+** compatible compilers, as the main interpreter loop does. (Debug
+** builds keep the 'switch' so that every step is traced.)
+*/
+#if !defined(LPEG_USE_JUMPTABLE)
+#if defined(__GNUC__) && !defined(DEBUG)
+#define LPEG_USE_JUMPTABLE 1
+#else
+#define LPEG_USE_JUMPTABLE 0
+#endif
+#endif
+
+#if LPEG_USE_JUMPTABLE
+#define pdispatch(o) goto *pdisptab[o];
+#define pcase(l) L_##l:
+#define pbreak pdispatch(p->i.code)
+#else
+#define pdispatch(o) switch ((Opcode)(o))
+#define pcase(l) case l:
+#define pbreak continue
+#endif
+
 static const Instruction giveup = {{IGiveup, 0, 0}};
 
 /*
@@ -57,14 +81,6 @@ static const char *utf8_decode(const char *o, int *val) {
 ** =======================================================
 */
 
-typedef struct Stack {
-  const char *s;        /* saved position (or NULL for calls) */
-  const Instruction *p; /* next instruction */
-  int caplevel;
-  byte labenv;     /* labeled failure */
-  byte predchoice; /* labeled failure */
-} Stack;
-
 #define getstackbase(L, ptop) ((Stack *)lua_touserdata(L, stackidx(ptop)))
 
 /*
@@ -191,6 +207,9 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
   stack->labenv = insidepred;
   stack++;    /* labeled failure */
   *sfail = s; /* labeled failure */
+#if LPEG_USE_JUMPTABLE
+#include "lpljumptab.h"
+#endif
   lua_pushlightuserdata(L, stackbase);
   for (;;) {
 #if defined(DEBUG)
@@ -202,23 +221,23 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
 #endif
     assert(stackidx(ptop) + ndyncap == lua_gettop(L) && ndyncap <= captop);
     assert(insidepred == INPRED || insidepred == OUTPRED);
-    switch ((Opcode)p->i.code) {
-      case IEnd: {
+    pdispatch(p->i.code) {
+      pcase(IEnd) {
         assert(stack == getstackbase(L, ptop) + 1);
         capture[captop].kind = Cclose;
         capture[captop].s = NULL;
         return s;
       }
-      case IGiveup: {
+      pcase(IGiveup) {
         assert(stack == getstackbase(L, ptop));
         return NULL;
       }
-      case IRet: {
+      pcase(IRet) {
         assert(stack > getstackbase(L, ptop) && (stack - 1)->s == NULL);
         p = (--stack)->p;
-        continue;
+        pbreak;
       }
-      case IAny: {
+      pcase(IAny) {
         if (s < e) {
           p++;
           s++;
@@ -227,9 +246,9 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
           updatefarthest(*sfail, s); /*labeled failure */
           goto fail;
         }
-        continue;
+        pbreak;
       }
-      case IUTFR: {
+      pcase(IUTFR) {
         int codepoint;
         if (s >= e) goto fail;
         s = utf8_decode(s, &codepoint);
@@ -240,16 +259,16 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
           updatefarthest(*sfail, s); /*labeled failure */
           goto fail;
         }
-        continue;
+        pbreak;
       }
-      case ITestAny: {
+      pcase(ITestAny) {
         if (s < e)
           p += 2;
         else
           p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case IChar: {
+      pcase(IChar) {
         if ((byte)*s == p->i.aux && s < e) {
           p++;
           s++;
@@ -258,16 +277,16 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
           updatefarthest(*sfail, s); /*labeled failure */
           goto fail;
         }
-        continue;
+        pbreak;
       }
-      case ITestChar: {
+      pcase(ITestChar) {
         if ((byte)*s == p->i.aux && s < e)
           p += 2;
         else
           p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case ISet: {
+      pcase(ISet) {
         int c = (byte)*s;
         if (testchar((p + 1)->buff, c) && s < e) {
           p += CHARSETINSTSIZE;
@@ -277,17 +296,17 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
           updatefarthest(*sfail, s); /*labeled failure */
           goto fail;
         }
-        continue;
+        pbreak;
       }
-      case ITestSet: {
+      pcase(ITestSet) {
         int c = (byte)*s;
         if (testchar((p + 2)->buff, c) && s < e)
           p += 1 + CHARSETINSTSIZE;
         else
           p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case IBehind: {
+      pcase(IBehind) {
         int n = p->i.aux;
         if (n > s - o) {
           *labelf = LFAIL;           /* labeled failure */
@@ -296,21 +315,21 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
         }
         s -= n;
         p++;
-        continue;
+        pbreak;
       }
-      case ISpan: {
+      pcase(ISpan) {
         for (; s < e; s++) {
           int c = (byte)*s;
           if (!testchar((p + 1)->buff, c)) break;
         }
         p += CHARSETINSTSIZE;
-        continue;
+        pbreak;
       }
-      case IJmp: {
+      pcase(IJmp) {
         p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case IChoice: {
+      pcase(IChoice) {
         if (stack == stacklimit) stack = doublestack(L, &stacklimit, ptop);
         stack->p = p + getoffset(p);
         stack->s = s;
@@ -319,9 +338,9 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
         stack->predchoice = 0;      /* labeled failure */
         stack++;
         p += 2;
-        continue;
+        pbreak;
       }
-      case IPredChoice: { /* labeled failure: new instruction */
+      pcase(IPredChoice) { /* labeled failure: new instruction */
         if (stack == stacklimit) stack = doublestack(L, &stacklimit, ptop);
         stack->p = p + getoffset(p);
         stack->s = s;
@@ -331,30 +350,30 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
         stack++;
         insidepred = INPRED;
         p += 2;
-        continue;
+        pbreak;
       }
-      case ICall: {
+      pcase(ICall) {
         if (stack == stacklimit) stack = doublestack(L, &stacklimit, ptop);
         stack->s = NULL;
         stack->p = p + 2; /* save return address */
         stack++;
         p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case ICommit: {
+      pcase(ICommit) {
         assert(stack > getstackbase(L, ptop) && (stack - 1)->s != NULL);
         stack--;
         p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case IPartialCommit: {
+      pcase(IPartialCommit) {
         assert(stack > getstackbase(L, ptop) && (stack - 1)->s != NULL);
         (stack - 1)->s = s;
         (stack - 1)->caplevel = captop;
         p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case IBackCommit: {
+      pcase(IBackCommit) {
         assert(stack > getstackbase(L, ptop) && (stack - 1)->s != NULL);
         s = (--stack)->s;
         insidepred = stack->labenv; /* labeled failure */
@@ -362,9 +381,9 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
           ndyncap -= removedyncap(L, capture, stack->caplevel, captop);
         captop = stack->caplevel;
         p += getoffset(p);
-        continue;
+        pbreak;
       }
-      case IThrow: { /* labeled failure */
+      pcase(IThrow) { /* labeled failure */
         if (insidepred == OUTPRED) {
           *labelf = (p + 1)->i.key;
           stack = getstackbase(L, ptop);
@@ -378,7 +397,7 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
         *sfail = s;
         goto fail;
       }
-      case IThrowRec: { /* labeled failure */
+      pcase(IThrowRec) { /* labeled failure */
         if (insidepred == OUTPRED) {
           *labelf = (p + 2)->i.key;
           *sfail = s;
@@ -388,7 +407,7 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
           stack->caplevel = captop;
           stack++;
           p += getoffset(p);
-          continue;
+          pbreak;
         } else {
           while (!(stack - 1)->predchoice) {
             --stack;
@@ -398,11 +417,11 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
         }
         goto fail;
       }
-      case IFailTwice:
+      pcase(IFailTwice)
         assert(stack > getstackbase(L, ptop));
         stack--;
         /* go through */
-      case IFail:
+      pcase(IFail)
         *labelf = LFAIL;           /* labeled failure */
         updatefarthest(*sfail, s); /*labeled failure */
       fail : {                     /* pattern failed: try to backtrack */
@@ -420,9 +439,9 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
 #if defined(DEBUG)
         printf("**FAIL**\n");
 #endif
-        continue;
+        pbreak;
       }
-      case ICloseRunTime: {
+      pcase(ICloseRunTime) {
         CapState cs;
         int rem, res, n;
         int fr = lua_gettop(L) + 1; /* stack index of first result */
@@ -455,9 +474,9 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
           captop += n + 1; /* new captures + close group */
         }
         p++;
-        continue;
+        pbreak;
       }
-      case ICloseCapture: {
+      pcase(ICloseCapture) {
         const char *s1 = s;
         assert(captop > 0);
         /* if possible, turn capture into a full capture */
@@ -465,18 +484,18 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
             s1 - capture[captop - 1].s < UCHAR_MAX) {
           capture[captop - 1].siz = s1 - capture[captop - 1].s + 1;
           p++;
-          continue;
+          pbreak;
         } else {
           capture[captop].siz = 1; /* mark entry as closed */
           capture[captop].s = s;
           goto pushcapture;
         }
       }
-      case IOpenCapture:
+      pcase(IOpenCapture)
         capture[captop].siz = 0; /* mark entry as open */
         capture[captop].s = s;
         goto pushcapture;
-      case IFullCapture:
+      pcase(IFullCapture)
         capture[captop].siz = getoff(p) + 1; /* save capture size */
         capture[captop].s = s - getoff(p);
         /* goto pushcapture; */
@@ -486,12 +505,201 @@ const char *match(lua_State *L, const char *o, const char *s, const char *e,
         captop++;
         capture = growcap(L, capture, &capsize, captop, 0, ptop);
         p++;
-        continue;
+        pbreak;
       }
+      pcase(IOpenCall) /* must have been closed by 'compile' */
+      pcase(IEmpty)
+#if !LPEG_USE_JUMPTABLE
+      default:
+#endif
+        assert(0);
+        return NULL;
+    }
+  }
+}
+
+/*
+** Driver for the machine code of a pattern: runs it and does, in C,
+** whatever it leaves undone (see lplnative.h). Same interface and
+** results as 'match'.
+*/
+const char *nativematch(lua_State *L, const char *o, const char *s,
+                        const char *e, Instruction *op, NativeCode *nc,
+                        Capture *capture, int ptop, short *labelf,
+                        const char **sfail) {
+  Stack stackbase[INITBACK];
+  NState ns;
+  const void *at = nataddr(nc, 0); /* where to (re)enter machine code */
+  ns.s = s;
+  ns.e = e;
+  ns.o = o;
+  ns.stack = stackbase;
+  ns.stacklimit = stackbase + INITBACK;
+  ns.capture = capture;
+  ns.captop = 0;
+  ns.capsize = INITCAPSIZE;
+  ns.ndyncap = 0;
+  ns.insidepred = OUTPRED;
+  ns.labelf = LFAIL;
+  ns.sfail = s;
+  ns.pc = 0;
+  ns.stack->p = (const Instruction *)nc->giveup;
+  ns.stack->s = s;
+  ns.stack->caplevel = 0;
+  ns.stack->labenv = OUTPRED;
+  ns.stack->predchoice = 0;
+  ns.stack++;
+  lua_pushlightuserdata(L, stackbase);
+  for (;;) {
+    const Instruction *p;
+    switch (nc->run(&ns, at)) {
+      case NEXIT_END:
+        assert(ns.stack == getstackbase(L, ptop) + 1);
+        *labelf = ns.labelf;
+        *sfail = ns.sfail;
+        return ns.s;
+      case NEXIT_GIVEUP:
+        assert(ns.stack == getstackbase(L, ptop));
+        *labelf = ns.labelf;
+        *sfail = ns.sfail;
+        return NULL;
+      case NEXIT_CAPTURE:
+        ns.capture = growcap(L, ns.capture, &ns.capsize, ns.captop, 0, ptop);
+        at = nataddr(nc, ns.pc);
+        continue;
+      case NEXIT_FAIL:
+        goto fail;
+      case NEXIT_STEP:
+        break;
       default:
         assert(0);
         return NULL;
     }
+    assert(stackidx(ptop) + ns.ndyncap == lua_gettop(L) &&
+           ns.ndyncap <= ns.captop);
+    p = op + ns.pc;
+    switch ((Opcode)p->i.code) {
+      case IChoice:
+      case IPredChoice:
+        if (ns.stack == ns.stacklimit)
+          ns.stack = doublestack(L, &ns.stacklimit, ptop);
+        ns.stack->p = (const Instruction *)nataddr(nc, ns.pc + getoffset(p));
+        ns.stack->s = ns.s;
+        ns.stack->caplevel = ns.captop;
+        ns.stack->labenv = ns.insidepred;
+        ns.stack->predchoice = (p->i.code == IPredChoice);
+        ns.stack++;
+        if (p->i.code == IPredChoice) ns.insidepred = INPRED;
+        at = nataddr(nc, ns.pc + 2);
+        continue;
+      case ICall:
+        if (ns.stack == ns.stacklimit)
+          ns.stack = doublestack(L, &ns.stacklimit, ptop);
+        ns.stack->s = NULL;
+        ns.stack->p = (const Instruction *)nataddr(nc, ns.pc + 2);
+        ns.stack++;
+        at = nataddr(nc, ns.pc + getoffset(p));
+        continue;
+      case IBackCommit:
+        assert(ns.stack > getstackbase(L, ptop) && (ns.stack - 1)->s != NULL);
+        ns.s = (--ns.stack)->s;
+        ns.insidepred = ns.stack->labenv;
+        if (ns.ndyncap > 0)
+          ns.ndyncap -=
+              removedyncap(L, ns.capture, ns.stack->caplevel, ns.captop);
+        ns.captop = ns.stack->caplevel;
+        at = nataddr(nc, ns.pc + getoffset(p));
+        continue;
+      case IUTFR: {
+        int codepoint;
+        const char *s1;
+        if (ns.s >= ns.e) goto fail;
+        s1 = utf8_decode(ns.s, &codepoint);
+        if (s1 && p[1].offset <= codepoint && codepoint <= utf_to(p)) {
+          ns.s = s1;
+          at = nataddr(nc, ns.pc + 2);
+          continue;
+        }
+        ns.labelf = LFAIL;
+        updatefarthest(ns.sfail, s1);
+        goto fail;
+      }
+      case IThrow:
+        if (ns.insidepred == OUTPRED) {
+          ns.labelf = (p + 1)->i.key;
+          ns.stack = getstackbase(L, ptop) + 1;
+        } else {
+          while (!(ns.stack - 1)->predchoice) --ns.stack;
+          ns.labelf = LFAIL;
+        }
+        ns.sfail = ns.s;
+        goto fail;
+      case IThrowRec:
+        if (ns.insidepred == OUTPRED) {
+          ns.labelf = (p + 2)->i.key;
+          ns.sfail = ns.s;
+          if (ns.stack == ns.stacklimit)
+            ns.stack = doublestack(L, &ns.stacklimit, ptop);
+          ns.stack->s = NULL;
+          ns.stack->p = (const Instruction *)nataddr(nc, ns.pc + 3);
+          ns.stack->caplevel = ns.captop;
+          ns.stack++;
+          at = nataddr(nc, ns.pc + getoffset(p));
+          continue;
+        }
+        while (!(ns.stack - 1)->predchoice) --ns.stack;
+        ns.labelf = LFAIL;
+        ns.sfail = ns.s;
+        goto fail;
+      case ICloseRunTime: {
+        CapState cs;
+        int rem, res, n;
+        int fr = lua_gettop(L) + 1; /* stack index of first result */
+        cs.reclevel = 0;
+        cs.L = L;
+        cs.s = o;
+        cs.ocap = ns.capture;
+        cs.ptop = ptop;
+        n = runtimecap(&cs, ns.capture + ns.captop, ns.s, &rem);
+        ns.captop -= n;    /* remove nested captures */
+        ns.ndyncap -= rem; /* update number of dynamic captures */
+        fr -= rem;         /* 'rem' items were popped from Lua stack */
+        res = resdyncaptures(L, fr, ns.s - o, e - o);
+        if (res == -1) {
+          ns.labelf = LFAIL;
+          updatefarthest(ns.sfail, ns.s);
+          goto fail;
+        }
+        ns.s = o + res;
+        n = lua_gettop(L) - fr + 1; /* number of new captures */
+        ns.ndyncap += n;
+        if (n == 0) /* no new captures? */
+          ns.captop--; /* remove open group */
+        else {
+          if (fr + n >= SHRT_MAX)
+            luaL_error(L, "too many results in match-time capture");
+          ns.capture =
+              growcap(L, ns.capture, &ns.capsize, ns.captop, n + 1, ptop);
+          adddyncaptures(ns.s, ns.capture + ns.captop, n, fr);
+          ns.captop += n + 1; /* new captures + close group */
+        }
+        at = nataddr(nc, ns.pc + 1);
+        continue;
+      }
+      default: /* IOpenCall and IEmpty never run */
+        assert(0);
+        return NULL;
+    }
+  fail: /* backtrack, removing dynamic captures */
+    do {
+      assert(ns.stack > getstackbase(L, ptop));
+      ns.s = (--ns.stack)->s;
+    } while (ns.s == NULL);
+    if (ns.ndyncap > 0)
+      ns.ndyncap -= removedyncap(L, ns.capture, ns.stack->caplevel, ns.captop);
+    ns.captop = ns.stack->caplevel;
+    ns.insidepred = ns.stack->labenv;
+    at = (const void *)ns.stack->p;
   }
 }
 
@@ -59,6 +59,18 @@ typedef union Instruction {
 /* extract 24-bit value from an instruction */
 #define utf_to(inst) (((inst)->i.key << 8) | (inst)->i.aux)
 
+/*
+** Entry of the call/backtrack stack. In a native match, 'p' is the
+** address of machine code instead (see lplnative.h).
+*/
+typedef struct Stack {
+  const char *s;        /* saved position (or NULL for calls) */
+  const Instruction *p; /* next instruction */
+  int caplevel;
+  byte labenv;     /* labeled failure */
+  byte predchoice; /* labeled failure */
+} Stack;
+
 LUAI_FUNC void printpatt(Instruction *p, int n);
 LUAI_FUNC const char *match(lua_State *L, const char *o, const char *s,
                             const char *e, Instruction *op, Capture *capture,
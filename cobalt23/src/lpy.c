@@ -607,6 +607,606 @@ py_object* luaPy_to_pobject(lua_State *L, int n)
     return is_pobject ? (py_object *) lua_touserdata(L, n) : NULL;
 }
 
+py_buffer* luaPy_to_pbuffer(lua_State *L, int n)
+{
+    return (py_buffer *) luaL_testudata(L, n, PBUFFER);
+}
+
+/*
+** Buffers and batch conversions. Element types are the struct module
+** codes numpy and array use, reduced to a kind and a width so that
+** native ('@') and standard ('=', '<') layouts map the same way.
+*/
+
+static int py_littleendian(void)
+{
+    const int one = 1;
+    return *(const char *) &one;
+}
+
+static char py_format_kind(const char *format, Py_ssize_t itemsize)
+{
+    char kind;
+
+    if (format == NULL)
+        format = "B";
+    if (*format == '@' || *format == '=' || (*format == '<' && py_littleendian()))
+        format++;
+    if (format[0] == '\0' || format[1] != '\0')
+        return 0;
+
+    switch (format[0]) {
+        case 'b': case 'h': case 'i': case 'l': case 'q': case 'n':
+            kind = 'i';
+            break;
+        case 'B': case 'H': case 'I': case 'L': case 'Q': case 'N': case 'c':
+            kind = 'u';
+            break;
+        case 'f': case 'd':
+            kind = 'f';
+            break;
+        case '?':
+            kind = '?';
+            break;
+        default:
+            return 0;
+    }
+
+    if (kind == 'f' ? (itemsize != 4 && itemsize != 8)
+                    : (itemsize != 1 && itemsize != 2 && itemsize != 4 && itemsize != 8))
+        return 0;
+    return kind;
+}
+
+/* native size of a single struct module code, 0 if unsupported */
+static size_t py_format_size(char code)
+{
+    switch (code) {
+        case 'b': case 'B': case 'c': case '?': return 1;
+        case 'h': case 'H': return sizeof(short);
+        case 'i': case 'I': return sizeof(int);
+        case 'l': case 'L': return sizeof(long);
+        case 'q': case 'Q': return sizeof(long long);
+        case 'n': case 'N': return sizeof(size_t);
+        case 'f': return sizeof(float);
+        case 'd': return sizeof(double);
+        default: return 0;
+    }
+}
+
+#define PY_LOAD(T, p) (memcpy(&v_ ## T, (p), sizeof(T)), v_ ## T)
+
+static void py_pushelem(lua_State *L, char kind, Py_ssize_t size, const char *p)
+{
+    int8_t v_int8_t; int16_t v_int16_t; int32_t v_int32_t; int64_t v_int64_t;
+    uint8_t v_uint8_t; uint16_t v_uint16_t; uint32_t v_uint32_t; uint64_t v_uint64_t;
+    float v_float; double v_double;
+
+    switch (kind * 16 + size) {
+        case 'i' * 16 + 1: lua_pushinteger(L, PY_LOAD(int8_t, p)); break;
+        case 'i' * 16 + 2: lua_pushinteger(L, PY_LOAD(int16_t, p)); break;
+        case 'i' * 16 + 4: lua_pushinteger(L, PY_LOAD(int32_t, p)); break;
+        case 'i' * 16 + 8: lua_pushinteger(L, PY_LOAD(int64_t, p)); break;
+        case 'u' * 16 + 1: lua_pushinteger(L, PY_LOAD(uint8_t, p)); break;
+        case 'u' * 16 + 2: lua_pushinteger(L, PY_LOAD(uint16_t, p)); break;
+        case 'u' * 16 + 4: lua_pushinteger(L, PY_LOAD(uint32_t, p)); break;
+        case 'u' * 16 + 8: lua_pushinteger(L, (lua_Integer) PY_LOAD(uint64_t, p)); break;
+        case 'f' * 16 + 4: lua_pushnumber(L, PY_LOAD(float, p)); break;
+        case 'f' * 16 + 8: lua_pushnumber(L, PY_LOAD(double, p)); break;
+        default: lua_pushboolean(L, *p != 0); break;
+    }
+}
+
+static void py_setelem(lua_State *L, char kind, Py_ssize_t size, char *p, int idx)
+{
+    if (kind == '?') {
+        *p = (char) lua_toboolean(L, idx);
+    } else if (kind == 'f') {
+        lua_Number n = luaL_checknumber(L, idx);
+        if (size == 4) {
+            float f = (float) n;
+            memcpy(p, &f, 4);
+        } else {
+            double d = (double) n;
+            memcpy(p, &d, 8);
+        }
+    } else {
+        uint64_t v = (uint64_t) luaL_checkinteger(L, idx);
+        switch (size) {
+            case 1: { uint8_t u = (uint8_t) v; memcpy(p, &u, 1); break; }
+            case 2: { uint16_t u = (uint16_t) v; memcpy(p, &u, 2); break; }
+            case 4: { uint32_t u = (uint32_t) v; memcpy(p, &u, 4); break; }
+            default: memcpy(p, &v, 8); break;
+        }
+    }
+}
+
+/* pushes a table with the 'n' elements at 'p', 'stride' bytes apart */
+#define PY_PUSHRANGE(T, push) \
+    for (i = 0; i < n; i++, p += stride) { \
+        T v; \
+        memcpy(&v, p, sizeof(T)); \
+        push(L, v); \
+        lua_rawseti(L, -2, i + 1); \
+    }
+
+static void py_pushrange(lua_State *L, char kind, Py_ssize_t size,
+                         const char *p, Py_ssize_t n, Py_ssize_t stride)
+{
+    Py_ssize_t i;
+
+    lua_createtable(L, (int) n, 0);
+    switch (kind * 16 + size) {
+        case 'i' * 16 + 1: PY_PUSHRANGE(int8_t, lua_pushinteger); break;
+        case 'i' * 16 + 2: PY_PUSHRANGE(int16_t, lua_pushinteger); break;
+        case 'i' * 16 + 4: PY_PUSHRANGE(int32_t, lua_pushinteger); break;
+        case 'i' * 16 + 8: PY_PUSHRANGE(int64_t, lua_pushinteger); break;
+        case 'u' * 16 + 1: PY_PUSHRANGE(uint8_t, lua_pushinteger); break;
+        case 'u' * 16 + 2: PY_PUSHRANGE(uint16_t, lua_pushinteger); break;
+        case 'u' * 16 + 4: PY_PUSHRANGE(uint32_t, lua_pushinteger); break;
+        case 'u' * 16 + 8: PY_PUSHRANGE(uint64_t, lua_pushinteger); break;
+        case 'f' * 16 + 4: PY_PUSHRANGE(float, lua_pushnumber); break;
+        case 'f' * 16 + 8: PY_PUSHRANGE(double, lua_pushnumber); break;
+        default: PY_PUSHRANGE(char, lua_pushboolean); break;
+    }
+}
+
+/* pushes dimension 'dim' of a buffer as nested tables */
+static void py_pushdims(lua_State *L, const Py_buffer *view, char kind,
+                        const char *p, int dim)
+{
+    Py_ssize_t i, n = view->shape[dim];
+    Py_ssize_t stride = view->strides ? view->strides[dim] : view->itemsize;
+
+    luaL_checkstack(L, 3, "buffer has too many dimensions");
+    if (dim == view->ndim - 1) {
+        py_pushrange(L, kind, view->itemsize, p, n, stride);
+        return;
+    }
+
+    lua_createtable(L, (int) n, 0);
+    for (i = 0; i < n; i++, p += stride) {
+        py_pushdims(L, view, kind, p, dim + 1);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+static void py_pushbuffer(lua_State *L, const Py_buffer *view, char kind)
+{
+    if (view->ndim == 0)
+        py_pushelem(L, kind, view->itemsize, (const char *) view->buf);
+    else if (view->shape == NULL)
+        py_pushrange(L, kind, view->itemsize, (const char *) view->buf,
+                     view->len / view->itemsize, view->itemsize);
+    else
+        py_pushdims(L, view, kind, (const char *) view->buf, 0);
+}
+
+#define PY_MAXDEPTH 100
+
+static void py_pushvalue(lua_State *L, PyObject *o, int depth);
+
+static void py_totable_(lua_State *L, PyObject *o, int depth)
+{
+    Py_ssize_t i, n;
+
+    luaL_checkstack(L, 4, "python object nested too deep");
+
+    if (PyList_Check(o) || PyTuple_Check(o)) {
+        PyObject **items = PySequence_Fast_ITEMS(o);
+        n = PySequence_Fast_GET_SIZE(o);
+        lua_createtable(L, (int) n, 0);
+        for (i = 0; i < n; i++) {
+            py_pushvalue(L, items[i], depth + 1);
+            lua_rawseti(L, -2, i + 1);
+        }
+    } else if (PyDict_Check(o)) {
+        PyObject *key, *value;
+        i = 0;
+        lua_createtable(L, 0, (int) PyDict_Size(o));
+        while (PyDict_Next(o, &i, &key, &value)) {
+            if (key == Py_None)
+                continue;
+            py_pushvalue(L, key, depth + 1);
+            py_pushvalue(L, value, depth + 1);
+            lua_rawset(L, -3);
+        }
+    } else {
+        PyObject *iter, *item;
+
+        if (PyObject_CheckBuffer(o)) {
+            Py_buffer view;
+            if (PyObject_GetBuffer(o, &view, PyBUF_RECORDS_RO) == 0) {
+                char kind = py_format_kind(view.format, view.itemsize);
+                if (kind) {
+                    py_pushbuffer(L, &view, kind);
+                    PyBuffer_Release(&view);
+                    return;
+                }
+                PyBuffer_Release(&view);
+            }
+            PyErr_Clear();
+        }
+
+        iter = PyObject_GetIter(o);
+        if (!iter) {
+            PyErr_Clear();
+            luaL_error(L, "python object is not iterable");
+        }
+        lua_newtable(L);
+        for (i = 1; (item = PyIter_Next(iter)); i++) {
+            py_pushvalue(L, item, depth + 1);
+            Py_DECREF(item);
+            lua_rawseti(L, -2, i);
+        }
+        Py_DECREF(iter);
+        if (PyErr_Occurred()) {
+            PyErr_Print();
+            luaL_error(L, "error iterating python object");
+        }
+    }
+}
+
+static void py_pushvalue(lua_State *L, PyObject *o, int depth)
+{
+    if (PyFloat_CheckExact(o)) {
+        lua_pushnumber(L, PyFloat_AS_DOUBLE(o));
+    } else if (PyLong_CheckExact(o)) {
+        int overflow;
+        long long v = PyLong_AsLongLongAndOverflow(o, &overflow);
+        if (overflow)
+            lua_pushnumber(L, PyLong_AsDouble(o));
+        else
+            lua_pushinteger(L, (lua_Integer) v);
+    } else if (depth < PY_MAXDEPTH &&
+               (PyList_Check(o) || PyTuple_Check(o) || PyDict_Check(o))) {
+        py_totable_(L, o, depth);
+    } else if (!py_convert(L, o)) {
+        lua_pushnil(L);
+    }
+}
+
+/* 'mt' is the index of the metatable every table gets by default */
+static int py_isplaintable(lua_State *L, int idx, int mt)
+{
+    int plain;
+    if (!lua_getmetatable(L, idx))
+        return 1;
+    plain = lua_rawequal(L, -1, mt);
+    lua_pop(L, 1);
+    return plain;
+}
+
+static PyObject *py_tolist_(lua_State *L, int idx, int mt, int depth)
+{
+    lua_Integer i, n = (lua_Integer) lua_rawlen(L, idx);
+    PyObject *list = PyList_New((Py_ssize_t) n);
+    if (!list)
+        return NULL;
+
+    luaL_checkstack(L, 2, "table nested too deep");
+    for (i = 1; i <= n; i++) {
+        PyObject *item;
+        switch (lua_rawgeti(L, idx, i)) {
+            case LUA_TNUMBER:
+                item = lua_isinteger(L, -1)
+                    ? PyLong_FromLongLong((long long) lua_tointeger(L, -1))
+                    : PyFloat_FromDouble((double) lua_tonumber(L, -1));
+                break;
+            case LUA_TTABLE:
+                /* tables with their own metatable stay Cobalt objects */
+                if (depth < PY_MAXDEPTH && py_isplaintable(L, -1, mt)) {
+                    item = py_tolist_(L, lua_gettop(L), mt, depth + 1);
+                    break;
+                }
+                /* FALLTHROUGH */
+            default:
+                item = LuaConvert(L, -1);
+                break;
+        }
+        lua_pop(L, 1);
+        if (!item) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t) i - 1, item);
+    }
+
+    return list;
+}
+
+static int py_totable(lua_State *L)
+{
+    py_buffer *buf = luaPy_to_pbuffer(L, 1);
+    py_object *obj;
+
+    if (buf) {
+        if (buf->released)
+            return luaL_argerror(L, 1, "buffer has been released");
+        if (!buf->kind)
+            return luaL_argerror(L, 1, "unsupported buffer format");
+        py_pushbuffer(L, &buf->view, buf->kind);
+        return 1;
+    }
+
+    obj = (py_object*) luaL_checkudata(L, 1, POBJECT);
+    py_totable_(L, obj->o, 0);
+    return 1;
+}
+
+static int py_tolist(lua_State *L)
+{
+    PyObject *list;
+    int ret;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 1);
+    lua_getfield(L, LUA_REGISTRYINDEX, "Py_TableMT");
+    list = py_tolist_(L, 1, 2, 0);
+    if (!list) {
+        PyErr_Print();
+        return luaL_error(L, "failed to convert table");
+    }
+
+    ret = py_convert_custom(L, list, 1);
+    Py_DECREF(list);
+    return ret;
+}
+
+static int py_memoryview(lua_State *L)
+{
+    py_buffer *buf = luaPy_to_pbuffer(L, 1);
+    const char *format = luaL_optstring(L, 2, "B");
+    size_t itemsize = py_format_size(format[0]);
+    PyObject *exporter, *view;
+    void *ptr;
+    size_t len;
+    int readonly, ret;
+
+    if (format[0] == '\0' || format[1] != '\0' || itemsize == 0)
+        return luaL_argerror(L, 2, "invalid format");
+
+    if (lua_type(L, 1) == LUA_TSTRING) {
+        ptr = (void *) lua_tolstring(L, 1, &len);
+        readonly = 1;
+    } else if (buf) {
+        if (buf->released)
+            return luaL_argerror(L, 1, "buffer has been released");
+        ptr = buf->view.buf;
+        len = (size_t) buf->view.len;
+        readonly = buf->view.readonly;
+    } else if (lua_type(L, 1) == LUA_TUSERDATA) {
+        /* hostmem and anything else with ptr() and size() methods */
+        lua_getfield(L, 1, "ptr");
+        lua_pushvalue(L, 1);
+        lua_call(L, 1, 1);
+        lua_getfield(L, 1, "size");
+        lua_pushvalue(L, 1);
+        lua_call(L, 1, 1);
+        ptr = lua_touserdata(L, -2);
+        len = (size_t) luaL_checkinteger(L, -1);
+        lua_pop(L, 2);
+        if (!ptr)
+            return luaL_argerror(L, 1, "ptr() did not return a pointer");
+        readonly = 0;
+    } else {
+        return luaL_argerror(L, 1, "string, buffer or hostmem expected");
+    }
+
+    if (len % itemsize != 0)
+        return luaL_argerror(L, 2, "size is not a multiple of the item size");
+
+    exporter = LuaBuffer_New(L, 1, ptr, len, readonly, format[0], itemsize);
+    if (!exporter) {
+        PyErr_Print();
+        return luaL_error(L, "failed to create buffer");
+    }
+    view = PyMemoryView_FromObject(exporter);
+    Py_DECREF(exporter);
+    if (!view) {
+        PyErr_Print();
+        return luaL_error(L, "failed to create memoryview");
+    }
+
+    ret = py_convert_custom(L, view, 1);
+    Py_DECREF(view);
+    return ret;
+}
+
+static int py_buffer_new(lua_State *L)
+{
+    py_object *obj = (py_object*) luaL_checkudata(L, 1, POBJECT);
+    py_buffer *buf = (py_buffer*) lua_newuserdatauv(L, sizeof(py_buffer), 0);
+
+    buf->released = 1;
+    luaL_setmetatable(L, PBUFFER);
+
+    if (PyObject_GetBuffer(obj->o, &buf->view, PyBUF_RECORDS) != 0) {
+        PyErr_Clear();
+        if (PyObject_GetBuffer(obj->o, &buf->view, PyBUF_RECORDS_RO) != 0) {
+            PyErr_Print();
+            return luaL_argerror(L, 1, "object does not support the buffer protocol");
+        }
+    }
+    buf->released = 0;
+
+    if (!PyBuffer_IsContiguous(&buf->view, 'C')) {
+        PyBuffer_Release(&buf->view);
+        buf->released = 1;
+        return luaL_argerror(L, 1, "buffer is not contiguous");
+    }
+    buf->kind = py_format_kind(buf->view.format, buf->view.itemsize);
+
+    return 1;
+}
+
+static py_buffer *py_checkbuffer(lua_State *L, int n)
+{
+    py_buffer *buf = (py_buffer*) luaL_checkudata(L, n, PBUFFER);
+    if (buf->released)
+        luaL_argerror(L, n, "buffer has been released");
+    return buf;
+}
+
+/* checks that 'size' bytes at 'offset' lie inside the buffer */
+static char *py_checkrange(lua_State *L, py_buffer *buf, size_t offset, size_t size)
+{
+    size_t len = (size_t) buf->view.len;
+    if (offset > len || size > len - offset)
+        luaL_error(L, "out of boundaries");
+    return (char *) buf->view.buf + offset;
+}
+
+static char *py_checkindex(lua_State *L, py_buffer *buf, int n)
+{
+    lua_Integer i = luaL_checkinteger(L, n);
+    Py_ssize_t count = buf->view.len / buf->view.itemsize;
+    if (!buf->kind)
+        luaL_argerror(L, 1, "unsupported buffer format");
+    if (i < 1 || i > count)
+        luaL_argerror(L, n, "index out of range");
+    return (char *) buf->view.buf + (i - 1) * buf->view.itemsize;
+}
+
+static int py_buffer_ptr(lua_State *L)
+{
+    py_buffer *buf = py_checkbuffer(L, 1);
+    size_t offset = (size_t) luaL_optinteger(L, 2, 0);
+    size_t size = (size_t) luaL_optinteger(L, 3, 0);
+    lua_pushlightuserdata(L, py_checkrange(L, buf, offset, size));
+    return 1;
+}
+
+static int py_buffer_size(lua_State *L)
+{
+    py_buffer *buf = py_checkbuffer(L, 1);
+    lua_pushinteger(L, (lua_Integer) buf->view.len);
+    return 1;
+}
+
+static int py_buffer_read(lua_State *L)
+{
+    py_buffer *buf = py_checkbuffer(L, 1);
+    size_t offset = (size_t) luaL_optinteger(L, 2, 0);
+    size_t size = (size_t) luaL_optinteger(L, 3, (lua_Integer) buf->view.len - offset);
+    lua_pushlstring(L, py_checkrange(L, buf, offset, size), size);
+    return 1;
+}
+
+static int py_buffer_write(lua_State *L)
+{
+    py_buffer *buf = py_checkbuffer(L, 1);
+    size_t offset = (size_t) luaL_checkinteger(L, 2);
+    size_t len, i, n;
+    char *p;
+
+    if (buf->view.readonly)
+        return luaL_error(L, "buffer is read-only");
+
+    if (lua_type(L, 3) == LUA_TSTRING) {
+        const char *data = lua_tolstring(L, 3, &len);
+        memcpy(py_checkrange(L, buf, offset, len), data, len);
+        return 0;
+    }
+
+    luaL_checktype(L, 3, LUA_TTABLE);
+    if (!buf->kind)
+        return luaL_argerror(L, 1, "unsupported buffer format");
+    n = (size_t) lua_rawlen(L, 3);
+    p = py_checkrange(L, buf, offset, n * (size_t) buf->view.itemsize);
+    for (i = 1; i <= n; i++, p += buf->view.itemsize) {
+        lua_rawgeti(L, 3, (lua_Integer) i);
+        py_setelem(L, buf->kind, buf->view.itemsize, p, -1);
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+static int py_buffer_format(lua_State *L)
+{
+    py_buffer *buf = py_checkbuffer(L, 1);
+    lua_pushstring(L, buf->view.format ? buf->view.format : "B");
+    lua_pushinteger(L, (lua_Integer) buf->view.itemsize);
+    return 2;
+}
+
+static int py_buffer_release(lua_State *L)
+{
+    py_buffer *buf = (py_buffer*) luaL_checkudata(L, 1, PBUFFER);
+    if (!buf->released) {
+        buf->released = 1;
+        PyBuffer_Release(&buf->view);
+    }
+    return 0;
+}
+
+static int py_buffer_len(lua_State *L)
+{
+    py_buffer *buf = py_checkbuffer(L, 1);
+    lua_pushinteger(L, (lua_Integer) (buf->view.len / buf->view.itemsize));
+    return 1;
+}
+
+static int py_buffer_index(lua_State *L)
+{
+    py_buffer *buf = (py_buffer*) luaL_checkudata(L, 1, PBUFFER);
+
+    if (lua_type(L, 2) != LUA_TNUMBER) {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    if (buf->released)
+        return luaL_argerror(L, 1, "buffer has been released");
+    py_pushelem(L, buf->kind, buf->view.itemsize, py_checkindex(L, buf, 2));
+    return 1;
+}
+
+static int py_buffer_newindex(lua_State *L)
+{
+    py_buffer *buf = py_checkbuffer(L, 1);
+    char *p = py_checkindex(L, buf, 2);
+    if (buf->view.readonly)
+        return luaL_error(L, "buffer is read-only");
+    py_setelem(L, buf->kind, buf->view.itemsize, p, 3);
+    return 0;
+}
+
+static int py_buffer_tostring(lua_State *L)
+{
+    py_buffer *buf = (py_buffer*) luaL_checkudata(L, 1, PBUFFER);
+    if (buf->released)
+        lua_pushliteral(L, "python buffer (released)");
+    else
+        lua_pushfstring(L, "python buffer: %p (%I bytes, format '%s')",
+                        buf->view.buf, (lua_Integer) buf->view.len,
+                        buf->view.format ? buf->view.format : "B");
+    return 1;
+}
+
+static const luaL_Reg py_buffer_methods[] =
+{
+    {"ptr",     py_buffer_ptr},
+    {"size",    py_buffer_size},
+    {"read",    py_buffer_read},
+    {"write",   py_buffer_write},
+    {"format",  py_buffer_format},
+    {"totable", py_totable},
+    {"free",    py_buffer_release},
+    {NULL, NULL}
+};
+
+static const luaL_Reg py_buffer_mt[] =
+{
+    {"__len",       py_buffer_len},
+    {"__newindex",  py_buffer_newindex},
+    {"__gc",        py_buffer_release},
+    {"__close",     py_buffer_release},
+    {"__tostring",  py_buffer_tostring},
+    {NULL, NULL}
+};
+
 static const luaL_Reg py_lib[] =
 {
     {"execute", py_execute},
@@ -618,6 +1218,10 @@ static const luaL_Reg py_lib[] =
     {"globals", py_globals},
     {"builtins",py_builtins},
     {"import",  py_import},
+    {"buffer",  py_buffer_new},
+    {"memoryview", py_memoryview},
+    {"tolist",  py_tolist},
+    {"totable", py_totable},
     {NULL, NULL}
 };
 
@@ -633,6 +1237,14 @@ LUALIB_API int luaopen_python(lua_State *L)
     luaL_setfuncs(L, py_object_mt, 0);
     lua_pop(L, 1);
 
+    /* Register python buffer metatable */
+    luaL_newmetatable(L, PBUFFER);
+    luaL_setfuncs(L, py_buffer_mt, 0);
+    luaL_newlib(L, py_buffer_methods);
+    lua_pushcclosure(L, py_buffer_index, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
     /* Initialize Lua state in Python territory */
     if (!LuaState) LuaState = L;
 
@@ -690,5 +1302,15 @@ LUALIB_API int luaopen_python(lua_State *L)
 
     lua_setfield(L, -2, "none"); /* python.none */
 
+    /* Table constructors give tables a shared metatable; remember it so
+       python.tolist can tell plain tables from objects */
+    if (luaL_loadstring(L, "return {}") == LUA_OK) {
+        lua_call(L, 0, 1);
+        if (!lua_getmetatable(L, -1))
+            lua_pushnil(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, "Py_TableMT");
+    }
+    lua_pop(L, 1);
+
     return 1;
 }
@@ -10,6 +10,7 @@ extern "C" {
 #ifndef PYTHONINLUA_H
 #define PYTHONINLUA_H
 #define POBJECT "Python Object"
+#define PBUFFER "Python Buffer"
 
 #if PY_MAJOR_VERSION < 3
   #define PyBytes_Check           PyString_Check
@@ -24,7 +25,16 @@ typedef struct
     int asindx;
 } py_object;
 
+/* a Python buffer exported to Cobalt, see python.buffer() */
+typedef struct
+{
+    Py_buffer view;
+    int released;
+    char kind;    /* 'i', 'u', 'f' or '?'; 0 when only bytes are accessible */
+} py_buffer;
+
 py_object*    luaPy_to_pobject(lua_State *L, int n);
+py_buffer*    luaPy_to_pbuffer(lua_State *L, int n);
 #include "lualib.h"
 
 #endif
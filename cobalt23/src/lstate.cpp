@@ -350,6 +350,8 @@ LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud) {
   g->frealloc = f;
   g->ud = ud;
   g->warnf = NULL;
+  g->shapestamp = 0;
+  g->optlevel = 0;
   g->ud_warn = NULL;
   g->mainthread = L;
   g->seed = luai_makeseed(L);
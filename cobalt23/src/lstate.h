@@ -280,8 +280,10 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M]; /* cache for strings in API */
   lua_WarnFunction warnf;                    /* warning function */
   void *ud_warn;                             /* auxiliary data to 'warnf' */
+  lu_mem shapestamp; /* last shape given to a watched table ('BITWATCH') */
   int ready_for_table_mt;
   TValue table_mt;
+  lu_byte optlevel; /* default level of the bytecode optimizer */
 } global_State;
 
 /*
@@ -22,6 +22,10 @@
 #include "lprefix.h"
 #include "lualib.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
 ** maximum number of captures that a pattern can do during
 ** pattern-matching. This limit is arbitrary, but must fit in
@@ -44,7 +48,7 @@
 
 static int str_len(lua_State *L) {
   size_t l;
-  luaL_checklstring(L, 1, &l);
+  luaL_checklbytes(L, 1, &l);
   lua_pushinteger(L, (lua_Integer)l);
   return 1;
 }
@@ -87,7 +91,7 @@ static size_t getendpos(lua_State *L, int arg, lua_Integer def, size_t len) {
 
 static int str_sub(lua_State *L) {
   size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = luaL_checklbytes(L, 1, &l);
   size_t start = posrelatI(luaL_checkinteger(L, 2), l);
   size_t end = getendpos(L, 3, -1, l);
   if (start <= end)
@@ -158,7 +162,7 @@ static int str_rep(lua_State *L) {
 
 static int str_byte(lua_State *L) {
   size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = luaL_checklbytes(L, 1, &l);
   lua_Integer pi = luaL_optinteger(L, 2, 1);
   size_t posi = posrelatI(pi, l);
   size_t pose = getendpos(L, 3, pi, l);
@@ -305,10 +309,36 @@ static const luaL_Reg stringmetamethods[] = {
 #define CAP_UNFINISHED (-1)
 #define CAP_POSITION (-2)
 
+#define PF_NONE 0 /* any position may start a match */
+#define PF_CHAR 1 /* a match must start with the literal 'prefix' */
+#define PF_SET 2  /* a match must start with a byte in 'first' */
+
+/* maximum length of the literal prefix of a compiled pattern */
+#define MAXPREFIX 16
+
+typedef unsigned char CharSet[UCHAR_MAX / CHAR_BIT + 1];
+
+#define csset(cs, c) ((cs)[uchar(c) >> 3] |= (1 << (uchar(c) & 7)))
+#define cstest(cs, c) ((cs)[uchar(c) >> 3] & (1 << (uchar(c) & 7)))
+
+/* compiled pattern (see 'getpatprog') */
+typedef struct PatProg {
+  lua_Unsigned lastuse; /* when the cache last gave it out */
+  int kind;             /* which positions may start a match (PF_*) */
+  int ctype;            /* whether it depends on the locale */
+  size_t nprefix;
+  unsigned char prefix[MAXPREFIX];
+  CharSet first;
+  unsigned char *setidx; /* 1 + set of the class at each position, or 0 */
+  CharSet *sets;
+} PatProg;
+
 typedef struct MatchState {
   const char *src_init; /* init of source string */
   const char *src_end;  /* end ('\0') of source string */
+  const char *p_init;   /* init of pattern (with its anchor) */
   const char *p_end;    /* end ('\0') of pattern */
+  const PatProg *prog;  /* compiled pattern, or NULL */
   lua_State *L;
   int matchdepth; /* control for recursive depth (to avoid C stack overflow) */
   unsigned char level; /* total number of captures (finished or unfinished) */
@@ -437,6 +467,14 @@ static int matchbracketclass(int c, const char *p, const char *ec) {
   return !sig;
 }
 
+/* whether 'c' is in the bracket class [p, ep) of the pattern */
+static int matchset(MatchState *ms, int c, const char *p, const char *ep) {
+  int k;
+  if (ms->prog != NULL && (k = ms->prog->setidx[p - ms->p_init]) != 0)
+    return cstest(ms->prog->sets[k - 1], c);
+  return matchbracketclass(c, p, ep - 1);
+}
+
 static int singlematch(MatchState *ms, const char *s, const char *p,
                        const char *ep) {
   if (s >= ms->src_end)
@@ -449,7 +487,7 @@ static int singlematch(MatchState *ms, const char *s, const char *p,
       case L_ESC:
         return match_class(c, uchar(*(p + 1)));
       case '[':
-        return matchbracketclass(c, p, ep - 1);
+        return matchset(ms, c, p, ep);
       default:
         return (uchar(*p) == c);
     }
@@ -575,8 +613,8 @@ init:                   /* using goto's to optimize tail recursion */
               luaL_error(ms->L, "missing '[' after '%%f' in pattern");
             ep = classend(ms, p); /* points to what is next */
             previous = (s == ms->src_init) ? '\0' : *(s - 1);
-            if (!matchbracketclass(uchar(previous), p, ep - 1) &&
-                matchbracketclass(uchar(*s), p, ep - 1)) {
+            if (!matchset(ms, uchar(previous), p, ep) &&
+                matchset(ms, uchar(*s), p, ep)) {
               p = ep;
               goto init; /* return match(ms, s, ep); */
             }
@@ -650,24 +688,45 @@ init:                   /* using goto's to optimize tail recursion */
   return s;
 }
 
+/*
+** Plain substring search, shared by 'find', 'split', 'splititer' and
+** 'gsub' with plain patterns. Candidate positions are filtered on both
+** the first and the last byte of 's2', so 'memcmp' only runs where both
+** agree; with SSE2 sixteen candidates are filtered at once.
+*/
 static const char *lmemfind(const char *s1, size_t l1, const char *s2,
                             size_t l2) {
   if (l2 == 0)
     return s1; /* empty strings are everywhere */
   else if (l2 > l1)
     return NULL; /* avoids a negative 'l1' */
+  else if (l2 == 1)
+    return (const char *)memchr(s1, *s2, l1);
   else {
-    const char *init; /* to search for a '*s2' inside 's1' */
-    l2--;             /* 1st char will be checked by 'memchr' */
-    l1 = l1 - l2;     /* 's2' cannot be found after that */
-    while (l1 > 0 && (init = (const char *)memchr(s1, *s2, l1)) != NULL) {
-      init++; /* 1st char is already checked */
-      if (memcmp(init, s2 + 1, l2) == 0)
-        return init - 1;
-      else { /* correct 'l1' and 's1' to try again */
-        l1 -= init - s1;
-        s1 = init;
+    const char *init = s1;              /* next candidate position */
+    const char *last = s1 + (l1 - l2); /* last possible match position */
+    const char lc = s2[l2 - 1];
+#if defined(__SSE2__)
+    const __m128i vfirst = _mm_set1_epi8(s2[0]);
+    const __m128i vlast = _mm_set1_epi8(lc);
+    while (last - init >= 15) { /* 16 candidates left? */
+      __m128i bf = _mm_loadu_si128((const __m128i *)init);
+      __m128i bl = _mm_loadu_si128((const __m128i *)(init + l2 - 1));
+      unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+          _mm_cmpeq_epi8(bf, vfirst), _mm_cmpeq_epi8(bl, vlast)));
+      while (mask != 0) {
+        int i = __builtin_ctz(mask);
+        if (memcmp(init + i + 1, s2 + 1, l2 - 2) == 0) return init + i;
+        mask &= mask - 1; /* clear lowest candidate */
       }
+      init += 16;
+    }
+#endif
+    while (init <= last &&
+           (init = (const char *)memchr(init, *s2, last - init + 1)) != NULL) {
+      if (init[l2 - 1] == lc && memcmp(init + 1, s2 + 1, l2 - 2) == 0)
+        return init;
+      init++; /* try again after this candidate */
     }
     return NULL; /* not found */
   }
@@ -734,7 +793,9 @@ static void prepstate(MatchState *ms, lua_State *L, const char *s, size_t ls,
   ms->matchdepth = MAXCCALLS;
   ms->src_init = s;
   ms->src_end = s + ls;
+  ms->p_init = p;
   ms->p_end = p + lp;
+  ms->prog = NULL;
 }
 
 static void reprepstate(MatchState *ms) {
@@ -742,9 +803,291 @@ static void reprepstate(MatchState *ms) {
   lua_assert(ms->matchdepth == MAXCCALLS);
 }
 
+/*
+** {======================================================
+** COMPILED PATTERNS
+** A pattern is compiled once into a 'PatProg' that 'match' uses next to
+** the pattern text: the bytes accepted by each bracket class, and what
+** an unanchored search needs to skip start positions that cannot start
+** a match (a literal prefix, or the set of bytes the first item
+** accepts). Compiled patterns are cached per pattern string in the
+** registry, dropping the least recently used one when the cache is full.
+** =======================================================
+*/
+
+/* key, in the registry, for the cache of compiled patterns */
+#define PATCACHE "_PATCACHE"
+
+/* number of compiled patterns kept in the cache */
+#if !defined(PATCACHE_MAX)
+#define PATCACHE_MAX 64
+#endif
+
+/* state of the cache, at index 1 of its table */
+typedef struct PatCache {
+  lua_Unsigned clock; /* number of uses so far */
+  int n;              /* number of compiled patterns */
+} PatCache;
+
+/* whether class 'cl' (as in '%a') depends on the locale */
+static int localeclass(int cl) {
+  return strchr("acdglpsuwx", tolower(cl)) != NULL;
+}
+
+/*
+** End of the item at 'p' (as 'classend'), or NULL if it is malformed;
+** compiling leaves malformed items for 'match' to report.
+*/
+static const char *itemend(const char *p, const char *pe) {
+  if (*p == L_ESC) return (p + 1 < pe) ? p + 2 : NULL;
+  if (*p++ != '[') return p;
+  if (*p == '^') p++;
+  do { /* look for a ']' */
+    if (p == pe) return NULL;
+    if (*(p++) == L_ESC && p < pe) p++;
+  } while (*p != ']');
+  return p + 1;
+}
+
+#define isquantifier(c) ((c) == '*' || (c) == '+' || (c) == '-' || (c) == '?')
+
+/*
+** Go through the items of pattern [p, pe) and compile the bracket class
+** at 'q' of each one into the next set of 'prog'. Returns the number of
+** classes; with a NULL 'prog' it only counts them.
+*/
+static int compilesets(PatProg *prog, const char *p, const char *pe) {
+  int n = 0;
+  const char *q = p;
+  while (q < pe && n < UCHAR_MAX) {
+    const char *ep;
+    if (*q == '(' || *q == ')') {
+      q++;
+      continue;
+    }
+    if (*q == L_ESC && q + 1 < pe) {
+      if (*(q + 1) == 'b') {
+        q += 4;
+        continue;
+      } else if (isdigit(uchar(*(q + 1)))) {
+        q += 2;
+        continue;
+      } else if (*(q + 1) == 'f') { /* the set of a frontier is an item */
+        q += 2;
+        if (q >= pe || *q != '[') return n;
+      }
+    }
+    ep = itemend(q, pe);
+    if (ep == NULL) return n;
+    if (*q == '[') {
+      if (prog != NULL) {
+        unsigned char *cs = prog->sets[n];
+        const char *c;
+        int b;
+        memset(cs, 0, sizeof(CharSet));
+        for (b = 0; b <= UCHAR_MAX; b++)
+          if (matchbracketclass(b, q, ep - 1)) csset(cs, b);
+        for (c = q + 1; c < ep - 1; c++) {
+          if (*c == L_ESC && localeclass(uchar(*++c))) prog->ctype = 1;
+        }
+        prog->setidx[q - p] = (unsigned char)(n + 1);
+      }
+      n++;
+    }
+    q = ep;
+    if (q < pe && isquantifier(*q)) q++;
+  }
+  return n;
+}
+
+/*
+** Find out which positions may start a match of pattern [p, pe): the
+** first item must match a byte, so a match starts with a byte it
+** accepts, and with the literal characters that follow it, if any.
+*/
+static void compilestart(PatProg *prog, const char *p, const char *pe) {
+  const char *ep;
+  prog->kind = PF_NONE;
+  while (p < pe && *p == '(') /* captures do not consume input */
+    p += (p + 1 < pe && *(p + 1) == ')') ? 2 : 1;
+  if (p >= pe || *p == ')' || *p == '.' || (*p == '$' && p + 1 == pe))
+    return;
+  if (*p == L_ESC && p + 1 < pe) {
+    if (*(p + 1) == 'b') { /* balance: match starts with the opening char */
+      if (p + 2 < pe) {
+        prog->kind = PF_CHAR;
+        prog->prefix[0] = uchar(*(p + 2));
+        prog->nprefix = 1;
+      }
+      return;
+    } else if (*(p + 1) == 'f' || isdigit(uchar(*(p + 1))))
+      return; /* frontiers and back references */
+  }
+  ep = itemend(p, pe);
+  if (ep == NULL || (ep < pe && isquantifier(*ep) && *ep != '+'))
+    return; /* malformed, or the first item may match the empty string */
+  if (*p == '[') {
+    prog->kind = PF_SET;
+    memcpy(prog->first, prog->sets[prog->setidx[0] - 1], sizeof(CharSet));
+  } else if (*p == L_ESC && isalpha(uchar(*(p + 1)))) {
+    int c;
+    prog->kind = PF_SET;
+    memset(prog->first, 0, sizeof(CharSet));
+    for (c = 0; c <= UCHAR_MAX; c++)
+      if (match_class(c, uchar(*(p + 1)))) csset(prog->first, c);
+    if (localeclass(uchar(*(p + 1)))) prog->ctype = 1;
+  } else { /* literal (maybe escaped) characters */
+    prog->kind = PF_CHAR;
+    prog->nprefix = 0;
+    for (;;) {
+      prog->prefix[prog->nprefix++] = uchar(*p == L_ESC ? *(p + 1) : *p);
+      if (ep < pe && isquantifier(*ep)) break; /* '+': repeats */
+      p = ep;
+      if (p >= pe || prog->nprefix == MAXPREFIX) break;
+      if (*p == L_ESC) { /* only escaped punctuation is literal */
+        if (p + 1 >= pe || isalnum(uchar(*(p + 1)))) break;
+      } else if (strchr(SPECIALS ")]", *p) != NULL)
+        break;
+      ep = itemend(p, pe);
+      if (ep < pe && isquantifier(*ep) && *ep != '+') break;
+    }
+  }
+}
+
+/*
+** Compile the pattern 'p' of length 'lp' into a new userdata, pushed
+** on the stack. Userdata of locale-dependent patterns keep the name of
+** the locale in their user value.
+*/
+static PatProg *compilepattern(lua_State *L, const char *p, size_t lp) {
+  int n = compilesets(NULL, p, p + lp);
+  PatProg *prog = (PatProg *)lua_newuserdatauv(
+      L, sizeof(PatProg) + lp + n * sizeof(CharSet), 1);
+  prog->lastuse = 0;
+  prog->ctype = 0;
+  prog->nprefix = 0;
+  prog->setidx = (unsigned char *)(prog + 1);
+  prog->sets = (CharSet *)(prog->setidx + lp);
+  memset(prog->setidx, 0, lp);
+  compilesets(prog, p, p + lp);
+  compilestart(prog, p, p + lp);
+  if (prog->ctype) {
+    const char *loc = setlocale(LC_CTYPE, NULL);
+    lua_pushstring(L, loc ? loc : "");
+    lua_setiuservalue(L, -2, 1);
+  }
+  return prog;
+}
+
+/* whether the compiled pattern on the top was compiled in this locale */
+static int samelocale(lua_State *L, const PatProg *prog) {
+  const char *loc;
+  int same;
+  if (!prog->ctype) return 1;
+  loc = setlocale(LC_CTYPE, NULL);
+  lua_getiuservalue(L, -1, 1);
+  same = strcmp(lua_tostring(L, -1), loc ? loc : "") == 0;
+  lua_pop(L, 1);
+  return same;
+}
+
+/* remove the least recently used pattern from the cache on the top */
+static void evictpattern(lua_State *L, PatCache *pc) {
+  lua_Unsigned oldest = ~(lua_Unsigned)0;
+  lua_pushnil(L); /* key of the oldest */
+  lua_pushnil(L); /* first key */
+  while (lua_next(L, -3)) {
+    if (lua_type(L, -2) == LUA_TSTRING) {
+      const PatProg *prog = (const PatProg *)lua_touserdata(L, -1);
+      if (prog->lastuse < oldest) {
+        oldest = prog->lastuse;
+        lua_pushvalue(L, -2);
+        lua_replace(L, -4);
+      }
+    }
+    lua_pop(L, 1);
+  }
+  lua_pushnil(L);
+  lua_rawset(L, -3);
+  pc->n--;
+}
+
+/*
+** Push the compiled form of the pattern at stack index 'parg', which
+** stays on the stack while it is in use, and set it in 'ms'. Compiling
+** allocates, and finalizers run by the collector may grow, reset or
+** close a buffer subject, so this also fetches the subject (at index 1)
+** into 'ms' again; callers must use 'ms->src_init' afterwards.
+*/
+static const PatProg *getpatprog(MatchState *ms, int parg) {
+  lua_State *L = ms->L;
+  size_t lp, ls;
+  const char *p = lua_tolstring(L, parg, &lp);
+  PatCache *pc;
+  PatProg *prog;
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, PATCACHE);
+  if (lua_rawgeti(L, -1, 1) != LUA_TUSERDATA) { /* new cache? */
+    lua_pop(L, 1);
+    pc = (PatCache *)lua_newuserdatauv(L, sizeof(PatCache), 0);
+    pc->clock = 0;
+    pc->n = 0;
+    lua_rawseti(L, -2, 1);
+  } else {
+    pc = (PatCache *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+  }
+  lua_pushvalue(L, parg);
+  if (lua_rawget(L, -2) == LUA_TUSERDATA &&
+      samelocale(L, (prog = (PatProg *)lua_touserdata(L, -1)))) {
+    lua_remove(L, -2); /* remove cache */
+  } else {
+    if (lua_type(L, -1) == LUA_TUSERDATA) pc->n--; /* to be replaced */
+    lua_pop(L, 1);
+    if (pc->n >= PATCACHE_MAX) evictpattern(L, pc);
+    prog = compilepattern(L, p, lp);
+    lua_pushvalue(L, parg);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -4);
+    pc->n++;
+    lua_remove(L, -2); /* remove cache */
+  }
+  prog->lastuse = ++pc->clock;
+  ms->prog = prog;
+  ms->p_init = p;
+  ms->src_init = luaL_checklbytes(L, 1, &ls);
+  ms->src_end = ms->src_init + ls;
+  return prog;
+}
+
+/*
+** First position in [s, e) that may start a match, or 'e' if none
+** can (an empty match at 'e' is not possible when 'prog' limits them).
+*/
+static const char *nextstart(const PatProg *prog, const char *s,
+                             const char *e) {
+  switch (prog->kind) {
+    case PF_CHAR: {
+      for (;;) {
+        const char *c = (const char *)memchr(s, prog->prefix[0], e - s);
+        if (c == NULL || (size_t)(e - c) < prog->nprefix) return e;
+        if (memcmp(c, prog->prefix, prog->nprefix) == 0) return c;
+        s = c + 1;
+      }
+    }
+    case PF_SET: {
+      while (s < e && !cstest(prog->first, *s)) s++;
+      return s;
+    }
+    default:
+      return s;
+  }
+}
+
+/* }====================================================== */
+
 static int str_find_aux(lua_State *L, int find) {
   size_t ls, lp;
-  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *s = luaL_checklbytes(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
   size_t init = posrelatI(luaL_optinteger(L, 3, 1), ls) - 1;
   if (init > ls) {    /* start after string's end? */
@@ -762,15 +1105,24 @@ static int str_find_aux(lua_State *L, int find) {
     }
   } else {
     MatchState ms;
-    const char *s1 = s + init;
+    const PatProg *prog;
+    const char *s1;
     int anchor = (*p == '^');
     if (anchor) {
       p++;
       lp--; /* skip anchor character */
     }
     prepstate(&ms, L, s, ls, p, lp);
+    prog = getpatprog(&ms, 2);
+    s = ms.src_init; /* the subject may have changed */
+    if (init > (size_t)(ms.src_end - s)) {
+      luaL_pushfail(L);
+      return 1;
+    }
+    s1 = s + init;
     do {
       const char *res;
+      if (!anchor) s1 = nextstart(prog, s1, ms.src_end);
       reprepstate(&ms);
       if ((res = match(&ms, s1, p)) != NULL) {
         if (find) {
@@ -801,9 +1153,14 @@ typedef struct GMatchState {
 static int gmatch_aux(lua_State *L) {
   GMatchState *gm = (GMatchState *)lua_touserdata(L, lua_upvalueindex(3));
   const char *src;
+  size_t ls;
+  const char *s = luaL_tolbytes(L, lua_upvalueindex(1), &ls);
   gm->ms.L = L;
+  if (l_unlikely(s != gm->ms.src_init || s + ls != gm->ms.src_end))
+    return luaL_error(L, "subject changed during iteration");
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    src = nextstart(gm->ms.prog, src, gm->ms.src_end);
     reprepstate(&gm->ms);
     if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
@@ -815,19 +1172,22 @@ static int gmatch_aux(lua_State *L) {
 
 static int gmatch(lua_State *L) {
   size_t ls, lp;
-  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *s = luaL_checklbytes(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
   size_t init = posrelatI(luaL_optinteger(L, 3, 1), ls) - 1;
   GMatchState *gm;
   lua_settop(L, 2); /* keep strings on closure to avoid being collected */
   gm = (GMatchState *)lua_newuserdatauv(L, sizeof(GMatchState), 0);
+  prepstate(&gm->ms, L, s, ls, p, lp);
+  getpatprog(&gm->ms, 2); /* also kept on the closure */
+  s = gm->ms.src_init; /* the subject may have changed */
+  ls = gm->ms.src_end - s;
   if (init > ls)   /* start after string's end? */
     init = ls + 1; /* avoid overflows in 's + init' */
-  prepstate(&gm->ms, L, s, ls, p, lp);
   gm->src = s + init;
   gm->p = p;
   gm->lastmatch = NULL;
-  lua_pushcclosure(L, gmatch_aux, 3);
+  lua_pushcclosure(L, gmatch_aux, 4);
   return 1;
 }
 
@@ -908,30 +1268,49 @@ static int str_gsub(lua_State *L) {
   int anchor = (*p == '^');
   lua_Integer n = 0; /* replacement count */
   int changed = 0;   /* change flag */
+  int plain;
   MatchState ms;
   luaL_Buffer b;
   luaL_argexpected(L,
                    tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                        tr == LUA_TFUNCTION || tr == LUA_TTABLE,
                    3, "string/function/table");
-  luaL_buffinit(L, &b);
   if (anchor) {
     p++;
     lp--; /* skip anchor character */
   }
   prepstate(&ms, L, src, srcl, p, lp);
-  while (n < max_s) {
+  plain = (!anchor && lp > 0 && nospecials(p, lp));
+  if (!plain) getpatprog(&ms, 2); /* before 'b', which needs the top */
+  luaL_buffinit(L, &b);
+  if (plain) { /* plain pattern? */
     const char *e;
-    reprepstate(&ms); /* (re)prepare state for new match */
-    if ((e = match(&ms, src, p)) != NULL && e != lastmatch) { /* match? */
+    while (n < max_s && (e = lmemfind(src, ms.src_end - src, p, lp)) != NULL) {
+      luaL_addlstring(&b, src, e - src); /* keep text before the match */
+      reprepstate(&ms);
       n++;
-      changed = add_value(&ms, &b, src, e, tr) | changed;
-      src = lastmatch = e;
-    } else if (src < ms.src_end) /* otherwise, skip one character */
-      luaL_addchar(&b, *src++);
-    else
-      break; /* end of subject */
-    if (anchor) break;
+      changed = add_value(&ms, &b, e, e + lp, tr) | changed;
+      src = e + lp;
+    }
+  } else {
+    while (n < max_s) {
+      const char *e;
+      if (!anchor) { /* copy positions that cannot start a match */
+        const char *c = nextstart(ms.prog, src, ms.src_end);
+        luaL_addlstring(&b, src, c - src);
+        src = c;
+      }
+      reprepstate(&ms); /* (re)prepare state for new match */
+      if ((e = match(&ms, src, p)) != NULL && e != lastmatch) { /* match? */
+        n++;
+        changed = add_value(&ms, &b, src, e, tr) | changed;
+        src = lastmatch = e;
+      } else if (src < ms.src_end) /* otherwise, skip one character */
+        luaL_addchar(&b, *src++);
+      else
+        break; /* end of subject */
+      if (anchor) break;
+    }
   }
   if (!changed)          /* no changes? */
     lua_pushvalue(L, 1); /* return original string */
@@ -1803,24 +2182,56 @@ static int str_unpack(lua_State *L) {
   return n + 1;
 }
 static int str_split(lua_State *L) {
-  const char *str = luaL_checkstring(L, 1);
-  const char *splitter = luaL_checkstring(L, 2);
-
+  size_t ls, lsep;
+  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *sep = luaL_checklstring(L, 2, &lsep);
+  const char *e = s + ls;
+  const char *p;
+  lua_Integer i = 1;
+  luaL_argcheck(L, lsep > 0, 2, "empty separator");
   lua_newtable(L);
-
-  int i = 1;
-  const char *start = str;
-  const char *end = strstr(start, splitter);
-  while (end != NULL) {
-    lua_pushlstring(L, start, end - start);
+  while ((p = lmemfind(s, e - s, sep, lsep)) != NULL) {
+    lua_pushlstring(L, s, p - s);
     lua_rawseti(L, -2, i++);
-    start = end + strlen(splitter);
-    end = strstr(start, splitter);
+    s = p + lsep;
   }
-
-  lua_pushstring(L, start);
+  lua_pushlstring(L, s, e - s);
   lua_rawseti(L, -2, i);
+  return 1;
+}
+
+/*
+** Iteration function for 'splititer'. Upvalues are the subject, the
+** separator and the position of the next slice (-1 after the last one).
+*/
+static int splititer_aux(lua_State *L) {
+  size_t ls, lsep;
+  const char *s = lua_tolstring(L, lua_upvalueindex(1), &ls);
+  const char *sep = lua_tolstring(L, lua_upvalueindex(2), &lsep);
+  lua_Integer pos = lua_tointeger(L, lua_upvalueindex(3));
+  const char *p;
+  if (pos < 0) return 0; /* last slice already returned */
+  p = lmemfind(s + pos, ls - pos, sep, lsep);
+  if (p == NULL) { /* last slice? */
+    lua_pushlstring(L, s + pos, ls - pos);
+    pos = -1;
+  } else {
+    lua_pushlstring(L, s + pos, p - (s + pos));
+    pos = (p - s) + lsep;
+  }
+  lua_pushinteger(L, pos);
+  lua_replace(L, lua_upvalueindex(3));
+  return 1;
+}
 
+static int str_splititer(lua_State *L) {
+  size_t lsep;
+  luaL_checkstring(L, 1);
+  luaL_checklstring(L, 2, &lsep);
+  luaL_argcheck(L, lsep > 0, 2, "empty separator");
+  lua_settop(L, 2);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, splititer_aux, 3);
   return 1;
 }
 static int str_get(lua_State *L){
@@ -1868,11 +2279,154 @@ static int str_set(lua_State *L){
 }
 /* }====================================================== */
 
-static const luaL_Reg strlib[] = {{"byte", str_byte},
+/*
+** read-only functions that also work as methods of mapped buffers
+** and string buffers
+*/
+static const luaL_Reg bytesmethods[] = {{"byte", str_byte},   {"find", str_find},
+                                      {"gmatch", gmatch},   {"len", str_len},
+                                      {"match", str_match}, {"sub", str_sub},
+                                      {NULL, NULL}};
+
+/*
+** {======================================================
+** STRING BUFFERS
+** Mutable byte buffers ('string.buffer') for building large outputs
+** without intermediate strings. They use the 'luaL_StrBuf' growth
+** logic from lauxlib and are accepted by 'file:write' and the socket
+** functions as they are.
+** =======================================================
+*/
+
+#define checkstrbuf(L) \
+  ((luaL_StrBuf *)luaL_checkudata(L, 1, LUA_STRBUFHANDLE))
+
+static int str_buffer(lua_State *L) {
+  lua_Integer sz = luaL_optinteger(L, 1, 0);
+  luaL_argcheck(L, sz >= 0, 1, "invalid size");
+  luaL_newstrbuf(L, (size_t)sz);
+  return 1;
+}
+
+static int buf_put(lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L);
+  int i, n = lua_gettop(L);
+  for (i = 2; i <= n; i++) {
+    size_t l;
+    const char *s = luaL_checklbytes(L, i, &l);
+    if (lua_rawequal(L, 1, i)) { /* appending the buffer to itself? */
+      char *b = luaL_strbufprep(L, sb, l); /* may move the contents */
+      memcpy(b, luaL_strbufaddr(sb), l);
+      luaL_strbufaddsize(sb, l);
+    } else
+      luaL_strbufaddlstring(L, sb, s, l);
+  }
+  lua_settop(L, 1); /* return buffer */
+  return 1;
+}
+
+static int buf_putf(lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L);
+  int n = lua_gettop(L) - 1; /* format and its arguments */
+  size_t l;
+  const char *s;
+  lua_pushcfunction(L, str_format);
+  lua_insert(L, 2);
+  lua_call(L, n, 1);
+  s = lua_tolstring(L, 2, &l);
+  luaL_strbufaddlstring(L, sb, s, l);
+  lua_settop(L, 1); /* return buffer */
+  return 1;
+}
+
+static int buf_reserve(lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, n >= 0, 2, "invalid size");
+  luaL_strbufprep(L, sb, (size_t)n);
+  lua_settop(L, 1);
+  return 1;
+}
+
+/*
+** Consume up to 'n' bytes from the front of the buffer; an emptied
+** buffer restarts at the beginning of its storage.
+*/
+static size_t consume(lua_State *L, luaL_StrBuf *sb, int arg) {
+  size_t len = luaL_strbuflen(sb);
+  lua_Integer n = luaL_optinteger(L, arg, (lua_Integer)len);
+  size_t k = (n < 0) ? 0 : ((size_t)n > len ? len : (size_t)n);
+  sb->r += k;
+  if (sb->r == sb->w) sb->r = sb->w = 0;
+  return k;
+}
+
+static int buf_get(lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L);
+  const char *s = luaL_strbufaddr(sb);
+  size_t k = consume(L, sb, 2);
+  lua_pushlstring(L, s, k); /* storage is not touched by 'consume' */
+  return 1;
+}
+
+static int buf_skip(lua_State *L) {
+  consume(L, checkstrbuf(L), 2);
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int buf_reset(lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L);
+  sb->r = sb->w = 0;
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int buf_tostring(lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L);
+  lua_pushlstring(L, luaL_strbufaddr(sb), luaL_strbuflen(sb));
+  return 1;
+}
+
+static int buf_gc(lua_State *L) {
+  luaL_strbuffree(L, checkstrbuf(L));
+  return 0;
+}
+
+static const luaL_Reg bufmeth[] = {{"put", buf_put},
+                                   {"putf", buf_putf},
+                                   {"reserve", buf_reserve},
+                                   {"get", buf_get},
+                                   {"skip", buf_skip},
+                                   {"reset", buf_reset},
+                                   {"tostring", buf_tostring},
+                                   {NULL, NULL}};
+
+static const luaL_Reg bufmetameth[] = {{"__index", NULL}, /* place holder */
+                                       {"__len", str_len},
+                                       {"__gc", buf_gc},
+                                       {"__tostring", buf_tostring},
+                                       {NULL, NULL}};
+
+static void createbufmeta(lua_State *L) {
+  luaL_newmetatable(L, LUA_STRBUFHANDLE); /* lauxlib may have created it */
+  luaL_setfuncs(L, bufmetameth, 0);
+  luaL_newlibtable(L, bufmeth);
+  luaL_setfuncs(L, bufmeth, 0);
+  luaL_setfuncs(L, bytesmethods, 0); /* 'find', 'sub', ... */
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
+/* }====================================================== */
+
+static const luaL_Reg strlib[] = {{"buffer", str_buffer},
+                                  {"byte", str_byte},
                                   {"char", str_char},
                                   {"dump", str_dump},
                                   {"find", str_find},
                                   {"split", str_split},
+                                  {"splititer", str_splititer},
                                   {"format", str_format},
                                   {"gmatch", gmatch},
                                   {"gsub", str_gsub},
@@ -1901,6 +2455,9 @@ static void createmetatable(lua_State *L) {
   lua_pushvalue(L, -2);           /* get string library */
   lua_setfield(L, -2, "__index"); /* metatable.__index = string */
   lua_pop(L, 1);                  /* pop metatable */
+  luaL_mapmethods(L);
+  luaL_setfuncs(L, bytesmethods, 0); /* add them to mapped buffers */
+  lua_pop(L, 1);                     /* pop method table */
 }
 
 /*
@@ -1909,5 +2466,6 @@ static void createmetatable(lua_State *L) {
 LUAMOD_API int luaopen_string(lua_State *L) {
   luaL_newlib(L, strlib);
   createmetatable(L);
+  createbufmeta(L);
   return 1;
 }
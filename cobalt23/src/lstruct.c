@@ -358,14 +358,387 @@ static int b_size(lua_State *L) {
   return 1;
 }
 
+/*
+** {======================================================
+** Compiled formats
+** =======================================================
+*/
+
+#define FORMATHANDLE "struct.format"
+
+/* one data option of a compiled format */
+typedef struct FmtItem {
+  char opt;
+  char endian;
+  int align;     /* alignment boundary for this item (0 = none) */
+  size_t size;   /* 0 for 's' and 'c0' */
+  size_t offset; /* offset inside the record (fixed formats only) */
+} FmtItem;
+
+typedef struct Format {
+  int nitems;
+  int fixed;   /* no 's' or 'c0' items? */
+  size_t size; /* record size (fixed formats only) */
+  FmtItem items[1];
+} Format;
+
+#define checkformat(L, i) ((Format *)luaL_checkudata(L, i, FORMATHANDLE))
+
+/* number of padding bytes before an item at record offset 'pos' */
+#define itempad(it, pos) \
+  ((it)->align == 0 ? 0 \
+                    : ((it)->align - ((pos) & ((it)->align - 1))) & \
+                          ((it)->align - 1))
+
+static Format *compileformat(lua_State *L, const char *fmt) {
+  Header h;
+  size_t n = strlen(fmt);
+  size_t pos = 0;
+  Format *F = (Format *)lua_newuserdatauv(
+      L, sizeof(Format) + (n > 0 ? n - 1 : 0) * sizeof(FmtItem), 0);
+  F->nitems = 0;
+  F->fixed = 1;
+  defaultoptions(&h);
+  luaL_setmetatable(L, FORMATHANDLE);
+  while (*fmt) {
+    int opt = *fmt++;
+    size_t size = optsize(L, opt, &fmt);
+    if (opt != '\0' && strchr("bBhHlLTiIxfdcs", opt) != NULL) {
+      FmtItem *it = &F->items[F->nitems++];
+      it->opt = (char)opt;
+      it->endian = (char)h.endian;
+      it->size = size;
+      if (size == 0 || opt == 'c')
+        it->align = 0;
+      else
+        it->align = size > (size_t)h.align ? h.align : (int)size;
+      if (size == 0) F->fixed = 0; /* 's' or 'c0' */
+      pos += itempad(it, pos);
+      it->offset = pos;
+      pos += size;
+    } else
+      controloptions(L, opt, &fmt, &h);
+  }
+  F->size = pos;
+  return F;
+}
+
+/* value 'idx' for an item; 'rec' > 0 names the record for pack_many */
+static lua_Number checkitemnumber(lua_State *L, int idx, int rec) {
+  int isnum;
+  lua_Number n = lua_tonumberx(L, idx, &isnum);
+  if (!isnum) {
+    if (rec == 0) return luaL_checknumber(L, idx);
+    luaL_error(L, "record %d: number expected, got %s", rec,
+               luaL_typename(L, idx));
+  }
+  return n;
+}
+
+static const char *checkitemstring(lua_State *L, int idx, int rec,
+                                   size_t *l) {
+  const char *s = lua_tolstring(L, idx, l);
+  if (s == NULL) {
+    if (rec == 0) return luaL_checklstring(L, idx, l);
+    luaL_error(L, "record %d: string expected, got %s", rec,
+               luaL_typename(L, idx));
+  }
+  return s;
+}
+
+/*
+** Appends item 'it' to 'sb' taking its value from stack index 'idx'
+** (ignored for 'x'); returns the number of bytes written.
+*/
+static size_t putitem(lua_State *L, luaL_StrBuf *sb, const FmtItem *it,
+                      int idx, int rec) {
+  size_t size = it->size;
+  char *p;
+  switch (it->opt) {
+    case 'x':
+      p = luaL_strbufprep(L, sb, 1);
+      *p = '\0';
+      break;
+    case 'f': {
+      float f = (float)checkitemnumber(L, idx, rec);
+      correctbytes((char *)&f, size, it->endian);
+      p = luaL_strbufprep(L, sb, size);
+      memcpy(p, &f, size);
+      break;
+    }
+    case 'd': {
+      double d = checkitemnumber(L, idx, rec);
+      correctbytes((char *)&d, size, it->endian);
+      p = luaL_strbufprep(L, sb, size);
+      memcpy(p, &d, size);
+      break;
+    }
+    case 'c':
+    case 's': {
+      size_t l;
+      const char *s = checkitemstring(L, idx, rec, &l);
+      if (size == 0) size = l;
+      if (l < size) luaL_error(L, "string too short");
+      p = luaL_strbufprep(L, sb, size + 1);
+      memcpy(p, s, size);
+      if (it->opt == 's') p[size++] = '\0'; /* add zero at the end */
+      break;
+    }
+    default: { /* integer types */
+      lua_Number n = checkitemnumber(L, idx, rec);
+      Uinttype value = n < 0 ? (Uinttype)(Inttype)n : (Uinttype)n;
+      int i;
+      p = luaL_strbufprep(L, sb, size);
+      if (it->endian == LITTLE)
+        for (i = 0; i < (int)size; i++, value >>= 8) p[i] = (value & 0xff);
+      else
+        for (i = (int)size - 1; i >= 0; i--, value >>= 8)
+          p[i] = (value & 0xff);
+      break;
+    }
+  }
+  luaL_strbufaddsize(sb, size);
+  return size;
+}
+
+/*
+** Appends one record whose values are at stack indices 'base',
+** 'base + 1', ...; padding is relative to the start of the record.
+*/
+static void packrecord(lua_State *L, const Format *F, luaL_StrBuf *sb,
+                       int base, int rec) {
+  size_t pos = 0;
+  int i;
+  for (i = 0; i < F->nitems; i++) {
+    const FmtItem *it = &F->items[i];
+    size_t pad = itempad(it, pos);
+    if (pad > 0) {
+      memset(luaL_strbufprep(L, sb, pad), 0, pad);
+      luaL_strbufaddsize(sb, pad);
+      pos += pad;
+    }
+    pos += putitem(L, sb, it, base, rec);
+    if (it->opt != 'x') base++;
+  }
+}
+
+/*
+** Pushes the values of one record starting at 'pos' in 'data' and
+** returns the position after it, or (size_t)-1 when 'data' is too
+** short.
+*/
+static size_t unpackrecord(lua_State *L, const Format *F, const char *data,
+                           size_t ld, size_t pos) {
+  size_t start = pos;
+  int i;
+  if (F->fixed && F->size > ld - pos) return (size_t)-1;
+  for (i = 0; i < F->nitems; i++) {
+    const FmtItem *it = &F->items[i];
+    size_t size = it->size;
+    if (F->fixed)
+      pos = start + it->offset;
+    else {
+      pos += itempad(it, pos - start);
+      if (pos + size > ld) return (size_t)-1;
+    }
+    switch (it->opt) {
+      case 'x':
+        break;
+      case 'f': {
+        float f;
+        memcpy(&f, data + pos, size);
+        correctbytes((char *)&f, sizeof(f), it->endian);
+        lua_pushnumber(L, f);
+        break;
+      }
+      case 'd': {
+        double d;
+        memcpy(&d, data + pos, size);
+        correctbytes((char *)&d, sizeof(d), it->endian);
+        lua_pushnumber(L, d);
+        break;
+      }
+      case 'c': {
+        if (size == 0) {
+          if (!lua_isnumber(L, -1))
+            luaL_error(L, "format `c0' needs a previous size");
+          size = lua_tonumber(L, -1);
+          lua_pop(L, 1);
+          if (size > ld - pos) return (size_t)-1;
+        }
+        lua_pushlstring(L, data + pos, size);
+        break;
+      }
+      case 's': {
+        const char *e = (const char *)memchr(data + pos, '\0', ld - pos);
+        if (e == NULL) luaL_error(L, "unfinished string in data");
+        size = (e - (data + pos)) + 1;
+        lua_pushlstring(L, data + pos, size - 1);
+        break;
+      }
+      default: /* integer types */
+        lua_pushnumber(L, getinteger(data + pos, it->endian, islower(it->opt),
+                                     size));
+        break;
+    }
+    pos += size;
+  }
+  return F->fixed ? start + F->size : pos;
+}
+
+static int f_compile(lua_State *L) {
+  compileformat(L, luaL_checkstring(L, 1));
+  return 1;
+}
+
+static int f_pack(lua_State *L) {
+  Format *F = checkformat(L, 1);
+  luaL_StrBuf *sb = luaL_newstrbuf(L, F->fixed ? F->size : 0);
+  packrecord(L, F, sb, 2, 0);
+  lua_pushlstring(L, luaL_strbufaddr(sb), luaL_strbuflen(sb));
+  luaL_strbuffree(L, sb);
+  return 1;
+}
+
+static int f_unpack(lua_State *L) {
+  Format *F = checkformat(L, 1);
+  size_t ld;
+  const char *data = luaL_checklbytes(L, 2, &ld);
+  size_t pos = luaL_optinteger(L, 3, 1) - 1;
+  luaL_argcheck(L, pos <= ld, 3, "initial position out of data");
+  lua_settop(L, 3);
+  luaL_checkstack(L, F->nitems + 1, "too many results");
+  pos = unpackrecord(L, F, data, ld, pos);
+  luaL_argcheck(L, pos != (size_t)-1, 2, "data string too short");
+  lua_pushinteger(L, pos + 1);
+  return lua_gettop(L) - 3;
+}
+
+static int f_size(lua_State *L) {
+  Format *F = checkformat(L, 1);
+  if (!F->fixed) luaL_argerror(L, 1, "format has no fixed size");
+  lua_pushinteger(L, F->size);
+  return 1;
+}
+
+/*
+** fmt:unpack_many(data, count [, pos [, t]]) decodes up to 'count'
+** consecutive records (all of them when 'count' is nil) into 't[1..n]',
+** one table per record. Record tables already in 't' are reused, so
+** a decoder can keep refilling the same tables. Decoding stops early at
+** the end of the data or at an incomplete record. Returns 't', the
+** number of records decoded and the position after the last one.
+*/
+static int f_unpack_many(lua_State *L) {
+  Format *F = checkformat(L, 1);
+  size_t ld;
+  const char *data = luaL_checklbytes(L, 2, &ld);
+  lua_Integer count = luaL_optinteger(L, 3, LUA_MAXINTEGER);
+  size_t pos = luaL_optinteger(L, 4, 1) - 1;
+  lua_Integer i;
+  luaL_argcheck(L, count >= 0, 3, "count must be non-negative");
+  luaL_argcheck(L, pos <= ld, 4, "initial position out of data");
+  if (lua_isnoneornil(L, 5)) {
+    lua_Integer hint = count;
+    if (F->fixed && F->size > 0 && (lua_Integer)((ld - pos) / F->size) < hint)
+      hint = (ld - pos) / F->size;
+    lua_settop(L, 4);
+    lua_createtable(L, hint < INT_MAX ? (int)hint : 0, 0);
+  } else {
+    luaL_checktype(L, 5, LUA_TTABLE);
+    lua_settop(L, 5);
+  }
+  luaL_checkstack(L, F->nitems + 2, "too many values in a record");
+  for (i = 0; i < count && pos < ld; i++) {
+    int top = lua_gettop(L);
+    int nv, k;
+    size_t next = unpackrecord(L, F, data, ld, pos);
+    if (next == (size_t)-1) { /* incomplete record? */
+      lua_settop(L, top);
+      break; /* leave it for the next call */
+    }
+    nv = lua_gettop(L) - top;
+    if (lua_rawgeti(L, 5, i + 1) != LUA_TTABLE) { /* no table to reuse? */
+      lua_pop(L, 1);
+      lua_createtable(L, nv, 0);
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, 5, i + 1);
+    }
+    lua_insert(L, top + 1); /* record table below its values */
+    for (k = nv; k >= 1; k--) lua_rawseti(L, top + 1, k);
+    lua_pop(L, 1);
+    pos = next;
+  }
+  lua_pushinteger(L, i);
+  lua_pushinteger(L, pos + 1);
+  return 3;
+}
+
+/*
+** fmt:pack_many(records [, buf]) encodes the records 'records[1..n]',
+** each an array with the values for one record. When a string buffer
+** is given the bytes are appended to it and it is returned; otherwise
+** the result is a string.
+*/
+static int f_pack_many(lua_State *L) {
+  Format *F = checkformat(L, 1);
+  lua_Integer n, i;
+  int nv = 0, k, base;
+  int tostr = lua_isnoneornil(L, 3);
+  luaL_StrBuf *sb;
+  luaL_checktype(L, 2, LUA_TTABLE);
+  n = luaL_len(L, 2);
+  for (k = 0; k < F->nitems; k++)
+    if (F->items[k].opt != 'x') nv++;
+  if (tostr) {
+    lua_settop(L, 2);
+    sb = luaL_newstrbuf(L, F->fixed ? F->size * (size_t)n : 0);
+  } else {
+    sb = (luaL_StrBuf *)luaL_checkudata(L, 3, LUA_STRBUFHANDLE);
+    lua_settop(L, 3);
+  }
+  luaL_checkstack(L, nv + 1, "too many values in a record");
+  base = lua_gettop(L) + 2;
+  for (i = 1; i <= n; i++) {
+    if (lua_rawgeti(L, 2, i) != LUA_TTABLE)
+      luaL_error(L, "record %d: table expected, got %s", (int)i,
+                 luaL_typename(L, -1));
+    for (k = 1; k <= nv; k++) lua_rawgeti(L, base - 1, k);
+    packrecord(L, F, sb, base, (int)i);
+    lua_settop(L, base - 2);
+  }
+  if (tostr) {
+    lua_pushlstring(L, luaL_strbufaddr(sb), luaL_strbuflen(sb));
+    luaL_strbuffree(L, sb);
+  } else
+    lua_pushvalue(L, 3);
+  return 1;
+}
+
+static const struct luaL_Reg formatmeth[] = {{"pack", f_pack},
+                                             {"unpack", f_unpack},
+                                             {"size", f_size},
+                                             {"unpack_many", f_unpack_many},
+                                             {"pack_many", f_pack_many},
+                                             {NULL, NULL}};
+
+static void createformatmeta(lua_State *L) {
+  luaL_newmetatable(L, FORMATHANDLE);
+  luaL_newlib(L, formatmeth);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
 /* }====================================================== */
 
 static const struct luaL_Reg thislib[] = {
-    {"pack", b_pack}, {"unpack", b_unpack}, {"size", b_size}, {NULL, NULL}};
+    {"pack", b_pack},       {"unpack", b_unpack}, {"size", b_size},
+    {"compile", f_compile}, {NULL, NULL}};
 
 LUALIB_API int luaopen_struct(lua_State *L);
 
 LUALIB_API int luaopen_struct(lua_State *L) {
+  createformatmeta(L);
   luaL_register(L, "struct", thislib);
   return 1;
 }
@@ -496,6 +496,13 @@ static void exchangehashpart(Table *t1, Table *t2) {
   t2->lastfree = lastfree;
 }
 
+/*
+** The nodes of 't' may move: if a lookup cache holds slots of 't', give
+** it a new shape so that the cache stops using them (see 'BITWATCH').
+*/
+#define reshape(L, t) \
+  { if (l_unlikely(iswatched(t))) (t)->shape = ++G(L)->shapestamp; }
+
 /*
 ** Resize table 't' for the new given sizes. Both allocations (for
 ** the hash part and for the array part) can fail, which creates some
@@ -515,6 +522,7 @@ void luaH_resize(lua_State *L, Table *t, unsigned int newasize,
   Table newt; /* to keep the new hash part */
   unsigned int oldasize = setlimittosize(t);
   TValue *newarray;
+  reshape(L, t);
   /* create new hash part with appropriate size into 'newt' */
   setnodevector(L, &newt, nhsize);
   if (newasize < oldasize) {    /* will array shrink? */
@@ -584,6 +592,7 @@ Table *luaH_new(lua_State *L) {
   t->array = NULL;
   t->alimit = 0;
   t->locked = 0;
+  t->shape = 0;
   setnodevector(L, t, 0);
   return t;
 }
@@ -626,6 +635,7 @@ void luaH_newkey(lua_State *L, Table *t, const TValue *key, TValue *value) {
       luaG_runerror(L, "table index is NaN");
   }
   if (ttisnil(value)) return; /* do not insert nil values */
+  reshape(L, t);
   mp = mainpositionTV(t, key);
   if (!isempty(gval(mp)) || isdummy(t)) { /* main position is taken? */
     Node *othern;
@@ -668,6 +678,8 @@ void luaH_newkey(lua_State *L, Table *t, const TValue *key, TValue *value) {
 void luaH_initmetatable (lua_State *L, Table *t) {
   if (!G(L)->ready_for_table_mt)
      return;
+  sethvalue2s(L, L->top, t); /* keep 't' while creating the metatable */
+  L->top++;
   lua_pushnil(L); /* space on the stack where the metatable will go */
   if (ttisnil(&G(L)->table_mt)) {
     /* create metatable */
@@ -685,7 +697,7 @@ void luaH_initmetatable (lua_State *L, Table *t) {
   }
   /* set stack value as metatable and pop */
   t->metatable = hvalue(s2v(L->top - 1));
-  lua_pop(L, 1);
+  lua_pop(L, 2);
 }
 
 /*
@@ -233,6 +233,8 @@ static void loadFunction(LoadState *S, Proto *f, TString *psource) {
   loadUpvalues(S, f);
   loadProtos(S, f);
   loadDebug(S, f);
+  luaF_initcache(S->L, f);
+  luaF_initjumptabs(S->L, f);
 }
 
 static void checkliteral(LoadState *S, const char *s, const char *msg) {
@@ -329,6 +329,45 @@ void luaV_finishget(lua_State *L, const TValue *t, TValue *key, StkId val,
 }
 #endif
 
+/*
+** Start watching table 't' (see 'BITWATCH').
+*/
+#define watch(L, t) \
+  { if (!iswatched(t)) { setwatched(t); (t)->shape = ++G(L)->shapestamp; } }
+
+/*
+** Fill the lookup cache 'lc' of the OP_GETTABUP before 'pc', which just
+** found its value at 'slot' in table 'env'. When the instruction at 'pc'
+** is an OP_GETFIELD from and to the same register, and that field is
+** present, the cache also keeps the slot of the field so that the
+** OP_GETFIELD can be skipped. Either way, the tables read become watched.
+*/
+#ifndef AOT_IS_MODULE
+void luaV_fillcache(lua_State *L, LookupCache *lc, Table *env,
+                    const TValue *slot, const Instruction *pc,
+                    const TValue *k) {
+  Instruction i = *pc;
+  int a = GETARG_A(*(pc - 1));
+  lc->pair = 0;
+  if (GET_OPCODE(i) == OP_GETFIELD && GETARG_A(i) == a && GETARG_B(i) == a &&
+      ttistable(slot)) {
+    Table *t = hvalue(slot);
+    const TValue *fslot = luaH_getshortstr(t, tsvalue(&k[GETARG_C(i)]));
+    if (!isempty(fslot)) {
+      watch(L, t);
+      lc->tab = t;
+      lc->tabshape = t->shape;
+      lc->fslot = fslot;
+      lc->pair = 1;
+    }
+  }
+  watch(L, env);
+  lc->env = env;
+  lc->envshape = env->shape;
+  lc->slot = slot;
+}
+#endif
+
 /*
 ** Finish a table assignment 't[key] = val'.
 ** If 'slot' is NULL, 't' is not a table.  Otherwise, 'slot' points
@@ -801,16 +840,26 @@ lua_Integer luaV_shiftl(lua_Integer x, lua_Integer y) {
 
 /*
 ** create a new Lua closure, push it in the stack, and initialize
-** its upvalues.
+** its upvalues. A function without upvalues cannot tell its instances
+** apart, so they all are the one closure cached in its prototype.
 */
 static void pushclosure(lua_State *L, Proto *p, UpVal **encup, StkId base,
                         StkId ra) {
   int nup = p->sizeupvalues;
   Upvaldesc *uv = p->upvalues;
   int i;
-  LClosure *ncl = luaF_newLclosure(L, nup);
+  LClosure *ncl;
+  if (nup == 0 && p->cache != NULL) {
+    setclLvalue2s(L, ra, p->cache);  /* reuse it */
+    return;
+  }
+  ncl = luaF_newLclosure(L, nup);
   ncl->p = p;
   setclLvalue2s(L, ra, ncl);  /* anchor new closure in stack */
+  if (nup == 0) {
+    p->cache = ncl;  /* save it for the next instances */
+    luaC_objbarrier(L, p, ncl);
+  }
   for (i = 0; i < nup; i++) { /* fill in its upvalues */
     if (uv[i].instack)        /* upvalue refers to local variable? */
       ncl->upvals[i] = luaF_findupval(L, base + uv[i].idx);
@@ -106,6 +106,19 @@ typedef enum {
     luaC_barrierback(L, gcvalue(t), v);   \
   }
 
+/*
+** Slot with the value cached by 'lc' for a lookup in table 't', or NULL
+** if the cache does not hold it (see 'LookupCache').
+*/
+#define luaV_cachedslot(lc, t)                                             \
+  (((t) == (lc)->env && (t)->shape == (lc)->envshape &&                    \
+    !isempty((lc)->slot) &&                                                \
+    (!(lc)->pair ||                                                        \
+     (ttistable((lc)->slot) && hvalue((lc)->slot) == (lc)->tab &&          \
+      (lc)->tab->shape == (lc)->tabshape && !isempty((lc)->fslot))))       \
+       ? ((lc)->pair ? (lc)->fslot : (lc)->slot)                           \
+       : NULL)
+
 LUAI_FUNC int luaV_equalobj(lua_State *L, const TValue *t1, const TValue *t2);
 LUAI_FUNC int luaV_lessthan(lua_State *L, const TValue *l, const TValue *r);
 LUAI_FUNC int luaV_lessequal(lua_State *L, const TValue *l, const TValue *r);
@@ -117,6 +130,9 @@ LUAI_FUNC void luaV_finishget(lua_State *L, const TValue *t, TValue *key,
                               StkId val, const TValue *slot);
 LUAI_FUNC void luaV_finishset(lua_State *L, const TValue *t, TValue *key,
                               TValue *val, const TValue *slot);
+LUAI_FUNC void luaV_fillcache(lua_State *L, LookupCache *lc, Table *env,
+                              const TValue *slot, const Instruction *pc,
+                              const TValue *k);
 LUAI_FUNC void luaV_finishOp(lua_State *L);
 LUAI_FUNC void luaV_execute(lua_State *L, CallInfo *ci);
 LUAI_FUNC void luaV_concat(lua_State *L, int total);
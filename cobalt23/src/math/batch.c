@@ -0,0 +1,457 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2016 Stefano Trettel
+ *
+ * Software repository: MoonGLMATH, https://github.com/stetre/moonglmath
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(UNIX_SYSTEM)
+#include <pthread.h>
+#endif
+
+/* Batch operations over arrays of vectors (or quaternions) stored in hostmem.
+ *
+ * An array is described by (hostmem, offset, stride, count): element i starts
+ * at byte offset + i*stride and has n components of the given type ('float'
+ * or 'double'). Each operation runs as one C call, and large batches are split
+ * across batchthreads() threads.
+ */
+
+#define MAX_THREADS 64
+#define MIN_PER_THREAD 4096 /* don't split batches smaller than this per thread */
+
+static int nthreads = 1;
+
+typedef struct {
+    char *dst, *a, *b;      /* base pointers (offset already applied) */
+    size_t stride, n;
+    int isfloat;
+    double t;
+    double m[4][4];         /* transform */
+    size_t nc;
+    double part[MAX_THREADS][8]; /* per-slice partial results (reductions) */
+} job_t;
+
+typedef void (*kernel_t)(job_t *job, size_t first, size_t last, size_t slice);
+
+/*------------------------------------------------------------------------------*
+ | Checks and dispatch                                                          |
+ *------------------------------------------------------------------------------*/
+
+static char *checkarray(lua_State *L, int arg, size_t offset, size_t stride, size_t count, size_t elemsize)
+/* Checks that the array fits in the hostmem at arg, and returns its base */
+    {
+    hostmem_t *hostmem = checkhostmem(L, arg, NULL);
+    if(count == 0)
+        return hostmem->ptr;
+    if((offset >= hostmem->size) || (elemsize > hostmem->size - offset) ||
+        ((count-1) > (hostmem->size - offset - elemsize) / stride))
+        {
+        luaL_error(L, errstring(ERR_BOUNDARIES));
+        return NULL;
+        }
+    return hostmem->ptr + offset;
+    }
+
+static size_t checklayout(lua_State *L, int arg, size_t n, size_t *stride, size_t *count, int *isfloat)
+/* Reads stride and count at arg, arg+1 and the optional type at arg+3,
+ * and returns the element size in bytes.
+ */
+    {
+    int type = lua_isnoneornil(L, arg+3) ? MOONGLMATH_TYPE_FLOAT : checktype(L, arg+3);
+    size_t elemsize;
+    if(type != MOONGLMATH_TYPE_FLOAT && type != MOONGLMATH_TYPE_DOUBLE)
+        return luaL_argerror(L, arg+3, "'float' or 'double' expected");
+    *isfloat = (type == MOONGLMATH_TYPE_FLOAT);
+    elemsize = n * sizeoftype(type);
+    *stride = luaL_checkinteger(L, arg);
+    *count = luaL_checkinteger(L, arg+1);
+    if(*stride == 0) *stride = elemsize; /* tightly packed */
+    if(*stride < elemsize)
+        return luaL_argerror(L, arg, "stride is smaller than the element size");
+    return elemsize;
+    }
+
+static size_t optcomponents(lua_State *L, int arg, size_t def, size_t min, size_t max)
+    {
+    size_t n = luaL_optinteger(L, arg, def);
+    if(n < min || n > max)
+        return luaL_argerror(L, arg, "invalid number of components");
+    return n;
+    }
+
+#if defined(UNIX_SYSTEM)
+typedef struct {
+    kernel_t kernel;
+    job_t *job;
+    size_t first, last, slice;
+} slice_t;
+
+static void *slicemain(void *arg)
+    {
+    slice_t *s = (slice_t*)arg;
+    s->kernel(s->job, s->first, s->last, s->slice);
+    return NULL;
+    }
+#endif
+
+static size_t run(kernel_t kernel, job_t *job, size_t count)
+/* Runs kernel over [0, count), splitting it in slices if worthwhile.
+ * Returns the number of slices used (= no. of valid job->part[] entries).
+ */
+    {
+#if defined(UNIX_SYSTEM)
+    pthread_t tid[MAX_THREADS];
+    slice_t slice[MAX_THREADS];
+    int started[MAX_THREADS];
+    size_t i, nslices = count / MIN_PER_THREAD, per;
+    if(nslices > (size_t)nthreads) nslices = nthreads;
+    if(nslices > 1)
+        {
+        per = (count + nslices - 1) / nslices;
+        for(i = 0; i < nslices; i++)
+            {
+            slice[i].kernel = kernel;
+            slice[i].job = job;
+            slice[i].first = i * per;
+            slice[i].last = (i+1)*per < count ? (i+1)*per : count;
+            slice[i].slice = i;
+            /* slice 0 runs in the calling thread, as do slices whose thread fails to start */
+            started[i] = (i > 0) && (pthread_create(&tid[i], NULL, slicemain, &slice[i]) == 0);
+            }
+        for(i = 0; i < nslices; i++)
+            if(!started[i]) slicemain(&slice[i]);
+        for(i = 1; i < nslices; i++)
+            if(started[i]) pthread_join(tid[i], NULL);
+        return nslices;
+        }
+#endif
+    kernel(job, 0, count, 0);
+    return 1;
+    }
+
+#define ELEM(base, i) ((base) + (i)*job->stride)
+
+static void load(const job_t *job, const char *p, double v[4])
+    {
+    size_t k;
+    if(job->isfloat)
+        for(k = 0; k < job->n; k++) v[k] = ((const float*)p)[k];
+    else
+        for(k = 0; k < job->n; k++) v[k] = ((const double*)p)[k];
+    }
+
+static void store(const job_t *job, char *p, const double v[4])
+    {
+    size_t k;
+    if(job->isfloat)
+        for(k = 0; k < job->n; k++) ((float*)p)[k] = (float)v[k];
+    else
+        for(k = 0; k < job->n; k++) ((double*)p)[k] = v[k];
+    }
+
+/*------------------------------------------------------------------------------*
+ | Kernels                                                                      |
+ *------------------------------------------------------------------------------*/
+
+#if defined(__SSE2__)
+static void xform4_f(job_t *job, size_t first, size_t last, size_t slice)
+/* float points, 4x4 matrix: columns kept in registers, one point per iteration */
+    {
+    size_t i;
+    float *p;
+    __m128 c0, c1, c2, c3, r;
+    (void)slice;
+    c0 = _mm_setr_ps(job->m[0][0], job->m[1][0], job->m[2][0], job->m[3][0]);
+    c1 = _mm_setr_ps(job->m[0][1], job->m[1][1], job->m[2][1], job->m[3][1]);
+    c2 = _mm_setr_ps(job->m[0][2], job->m[1][2], job->m[2][2], job->m[3][2]);
+    c3 = _mm_setr_ps(job->m[0][3], job->m[1][3], job->m[2][3], job->m[3][3]);
+    for(i = first; i < last; i++)
+        {
+        p = (float*)ELEM(job->dst, i);
+        r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p[0])), _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+        r = _mm_add_ps(r, job->n == 4 ? _mm_mul_ps(c3, _mm_set1_ps(p[3])) : c3);
+        if(job->n == 4)
+            _mm_storeu_ps(p, r);
+        else
+            {
+            float out[4];
+            _mm_storeu_ps(out, r);
+            p[0] = out[0]; p[1] = out[1]; p[2] = out[2];
+            }
+        }
+    }
+#endif
+
+static void xform(job_t *job, size_t first, size_t last, size_t slice)
+/* generic: n = nc (full product) or nc-1 (implicit last coordinate = 1) */
+    {
+    size_t i, r, c;
+    double v[4], out[4];
+    (void)slice;
+    for(i = first; i < last; i++)
+        {
+        load(job, ELEM(job->dst, i), v);
+        if(job->n < job->nc) v[job->n] = 1;
+        for(r = 0; r < job->n; r++)
+            {
+            out[r] = 0;
+            for(c = 0; c < job->nc; c++)
+                out[r] += job->m[r][c] * v[c];
+            }
+        store(job, ELEM(job->dst, i), out);
+        }
+    }
+
+static void normalize(job_t *job, size_t first, size_t last, size_t slice)
+    {
+    size_t i, k;
+    double v[4], norm;
+    (void)slice;
+    for(i = first; i < last; i++)
+        {
+        load(job, ELEM(job->dst, i), v);
+        norm = 0;
+        for(k = 0; k < job->n; k++) norm += v[k]*v[k];
+        if(norm == 0) continue; /* leave null vectors alone */
+        norm = 1.0/sqrt(norm);
+        for(k = 0; k < job->n; k++) v[k] *= norm;
+        store(job, ELEM(job->dst, i), v);
+        }
+    }
+
+static void lerp(job_t *job, size_t first, size_t last, size_t slice)
+    {
+    size_t i, k, nn = job->n;
+    double t = job->t;
+    (void)slice;
+    if(job->isfloat)
+        {
+        float *d, *a, *b, tf = (float)t;
+        for(i = first; i < last; i++)
+            {
+            d = (float*)ELEM(job->dst, i); a = (float*)ELEM(job->a, i); b = (float*)ELEM(job->b, i);
+            for(k = 0; k < nn; k++) d[k] = a[k] + tf*(b[k] - a[k]);
+            }
+        }
+    else
+        {
+        double *d, *a, *b;
+        for(i = first; i < last; i++)
+            {
+            d = (double*)ELEM(job->dst, i); a = (double*)ELEM(job->a, i); b = (double*)ELEM(job->b, i);
+            for(k = 0; k < nn; k++) d[k] = a[k] + t*(b[k] - a[k]);
+            }
+        }
+    }
+
+static void slerp(job_t *job, size_t first, size_t last, size_t slice)
+    {
+    size_t i;
+    quat_t q, p, r;
+    (void)slice;
+    for(i = first; i < last; i++)
+        {
+        load(job, ELEM(job->a, i), q);
+        load(job, ELEM(job->b, i), p);
+        quat_slerp(r, q, p, job->t);
+        store(job, ELEM(job->dst, i), r);
+        }
+    }
+
+static void bounds(job_t *job, size_t first, size_t last, size_t slice)
+/* part[slice] = { minx, maxx, miny, maxy, minz, maxz } (box layout) */
+    {
+    size_t i, k;
+    double v[4], *b = job->part[slice];
+    for(k = 0; k < job->n; k++)
+        {
+        b[2*k] = HUGE_VAL;
+        b[2*k+1] = -HUGE_VAL;
+        }
+    for(i = first; i < last; i++)
+        {
+        load(job, ELEM(job->dst, i), v);
+        for(k = 0; k < job->n; k++)
+            {
+            if(v[k] < b[2*k]) b[2*k] = v[k];
+            if(v[k] > b[2*k+1]) b[2*k+1] = v[k];
+            }
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Functions                                                                    |
+ *------------------------------------------------------------------------------*/
+
+static int TransformPoints(lua_State *L)
+/* transform_points(m, hostmem, offset, stride, count [, n [, type]])
+ * Replaces each n-component point p with m*p. With n = m.columns-1 (the default),
+ * p is extended with 1 as last coordinate, as for affine transforms of points.
+ */
+    {
+    mat_t m;
+    size_t nr, nc, offset, stride, count, elemsize;
+    job_t job;
+    checkmat(L, 1, m, &nr, &nc);
+    if(nr != nc)
+        return luaL_argerror(L, 1, "not a square matrix");
+    offset = luaL_checkinteger(L, 3);
+    job.n = optcomponents(L, 6, nc-1, nc > 1 ? nc-1 : nc, nc);
+    elemsize = checklayout(L, 4, job.n, &stride, &count, &job.isfloat);
+    job.dst = checkarray(L, 2, offset, stride, count, elemsize);
+    job.stride = stride;
+    job.nc = nc;
+    memcpy(job.m, m, sizeof(mat_t));
+#if defined(__SSE2__)
+    if(job.isfloat && nc == 4)
+        {
+        run(xform4_f, &job, count);
+        return 0;
+        }
+#endif
+    run(xform, &job, count);
+    return 0;
+    }
+
+static int NormalizeAll(lua_State *L)
+/* normalize_all(hostmem, offset, stride, count [, n [, type]]) */
+    {
+    size_t offset, stride, count, elemsize;
+    job_t job;
+    offset = luaL_checkinteger(L, 2);
+    job.n = optcomponents(L, 5, 3, 1, 4);
+    elemsize = checklayout(L, 3, job.n, &stride, &count, &job.isfloat);
+    job.dst = checkarray(L, 1, offset, stride, count, elemsize);
+    job.stride = stride;
+    run(normalize, &job, count);
+    return 0;
+    }
+
+static int LerpAll(lua_State *L)
+/* lerp_all(dst, a, b, t, offset, stride, count [, n [, type]])
+ * dst[i] = a[i] + t*(b[i] - a[i]). The three hostmems share the same layout,
+ * and dst may be a or b.
+ */
+    {
+    size_t offset, stride, count, elemsize;
+    job_t job;
+    job.t = luaL_checknumber(L, 4);
+    offset = luaL_checkinteger(L, 5);
+    job.n = optcomponents(L, 8, 3, 1, 4);
+    elemsize = checklayout(L, 6, job.n, &stride, &count, &job.isfloat);
+    job.dst = checkarray(L, 1, offset, stride, count, elemsize);
+    job.a = checkarray(L, 2, offset, stride, count, elemsize);
+    job.b = checkarray(L, 3, offset, stride, count, elemsize);
+    job.stride = stride;
+    run(lerp, &job, count);
+    return 0;
+    }
+
+static int SlerpAll(lua_State *L)
+/* slerp_all(dst, q1, q2, t, offset, stride, count [, type])
+ * Spherical interpolation of arrays of quaternions (w, x, y, z).
+ */
+    {
+    size_t offset, stride, count, elemsize;
+    job_t job;
+    job.t = luaL_checknumber(L, 4);
+    offset = luaL_checkinteger(L, 5);
+    job.n = 4;
+    lua_settop(L, 8);
+    lua_pushnil(L);
+    lua_insert(L, 8); /* type from arg 8 to arg 9, as expected by checklayout() */
+    elemsize = checklayout(L, 6, job.n, &stride, &count, &job.isfloat);
+    job.dst = checkarray(L, 1, offset, stride, count, elemsize);
+    job.a = checkarray(L, 2, offset, stride, count, elemsize);
+    job.b = checkarray(L, 3, offset, stride, count, elemsize);
+    job.stride = stride;
+    run(slerp, &job, count);
+    return 0;
+    }
+
+static int BoundingBox(lua_State *L)
+/* bounding_box(hostmem, offset, stride, count [, n [, type]]) -> box
+ * n = 2 or 3 (default), i.e. the box dimensions.
+ */
+    {
+    size_t offset, stride, count, elemsize, nslices, s, k;
+    job_t job;
+    box_t b;
+    offset = luaL_checkinteger(L, 2);
+    job.n = optcomponents(L, 5, 3, 2, 3);
+    elemsize = checklayout(L, 3, job.n, &stride, &count, &job.isfloat);
+    if(count == 0)
+        return luaL_argerror(L, 4, "empty array");
+    job.dst = checkarray(L, 1, offset, stride, count, elemsize);
+    job.stride = stride;
+    nslices = run(bounds, &job, count);
+    box_clear(b);
+    memcpy(b, job.part[0], 2*job.n*sizeof(double));
+    for(s = 1; s < nslices; s++)
+        for(k = 0; k < job.n; k++)
+            {
+            if(job.part[s][2*k] < b[2*k]) b[2*k] = job.part[s][2*k];
+            if(job.part[s][2*k+1] > b[2*k+1]) b[2*k+1] = job.part[s][2*k+1];
+            }
+    return pushbox(L, b, job.n);
+    }
+
+static int BatchThreads(lua_State *L)
+/* batchthreads([n]) -> previous n
+ * Sets the max no. of threads used by batch operations (default 1).
+ */
+    {
+    lua_Integer n = luaL_optinteger(L, 1, nthreads);
+    lua_pushinteger(L, nthreads);
+    if(n < 1 || n > MAX_THREADS)
+        return luaL_argerror(L, 1, "invalid number of threads");
+#if defined(UNIX_SYSTEM)
+    nthreads = n;
+#endif
+    return 1;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "transform_points", TransformPoints },
+        { "normalize_all", NormalizeAll },
+        { "lerp_all", LerpAll },
+        { "slerp_all", SlerpAll },
+        { "bounding_box", BoundingBox },
+        { "batchthreads", BatchThreads },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonglmath_open_batch(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
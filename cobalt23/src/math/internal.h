@@ -83,8 +83,27 @@
  *
  * A RECT is implemented as a table, with the elements in the array part
  * rect = { x, y, w, h }
+ *
+ * A PACKED VECTOR (MATRIX) is a full userdata holding the elements inline, as
+ * double[4] (double[4][4]) or float[4] (float[4][4]), zero-padded. It supports
+ * the same indexing (v[i], v.size, v.type, m.rows, m.columns, m[i] as a row
+ * vector) and arithmetic as the table form, and is accepted wherever a vector
+ * (matrix) is expected. Arithmetic on packed operands produces packed results.
  */
 
+#define PVEC_MT "pvec"
+#define PMAT_MT "pmat"
+
+typedef struct {
+    union { double d[4]; float f[4]; } e;
+    unsigned char size, isrow, isfloat;
+} pvec_t;
+
+typedef struct {
+    union { double d[4][4]; float f[4][4]; } e;
+    unsigned char nr, nc, isfloat;
+} pmat_t;
+
 #define FMT "%g"    // format used in __tostring()
 //#define FMT "%.5f"
 
@@ -259,6 +278,13 @@ int num_Smoothstep(lua_State *L);
 #define num_Fade moonglmath_num_Fade
 int num_Fade(lua_State *L);
 
+/* packed.c --------------------------------------------------------------------*/
+
+#define testpvec moonglmath_testpvec
+int testpvec(lua_State *L, int arg, vec_t v, size_t *size, unsigned int *isrow);
+#define testpmat moonglmath_testpmat
+int testpmat(lua_State *L, int arg, mat_t m, size_t *nr, size_t *nc);
+
 /* datahandling.c */
 #define sizeoftype moonglmath_sizeoftype
 size_t sizeoftype(int type);
@@ -280,6 +306,8 @@ void moonglmath_open_tracing(lua_State *L);
 void moonglmath_open_enums(lua_State *L);
 void moonglmath_open_mat(lua_State *L);
 void moonglmath_open_vec(lua_State *L);
+void moonglmath_open_packed(lua_State *L);
+void moonglmath_open_batch(lua_State *L);
 void moonglmath_open_box(lua_State *L);
 void moonglmath_open_rect(lua_State *L);
 void moonglmath_open_quat(lua_State *L);
@@ -60,12 +60,14 @@ LUALIB_API int luaopen_moonglmath(lua_State *L)
     moonglmath_open_box(L);
     moonglmath_open_rect(L);
     moonglmath_open_mat(L);
+    moonglmath_open_packed(L);
     moonglmath_open_quat(L);
     moonglmath_open_complex(L);
     moonglmath_open_funcs(L);
     moonglmath_open_transform(L);
     moonglmath_open_viewing(L);
     moonglmath_open_hostmem(L);
+    moonglmath_open_batch(L);
 
     /* Implemented in moonglmath but removed for the cobalt implementation:
     lua_pushvalue(L, -1); lua_setglobal(L, "glmath");
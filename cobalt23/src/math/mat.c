@@ -39,6 +39,8 @@ int testmat(lua_State *L, int arg, mat_t m, size_t *nr, size_t *nc)
     {
     int row;
     size_t i, j, nr_, nc_;
+    if(testpmat(L, arg, m, nr, nc))
+        return 1;
     if(!testmetatable(L, arg, MAT_MT))
         return 0;
 
@@ -60,12 +60,13 @@ typedef double complex moonglmath_complex_t;
 int moonglmath_testmetatable(lua_State *L, int arg, const char *metatable);
 int moonglmath_checkmetatable(lua_State *L, int arg, const char *metatable);
 
-#define moonglmath_isvec(L, arg) moonglmath_testmetatable((L), arg, MOONGLMATH_VEC_MT)
 #define moonglmath_isbox(L, arg) moonglmath_testmetatable((L), arg, MOONGLMATH_BOX_MT)
 #define moonglmath_isrect(L, arg) moonglmath_testmetatable((L), arg, MOONGLMATH_RECT_MT)
-#define moonglmath_ismat(L, arg) moonglmath_testmetatable((L), arg, MOONGLMATH_MAT_MT)
 #define moonglmath_isquat(L, arg) moonglmath_testmetatable((L), arg, MOONGLMATH_QUAT_MT)
 #define moonglmath_iscomplex(L, arg) moonglmath_testmetatable((L), arg, MOONGLMATH_COMPLEX_MT)
+/* vectors and matrices may also be packed (see 'glmath.pvec', 'glmath.pmat') */
+int moonglmath_isvec(lua_State *L, int arg);
+int moonglmath_ismat(lua_State *L, int arg);
 
 int moonglmath_testvec(lua_State *L, int arg, moonglmath_vec_t v, size_t *size, unsigned int *isrow);
 int moonglmath_checkvec(lua_State *L, int arg, moonglmath_vec_t v, size_t *size, unsigned int *isrow);
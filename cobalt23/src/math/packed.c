@@ -0,0 +1,1148 @@
+/* ============================================================================== //
+// This file is apart of the Cobalt Programming Language. Cobalt is under the MIT //
+// License. Read `cobalt.h` for license information.                              //
+// ============================================================================== */
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2016 Stefano Trettel
+ *
+ * Software repository: MoonGLMATH, https://github.com/stetre/moonglmath
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+/* Packed vectors and matrices (see internal.h).
+ *
+ * Elements are stored zero-padded to 4 (4x4), so that the kernels below can
+ * always work on full rows regardless of the actual size. Every result has its
+ * padding cleared again before being handed back to Lua.
+ */
+
+/*------------------------------------------------------------------------------*
+ | Kernels                                                                      |
+ *------------------------------------------------------------------------------*/
+
+/* dst[i] = a[i] op b[i], i=0..n-1 (n multiple of 4) */
+#if defined(__AVX__)
+#define KVV_D(name, op, cop)                                                \
+static void name(double *dst, const double *a, const double *b, size_t n)  \
+    {                                                                       \
+    size_t i;                                                               \
+    for(i=0; i<n; i+=4)                                                     \
+        _mm256_storeu_pd(dst+i,                                             \
+            _mm256_##op##_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i)));  \
+    }
+#define KVS_D(name, op, cop)                                                \
+static void name(double *dst, const double *a, double s, size_t n)         \
+    {                                                                       \
+    size_t i;                                                               \
+    __m256d vs = _mm256_set1_pd(s);                                         \
+    for(i=0; i<n; i+=4)                                                     \
+        _mm256_storeu_pd(dst+i, _mm256_##op##_pd(_mm256_loadu_pd(a+i), vs));\
+    }
+#elif defined(__SSE2__)
+#define KVV_D(name, op, cop)                                                \
+static void name(double *dst, const double *a, const double *b, size_t n)  \
+    {                                                                       \
+    size_t i;                                                               \
+    for(i=0; i<n; i+=2)                                                     \
+        _mm_storeu_pd(dst+i, _mm_##op##_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));\
+    }
+#define KVS_D(name, op, cop)                                                \
+static void name(double *dst, const double *a, double s, size_t n)         \
+    {                                                                       \
+    size_t i;                                                               \
+    __m128d vs = _mm_set1_pd(s);                                            \
+    for(i=0; i<n; i+=2)                                                     \
+        _mm_storeu_pd(dst+i, _mm_##op##_pd(_mm_loadu_pd(a+i), vs));         \
+    }
+#else
+#define KVV_D(name, op, cop)                                                \
+static void name(double *dst, const double *a, const double *b, size_t n)  \
+    {                                                                       \
+    size_t i;                                                               \
+    for(i=0; i<n; i++)                                                      \
+        dst[i] = a[i] cop b[i];                                             \
+    }
+#define KVS_D(name, op, cop)                                                \
+static void name(double *dst, const double *a, double s, size_t n)         \
+    {                                                                       \
+    size_t i;                                                               \
+    for(i=0; i<n; i++)                                                      \
+        dst[i] = a[i] cop s;                                                \
+    }
+#endif
+
+#if defined(__SSE2__)
+#define KVV_F(name, op, cop)                                                \
+static void name(float *dst, const float *a, const float *b, size_t n)     \
+    {                                                                       \
+    size_t i;                                                               \
+    for(i=0; i<n; i+=4)                                                     \
+        _mm_storeu_ps(dst+i, _mm_##op##_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));\
+    }
+#define KVS_F(name, op, cop)                                                \
+static void name(float *dst, const float *a, double s, size_t n)           \
+    {                                                                       \
+    size_t i;                                                               \
+    __m128 vs = _mm_set1_ps((float)s);                                      \
+    for(i=0; i<n; i+=4)                                                     \
+        _mm_storeu_ps(dst+i, _mm_##op##_ps(_mm_loadu_ps(a+i), vs));         \
+    }
+#else
+#define KVV_F(name, op, cop)                                                \
+static void name(float *dst, const float *a, const float *b, size_t n)     \
+    {                                                                       \
+    size_t i;                                                               \
+    for(i=0; i<n; i++)                                                      \
+        dst[i] = a[i] cop b[i];                                             \
+    }
+#define KVS_F(name, op, cop)                                                \
+static void name(float *dst, const float *a, double s, size_t n)           \
+    {                                                                       \
+    size_t i;                                                               \
+    for(i=0; i<n; i++)                                                      \
+        dst[i] = a[i] cop (float)s;                                         \
+    }
+#endif
+
+KVV_D(kadd_d, add, +)
+KVV_D(ksub_d, sub, -)
+KVS_D(kmuls_d, mul, *)
+KVS_D(kdivs_d, div, /)
+KVV_F(kadd_f, add, +)
+KVV_F(ksub_f, sub, -)
+KVS_F(kmuls_f, mul, *)
+KVS_F(kdivs_f, div, /)
+
+static double kdot_d(const double *a, const double *b)
+    {
+#if defined(__SSE2__)
+    __m128d s = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)),
+                           _mm_mul_pd(_mm_loadu_pd(a+2), _mm_loadu_pd(b+2)));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+#else
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+#endif
+    }
+
+static double kdot_f(const float *a, const float *b)
+    {
+#if defined(__SSE2__)
+    __m128 s = _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+#else
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+#endif
+    }
+
+static void kvxm_d(double dst[4], const double v[4], const double m[4][4])
+/* dst = v * m (row vector times matrix): linear combination of the rows of m */
+    {
+#if defined(__AVX__)
+    __m256d r = _mm256_mul_pd(_mm256_set1_pd(v[0]), _mm256_loadu_pd(m[0]));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_set1_pd(v[1]), _mm256_loadu_pd(m[1])));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_set1_pd(v[2]), _mm256_loadu_pd(m[2])));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_set1_pd(v[3]), _mm256_loadu_pd(m[3])));
+    _mm256_storeu_pd(dst, r);
+#elif defined(__SSE2__)
+    size_t k;
+    __m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd(), s;
+    for(k=0; k<4; k++)
+        {
+        s = _mm_set1_pd(v[k]);
+        lo = _mm_add_pd(lo, _mm_mul_pd(s, _mm_loadu_pd(m[k])));
+        hi = _mm_add_pd(hi, _mm_mul_pd(s, _mm_loadu_pd(m[k]+2)));
+        }
+    _mm_storeu_pd(dst, lo);
+    _mm_storeu_pd(dst+2, hi);
+#else
+    size_t j;
+    for(j=0; j<4; j++)
+        dst[j] = v[0]*m[0][j] + v[1]*m[1][j] + v[2]*m[2][j] + v[3]*m[3][j];
+#endif
+    }
+
+static void kvxm_f(float dst[4], const float v[4], const float m[4][4])
+    {
+#if defined(__SSE2__)
+    __m128 r = _mm_mul_ps(_mm_set1_ps(v[0]), _mm_loadu_ps(m[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v[1]), _mm_loadu_ps(m[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v[2]), _mm_loadu_ps(m[2])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v[3]), _mm_loadu_ps(m[3])));
+    _mm_storeu_ps(dst, r);
+#else
+    size_t j;
+    for(j=0; j<4; j++)
+        dst[j] = v[0]*m[0][j] + v[1]*m[1][j] + v[2]*m[2][j] + v[3]*m[3][j];
+#endif
+    }
+
+static void kmxv_d(double dst[4], const double m[4][4], const double v[4])
+/* dst = m * v (matrix times column vector): one dot product per row */
+    {
+#if defined(__AVX__)
+    __m256d vv = _mm256_loadu_pd(v);
+    __m256d t0 = _mm256_hadd_pd(_mm256_mul_pd(_mm256_loadu_pd(m[0]), vv),
+                                _mm256_mul_pd(_mm256_loadu_pd(m[1]), vv));
+    __m256d t1 = _mm256_hadd_pd(_mm256_mul_pd(_mm256_loadu_pd(m[2]), vv),
+                                _mm256_mul_pd(_mm256_loadu_pd(m[3]), vv));
+    _mm256_storeu_pd(dst, _mm256_add_pd(_mm256_permute2f128_pd(t0, t1, 0x21),
+                                        _mm256_blend_pd(t0, t1, 0xc)));
+#elif defined(__SSE2__)
+    size_t i;
+    __m128d vlo = _mm_loadu_pd(v), vhi = _mm_loadu_pd(v+2), s0, s1;
+    for(i=0; i<4; i+=2)
+        {
+        s0 = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(m[i]), vlo), _mm_mul_pd(_mm_loadu_pd(m[i]+2), vhi));
+        s1 = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(m[i+1]), vlo), _mm_mul_pd(_mm_loadu_pd(m[i+1]+2), vhi));
+        _mm_storeu_pd(dst+i, _mm_add_pd(_mm_unpacklo_pd(s0, s1), _mm_unpackhi_pd(s0, s1)));
+        }
+#else
+    size_t i;
+    for(i=0; i<4; i++)
+        dst[i] = m[i][0]*v[0] + m[i][1]*v[1] + m[i][2]*v[2] + m[i][3]*v[3];
+#endif
+    }
+
+static void kmxv_f(float dst[4], const float m[4][4], const float v[4])
+    {
+#if defined(__SSE2__)
+    __m128 c0 = _mm_loadu_ps(m[0]), c1 = _mm_loadu_ps(m[1]);
+    __m128 c2 = _mm_loadu_ps(m[2]), c3 = _mm_loadu_ps(m[3]), r;
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3); /* rows -> columns */
+    r = _mm_mul_ps(c0, _mm_set1_ps(v[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(v[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(v[2])));
+    r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(v[3])));
+    _mm_storeu_ps(dst, r);
+#else
+    size_t i;
+    for(i=0; i<4; i++)
+        dst[i] = m[i][0]*v[0] + m[i][1]*v[1] + m[i][2]*v[2] + m[i][3]*v[3];
+#endif
+    }
+
+static void kmxm_d(double dst[4][4], const double a[4][4], const double b[4][4])
+/* dst = a * b, dst may alias a or b */
+    {
+    double r[4][4];
+    size_t i;
+    for(i=0; i<4; i++)
+        kvxm_d(r[i], a[i], b);
+    memcpy(dst, r, sizeof(r));
+    }
+
+static void kmxm_f(float dst[4][4], const float a[4][4], const float b[4][4])
+    {
+    float r[4][4];
+    size_t i;
+    for(i=0; i<4; i++)
+        kvxm_f(r[i], a[i], b);
+    memcpy(dst, r, sizeof(r));
+    }
+
+static int kinv4_d(double dst[4][4], const double a[4][4])
+/* 4x4 inverse via 2x2 sub-determinants (Laplace expansion). Returns 0 if singular.
+ * The sub-determinants are independent of each other, so this compiles to
+ * straight-line vector code rather than the 16 3x3 cofactors of mat_adj().
+ */
+    {
+    double s0 = a[0][0]*a[1][1] - a[1][0]*a[0][1];
+    double s1 = a[0][0]*a[1][2] - a[1][0]*a[0][2];
+    double s2 = a[0][0]*a[1][3] - a[1][0]*a[0][3];
+    double s3 = a[0][1]*a[1][2] - a[1][1]*a[0][2];
+    double s4 = a[0][1]*a[1][3] - a[1][1]*a[0][3];
+    double s5 = a[0][2]*a[1][3] - a[1][2]*a[0][3];
+    double c5 = a[2][2]*a[3][3] - a[3][2]*a[2][3];
+    double c4 = a[2][1]*a[3][3] - a[3][1]*a[2][3];
+    double c3 = a[2][1]*a[3][2] - a[3][1]*a[2][2];
+    double c2 = a[2][0]*a[3][3] - a[3][0]*a[2][3];
+    double c1 = a[2][0]*a[3][2] - a[3][0]*a[2][2];
+    double c0 = a[2][0]*a[3][1] - a[3][0]*a[2][1];
+    double det = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+    double r[4][4];
+    if(det == 0.0)
+        return 0;
+    r[0][0] =  a[1][1]*c5 - a[1][2]*c4 + a[1][3]*c3;
+    r[0][1] = -a[0][1]*c5 + a[0][2]*c4 - a[0][3]*c3;
+    r[0][2] =  a[3][1]*s5 - a[3][2]*s4 + a[3][3]*s3;
+    r[0][3] = -a[2][1]*s5 + a[2][2]*s4 - a[2][3]*s3;
+    r[1][0] = -a[1][0]*c5 + a[1][2]*c2 - a[1][3]*c1;
+    r[1][1] =  a[0][0]*c5 - a[0][2]*c2 + a[0][3]*c1;
+    r[1][2] = -a[3][0]*s5 + a[3][2]*s2 - a[3][3]*s1;
+    r[1][3] =  a[2][0]*s5 - a[2][2]*s2 + a[2][3]*s1;
+    r[2][0] =  a[1][0]*c4 - a[1][1]*c2 + a[1][3]*c0;
+    r[2][1] = -a[0][0]*c4 + a[0][1]*c2 - a[0][3]*c0;
+    r[2][2] =  a[3][0]*s4 - a[3][1]*s2 + a[3][3]*s0;
+    r[2][3] = -a[2][0]*s4 + a[2][1]*s2 - a[2][3]*s0;
+    r[3][0] = -a[1][0]*c3 + a[1][1]*c1 - a[1][2]*c0;
+    r[3][1] =  a[0][0]*c3 - a[0][1]*c1 + a[0][2]*c0;
+    r[3][2] = -a[3][0]*s3 + a[3][1]*s1 - a[3][2]*s0;
+    r[3][3] =  a[2][0]*s3 - a[2][1]*s1 + a[2][2]*s0;
+    kdivs_d(dst[0], r[0], det, 16);
+    return 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Check and push                                                               |
+ *------------------------------------------------------------------------------*/
+
+#define topvec(L, arg) ((pvec_t*)luaL_testudata((L), (arg), PVEC_MT))
+#define topmat(L, arg) ((pmat_t*)luaL_testudata((L), (arg), PMAT_MT))
+
+int moonglmath_isvec(lua_State *L, int arg)
+/* Tests if the element at arg is a vector, in table or packed form */
+    {
+    return testmetatable(L, arg, VEC_MT) || topvec(L, arg) != NULL;
+    }
+
+int moonglmath_ismat(lua_State *L, int arg)
+/* Tests if the element at arg is a matrix, in table or packed form */
+    {
+    return testmetatable(L, arg, MAT_MT) || topmat(L, arg) != NULL;
+    }
+
+static void vecpad(pvec_t *p)
+    {
+    size_t i;
+    for(i=p->size; i<4; i++)
+        {
+        if(p->isfloat) p->e.f[i] = 0; else p->e.d[i] = 0;
+        }
+    }
+
+static void matpad(pmat_t *p)
+    {
+    size_t i, j;
+    for(i=0; i<4; i++)
+        for(j=0; j<4; j++)
+            {
+            if(i < p->nr && j < p->nc) continue;
+            if(p->isfloat) p->e.f[i][j] = 0; else p->e.d[i][j] = 0;
+            }
+    }
+
+static void vecprec(pvec_t *dst, const pvec_t *src, int isfloat)
+/* Copies src into dst, converting to the given precision (dst may be src) */
+    {
+    size_t i;
+    pvec_t s = *src;
+    src = &s;
+    dst->size = src->size;
+    dst->isrow = src->isrow;
+    dst->isfloat = isfloat;
+    for(i=0; i<4; i++)
+        {
+        if(isfloat)
+            dst->e.f[i] = src->isfloat ? src->e.f[i] : (float)src->e.d[i];
+        else
+            dst->e.d[i] = src->isfloat ? (double)src->e.f[i] : src->e.d[i];
+        }
+    }
+
+static void matprec(pmat_t *dst, const pmat_t *src, int isfloat)
+    {
+    size_t i, j;
+    pmat_t s = *src;
+    src = &s;
+    dst->nr = src->nr;
+    dst->nc = src->nc;
+    dst->isfloat = isfloat;
+    for(i=0; i<4; i++)
+        for(j=0; j<4; j++)
+            {
+            if(isfloat)
+                dst->e.f[i][j] = src->isfloat ? src->e.f[i][j] : (float)src->e.d[i][j];
+            else
+                dst->e.d[i][j] = src->isfloat ? (double)src->e.f[i][j] : src->e.d[i][j];
+            }
+    }
+
+int testpvec(lua_State *L, int arg, vec_t v, size_t *size, unsigned int *isrow)
+/* testvec() for packed vectors: returns 0 if the element at arg is not one */
+    {
+    pvec_t *p = topvec(L, arg);
+    pvec_t tmp;
+    if(!p) return 0;
+    if(size) *size = p->size;
+    if(isrow) *isrow = p->isrow;
+    if(v)
+        {
+        vecprec(&tmp, p, 0);
+        memcpy(v, tmp.e.d, sizeof(vec_t));
+        }
+    return 1;
+    }
+
+int testpmat(lua_State *L, int arg, mat_t m, size_t *nr, size_t *nc)
+/* testmat() for packed matrices: returns 0 if the element at arg is not one */
+    {
+    pmat_t *p = topmat(L, arg);
+    pmat_t tmp;
+    if(!p) return 0;
+    if(nr) *nr = p->nr;
+    if(nc) *nc = p->nc;
+    if(m)
+        {
+        matprec(&tmp, p, 0);
+        memcpy(m, tmp.e.d, sizeof(mat_t));
+        }
+    return 1;
+    }
+
+static pvec_t *newpvec(lua_State *L, size_t size, unsigned int isrow, int isfloat)
+    {
+    pvec_t *p = (pvec_t*)lua_newuserdatauv(L, sizeof(pvec_t), 0);
+    memset(p, 0, sizeof(pvec_t));
+    p->size = size;
+    p->isrow = isrow;
+    p->isfloat = isfloat;
+    luaL_setmetatable(L, PVEC_MT);
+    return p;
+    }
+
+static pmat_t *newpmat(lua_State *L, size_t nr, size_t nc, int isfloat)
+    {
+    pmat_t *p = (pmat_t*)lua_newuserdatauv(L, sizeof(pmat_t), 0);
+    memset(p, 0, sizeof(pmat_t));
+    p->nr = nr;
+    p->nc = nc;
+    p->isfloat = isfloat;
+    luaL_setmetatable(L, PMAT_MT);
+    return p;
+    }
+
+static const pvec_t *loadvec(lua_State *L, int arg, pvec_t *tmp, int isfloat)
+/* Returns the vector at arg (packed or table) in the requested precision,
+ * either pointing directly into the userdata or converted into *tmp.
+ * Returns NULL if arg is not a vector.
+ */
+    {
+    size_t size;
+    unsigned int isrow;
+    vec_t v;
+    pvec_t *p = topvec(L, arg);
+    if(p)
+        {
+        if(p->isfloat == isfloat) return p;
+        vecprec(tmp, p, isfloat);
+        return tmp;
+        }
+    if(!testvec(L, arg, v, &size, &isrow)) return NULL;
+    tmp->size = size;
+    tmp->isrow = isrow;
+    tmp->isfloat = 0;
+    memcpy(tmp->e.d, v, sizeof(vec_t));
+    if(isfloat) vecprec(tmp, tmp, 1);
+    return tmp;
+    }
+
+static const pmat_t *loadmat(lua_State *L, int arg, pmat_t *tmp, int isfloat)
+    {
+    size_t nr, nc;
+    mat_t m;
+    pmat_t *p = topmat(L, arg);
+    if(p)
+        {
+        if(p->isfloat == isfloat) return p;
+        matprec(tmp, p, isfloat);
+        return tmp;
+        }
+    mat_clear(m);
+    if(!testmat(L, arg, m, &nr, &nc)) return NULL;
+    tmp->nr = nr;
+    tmp->nc = nc;
+    tmp->isfloat = 0;
+    memcpy(tmp->e.d, m, sizeof(mat_t));
+    if(isfloat) matprec(tmp, tmp, 1);
+    return tmp;
+    }
+
+static const pvec_t *checkloadvec(lua_State *L, int arg, pvec_t *tmp, int isfloat)
+    {
+    const pvec_t *p = loadvec(L, arg, tmp, isfloat);
+    if(!p)
+        luaL_argerror(L, arg, lua_pushfstring(L, "%s expected", VEC_MT));
+    return p;
+    }
+
+static const pmat_t *checkloadmat(lua_State *L, int arg, pmat_t *tmp, int isfloat)
+    {
+    const pmat_t *p = loadmat(L, arg, tmp, isfloat);
+    if(!p)
+        luaL_argerror(L, arg, lua_pushfstring(L, "%s expected", MAT_MT));
+    return p;
+    }
+
+static int resultprec(lua_State *L)
+/* Precision of the result of a binary operation: that of the first packed operand */
+    {
+    pvec_t *v;
+    pmat_t *m;
+    int arg;
+    for(arg=1; arg<=2; arg++)
+        {
+        if((v = topvec(L, arg)) != NULL) return v->isfloat;
+        if((m = topmat(L, arg)) != NULL) return m->isfloat;
+        }
+    return 0;
+    }
+
+static double vecget(const pvec_t *p, size_t i)
+    { return p->isfloat ? (double)p->e.f[i] : p->e.d[i]; }
+
+static double matget(const pmat_t *p, size_t i, size_t j)
+    { return p->isfloat ? (double)p->e.f[i][j] : p->e.d[i][j]; }
+
+static void vecset(pvec_t *p, size_t i, double val)
+    { if(p->isfloat) p->e.f[i] = (float)val; else p->e.d[i] = val; }
+
+static void matset(pmat_t *p, size_t i, size_t j, double val)
+    { if(p->isfloat) p->e.f[i][j] = (float)val; else p->e.d[i][j] = val; }
+
+/*------------------------------------------------------------------------------*
+ | Constructors and conversions                                                 |
+ *------------------------------------------------------------------------------*/
+
+static const char *PrecOptions[] = { "double", "float", NULL };
+
+static int Packed(lua_State *L)
+/* packed(v|m [, 'double'|'float']) -> packed copy of the vector or matrix v|m */
+    {
+    pvec_t tv, *v;
+    pmat_t tm, *m;
+    const pvec_t *srcv;
+    const pmat_t *srcm;
+    int isfloat = 0;
+    if((v = topvec(L, 1)) != NULL) isfloat = v->isfloat;
+    else if((m = topmat(L, 1)) != NULL) isfloat = m->isfloat;
+    if(!lua_isnoneornil(L, 2))
+        isfloat = checkoption(L, 2, NULL, PrecOptions);
+    if((srcv = loadvec(L, 1, &tv, isfloat)) != NULL)
+        {
+        v = newpvec(L, 0, 0, isfloat);
+        vecprec(v, srcv, isfloat);
+        return 1;
+        }
+    if((srcm = loadmat(L, 1, &tm, isfloat)) != NULL)
+        {
+        m = newpmat(L, 0, 0, isfloat);
+        matprec(m, srcm, isfloat);
+        return 1;
+        }
+    return luaL_argerror(L, 1, "vec or mat expected");
+    }
+
+static int IsPacked(lua_State *L)
+    {
+    lua_pushboolean(L, topvec(L, 1) != NULL || topmat(L, 1) != NULL);
+    return 1;
+    }
+
+static int ToTable(lua_State *L)
+/* p:totable() -> the equivalent table-based vec or mat */
+    {
+    vec_t v;
+    mat_t m;
+    size_t size, nr, nc;
+    unsigned int isrow;
+    if(testpvec(L, 1, v, &size, &isrow))
+        return pushvec(L, v, size, size, isrow);
+    if(testpmat(L, 1, m, &nr, &nc))
+        return pushmat(L, m, nr, nc, nr, nc);
+    return luaL_argerror(L, 1, "packed vec or mat expected");
+    }
+
+static void pushrow(lua_State *L, const pmat_t *m, size_t i)
+    {
+    pvec_t *v = newpvec(L, m->nc, 1, m->isfloat);
+    if(m->isfloat)
+        memcpy(v->e.f, m->e.f[i], sizeof(v->e.f));
+    else
+        memcpy(v->e.d, m->e.d[i], sizeof(v->e.d));
+    }
+
+/*------------------------------------------------------------------------------*
+ | Vector metamethods and methods                                               |
+ *------------------------------------------------------------------------------*/
+
+static int VIndex(lua_State *L)
+/* v[i], v.size, v.type, or a method (the methods table is upvalue 1) */
+    {
+    pvec_t *p = (pvec_t*)lua_touserdata(L, 1);
+    const char *key;
+    lua_Integer i;
+    if(lua_type(L, 2) == LUA_TNUMBER)
+        {
+        i = lua_tointeger(L, 2);
+        if(i >= 1 && i <= p->size)
+            lua_pushnumber(L, vecget(p, i-1));
+        else
+            lua_pushnil(L);
+        return 1;
+        }
+    key = lua_tostring(L, 2);
+    if(key && strcmp(key, "size") == 0)
+        lua_pushinteger(L, p->size);
+    else if(key && strcmp(key, "type") == 0)
+        pushisrow(L, p->isrow);
+    else
+        {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        }
+    return 1;
+    }
+
+static int VNewIndex(lua_State *L)
+    {
+    pvec_t *p = (pvec_t*)lua_touserdata(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    if(i < 1 || i > p->size)
+        return luaL_argerror(L, 2, "index out of range");
+    vecset(p, i-1, luaL_checknumber(L, 3));
+    return 0;
+    }
+
+static int VLen(lua_State *L)
+    {
+    pvec_t *p = (pvec_t*)lua_touserdata(L, 1);
+    lua_pushinteger(L, p->size);
+    return 1;
+    }
+
+static int VUnm(lua_State *L)
+    {
+    pvec_t *p = topvec(L, 1), *r;
+    if(!p) return unexpected(L);
+    r = newpvec(L, p->size, p->isrow, p->isfloat);
+    if(p->isfloat) kmuls_f(r->e.f, p->e.f, -1, 4); else kmuls_d(r->e.d, p->e.d, -1, 4);
+    vecpad(r);
+    return 1;
+    }
+
+static int VAddSub(lua_State *L, int sub)
+    {
+    pvec_t ta, tb, *r;
+    const pvec_t *a, *b;
+    int isfloat = resultprec(L);
+    a = checkloadvec(L, 1, &ta, isfloat);
+    b = checkloadvec(L, 2, &tb, isfloat);
+    if((a->size != b->size) || (a->isrow != b->isrow))
+        return luaL_error(L, OPERANDS_ERROR);
+    r = newpvec(L, a->size, a->isrow, isfloat);
+    if(isfloat)
+        (sub ? ksub_f : kadd_f)(r->e.f, a->e.f, b->e.f, 4);
+    else
+        (sub ? ksub_d : kadd_d)(r->e.d, a->e.d, b->e.d, 4);
+    return 1;
+    }
+
+static int VAdd(lua_State *L) { return VAddSub(L, 0); }
+static int VSub(lua_State *L) { return VAddSub(L, 1); }
+
+static int VScale(lua_State *L, int sarg, int varg, int div)
+    {
+    pvec_t *p, *r;
+    double s = luaL_checknumber(L, sarg);
+    if((p = topvec(L, varg)) == NULL) return unexpected(L);
+    r = newpvec(L, p->size, p->isrow, p->isfloat);
+    if(p->isfloat)
+        (div ? kdivs_f : kmuls_f)(r->e.f, p->e.f, s, 4);
+    else
+        (div ? kdivs_d : kmuls_d)(r->e.d, p->e.d, s, 4);
+    vecpad(r);
+    return 1;
+    }
+
+static int VMul(lua_State *L)
+    {
+    pvec_t ta, tb, *r;
+    pmat_t tm;
+    const pvec_t *a, *b;
+    const pmat_t *m;
+    pmat_t *rm;
+    size_t i, j;
+    int isfloat;
+    if(lua_isnumber(L, 1))
+        return VScale(L, 1, 2, 0);
+    if(lua_isnumber(L, 2))
+        return VScale(L, 2, 1, 0);
+    isfloat = resultprec(L);
+    a = checkloadvec(L, 1, &ta, isfloat);
+    if((m = loadmat(L, 2, &tm, isfloat)) != NULL)
+        {
+        /* 1xM * MxN = 1xN (row vector) */
+        if((!a->isrow) || (a->size != m->nr))
+            return luaL_error(L, OPERANDS_ERROR);
+        r = newpvec(L, m->nc, 1, isfloat);
+        if(isfloat) kvxm_f(r->e.f, a->e.f, m->e.f); else kvxm_d(r->e.d, a->e.d, m->e.d);
+        vecpad(r);
+        return 1;
+        }
+    b = checkloadvec(L, 2, &tb, isfloat);
+    if((!a->isrow) && b->isrow) /* Nx1 * 1xM = NxM */
+        {
+        rm = newpmat(L, a->size, b->size, isfloat);
+        for(i=0; i < a->size; i++)
+            for(j=0; j < b->size; j++)
+                matset(rm, i, j, vecget(a, i) * vecget(b, j));
+        return 1;
+        }
+    if(a->size != b->size)
+        return luaL_error(L, OPERANDS_ERROR);
+    lua_pushnumber(L, isfloat ? kdot_f(a->e.f, b->e.f) : kdot_d(a->e.d, b->e.d));
+    return 1;
+    }
+
+static int VDiv(lua_State *L)
+    {
+    if(!topvec(L, 1))
+        return luaL_argerror(L, 1, lua_pushfstring(L, "%s expected", VEC_MT));
+    return VScale(L, 2, 1, 1);
+    }
+
+static int VCross(lua_State *L)
+    {
+    vec_t v1, v2, v;
+    size_t size1, size2;
+    unsigned int isrow1, isrow2;
+    int isfloat = resultprec(L);
+    pvec_t *r;
+    checkvec(L, 1, v1, &size1, &isrow1);
+    checkvec(L, 2, v2, &size2, &isrow2);
+    if((isrow1 != isrow2) || (size1 != size2))
+        return luaL_error(L, OPERANDS_ERROR);
+    if(size1==2)
+        v1[2] = v2[2] = 0;
+    vec_cross(v, v1, v2);
+    r = newpvec(L, 3, isrow1, isfloat);
+    vecset(r, 0, v[0]); vecset(r, 1, v[1]); vecset(r, 2, v[2]);
+    return 1;
+    }
+
+static int VNorm2(lua_State *L)
+    {
+    pvec_t *p = topvec(L, 1);
+    if(!p) return luaL_argerror(L, 1, "packed vec expected");
+    lua_pushnumber(L, p->isfloat ? kdot_f(p->e.f, p->e.f) : kdot_d(p->e.d, p->e.d));
+    return 1;
+    }
+
+static int VNorm(lua_State *L)
+    {
+    VNorm2(L);
+    lua_pushnumber(L, sqrt(lua_tonumber(L, -1)));
+    return 1;
+    }
+
+static int VNormalize(lua_State *L)
+    {
+    pvec_t *p = topvec(L, 1), *r;
+    double n;
+    if(!p) return luaL_argerror(L, 1, "packed vec expected");
+    r = newpvec(L, p->size, p->isrow, p->isfloat);
+    if(p->isfloat)
+        {
+        n = sqrt(kdot_f(p->e.f, p->e.f));
+        kdivs_f(r->e.f, p->e.f, n, 4);
+        }
+    else
+        {
+        n = sqrt(kdot_d(p->e.d, p->e.d));
+        kdivs_d(r->e.d, p->e.d, n, 4);
+        }
+    vecpad(r);
+    return 1;
+    }
+
+static int VTranspose(lua_State *L)
+    {
+    pvec_t *p = topvec(L, 1), *r;
+    if(!p) return luaL_argerror(L, 1, "packed vec expected");
+    r = newpvec(L, 0, 0, 0);
+    *r = *p;
+    r->isrow = !p->isrow;
+    return 1;
+    }
+
+static const struct luaL_Reg VMetamethods[] = 
+    {
+        { "__len", VLen },
+        { "__newindex", VNewIndex },
+        { "__unm", VUnm },
+        { "__add", VAdd },
+        { "__sub", VSub },
+        { "__mul", VMul },
+        { "__div", VDiv },
+        { "__mod", VCross },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg VMethods[] = 
+    {
+        { "norm", VNorm },
+        { "norm2", VNorm2 },
+        { "normalize", VNormalize },
+        { "transpose", VTranspose },
+        { "totable", ToTable },
+        { NULL, NULL } /* sentinel */
+    };
+
+/*------------------------------------------------------------------------------*
+ | Matrix metamethods and methods                                               |
+ *------------------------------------------------------------------------------*/
+
+static int MIndex(lua_State *L)
+/* m[i] (a packed row vector), m.rows, m.columns, or a method (upvalue 1) */
+    {
+    pmat_t *p = (pmat_t*)lua_touserdata(L, 1);
+    const char *key;
+    lua_Integer i;
+    if(lua_type(L, 2) == LUA_TNUMBER)
+        {
+        i = lua_tointeger(L, 2);
+        if(i >= 1 && i <= p->nr)
+            pushrow(L, p, i-1);
+        else
+            lua_pushnil(L);
+        return 1;
+        }
+    key = lua_tostring(L, 2);
+    if(key && strcmp(key, "rows") == 0)
+        lua_pushinteger(L, p->nr);
+    else if(key && strcmp(key, "columns") == 0)
+        lua_pushinteger(L, p->nc);
+    else
+        {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        }
+    return 1;
+    }
+
+static int MNewIndex(lua_State *L)
+    {
+    return luaL_error(L, "packed matrix rows are read-only (use m:set(i, j, val))");
+    }
+
+static int MLen(lua_State *L)
+    {
+    pmat_t *p = (pmat_t*)lua_touserdata(L, 1);
+    lua_pushinteger(L, p->nr);
+    return 1;
+    }
+
+static int MUnm(lua_State *L)
+    {
+    pmat_t *p = topmat(L, 1), *r;
+    if(!p) return unexpected(L);
+    r = newpmat(L, p->nr, p->nc, p->isfloat);
+    if(p->isfloat) kmuls_f(r->e.f[0], p->e.f[0], -1, 16); else kmuls_d(r->e.d[0], p->e.d[0], -1, 16);
+    matpad(r);
+    return 1;
+    }
+
+static int MAddSub(lua_State *L, int sub)
+    {
+    pmat_t ta, tb, *r;
+    const pmat_t *a, *b;
+    int isfloat = resultprec(L);
+    a = checkloadmat(L, 1, &ta, isfloat);
+    b = checkloadmat(L, 2, &tb, isfloat);
+    if((a->nr != b->nr) || (a->nc != b->nc))
+        return luaL_error(L, OPERANDS_ERROR);
+    r = newpmat(L, a->nr, a->nc, isfloat);
+    if(isfloat)
+        (sub ? ksub_f : kadd_f)(r->e.f[0], a->e.f[0], b->e.f[0], 16);
+    else
+        (sub ? ksub_d : kadd_d)(r->e.d[0], a->e.d[0], b->e.d[0], 16);
+    return 1;
+    }
+
+static int MAdd(lua_State *L) { return MAddSub(L, 0); }
+static int MSub(lua_State *L) { return MAddSub(L, 1); }
+
+static int MScale(lua_State *L, int sarg, int marg, int div)
+    {
+    pmat_t *p, *r;
+    double s = luaL_checknumber(L, sarg);
+    if((p = topmat(L, marg)) == NULL) return unexpected(L);
+    r = newpmat(L, p->nr, p->nc, p->isfloat);
+    if(p->isfloat)
+        (div ? kdivs_f : kmuls_f)(r->e.f[0], p->e.f[0], s, 16);
+    else
+        (div ? kdivs_d : kmuls_d)(r->e.d[0], p->e.d[0], s, 16);
+    matpad(r);
+    return 1;
+    }
+
+static int MMul(lua_State *L)
+    {
+    pmat_t ta, tb, *r;
+    pvec_t tv, *rv;
+    const pmat_t *a, *b;
+    const pvec_t *v;
+    int isfloat;
+    if(lua_isnumber(L, 1))
+        return MScale(L, 1, 2, 0);
+    if(lua_isnumber(L, 2))
+        return MScale(L, 2, 1, 0);
+    isfloat = resultprec(L);
+    a = checkloadmat(L, 1, &ta, isfloat);
+    if((v = loadvec(L, 2, &tv, isfloat)) != NULL)
+        {
+        /* NxM * Mx1 = Nx1 (column vector) */
+        if(v->isrow || (v->size != a->nc))
+            return luaL_error(L, OPERANDS_ERROR);
+        rv = newpvec(L, a->nr, 0, isfloat);
+        if(isfloat) kmxv_f(rv->e.f, a->e.f, v->e.f); else kmxv_d(rv->e.d, a->e.d, v->e.d);
+        vecpad(rv);
+        return 1;
+        }
+    /* matrix product  NxK * KxM -> NxM */
+    b = checkloadmat(L, 2, &tb, isfloat);
+    if(a->nc != b->nr)
+        return luaL_error(L, OPERANDS_ERROR);
+    r = newpmat(L, a->nr, b->nc, isfloat);
+    if(isfloat) kmxm_f(r->e.f, a->e.f, b->e.f); else kmxm_d(r->e.d, a->e.d, b->e.d);
+    matpad(r);
+    return 1;
+    }
+
+static int MDiv(lua_State *L)
+    {
+    if(!topmat(L, 1))
+        return luaL_argerror(L, 1, lua_pushfstring(L, "%s expected", MAT_MT));
+    return MScale(L, 2, 1, 1);
+    }
+
+static int inverse(pmat_t *dst, const pmat_t *m)
+/* dst and m in double precision, square */
+    {
+    mat_t a, inv;
+    if(m->nr == 4)
+        return kinv4_d(dst->e.d, m->e.d);
+    memcpy(a, m->e.d, sizeof(mat_t));
+    mat_clear(inv);
+    if(!mat_inv(inv, a, m->nr))
+        return 0;
+    memcpy(dst->e.d, inv, sizeof(mat_t));
+    return 1;
+    }
+
+static int MInv(lua_State *L)
+    {
+    pmat_t *p = topmat(L, 1), *r;
+    pmat_t t, inv;
+    if(!p) return luaL_argerror(L, 1, "packed mat expected");
+    if(p->nr != p->nc)
+        return luaL_argerror(L, 1, "not a square matrix");
+    matprec(&t, p, 0);
+    inv = t;
+    if(!inverse(&inv, &t))
+        return luaL_argerror(L, 1, "singular matrix");
+    r = newpmat(L, 0, 0, 0);
+    matprec(r, &inv, p->isfloat);
+    matpad(r);
+    return 1;
+    }
+
+static int MPow(lua_State *L)
+    {
+    pmat_t *p = topmat(L, 1), *r;
+    pmat_t m, dst;
+    lua_Integer n, i;
+    if(!p) return luaL_argerror(L, 1, "packed mat expected");
+    if(p->nr != p->nc)
+        return luaL_error(L, OPERANDS_ERROR);
+    n = luaL_checkinteger(L, 2);
+    matprec(&m, p, 0);
+    dst = m;
+    if(n == 0) /* m^0 = identity */
+        {
+        mat_clear(dst.e.d);
+        for(i=0; i < p->nr; i++) dst.e.d[i][i] = 1;
+        }
+    else
+        {
+        if(n < 0)
+            {
+            if(!inverse(&dst, &m))
+                return luaL_argerror(L, 1, "singular matrix");
+            m = dst;
+            n = -n;
+            }
+        for(i = 0; i < (n-1); i++)
+            kmxm_d(dst.e.d, dst.e.d, m.e.d);
+        }
+    r = newpmat(L, 0, 0, 0);
+    matprec(r, &dst, p->isfloat);
+    matpad(r);
+    return 1;
+    }
+
+static int MDet(lua_State *L)
+    {
+    pmat_t *p = topmat(L, 1);
+    pmat_t t;
+    if(!p) return luaL_argerror(L, 1, "packed mat expected");
+    if(p->nr != p->nc)
+        return luaL_argerror(L, 1, "not a square matrix");
+    matprec(&t, p, 0);
+    if(p->nr == 2)
+        lua_pushnumber(L, mat_det2(t.e.d));
+    else if(p->nr == 3)
+        lua_pushnumber(L, mat_det3(t.e.d));
+    else
+        lua_pushnumber(L, mat_det4(t.e.d));
+    return 1;
+    }
+
+static int MTranspose(lua_State *L)
+    {
+    pmat_t *p = topmat(L, 1), *r;
+    size_t i, j;
+    if(!p) return luaL_argerror(L, 1, "packed mat expected");
+    r = newpmat(L, p->nc, p->nr, p->isfloat);
+    for(i=0; i<4; i++)
+        for(j=0; j<4; j++)
+            {
+            if(p->isfloat) r->e.f[j][i] = p->e.f[i][j];
+            else r->e.d[j][i] = p->e.d[i][j];
+            }
+    return 1;
+    }
+
+static int MGet(lua_State *L)
+    {
+    pmat_t *p = topmat(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    lua_Integer j = luaL_checkinteger(L, 3);
+    if(!p) return luaL_argerror(L, 1, "packed mat expected");
+    if(i < 1 || i > p->nr) return luaL_argerror(L, 2, "index out of range");
+    if(j < 1 || j > p->nc) return luaL_argerror(L, 3, "index out of range");
+    lua_pushnumber(L, matget(p, i-1, j-1));
+    return 1;
+    }
+
+static int MSet(lua_State *L)
+    {
+    pmat_t *p = topmat(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    lua_Integer j = luaL_checkinteger(L, 3);
+    double val = luaL_checknumber(L, 4);
+    if(!p) return luaL_argerror(L, 1, "packed mat expected");
+    if(i < 1 || i > p->nr) return luaL_argerror(L, 2, "index out of range");
+    if(j < 1 || j > p->nc) return luaL_argerror(L, 3, "index out of range");
+    matset(p, i-1, j-1, val);
+    return 0;
+    }
+
+static int MMulby(lua_State *L)
+/* m:mulby(m1) -> m, with m = m * m1 computed in place (no allocation) */
+    {
+    pmat_t *p = topmat(L, 1);
+    pmat_t tb;
+    const pmat_t *b;
+    if(!p) return luaL_argerror(L, 1, "packed mat expected");
+    b = checkloadmat(L, 2, &tb, p->isfloat);
+    if((p->nc != b->nr) || (b->nr != b->nc))
+        return luaL_error(L, OPERANDS_ERROR);
+    if(p->isfloat) kmxm_f(p->e.f, p->e.f, b->e.f); else kmxm_d(p->e.d, p->e.d, b->e.d);
+    lua_settop(L, 1);
+    return 1;
+    }
+
+static const struct luaL_Reg MMetamethods[] = 
+    {
+        { "__len", MLen },
+        { "__newindex", MNewIndex },
+        { "__unm", MUnm },
+        { "__add", MAdd },
+        { "__sub", MSub },
+        { "__mul", MMul },
+        { "__div", MDiv },
+        { "__pow", MPow },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg MMethods[] = 
+    {
+        { "det", MDet },
+        { "inv", MInv },
+        { "transpose", MTranspose },
+        { "get", MGet },
+        { "set", MSet },
+        { "mulby", MMulby },
+        { "totable", ToTable },
+        { NULL, NULL } /* sentinel */
+    };
+
+/*------------------------------------------------------------------------------*
+ | Registration                                                                 |
+ *------------------------------------------------------------------------------*/
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "packed", Packed },
+        { "ispacked", IsPacked },
+        { NULL, NULL } /* sentinel */
+    };
+
+static void createmeta(lua_State *L, const char *mt, const char *tablemt,
+            const luaL_Reg *metamethods, const luaL_Reg *methods, lua_CFunction index)
+/* __tostring and __concat are shared with the table form, whose check functions
+ * accept packed values too.
+ */
+    {
+    luaL_newmetatable(L, mt);
+    luaL_setfuncs(L, metamethods, 0);
+    luaL_getmetatable(L, tablemt);
+    lua_getfield(L, -1, "__tostring");
+    lua_setfield(L, -3, "__tostring");
+    lua_getfield(L, -1, "__concat");
+    lua_setfield(L, -3, "__concat");
+    lua_pop(L, 1);
+    lua_newtable(L); /* methods, upvalue of __index */
+    luaL_setfuncs(L, methods, 0);
+    lua_pushcclosure(L, index, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+    }
+
+void moonglmath_open_packed(lua_State *L)
+/* must be called after moonglmath_open_vec() and moonglmath_open_mat() */
+    {
+    createmeta(L, PVEC_MT, VEC_MT, VMetamethods, VMethods, VIndex);
+    createmeta(L, PMAT_MT, MAT_MT, MMetamethods, MMethods, MIndex);
+    luaL_setfuncs(L, Functions, 0);
+    }
+
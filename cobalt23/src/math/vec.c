@@ -41,6 +41,7 @@ int testvec(lua_State *L, int arg, vec_t v, size_t *size, unsigned int *isrow)
     size_t i;
     size_t size_;
     unsigned int isrow_;
+    if(testpvec(L, arg, v, size, isrow)) return 1;
     if(!testmetatable(L, arg, VEC_MT)) return 0;
 
     lua_getfield(L, arg, "type");   
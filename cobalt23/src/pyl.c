@@ -78,6 +78,14 @@ PyObject *LuaConvert(lua_State *L, int n)
                 break;
             }
 
+            py_buffer *buf = luaPy_to_pbuffer(L, n);
+
+            if (buf && !buf->released) {
+                Py_INCREF(buf->view.obj);
+                ret = buf->view.obj;
+                break;
+            }
+
             /* Otherwise go on and handle as custom. */
         }
 
@@ -433,6 +441,85 @@ PyTypeObject LuaObject_Type = {
     0,                        /*tp_is_gc*/
 };
 
+PyObject *LuaBuffer_New(lua_State *L, int n, void *ptr, size_t len,
+                        int readonly, char format, size_t itemsize)
+{
+    LuaBuffer *obj = PyObject_New(LuaBuffer, &LuaBuffer_Type);
+    if (obj)
+    {
+        lua_pushvalue(L, n);
+        obj->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        obj->buf = (char*) ptr;
+        obj->len = (Py_ssize_t) len;
+        obj->itemsize = (Py_ssize_t) itemsize;
+        obj->shape = (Py_ssize_t) (len / itemsize);
+        obj->readonly = readonly;
+        obj->format[0] = format;
+        obj->format[1] = '\0';
+    }
+    return (PyObject*) obj;
+}
+
+static void LuaBuffer_dealloc(LuaBuffer *self)
+{
+    luaL_unref(LuaState, LUA_REGISTRYINDEX, self->ref);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int LuaBuffer_getbuffer(PyObject *obj, Py_buffer *view, int flags)
+{
+    LuaBuffer *self = (LuaBuffer*) obj;
+
+    if ((flags & PyBUF_WRITABLE) && self->readonly) {
+        PyErr_SetString(PyExc_BufferError, "Cobalt buffer is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    Py_INCREF(obj);
+    view->obj = obj;
+    view->buf = self->buf;
+    view->len = self->len;
+    view->readonly = self->readonly;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ?
+                    &self->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs LuaBuffer_as_buffer = {
+    LuaBuffer_getbuffer,      /*bf_getbuffer*/
+    0,                        /*bf_releasebuffer*/
+};
+
+PyTypeObject LuaBuffer_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "lua.buffer",             /*tp_name*/
+    sizeof(LuaBuffer),        /*tp_basicsize*/
+    0,                        /*tp_itemsize*/
+    (destructor)LuaBuffer_dealloc, /*tp_dealloc*/
+    0,                        /*tp_print*/
+    0,                        /*tp_getattr*/
+    0,                        /*tp_setattr*/
+    0,                        /*tp_compare*/
+    0,                        /*tp_repr*/
+    0,                        /*tp_as_number*/
+    0,                        /*tp_as_sequence*/
+    0,                        /*tp_as_mapping*/
+    0,                        /*tp_hash*/
+    0,                        /*tp_call*/
+    0,                        /*tp_str*/
+    0,                        /*tp_getattro*/
+    0,                        /*tp_setattro*/
+    &LuaBuffer_as_buffer,     /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,       /*tp_flags*/
+    "memory owned by a lua object", /*tp_doc*/
+};
 
 PyObject *Lua_run(PyObject *args, int eval)
 {
@@ -537,6 +624,7 @@ PyMODINIT_FUNC PyInit_lua(void)
 {
   PyObject *m;
   if (PyType_Ready(&LuaObject_Type) < 0 ||
+      PyType_Ready(&LuaBuffer_Type) < 0 ||
 #if PY_MAJOR_VERSION >= 3
       (m = PyModule_Create(&lua_module)) == NULL)
       return NULL;
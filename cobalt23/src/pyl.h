@@ -23,6 +23,28 @@ extern PyTypeObject LuaObject_Type;
 
 PyObject* LuaConvert(lua_State *L, int n);
 
+/*
+** Exposes 'len' bytes at 'ptr', owned by the Cobalt value at 'n', through
+** the buffer protocol without copying; the value is kept alive until the
+** last view is gone. 'format' is a struct module code of 'itemsize' bytes.
+*/
+typedef struct
+{
+    PyObject_HEAD
+    int ref;
+    char *buf;
+    Py_ssize_t len;
+    Py_ssize_t itemsize;
+    Py_ssize_t shape;
+    int readonly;
+    char format[2];
+} LuaBuffer;
+
+extern PyTypeObject LuaBuffer_Type;
+
+PyObject* LuaBuffer_New(lua_State *L, int n, void *ptr, size_t len,
+                        int readonly, char format, size_t itemsize);
+
 extern lua_State *LuaState;
 
 #if PY_MAJOR_VERSION < 3
@@ -12,10 +12,8 @@
 #include "../cobalt.h"
 #include "../lauxlib.h"
 #include "../lualib.h"
-#include "tree.h"
 
 struct moonsdl2_udata_s {
-  RB_ENTRY(moonsdl2_udata_s) entry;
   uint64_t id; /* object id (search key) */
   /* references on the Lua registry */
   int ref;   /* the correspoding userdata */
@@ -25,44 +23,72 @@ struct moonsdl2_udata_s {
 
 #define UNEXPECTED_ERROR "unexpected error (%s, %d)", __FILE__, __LINE__
 
-static int cmp(udata_t *udata1, udata_t *udata2) /* the compare function */
-{
-  return (udata1->id < udata2->id ? -1 : udata1->id > udata2->id);
-}
+/* The udata database is an open addressing hash table with linear probing,
+ * keyed by id, so that searches by id (i.e. by object handle) cost the same no
+ * matter how many objects are alive. The table is kept at most half full.
+ */
+static udata_t **Slot = NULL; /* Capacity entries, NULL = free slot */
+static size_t Capacity = 0;   /* a power of 2 */
+static size_t Count = 0;      /* no. of used slots */
 
-static RB_HEAD(udatatree_s, udata_s) Head = RB_INITIALIZER(&Head);
+#define MASK (Capacity - 1)
 
-RB_PROTOTYPE_STATIC(udatatree_s, udata_s, entry, cmp)
-RB_GENERATE_STATIC(udatatree_s, udata_s, entry, cmp)
+/* Fibonacci hashing: ids are pointers, so their low bits are mostly zero */
+static size_t hashid(uint64_t id) {
+  return (size_t)((id * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & MASK;
+}
 
-static udata_t *udata_remove(udata_t *udata) {
-  return RB_REMOVE(udatatree_s, &Head, udata);
+static udata_t *udata_search(uint64_t id) {
+  size_t i;
+  if (Count == 0) return NULL;
+  for (i = hashid(id); Slot[i]; i = (i + 1) & MASK)
+    if (Slot[i]->id == id) return Slot[i];
+  return NULL;
 }
-static udata_t *udata_insert(udata_t *udata) {
-  return RB_INSERT(udatatree_s, &Head, udata);
+
+static void place(udata_t *udata) {
+  size_t i;
+  for (i = hashid(udata->id); Slot[i]; i = (i + 1) & MASK)
+    ;
+  Slot[i] = udata;
 }
-static udata_t *udata_search(uint64_t id) {
-  udata_t tmp;
-  tmp.id = id;
-  return RB_FIND(udatatree_s, &Head, &tmp);
+
+/* makes room for one more entry, growing the table if needed */
+static void udata_reserve(lua_State *L) {
+  udata_t **old = Slot;
+  size_t i, oldcapacity = Capacity;
+  if (2 * (Count + 1) <= Capacity) return;
+  Slot = (udata_t **)Malloc(L, sizeof(udata_t *) * (oldcapacity ? 2 * oldcapacity : 64));
+  Capacity = oldcapacity ? 2 * oldcapacity : 64;
+  for (i = 0; i < oldcapacity; i++)
+    if (old[i]) place(old[i]);
+  if (old) Free(L, old);
+}
+
+/* udata_reserve() must have been called */
+static void udata_insert(udata_t *udata) {
+  place(udata);
+  Count++;
 }
-static udata_t *udata_first(uint64_t id) {
-  udata_t tmp;
-  tmp.id = id;
-  return RB_NFIND(udatatree_s, &Head, &tmp);
+
+/* backward shift deletion: no tombstones, so searches never slow down */
+static void udata_remove(udata_t *udata) {
+  size_t i, j, k;
+  for (i = hashid(udata->id); Slot[i] != udata; i = (i + 1) & MASK)
+    if (!Slot[i]) return;
+  Slot[i] = NULL;
+  Count--;
+  for (j = (i + 1) & MASK; Slot[j]; j = (j + 1) & MASK) {
+    k = hashid(Slot[j]->id);
+    /* move the entry at j into the hole at i, unless its home k lies
+     * cyclically in (i, j] */
+    if ((i <= j) ? ((k <= i) || (k > j)) : ((k <= i) && (k > j))) {
+      Slot[i] = Slot[j];
+      Slot[j] = NULL;
+      i = j;
+    }
+  }
 }
-#if 0
-static udata_t *udata_next(udata_t *udata)
-    { return RB_NEXT(udatatree_s, &Head, udata); }
-static udata_t *udata_prev(udata_t *udata)
-    { return RB_PREV(udatatree_s, &Head, udata); }
-static udata_t *udata_min(void)
-    { return RB_MIN(udatatree_s, &Head); }
-static udata_t *udata_max(void)
-    { return RB_MAX(udatatree_s, &Head); }
-static udata_t *udata_root(void)
-    { return RB_ROOT(&Head); }
-#endif
 
 void *udata_new(lua_State *L, size_t size, uint64_t id_, const char *mt)
 /* Creates a new Lua userdata, optionally sets its metatable to mt (if != NULL),
@@ -77,6 +103,7 @@ void *udata_new(lua_State *L, size_t size, uint64_t id_, const char *mt)
  */
 {
   udata_t *udata;
+  udata_reserve(L);
   if ((udata = (udata_t *)Malloc(L, sizeof(udata_t))) == NULL) {
     luaL_error(L, "cannot allocate memory");
     return NULL;
@@ -151,11 +178,12 @@ int udata_push(lua_State *L, uint64_t id) {
 void udata_free_all(lua_State *L)
 /* free all without unreferencing (for atexit()) */
 {
-  udata_t *udata;
-  while ((udata = udata_first(0))) {
-    udata_remove(udata);
-    Free(L, udata);
-  }
+  size_t i;
+  for (i = 0; i < Capacity; i++)
+    if (Slot[i]) Free(L, Slot[i]);
+  if (Slot) Free(L, Slot);
+  Slot = NULL;
+  Capacity = Count = 0;
 }
 
 int udata_scan(lua_State *L, const char *mt, void *info,
@@ -167,16 +195,22 @@ int udata_scan(lua_State *L, const char *mt, void *info,
  */
 {
   int stop = 0;
-  uint64_t id = 0;
+  size_t i, n = 0;
+  uint64_t *ids;
   udata_t *udata;
-  while ((udata = udata_first(id))) {
-    id = udata->id + 1;
-    if (mt == udata->mt) {
+  if (Count == 0) return 0;
+  /* the callback may delete objects, which moves entries around in the table,
+   * so collect the ids first and look each of them up again before the call */
+  ids = (uint64_t *)Malloc(L, sizeof(uint64_t) * Count);
+  for (i = 0; i < Capacity; i++)
+    if (Slot[i] && Slot[i]->mt == mt) ids[n++] = Slot[i]->id;
+  for (i = 0; i < n && !stop; i++) {
+    udata = udata_search(ids[i]);
+    if (udata && (mt == udata->mt))
       stop = func(L, (const void *)(udata->mem), mt, info);
-      if (stop) return 1;
-    }
   }
-  return 0;
+  Free(L, ids);
+  return stop ? 1 : 0;
 }
 
 static int is_subclass(lua_State *L, int arg, int mt_index) {